@@ -525,32 +525,25 @@ iap_dialog_error_note_counters(const char *modem_id)
   gchar *tx_text;
   gchar *rx_fmt;
   gchar *rx_text;
-  gchar *rx;
-  gchar *tx;
+  guint64 rx;
+  guint64 tx;
 
   if (_is_home)
   {
     note_text = connui_cell_code_ui_error_note_type_to_text(
           NULL, "home_notification");
-    rx = gconf_client_get_string(_gconf, GPRS_HOME_RX_BYTES, NULL);
-    tx = gconf_client_get_string(_gconf, GPRS_HOME_TX_BYTES, NULL);
   }
   else
   {
     note_text = connui_cell_code_ui_error_note_type_to_text(
           NULL, "roaming_notification");
-    rx = gconf_client_get_string(_gconf, GPRS_ROAM_RX_BYTES, NULL);
-    tx = gconf_client_get_string(_gconf, GPRS_ROAM_TX_BYTES, NULL);
   }
 
-  if (rx)
-    rx_bytes = strtoull(rx, NULL, 10);
-
-  if (tx)
-    tx_bytes = strtoull(tx, NULL, 10);
-
-  g_free(rx);
-  g_free(tx);
+  if (connui_cell_datacounter_get_counters(_is_home, &rx, &tx, NULL))
+  {
+    rx_bytes = rx;
+    tx_bytes = tx;
+  }
 
   ttl_bytes = rx_bytes + tx_bytes;
 
@@ -196,23 +196,12 @@ _get_clir_cb(guint anonymity, GError *error, gpointer user_data)
 }
 
 static void
-_get_call_forward_cb(const char *modem_id, const connui_sups_call_forward *cf,
-                     gpointer user_data, GError *error)
+_call_forward_update(cellular_settings *cs, const connui_sups_call_forward *cf)
 {
-  cellular_settings *cs = user_data;
   const char *number = NULL;
   gboolean enabled = FALSE;
-  gint active;
-
-  cs->call.svc_call_id = 0;
-
-  if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
-  {
-    cs->pending--;
-    return;
-  }
 
-  if (!error)
+  if (cf)
   {
     if ((enabled = cf->cond.busy.enabled))
       number = cf->cond.busy.number;
@@ -221,18 +210,13 @@ _get_call_forward_cb(const char *modem_id, const connui_sups_call_forward *cf,
     else if ((enabled = cf->cond.unreachable.enabled))
       number = cf->cond.unreachable.number;
   }
-  else
-    CONNUI_ERR("Error in while fetching call forwarding: %s", error->message);
-
-  active = enabled ? 0 : 1;
 
-  cellular_settings_stop_progress_indicator(cs);
   cs->call.forward.enabled = enabled;
 
   hildon_picker_button_set_active(
-        HILDON_PICKER_BUTTON(cs->call.forward.option), active);
+        HILDON_PICKER_BUTTON(cs->call.forward.option), enabled ? 0 : 1);
 
-  _call_divert_option_show_widgets(cs, enabled && !error);
+  _call_divert_option_show_widgets(cs, enabled);
 
   if (number)
   {
@@ -242,7 +226,27 @@ _get_call_forward_cb(const char *modem_id, const connui_sups_call_forward *cf,
   }
   else
     g_object_set_data(G_OBJECT(cs->call.forward.to), "phone_number", NULL);
+}
+
+static void
+_get_call_forward_cb(const char *modem_id, const connui_sups_call_forward *cf,
+                     gpointer user_data, GError *error)
+{
+  cellular_settings *cs = user_data;
+
+  cs->call.svc_call_id = 0;
+
+  if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+  {
+    cs->pending--;
+    return;
+  }
 
+  if (error)
+    CONNUI_ERR("Error in while fetching call forwarding: %s", error->message);
+
+  cellular_settings_stop_progress_indicator(cs);
+  _call_forward_update(cs, error ? NULL : cf);
   gtk_widget_set_sensitive(cs->call.forward.option, !error);
 }
 
@@ -280,6 +284,9 @@ _get_call_waiting_cb(const char *modem_id, gboolean enabled, GError *error,
 void
 _call_show(cellular_settings *cs, const gchar *modem_id)
 {
+  connui_sups_call_forward cf;
+  gboolean enabled;
+
   _disable_widgets(cs);
 
   cs->call.forward.enabled = FALSE;
@@ -288,6 +295,17 @@ _call_show(cellular_settings *cs, const gchar *modem_id)
   hildon_picker_button_set_active(
         HILDON_PICKER_BUTTON(cs->call.forward.option), 1);
 
+  /* show the last known state until the network replies */
+  if (connui_cell_sups_get_cached_call_waiting(modem_id, &enabled, NULL))
+  {
+    cs->call.waiting.enabled = enabled;
+    hildon_check_button_set_active(
+          HILDON_CHECK_BUTTON(cs->call.waiting.button), enabled);
+  }
+
+  if (connui_cell_sups_get_cached_call_forwarding(modem_id, &cf, NULL))
+    _call_forward_update(cs, &cf);
+
   if (connui_cell_net_get_caller_id_anonymity(_get_clir_cb, cs))
     cs->pending++;
 
@@ -220,6 +220,12 @@ _modem_selection_changed_cb(HildonTouchSelector *selector, gint column,
                            gtk_tree_model_iter_n_children(model, NULL) > 1);
 }
 
+static void
+_context_ready_cb(gboolean ready, gpointer user_data)
+{
+  *(gboolean *)user_data = TRUE;
+}
+
 GtkWidget *
 _modem_widgets_create(cellular_settings *cs)
 {
@@ -228,9 +234,18 @@ _modem_widgets_create(cellular_settings *cs)
   HildonTouchSelector *selector;
   GList *l;
   GList *modems;
+  gboolean ready = FALSE;
 
   connui_cell_modem_status_register(_modem_state_cb, cs);
 
+  /* we need the modem list now, wait for the context to be bootstrapped */
+  connui_cell_context_ready_register(_context_ready_cb, &ready);
+
+  while (!ready)
+    g_main_context_iteration(NULL, TRUE);
+
+  connui_cell_context_ready_close(_context_ready_cb);
+
   modems = connui_cell_modem_get_modems();
   selector = HILDON_TOUCH_SELECTOR(hildon_touch_selector_new_text());
   button = hildon_picker_button_new(HILDON_SIZE_FINGER_HEIGHT,
@@ -23,6 +23,7 @@ static GtkWidget *dc_save_button = NULL;
 static GtkWidget *dc_limit_entry = NULL;
 static GtkWidget *dc_enable_warning_button = NULL;
 static time_t reset_time;
+static gboolean dc_home = TRUE;
 static struct
 {
   const char *msgid;
@@ -137,14 +138,15 @@ cellular_data_counter_save()
   gchar *warning_limit =
       g_strdup(hildon_entry_get_text(HILDON_ENTRY(dc_limit_entry)));
 
-  connui_cell_datacounter_save(notification_enabled, warning_limit);
+  connui_cell_datacounter_save_scope(dc_home, notification_enabled,
+                                     warning_limit);
   g_free(warning_limit);
 }
 
 void
 cellular_data_counter_reset()
 {
-  connui_cell_datacounter_reset();
+  connui_cell_datacounter_reset_scope(dc_home);
 }
 
 static GtkWidget *
@@ -235,6 +237,8 @@ cellular_data_counter_show(GtkWindow *parent, gboolean home_counter)
     return GTK_DIALOG(data_counters_dialog);
   }
 
+  dc_home = home_counter;
+
   if (home_counter)
     title = _("conn_ti_phone_data_counter");
   else
@@ -299,8 +303,8 @@ cellular_data_counter_show(GtkWindow *parent, gboolean home_counter)
 
   dc_unknown_bool_1 = TRUE;
 
-  if (!connui_cell_datacounter_register(cellular_data_counter_update_cb,
-                                        home_counter, NULL))
+  if (!connui_cell_datacounter_register_full(cellular_data_counter_update_cb,
+                                             home_counter, 1000, NULL))
   {
     CONNUI_ERR("Unable to register data counter update callback");
   }
@@ -65,12 +65,16 @@ typedef struct
   gchar *operator_name;
   connui_net_registration_status reg_status;
   connui_net_radio_access_tech rat_name;
+  guint operator_name_call;
+  OperatorNameCBSHomeItemPrivate *priv;
 }
 home_item_modem;
 
 struct _OperatorNameCBSHomeItemPrivate
 {
   GHashTable *modems;
+  /* replaced once the modems generation changes */
+  connui_cell_modems *snapshot;
   GtkWidget *label;
   guint flightmode;
 };
@@ -82,15 +86,28 @@ HD_DEFINE_PLUGIN_MODULE_WITH_PRIVATE(OperatorNameCBSHomeItem,
 static void
 update_widget(OperatorNameCBSHomeItemPrivate *priv)
 {
-  GList *modems = connui_cell_modem_get_modems();
-  GList *l;
+  connui_cell_modems *modems;
   GString *s = g_string_new(NULL);
   int count = 0;
+  guint i;
+
+  if (priv->snapshot &&
+      priv->snapshot->generation != connui_cell_modem_get_generation())
+  {
+    connui_cell_modems_unref(priv->snapshot);
+    priv->snapshot = NULL;
+  }
+
+  if (!priv->snapshot)
+    priv->snapshot = connui_cell_modem_get_snapshot();
+
+  modems = priv->snapshot;
 
   /* support only 2 modems in the status area */
-  for (l = modems; l && count < 2; l = l->next)
+  for (i = 0; i < modems->count && count < 2; i++)
   {
-    home_item_modem *modem = g_hash_table_lookup(priv->modems, l->data);
+    home_item_modem *modem = g_hash_table_lookup(priv->modems,
+                                                  modems->ids[i]);
     const gchar *op = NULL;
 
     if (modem)
@@ -110,7 +127,6 @@ update_widget(OperatorNameCBSHomeItemPrivate *priv)
     count++;
   }
 
-  g_list_free_full(modems, g_free);
   gtk_label_set_text(GTK_LABEL(priv->label), s->str);
   g_string_free(s, TRUE);
 
@@ -120,6 +136,9 @@ update_widget(OperatorNameCBSHomeItemPrivate *priv)
 static void
 destroy_modem(home_item_modem *modem)
 {
+  if (modem->operator_name_call)
+    connui_cell_cancel_service_call(modem->operator_name_call);
+
   g_free(modem->operator_name);
   g_free(modem);
 }
@@ -155,6 +174,7 @@ modem_create(OperatorNameCBSHomeItem *item, const char *modem_id)
 
   modem->reg_status = CONNUI_NET_REG_STATUS_UNKNOWN;
   modem->rat_name = CONNUI_NET_RAT_UNKNOWN;
+  modem->priv = priv;
 
   g_hash_table_insert(priv->modems, g_strdup(modem_id), modem);
 
@@ -171,7 +191,7 @@ modem_get(OperatorNameCBSHomeItem *item, const char *modem_id)
 
 static void
 widget_net_status_cb(const char *modem_id, const cell_network_state *state,
-                     gpointer user_data)
+                     guint changed, gpointer user_data)
 {
   OperatorNameCBSHomeItem *item = user_data;
   OperatorNameCBSHomeItemPrivate *priv = PRIVATE(item);
@@ -226,12 +246,31 @@ widget_net_status_cb(const char *modem_id, const cell_network_state *state,
   }
 }
 
+static void
+operator_name_cb(const gchar *operator_name, GError *error, gpointer user_data)
+{
+  home_item_modem *modem = user_data;
+
+  /* modem might be already gone if the call was cancelled */
+  if (error)
+    return;
+
+  modem->operator_name_call = 0;
+
+  if (operator_name && IS_EMPTY(modem->operator_name))
+  {
+    g_free(modem->operator_name);
+    modem->operator_name = g_strdup(operator_name);
+
+    update_widget(modem->priv);
+  }
+}
+
 static void
 get_operator_name(OperatorNameCBSHomeItem *item, const char *modem_id,
                   const cell_network_state *state)
 {
   OperatorNameCBSHomeItemPrivate *priv = PRIVATE(item);
-  gchar *name;
   cell_network *net;
   home_item_modem *modem = modem_get(item, modem_id);
 
@@ -251,20 +290,11 @@ get_operator_name(OperatorNameCBSHomeItem *item, const char *modem_id,
   if ((!net->country_code) || (!net->operator_code))
       return;
 
-  name = connui_cell_net_get_operator_name(net, NULL);
+  if (modem->operator_name_call)
+    connui_cell_cancel_service_call(modem->operator_name_call);
 
-  if (name)
-  {
-    if (IS_EMPTY(modem->operator_name))
-    {
-      g_free(modem->operator_name);
-      modem->operator_name = name;
-
-      update_widget(priv);
-    }
-    else
-      g_free(name);
-  }
+  modem->operator_name_call =
+      connui_cell_net_get_operator_name_async(net, operator_name_cb, modem);
 }
 
 static void
@@ -331,7 +361,11 @@ operator_name_cbs_home_item_init(OperatorNameCBSHomeItem *home_item)
 
   gtk_container_add(GTK_CONTAINER(home_item), priv->label);
 
-  connui_cell_net_status_register(widget_net_status_cb, home_item);
+  connui_cell_net_status_changed_register(CONNUI_NET_CHANGED_REG_STATUS |
+                                          CONNUI_NET_CHANGED_RAT |
+                                          CONNUI_NET_CHANGED_OPERATOR_NAME |
+                                          CONNUI_NET_CHANGED_NETWORK,
+                                          widget_net_status_cb, home_item);
   connui_cell_modem_status_register(widget_modem_status_cb, home_item);
   connui_flightmode_status(widget_flightmode_cb, home_item);
 }
@@ -339,10 +373,15 @@ operator_name_cbs_home_item_init(OperatorNameCBSHomeItem *home_item)
 static void
 operator_name_cbs_home_item_finalize(GObject* object)
 {
-  connui_cell_net_status_close(widget_net_status_cb);
+  OperatorNameCBSHomeItemPrivate *priv = PRIVATE(object);
+
+  connui_cell_net_status_changed_close(widget_net_status_cb);
   connui_cell_modem_status_close(widget_modem_status_cb);
   connui_flightmode_close(widget_flightmode_cb);
 
+  if (priv->snapshot)
+    connui_cell_modems_unref(priv->snapshot);
+
   G_OBJECT_CLASS(operator_name_cbs_home_item_parent_class)->finalize(object);
 }
 
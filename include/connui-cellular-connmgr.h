@@ -67,4 +67,27 @@ gboolean
 connui_cell_connection_set_powered(const char *modem_id, gboolean powered,
                                    GError **error);
 
+struct _cell_traffic_sample
+{
+  const char *interface;
+  /* bytes since sampling of @interface started */
+  guint64 rx_bytes;
+  guint64 tx_bytes;
+  /* bytes per second over the last sampling interval */
+  guint64 rx_rate;
+  guint64 tx_rate;
+};
+
+typedef struct _cell_traffic_sample cell_traffic_sample;
+
+typedef void (*cell_traffic_cb) (const char *modem_id,
+                                 const cell_traffic_sample *sample,
+                                 gpointer user_data);
+
+/* samples the active data interface of each modem while the display is on */
+gboolean
+connui_cell_traffic_register(cell_traffic_cb cb, gpointer user_data);
+void
+connui_cell_traffic_close(cell_traffic_cb cb);
+
 #endif // CONNUICELLULARCONNMGR_H
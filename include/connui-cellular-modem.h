@@ -63,6 +63,42 @@ connui_cell_modem_get_manufacturer(const char *modem_id, GError **error);
 GList *
 connui_cell_modem_get_modems();
 
+/* Immutable, refcounted list of the modems present at some point. Fields are
+ * read-only. A new snapshot, with a new generation, is made once a modem is
+ * added or removed, so comparing generations tells if a snapshot is current.
+ */
+typedef struct _connui_cell_modems
+{
+  guint generation;
+  guint count;
+  /* sorted, NULL terminated, interned with g_intern_string() */
+  const gchar *const *ids;
+  /*< private >*/
+  gint ref_count;
+}
+connui_cell_modems;
+
+/* Returns:(transfer full): unref with connui_cell_modems_unref() */
+connui_cell_modems *
+connui_cell_modem_get_snapshot(void);
+
+connui_cell_modems *
+connui_cell_modems_ref(connui_cell_modems *modems);
+
+void
+connui_cell_modems_unref(connui_cell_modems *modems);
+
+/* generation of the current snapshot, does not make one */
+guint
+connui_cell_modem_get_generation(void);
+
+/* index of @modem_id in @modems, -1 if not there. @modem_id does not have to
+ * be interned.
+ */
+gint
+connui_cell_modems_find(const connui_cell_modems *modems,
+                        const char *modem_id);
+
 GStrv connui_cell_emergency_get_numbers(const char *modem_id, GError **error);
 
 #endif /* __CONNUI_CELLULAR_MODEM_H_INCLUDED__ */
@@ -72,6 +72,60 @@ typedef struct _cell_network_state cell_network_state;
 typedef void (*cell_network_state_cb) (
     const char *modem_id, const cell_network_state *state, gpointer user_data);
 
+typedef enum
+{
+  CONNUI_NET_CHANGED_REG_STATUS = 1 << 0,
+  CONNUI_NET_CHANGED_LAC = 1 << 1,
+  CONNUI_NET_CHANGED_CELL_ID = 1 << 2,
+  /* rat_name, network_hsdpa_allocated and network_edge_allocated */
+  CONNUI_NET_CHANGED_RAT = 1 << 3,
+  CONNUI_NET_CHANGED_STRENGTH = 1 << 4,
+  CONNUI_NET_CHANGED_OPERATOR_NAME = 1 << 5,
+  /* MCC/MNC */
+  CONNUI_NET_CHANGED_NETWORK = 1 << 6,
+  CONNUI_NET_CHANGED_SELECTION_MODE = 1 << 7,
+  CONNUI_NET_CHANGED_ALL = (1 << 8) - 1
+}
+connui_net_changed;
+
+typedef void (*cell_network_state_changed_cb) (
+    const char *modem_id, const cell_network_state *state, guint changed,
+    gpointer user_data);
+
+#define CONNUI_NET_SIGNAL_BARS 5
+
+/*
+ * network_signals_bar is only updated when the (smoothed) strength moves to
+ * another bar, so it does not flap around thresholds. Bar n (1 to
+ * CONNUI_NET_SIGNAL_BARS) is reached when strength is above thresholds[n - 1]
+ * by more than hysteresis[n - 1], and left when it drops below it by more than
+ * that. Defaults are thresholds 0, 20, 40, 60, 80, hysteresis 0, 3, 3, 3, 3,
+ * 1000 ms interval and no EWMA.
+ */
+typedef struct _connui_net_strength_filter
+{
+  guchar thresholds[CONNUI_NET_SIGNAL_BARS];
+  guchar hysteresis[CONNUI_NET_SIGNAL_BARS];
+  /* minimum interval between strength notifications, in ms */
+  guint min_interval;
+  /* weight of a new sample in EWMA, in percent, 100 disables smoothing */
+  guint ewma_weight;
+}
+connui_net_strength_filter;
+
+typedef struct _connui_net_strength_stats
+{
+  /* Strength changes received from ofono */
+  guint received;
+  /* dropped as they did not change the bar */
+  guint suppressed;
+  /* delayed by min_interval, only the last one gets notified */
+  guint coalesced;
+  /* strength changes applied to network_signals_bar */
+  guint notified;
+}
+connui_net_strength_stats;
+
 typedef void (*cell_get_anonymity_cb)(guint anonymity, GError *error, gpointer user_data);
 
 typedef void (*cell_set_cb)(GError *error, gpointer user_data);
@@ -165,12 +219,20 @@ connui_net_selection_mode;
 #define GPRS_ROAM_DISABLED ICD_GCONF_NETWORK_MAPPING_GPRS "/gprs_roaming_disabled"
 
 typedef void (*service_call_cb_f)(gboolean enabled, gint error_value, const gchar *phone_number, gpointer user_data);
+typedef void (*cell_operator_name_cb)(const gchar *operator_name, GError *error, gpointer user_data);
 
 /* NET */
 gboolean connui_cell_net_status_register(cell_network_state_cb cb, gpointer user_data);
 void connui_cell_net_status_close(cell_network_state_cb cb);
+gboolean connui_cell_net_status_changed_register(guint mask, cell_network_state_changed_cb cb, gpointer user_data);
+void connui_cell_net_status_changed_close(cell_network_state_changed_cb cb);
+
+void connui_cell_net_set_strength_filter(const connui_net_strength_filter *filter);
+void connui_cell_net_get_strength_filter(connui_net_strength_filter *filter);
+void connui_cell_net_get_strength_stats(connui_net_strength_stats *stats);
 
 gchar *connui_cell_net_get_operator_name(cell_network *network, GError **error);
+guint connui_cell_net_get_operator_name_async(const cell_network *network, cell_operator_name_cb cb, gpointer user_data);
 
 connui_net_selection_mode
 connui_cell_net_get_network_selection_mode(const gchar *modem_id,
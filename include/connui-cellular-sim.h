@@ -49,6 +49,9 @@ typedef void (*cell_sec_code_query_cb_callback)(
     const char *modem_id, connui_sim_security_code_type code_type, gboolean ok,
     gpointer user_data, GError *error);
 
+typedef void (*cell_sim_code_cb)(const char *modem_id, GError *error,
+                                 gpointer user_data);
+
 typedef void (*cell_sim_status_cb) (
     const char *modem_id,
     const connui_sim_status *status,
@@ -114,6 +117,30 @@ gboolean
 connui_cell_security_code_set_enabled(const char *modem_id,
                                       gboolean active, GError **error);
 
+/* Asynchronous SIM security code operations. All of them return a service
+ * call id, that can be passed to connui_cell_cancel_service_call(), or 0 on
+ * error. Operations not completed within the timeout (30 seconds by default,
+ * 0 disables it) fail with CONNUI_ERROR_TIMED_OUT.
+ */
+/* for PUK and PUK2 @new_pin is the PIN to set after the reset */
+guint
+connui_cell_sim_enter_code(const char *modem_id,
+                           connui_sim_security_code_type code_type,
+                           const gchar *code, const gchar *new_pin,
+                           cell_sim_code_cb cb, gpointer user_data);
+guint
+connui_cell_sim_change_code(const char *modem_id,
+                            connui_sim_security_code_type code_type,
+                            const gchar *old_code, const gchar *new_code,
+                            cell_sim_code_cb cb, gpointer user_data);
+guint
+connui_cell_sim_set_code_enabled(const char *modem_id,
+                                 connui_sim_security_code_type code_type,
+                                 gboolean enabled, const gchar *code,
+                                 cell_sim_code_cb cb, gpointer user_data);
+void
+connui_cell_sim_set_code_timeout(guint timeout);
+
 const gchar *
 connui_cell_sim_get_service_provider(const char *modem_id, GError **error);
 
@@ -123,4 +150,16 @@ connui_cell_sim_get_imsi(const char *modem_id, GError **error);
 gboolean
 connui_cell_sim_get_present(const char *modem_id, GError **error);
 
+const gchar *
+connui_cell_sim_get_card_identifier(const char *modem_id, GError **error);
+
+const gchar * const *
+connui_cell_sim_get_subscriber_numbers(const char *modem_id, GError **error);
+
+gboolean
+connui_cell_sim_get_fixed_dialing(const char *modem_id, GError **error);
+
+gboolean
+connui_cell_sim_get_barred_dialing(const char *modem_id, GError **error);
+
 #endif /* __CONNUI_CELLULAR_SIM_H_INCLUDED__ */
@@ -81,4 +81,44 @@ connui_cell_sups_get_call_forwarding_enabled(const char *modem_id,
                                              call_forwarding_get_cb cb,
                                              gpointer user_data);
 
+/* Requests to a modem are sent one at a time, sets before queries */
+typedef struct _connui_sups_queue_stats
+{
+  /* requests waiting to be sent */
+  guint depth;
+  guint max_depth;
+  /* Initiate or CallSettings SetProperty calls sent, not counting retries */
+  guint sent;
+  /* retries after InProgress errors */
+  guint retries;
+  /* time requests waited in the queue, in microseconds */
+  guint64 total_wait;
+  guint64 max_wait;
+}
+connui_sups_queue_stats;
+
+gboolean
+connui_cell_sups_get_queue_stats(const char *modem_id,
+                                 connui_sups_queue_stats *stats);
+
+/* Results of the getters above are cached per modem and SIM for the cache
+ * TTL (10 minutes by default, 0 disables caching), until a set succeeds or
+ * the modem is removed. Within the TTL, the getters reply from the cache.
+ * Those return the last known values even if expired, @stale is set then.
+ * On modems with CallSettings and CallForwarding, the current property values
+ * are returned instead, never stale. Numbers in @cf are owned by the library
+ * and stay valid until the next connui_cell_sups_get_cached_call_forwarding()
+ * call or call forwarding query or set for the modem completes, or the modem
+ * is removed.
+ */
+gboolean
+connui_cell_sups_get_cached_call_waiting(const char *modem_id,
+                                         gboolean *enabled, gboolean *stale);
+gboolean
+connui_cell_sups_get_cached_call_forwarding(const char *modem_id,
+                                            connui_sups_call_forward *cf,
+                                            gboolean *stale);
+void
+connui_cell_sups_set_cache_ttl(guint ttl);
+
 #endif /* __CONNUI_CELLULAR_SUPS_H_INCLUDED__ */
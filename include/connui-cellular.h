@@ -10,6 +10,41 @@
 #include "connui-cellular-sups.h"
 #include "connui-cellular-code-ui.h"
 
+/* context */
+typedef void (*cell_context_ready_cb) (gboolean ready, gpointer user_data);
+
+gboolean connui_cell_context_ready_register(cell_context_ready_cb cb, gpointer user_data);
+void connui_cell_context_ready_close(cell_context_ready_cb cb);
+gboolean connui_cell_context_is_ready();
+void connui_cell_context_hold();
+void connui_cell_context_release();
+void connui_cell_context_set_linger(guint seconds);
+
+/* stats */
+#define CONNUI_CELL_STATS_BUCKETS 8
+
+typedef struct _connui_cell_stats_method
+{
+  /* ofono interface and method, like "SimManager.EnterPin" */
+  const gchar *method;
+  guint calls;
+  guint errors;
+  guint timeouts;
+  guint in_flight;
+  /* in microseconds */
+  guint64 total_time;
+  guint64 max_time;
+  /* bucket n counts calls faster than 4^n ms, the last one the slower ones */
+  guint histogram[CONNUI_CELL_STATS_BUCKETS];
+}
+connui_cell_stats_method;
+
+void connui_cell_stats_set_enabled(gboolean enabled);
+gboolean connui_cell_stats_get_enabled();
+GList *connui_cell_stats_get();
+void connui_cell_stats_reset();
+gboolean connui_cell_stats_dump();
+
 /* CALL */
 typedef void (*cell_call_status_cb) (gboolean calls, gpointer user_data);
 
@@ -23,7 +58,21 @@ typedef void (*cell_datacounter_cb) (guint64 rx_bytes, guint64 tx_bytes, time_t
 void connui_cell_datacounter_close(cell_datacounter_cb cb);
 void connui_cell_datacounter_reset();
 gboolean connui_cell_datacounter_register(cell_datacounter_cb cb, gboolean home, gpointer user_data);
+/* @interval: min ms between notifications, changes in between are coalesced */
+gboolean connui_cell_datacounter_register_full(cell_datacounter_cb cb, gboolean home, guint interval, gpointer user_data);
 void connui_cell_datacounter_save(gboolean notification_enabled, const gchar *warning_limit);
+void connui_cell_datacounter_reset_scope(gboolean home);
+void connui_cell_datacounter_save_scope(gboolean home, gboolean notification_enabled, const gchar *warning_limit);
+void connui_cell_datacounter_add(gboolean home, guint64 rx_bytes, guint64 tx_bytes);
+gboolean connui_cell_datacounter_get_counters(gboolean home, guint64 *rx_bytes, guint64 *tx_bytes, time_t *reset_time);
+/* usage history, kept per hour; an hour is counted where its start falls.
+ * Like the counters it is kept per scope, not per SIM. Totals are recorded
+ * only while a datacounter of the scope is registered, usage that shows up
+ * after a gap is spread over at most the 24 hours before it was seen.
+ */
+gboolean connui_cell_datacounter_get_usage(gboolean home, time_t from, time_t to, guint64 *rx_bytes, guint64 *tx_bytes);
+/* fills @n buckets of @step seconds from @from, e.g. daily usage of a billing cycle */
+gboolean connui_cell_datacounter_get_usage_series(gboolean home, time_t from, guint step, guint n, guint64 *rx_bytes, guint64 *tx_bytes);
 
 #define CONNUI_ERROR (connui_error_quark())
 GQuark connui_error_quark(void);
@@ -57,4 +106,19 @@ typedef enum connui_error {
 void
 connui_cell_cancel_service_call(guint id);
 
+typedef struct _connui_cell_service_call_info
+{
+  guint id;
+  /* ofono method the call waits for, "cache" if it is replied from a cache,
+   * NULL if not known */
+  const gchar *method;
+  /* in microseconds */
+  gint64 age;
+  gboolean cancelled;
+}
+connui_cell_service_call_info;
+
+GList *connui_cell_service_calls_get();
+void connui_cell_service_calls_dump();
+
 #endif /* __CONNUI_CELLULAR_H__ */
@@ -1,122 +1,312 @@
 #include <dbus/dbus.h>
-#include <dbus/dbus-glib.h>
-#include <libosso.h>
 #include <connui/connui-utils.h>
 #include <connui/connui-log.h>
 
 #include "context.h"
 
+#include "call.h"
+#include "stats.h"
+
+#define DATA "connui_cell_call_data"
+
+#define GET_CALLS "VoiceCallManager.GetCalls"
+
+/* calls of a modem, kept current by CallAdded/CallRemoved */
+typedef struct _call_data
+{
+  connui_cell_context *ctx;
+  ConnuiCellVoiceCallManager *proxy;
+  gchar *path;
+
+  /* call object paths */
+  GHashTable *calls;
+
+  GCancellable *cancellable;
+  gint64 stats_start;
+  /* GetCalls replied, see ctx->get_calls_pending */
+  gboolean got_calls;
+  gulong added_id;
+  gulong removed_id;
+}
+call_data;
+
+static gboolean
+_idle_notify(gpointer user_data)
+{
+  connui_cell_context *ctx = user_data;
+
+  ctx->call_status_idle_id = 0;
+
+  connui_utils_notify_notify_BOOLEAN(ctx->call_status_cbs,
+                                     ctx->active_calls != 0);
+
+  return G_SOURCE_REMOVE;
+}
+
 static void
-connui_cell_call_status_change_cb(DBusGProxy *proxy, gboolean call,
-                                  gboolean unk, connui_cell_context *ctx)
+_notify(connui_cell_context *ctx)
 {
-  g_return_if_fail(ctx != NULL);
+  if (ctx->call_status_cbs && !ctx->call_status_idle_id)
+    ctx->call_status_idle_id = g_idle_add(_idle_notify, ctx);
+}
 
-  if (proxy)
-    connui_utils_notify_notify_BOOLEAN(ctx->call_status_cbs, call);
+typedef struct _call_status_pending_cb
+{
+  cell_call_status_cb cb;
+  gpointer user_data;
 }
+call_status_pending_cb;
 
-void
-connui_cell_call_status_close(cell_call_status_cb cb)
+/* only callbacks not notified yet, the others get _idle_notify() */
+static gboolean
+_idle_notify_pending(gpointer user_data)
 {
-  connui_cell_context *ctx = connui_cell_context_get(NULL);
+  connui_cell_context *ctx = user_data;
 
-  g_return_if_fail(ctx != NULL);
+  ctx->call_status_pending_id = 0;
 
-  ctx->call_status_cbs  = connui_utils_notify_remove(ctx->call_status_cbs, cb);
+  /* another modem showed up in the meantime */
+  if (ctx->bootstrap_pending || ctx->get_calls_pending)
+    return G_SOURCE_REMOVE;
 
-  if (!ctx->call_status_cbs)
+  while (ctx->call_status_pending)
   {
-   /* dbus_g_proxy_disconnect_signal(ctx->csd_call_proxy,
-                                   "ServerStatus",
-                                   (GCallback)connui_cell_call_status_change_cb,
-                                   ctx);*/
+    call_status_pending_cb *pcb = ctx->call_status_pending->data;
+
+    ctx->call_status_pending = g_slist_delete_link(ctx->call_status_pending,
+                                                   ctx->call_status_pending);
+    pcb->cb(ctx->active_calls != 0, pcb->user_data);
+    g_free(pcb);
   }
 
-  connui_cell_context_destroy(ctx);
+  return G_SOURCE_REMOVE;
+}
+
+__attribute__((visibility("hidden"))) void
+connui_cell_call_status_notify_pending(connui_cell_context *ctx)
+{
+  if (ctx->call_status_pending && !ctx->call_status_pending_id &&
+      !ctx->bootstrap_pending && !ctx->get_calls_pending)
+  {
+    ctx->call_status_pending_id = g_idle_add(_idle_notify_pending, ctx);
+  }
 }
 
 static void
-conn_cell_get_call_instances_cb(DBusGProxy *proxy, GPtrArray *instances,
-                                GError *error, gpointer user_data)
+_get_calls_done(call_data *cd)
 {
-  connui_cell_context *ctx = user_data;
+  cd->got_calls = TRUE;
+  cd->ctx->get_calls_pending--;
+  connui_cell_call_status_notify_pending(cd->ctx);
+}
 
-  g_return_if_fail(ctx != NULL);
+static void
+_call_add(call_data *cd, const gchar *call)
+{
+  if (!g_hash_table_add(cd->calls, g_strdup(call)))
+    return;
+
+  g_debug("Modem %s call %s added", cd->path, call);
+
+  /* listeners only care about no calls vs. some */
+  if (cd->ctx->active_calls++ == 0)
+    _notify(cd->ctx);
+}
+
+static void
+_call_added_cb(ConnuiCellVoiceCallManager *proxy, const gchar *call,
+               GVariant *properties, gpointer user_data)
+{
+  _call_add(user_data, call);
+}
+
+static void
+_call_removed_cb(ConnuiCellVoiceCallManager *proxy, const gchar *call,
+                 gpointer user_data)
+{
+  call_data *cd = user_data;
+
+  if (!g_hash_table_remove(cd->calls, call))
+    return;
+
+  g_debug("Modem %s call %s removed", cd->path, call);
 
-  gboolean calls = FALSE;
+  if (--cd->ctx->active_calls == 0)
+    _notify(cd->ctx);
+}
 
-  if (error)
+static void
+_get_calls_cb(GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  GVariant *calls = NULL;
+  GError *error = NULL;
+  call_data *cd;
+  gboolean ok;
+
+  ok = connui_cell_voice_call_manager_call_get_calls_finish(
+        CONNUI_CELL_VOICE_CALL_MANAGER(object), &calls, res, &error);
+
+  /* user_data is gone if cancelled */
+  if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
   {
-    CONNUI_ERR("Error: %s", error->message);
-    g_clear_error(&error);
+    g_error_free(error);
     return;
   }
 
-  if (instances )
+  cd = user_data;
+  stats_call_end(GET_CALLS, cd->stats_start, ok, &error);
+
+  if (ok)
+  {
+    GVariantIter i;
+    const gchar *call;
+
+    g_variant_iter_init(&i, calls);
+
+    while (g_variant_iter_loop(&i, "(&o@a{sv})", &call, NULL))
+      _call_add(cd, call);
+
+    g_variant_unref(calls);
+  }
+  else
+  {
+    CONNUI_ERR("Unable to get modem [%s] calls: %s", cd->path,
+               error->message);
+    g_error_free(error);
+  }
+
+  _get_calls_done(cd);
+}
+
+static void
+_call_data_destroy(gpointer data)
+{
+  call_data *cd = data;
+  guint count = g_hash_table_size(cd->calls);
+
+  g_debug("Removing ofono voice call manager for %s", cd->path);
+
+  g_cancellable_cancel(cd->cancellable);
+  g_object_unref(cd->cancellable);
+
+  /* _get_calls_cb() will not touch @cd after the cancel */
+  if (!cd->got_calls)
   {
-    int i;
+    stats_call_end(GET_CALLS, cd->stats_start, FALSE, NULL);
+    _get_calls_done(cd);
+  }
 
-    for (i = 0; i < instances->len; i++)
-    {
-      GValueArray *val_array = instances->pdata[i];
+  g_signal_handler_disconnect(cd->proxy, cd->added_id);
+  g_signal_handler_disconnect(cd->proxy, cd->removed_id);
+  g_object_unref(cd->proxy);
 
-      if (val_array->n_values > 1 && g_value_get_uint(&val_array->values[i]))
-        calls = TRUE;
-    }
+  if (count)
+  {
+    cd->ctx->active_calls -= count;
 
-    g_ptr_array_free(instances, TRUE);
+    if (!cd->ctx->active_calls)
+      _notify(cd->ctx);
   }
 
-  if (proxy)
-    connui_utils_notify_notify_BOOLEAN(ctx->call_status_cbs, calls);
+  g_hash_table_unref(cd->calls);
+  g_free(cd->path);
+  g_free(cd);
 }
 
-typedef void (*call_instances_cb_f)(DBusGProxy *, GPtrArray *, GError *, gpointer);
+__attribute__((visibility("hidden"))) void
+connui_cell_modem_add_calls(connui_cell_context *ctx, const char *path,
+                            ConnuiCellVoiceCallManager *proxy)
+{
+  ConnuiCellModem *modem = g_hash_table_lookup(ctx->modems, path);
+  call_data *cd = g_new0(call_data, 1);
 
-static void
-get_call_instances_cb(DBusGProxy *proxy, DBusGProxyCall *call, void *user_data)
-{
-  GType g_value_array_type =
-      dbus_g_type_get_struct("GValueArray", dbus_g_object_path_get_g_type(),
-                             G_TYPE_UINT, G_TYPE_INVALID);
-  GType g_ptr_array_type =
-      dbus_g_type_get_collection("GPtrArray", g_value_array_type);
-  sim_status_data *data = user_data;
-  GError *error = NULL;
-  GPtrArray *instances;
+  g_assert(modem);
 
-  dbus_g_proxy_end_call(proxy, call, &error,
-                        g_ptr_array_type, &instances,
-                        G_TYPE_INVALID);
-  ((call_instances_cb_f)data->cb)(proxy, instances, error, data->data);
+  cd->ctx = ctx;
+  cd->proxy = g_object_ref(proxy);
+  cd->path = g_strdup(path);
+  cd->calls = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  cd->cancellable = g_cancellable_new();
+
+  g_object_set_data_full(G_OBJECT(modem), DATA, cd, _call_data_destroy);
+
+  /* before GetCalls, so nothing is missed in between */
+  cd->added_id = g_signal_connect(proxy, "call-added",
+                                  G_CALLBACK(_call_added_cb), cd);
+  cd->removed_id = g_signal_connect(proxy, "call-removed",
+                                    G_CALLBACK(_call_removed_cb), cd);
+
+  ctx->get_calls_pending++;
+  cd->stats_start = stats_call_begin(GET_CALLS);
+  connui_cell_voice_call_manager_call_get_calls(proxy, cd->cancellable,
+                                                _get_calls_cb, cd);
 }
 
-gboolean
-connui_cell_call_status_register(cell_call_status_cb cb, gpointer user_data)
+__attribute__((visibility("hidden"))) void
+connui_cell_modem_remove_calls(ConnuiCellModem *modem)
+{
+  g_object_set_data(G_OBJECT(modem), DATA, NULL);
+}
+
+void
+connui_cell_call_status_close(cell_call_status_cb cb)
 {
   connui_cell_context *ctx = connui_cell_context_get(NULL);
-  sim_status_data *data;
+  GSList *l;
 
-  g_return_val_if_fail(ctx != NULL, FALSE);
+  g_return_if_fail(ctx != NULL);
+
+  ctx->call_status_cbs  = connui_utils_notify_remove(ctx->call_status_cbs, cb);
+
+  for (l = ctx->call_status_pending; l; )
+  {
+    call_status_pending_cb *pcb = l->data;
+
+    l = l->next;
+
+    if (pcb->cb == cb)
+    {
+      ctx->call_status_pending = g_slist_remove(ctx->call_status_pending,
+                                                pcb);
+      g_free(pcb);
+    }
+  }
 
-  if (!ctx->call_status_cbs)
+  if (!ctx->call_status_pending && ctx->call_status_pending_id)
   {
-    dbus_g_proxy_connect_signal(ctx->csd_call_proxy, "ServerStatus",
-                                (GCallback)connui_cell_call_status_change_cb,
-                                ctx, NULL);
+    g_source_remove(ctx->call_status_pending_id);
+    ctx->call_status_pending_id = 0;
   }
 
+  if (!ctx->call_status_cbs && ctx->call_status_idle_id)
+  {
+    g_source_remove(ctx->call_status_idle_id);
+    ctx->call_status_idle_id = 0;
+  }
+
+  connui_cell_context_destroy(ctx);
+}
+
+gboolean
+connui_cell_call_status_register(cell_call_status_cb cb, gpointer user_data)
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+  call_status_pending_cb *pcb;
+
+  g_return_val_if_fail(ctx != NULL, FALSE);
+
   ctx->call_status_cbs =
       connui_utils_notify_add(ctx->call_status_cbs, cb, user_data);
 
-  data = g_slice_new(sim_status_data);
-  data->cb = (GCallback)conn_cell_get_call_instances_cb;
-  data->data = ctx;
-
-  dbus_g_proxy_begin_call(ctx->csd_call_proxy, "GetCallInstances",
-                          get_call_instances_cb, data,
-                          destroy_sim_status_data, G_TYPE_INVALID);
+  /*
+   * current status, calls are tracked all the time, but it is not known
+   * before the modems are there and GetCalls replied
+   */
+  pcb = g_new(call_status_pending_cb, 1);
+  pcb->cb = cb;
+  pcb->user_data = user_data;
+  ctx->call_status_pending = g_slist_append(ctx->call_status_pending, pcb);
+  connui_cell_call_status_notify_pending(ctx);
 
   connui_cell_context_destroy(ctx);
 
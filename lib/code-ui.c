@@ -2,6 +2,7 @@
 #include <dbus/dbus-glib.h>
 #include <connui/connui-log.h>
 #include <clui-code-dialog.h>
+#include <hildon/hildon-gtk.h>
 #include <X11/Xlib.h>
 
 #include <libintl.h>
@@ -17,11 +18,14 @@
 #include "context.h"
 #include "ofono-context.h"
 #include "connui-cell-note.h"
+#include "emergency.h"
 
 #include "config.h"
 
 #define LOCK_FILE "/tmp/connui-cell-code-ui.lock"
 
+#define CODE_MAX_LEN 8
+
 #define _(s) dgettext(GETTEXT_PACKAGE, s)
 
 typedef enum {
@@ -54,8 +58,11 @@ struct _cell_code_ui
   guint sim_status_timeout;
   gboolean get_current_pin;
   gboolean show_status_notes;
-  GStrv emergency_numbers;
-  gchar *clui_em_number;
+  connui_emergency_trie *emergency_trie;
+  /* typed digits and the trie state after each, [0] is the empty input */
+  gchar em_input[CODE_MAX_LEN];
+  guint16 em_states[CODE_MAX_LEN + 1];
+  guint em_len;
   guint emcall_timeout;
   guint unused_timeout;
   connui_sim_status sim_status;
@@ -269,6 +276,12 @@ connui_cell_code_ui_modem_state_cb(const char *modem_id,
       *((connui_modem_status *)user_data) = *status;
 }
 
+static void
+connui_cell_code_ui_ready_cb(gboolean ready, gpointer user_data)
+{
+  *((gboolean *)user_data) = TRUE;
+}
+
 static gboolean
 sim_status_timeout_cb(cell_code_ui *code_ui)
 {
@@ -431,6 +444,18 @@ connui_cell_code_ui_pin_correct(cell_code_ui *code_ui)
   code_ui->state = CONNUI_CELL_CODE_UI_STATE_OK;
 }
 
+/* keep the dialog on screen while the SIM verifies the code */
+static void
+connui_cell_code_ui_set_busy(cell_code_ui *code_ui, gboolean busy)
+{
+  if (GTK_IS_WINDOW(code_ui->dialog))
+  {
+    hildon_gtk_window_set_progress_indicator(GTK_WINDOW(code_ui->dialog),
+                                             busy);
+    gtk_widget_set_sensitive(code_ui->dialog, !busy);
+  }
+}
+
 static void
 connui_cell_code_ui_verify_code_cb(const char *modem_id,
                                    connui_sim_security_code_type code_type,
@@ -442,6 +467,8 @@ connui_cell_code_ui_verify_code_cb(const char *modem_id,
 
   g_return_if_fail(code_ui != NULL);
 
+  connui_cell_code_ui_set_busy(code_ui, FALSE);
+
   if (ok)
   {
     if (code_ui->show_status_notes)
@@ -536,77 +563,284 @@ connui_cell_code_ui_verify_code_cb(const char *modem_id,
   }
 }
 
-static void
-connui_cell_code_ui_code_cb(const char *modem_id,
-                            const connui_sim_security_code_type *code_type,
-                            gchar ***old_code, gchar ***new_code,
-                            cell_sec_code_query_cb_callback *query_cb,
-                            gpointer *query_user_data,
-                            gpointer user_data)
+/* asks the user for the codes, @new_code is NULL if no new one is needed */
+static gboolean
+connui_cell_code_ui_query_codes(cell_code_ui *code_ui,
+                                connui_sim_security_code_type code_type,
+                                gchar **old_code, gchar **new_code)
 {
-  cell_code_ui *code_ui = user_data;
   gchar *code;
 
-  if (strcmp(modem_id, code_ui->modem_id))
-    return;
-
-  g_return_if_fail(
-        code_ui != NULL && code_ui->state != CONNUI_CELL_CODE_UI_STATE_NONE);
-
   if (code_ui->state != CONNUI_CELL_CODE_UI_STATE_STARTUP)
     code_ui->state = CONNUI_CELL_CODE_UI_STATE_PIN_ENABLE;
 
-  if (*old_code && *code_type == CONNUI_SIM_SECURITY_CODE_PIN && code_ui->code)
-    **old_code = g_strdup(code_ui->code);
+  if (code_type == CONNUI_SIM_SECURITY_CODE_PIN && code_ui->code)
+    *old_code = g_strdup(code_ui->code);
   else
   {
-    code = connui_cell_code_ui_get_code(*code_type, code_ui);
+    code = connui_cell_code_ui_get_code(code_type, code_ui);
 
     if (!code)
     {
       code_ui->state = CONNUI_CELL_CODE_UI_STATE_PIN_ERROR;
-      return;
+      return FALSE;
     }
 
-    **old_code = g_strdup(code);
+    *old_code = g_strdup(code);
   }
 
-  if (*new_code)
+  if (new_code)
   {
-    code = connui_cell_code_ui_code_get_new_code(*code_type, code_ui);
+    code = connui_cell_code_ui_code_get_new_code(code_type, code_ui);
 
     if (!code)
     {
-      g_free(**old_code);
-      **old_code = NULL;
-      return;
+      g_free(*old_code);
+      *old_code = NULL;
+      return FALSE;
     }
 
-    **new_code = code;
+    *new_code = code;
   }
   else
     code = NULL;
 
-  if (*code_type == CONNUI_SIM_SECURITY_CODE_PIN ||
-      *code_type == CONNUI_SIM_SECURITY_CODE_PUK)
+  if (code_type == CONNUI_SIM_SECURITY_CODE_PIN ||
+      code_type == CONNUI_SIM_SECURITY_CODE_PUK)
   {
     g_free(code_ui->code);
 
-    if (*code_type == CONNUI_SIM_SECURITY_CODE_PUK)
+    if (code_type == CONNUI_SIM_SECURITY_CODE_PUK)
       code_ui->code = g_strdup(code);
     else
     {
       if (!code)
-        code_ui->code = g_strdup(**old_code);
+        code_ui->code = g_strdup(*old_code);
       else
         code_ui->code = g_strdup(code);
     }
   }
 
-  *query_user_data = code_ui;
-  *query_cb = connui_cell_code_ui_verify_code_cb;
+  connui_cell_code_ui_set_busy(code_ui, TRUE);
 
-  return;
+  return TRUE;
+}
+
+static void
+connui_cell_code_ui_code_cb(const char *modem_id,
+                            const connui_sim_security_code_type *code_type,
+                            gchar ***old_code, gchar ***new_code,
+                            cell_sec_code_query_cb_callback *query_cb,
+                            gpointer *query_user_data,
+                            gpointer user_data)
+{
+  cell_code_ui *code_ui = user_data;
+
+  if (strcmp(modem_id, code_ui->modem_id))
+    return;
+
+  g_return_if_fail(
+        code_ui != NULL && code_ui->state != CONNUI_CELL_CODE_UI_STATE_NONE);
+
+  if (!*old_code)
+    return;
+
+  if (connui_cell_code_ui_query_codes(code_ui, *code_type, *old_code,
+                                      *new_code))
+  {
+    *query_user_data = code_ui;
+    *query_cb = connui_cell_code_ui_verify_code_cb;
+  }
+}
+
+typedef enum
+{
+  CODE_UI_CALL_LOCK,
+  CODE_UI_CALL_CHANGE,
+  CODE_UI_CALL_UNLOCK,
+  CODE_UI_CALL_SET_ENABLED
+}
+code_ui_call_step;
+
+/* code change or PIN enable/disable, driven by the SIM call callbacks */
+typedef struct _code_ui_call
+{
+  cell_code_ui *code_ui;
+  connui_sim_security_code_type code_type;
+  gchar *old_code;
+  gchar *new_code;
+  code_ui_call_step step;
+  /* PIN lock is off, turn it on for the change and off again after it */
+  gboolean unlocked;
+  GError *error;
+  gboolean done;
+  gboolean ok;
+}
+code_ui_call;
+
+static void
+connui_cell_code_ui_call_done(code_ui_call *call, const char *modem_id,
+                              GError *error)
+{
+  connui_cell_code_ui_verify_code_cb(modem_id, call->code_type, !error,
+                                     call->code_ui, error);
+  call->ok = !error;
+  call->done = TRUE;
+}
+
+/* @id is what the SIM call returned, 0 if it was not made */
+static void
+connui_cell_code_ui_call_started(code_ui_call *call, const char *modem_id,
+                                 guint id)
+{
+  GError *error;
+
+  if (id)
+    return;
+
+  error = g_error_new(CONNUI_ERROR, CONNUI_ERROR_NOT_FOUND,
+                      "No such modem [%s]", modem_id);
+  connui_cell_code_ui_call_done(call, modem_id, error);
+  g_error_free(error);
+}
+
+static void
+connui_cell_code_ui_call_cb(const char *modem_id, GError *error,
+                            gpointer user_data)
+{
+  code_ui_call *call = user_data;
+  guint id;
+
+  switch (call->step)
+  {
+    case CODE_UI_CALL_LOCK:
+    {
+      if (error)
+        break;
+
+      call->step = CODE_UI_CALL_CHANGE;
+      id = connui_cell_sim_change_code(modem_id, call->code_type,
+                                       call->old_code, call->new_code,
+                                       connui_cell_code_ui_call_cb, call);
+      connui_cell_code_ui_call_started(call, modem_id, id);
+      return;
+    }
+    case CODE_UI_CALL_CHANGE:
+    {
+      if (!call->unlocked)
+        break;
+
+      /* the change result is reported, not the one of the unlock */
+      if (error)
+        call->error = g_error_copy(error);
+
+      call->step = CODE_UI_CALL_UNLOCK;
+      id = connui_cell_sim_set_code_enabled(
+            modem_id, CONNUI_SIM_SECURITY_CODE_PIN, FALSE,
+            error ? call->old_code : call->new_code,
+            connui_cell_code_ui_call_cb, call);
+      connui_cell_code_ui_call_started(call, modem_id, id);
+      return;
+    }
+    case CODE_UI_CALL_UNLOCK:
+    {
+      if (call->error)
+        error = call->error;
+
+      break;
+    }
+    case CODE_UI_CALL_SET_ENABLED:
+      break;
+  }
+
+  connui_cell_code_ui_call_done(call, modem_id, error);
+}
+
+/*
+ * Compatibility shim for the synchronous code UI API, that returns the result
+ * of the SIM call. The calls themselves are asynchronous and the UI is updated
+ * from their callbacks.
+ */
+static gboolean
+connui_cell_code_ui_call_wait(code_ui_call *call)
+{
+  while (!call->done)
+    g_main_context_iteration(NULL, TRUE);
+
+  g_free(call->old_code);
+  g_free(call->new_code);
+  g_clear_error(&call->error);
+
+  return call->ok;
+}
+
+static gboolean
+connui_cell_code_ui_call_change(cell_code_ui *code_ui,
+                                connui_sim_security_code_type code_type)
+{
+  code_ui_call call = {code_ui, code_type};
+  const gchar *modem_id = code_ui->modem_id;
+  guint id;
+
+  if (!connui_cell_code_ui_query_codes(code_ui, code_type, &call.old_code,
+                                       &call.new_code))
+  {
+    return FALSE;
+  }
+
+  if (!*call.new_code)
+  {
+    g_free(call.old_code);
+    g_free(call.new_code);
+    connui_cell_code_ui_set_busy(code_ui, FALSE);
+    return FALSE;
+  }
+
+  call.unlocked = code_type == CONNUI_SIM_SECURITY_CODE_PIN &&
+      connui_cell_security_code_get_active(modem_id, NULL) !=
+      CONNUI_SIM_SECURITY_CODE_PIN;
+
+  /* PIN can be changed only while the lock is on */
+  if (call.unlocked)
+  {
+    call.step = CODE_UI_CALL_LOCK;
+    id = connui_cell_sim_set_code_enabled(modem_id,
+                                          CONNUI_SIM_SECURITY_CODE_PIN, TRUE,
+                                          call.old_code,
+                                          connui_cell_code_ui_call_cb, &call);
+  }
+  else
+  {
+    call.step = CODE_UI_CALL_CHANGE;
+    id = connui_cell_sim_change_code(modem_id, code_type, call.old_code,
+                                     call.new_code,
+                                     connui_cell_code_ui_call_cb, &call);
+  }
+
+  connui_cell_code_ui_call_started(&call, modem_id, id);
+
+  return connui_cell_code_ui_call_wait(&call);
+}
+
+static gboolean
+connui_cell_code_ui_call_set_enabled(cell_code_ui *code_ui, gboolean enabled)
+{
+  code_ui_call call = {code_ui, CONNUI_SIM_SECURITY_CODE_PIN};
+  guint id;
+
+  if (!connui_cell_code_ui_query_codes(code_ui, call.code_type,
+                                       &call.old_code, NULL))
+  {
+    return FALSE;
+  }
+
+  call.step = CODE_UI_CALL_SET_ENABLED;
+  id = connui_cell_sim_set_code_enabled(code_ui->modem_id, call.code_type,
+                                        enabled, call.old_code,
+                                        connui_cell_code_ui_call_cb, &call);
+  connui_cell_code_ui_call_started(&call, code_ui->modem_id, id);
+
+  return connui_cell_code_ui_call_wait(&call);
 }
 
 static void
@@ -854,8 +1088,21 @@ connui_cell_code_ui_init(const char *modem_id,
   }
   else
   {
+    gboolean ready = FALSE;
+
     code_ui->state = CONNUI_CELL_CODE_UI_STATE_NONE;
 
+    if (!connui_cell_context_ready_register(connui_cell_code_ui_ready_cb,
+                                            &ready))
+    {
+      goto out;
+    }
+
+    while (!ready)
+      g_main_context_iteration(NULL, TRUE);
+
+    connui_cell_context_ready_close(connui_cell_code_ui_ready_cb);
+
     if (!connui_cell_modem_is_powered(modem_id, NULL))
     {
       GtkWidget *note;
@@ -934,8 +1181,9 @@ connui_cell_code_ui_destroy()
     g_free(_code_ui->modem_id);
     g_free(_code_ui->code);
     g_free(_code_ui->pin_message);
-    g_free(_code_ui->clui_em_number);
-    g_strfreev(_code_ui->emergency_numbers);
+
+    if (_code_ui->emergency_trie)
+      connui_cell_emergency_trie_unref(_code_ui->emergency_trie);
 
     g_free(_code_ui);
     _code_ui = NULL;
@@ -1009,24 +1257,45 @@ find_done_button(GtkWidget *parent)
   return NULL;
 }
 
-static gboolean
-get_em_mode(cell_code_ui *code_ui)
+static void
+em_input_replay(cell_code_ui *code_ui)
 {
-  GStrv em_numbers = code_ui->emergency_numbers;
-  int i = 0;
+  guint i;
 
-  if (!code_ui->clui_em_number)
-    return FALSE;
+  code_ui->em_states[0] = CONNUI_EMERGENCY_STATE_START;
 
-  while (em_numbers[i])
+  for (i = 0; i < code_ui->em_len; i++)
   {
-    if (!strcmp(code_ui->clui_em_number, em_numbers[i]))
-      return TRUE;
+    code_ui->em_states[i + 1] = connui_cell_emergency_trie_next(
+          code_ui->emergency_trie, code_ui->em_states[i],
+          code_ui->em_input[i]);
+  }
+}
 
-    i++;
+/*
+ * the dialog changes the code on its own too, e.g. clears it after a wrong
+ * code. It is the code before @digit_str was typed, catch up with it.
+ */
+static void
+em_input_sync(cell_code_ui *code_ui)
+{
+  gchar *code = clui_code_dialog_get_code(CLUI_CODE_DIALOG(code_ui->dialog));
+  gsize len = code ? strlen(code) : 0;
+
+  if (len > CODE_MAX_LEN)
+    len = CODE_MAX_LEN;
+
+  if (len != code_ui->em_len ||
+      (len && memcmp(code, code_ui->em_input, len)))
+  {
+    if (len)
+      memcpy(code_ui->em_input, code, len);
+
+    code_ui->em_len = len;
+    em_input_replay(code_ui);
   }
 
-  return FALSE;
+  g_free(code);
 }
 
 static void
@@ -1034,34 +1303,50 @@ connui_cell_code_ui_dialog_input(cell_code_ui *code_ui, gchar *digit_str,
                                  CluiCodeDialog *code_dialog)
 {
   GtkWidget *done_button = NULL;
+  connui_emergency_match match;
 
   g_return_if_fail(code_ui != NULL && code_ui->dialog != NULL &&
-      code_ui->emergency_numbers != NULL && digit_str != NULL);
+      digit_str != NULL);
+
+  em_input_sync(code_ui);
 
   if (strcmp(digit_str, "BSP")) /* BackSPace ;) */
   {
-    gchar *code = clui_code_dialog_get_code(CLUI_CODE_DIALOG(code_ui->dialog));
+    guint len = code_ui->em_len;
 
-    g_free(code_ui->clui_em_number);
-    code_ui->clui_em_number = g_strconcat(code, digit_str, NULL);
-    g_free(code);
+    if (len < CODE_MAX_LEN)
+    {
+      code_ui->em_input[len] = *digit_str;
+      code_ui->em_states[len + 1] = connui_cell_emergency_trie_next(
+            code_ui->emergency_trie, code_ui->em_states[len], *digit_str);
+      code_ui->em_len++;
+    }
+  }
+  else if (code_ui->em_len)
+    code_ui->em_len--;
+
+  /* numbers were not known when the dialog was created */
+  if (!code_ui->emergency_trie && code_ui->modem_id)
+  {
+    code_ui->emergency_trie =
+        connui_cell_emergency_get_trie(code_ui->modem_id);
+
+    if (code_ui->emergency_trie)
+      em_input_replay(code_ui);
   }
-  else if (*code_ui->clui_em_number)
-      code_ui->clui_em_number[strlen(code_ui->clui_em_number) - 1] = '\0';
 
+  match = connui_cell_emergency_trie_match(
+        code_ui->emergency_trie, code_ui->em_states[code_ui->em_len]);
   clui_code_dialog_set_emergency_mode(CLUI_CODE_DIALOG(code_ui->dialog),
-                                      get_em_mode(code_ui));
+                                      match == CONNUI_EMERGENCY_MATCH_FULL);
 
   if (GTK_IS_DIALOG(code_ui->dialog))
     done_button = find_done_button(GTK_DIALOG(code_ui->dialog)->action_area);
 
   if (done_button)
   {
-    if (code_ui->clui_em_number &&
-        strlen(code_ui->clui_em_number) >= code_ui->code_min_len)
-    {
+    if (code_ui->em_len >= code_ui->code_min_len)
       gtk_widget_set_sensitive(done_button, TRUE);
-    }
     else
       gtk_widget_set_sensitive(done_button, FALSE);
   }
@@ -1080,7 +1365,8 @@ connui_cell_code_ui_create_dialog(const char *modem_id,
   g_return_val_if_fail(_code_ui->dialog == NULL, NULL);
 
   dialog = clui_code_dialog_new(TRUE);
-  clui_code_dialog_set_max_code_length(CLUI_CODE_DIALOG(dialog), 8);
+  clui_code_dialog_set_max_code_length(CLUI_CODE_DIALOG(dialog),
+                                       CODE_MAX_LEN);
 
   if (_code_ui->show_status_notes)
   {
@@ -1113,11 +1399,13 @@ connui_cell_code_ui_create_dialog(const char *modem_id,
     _code_ui->pin_message = NULL;
   }
 
-  if (!_code_ui->emergency_numbers)
-  {
-    _code_ui->emergency_numbers =
-        connui_cell_emergency_get_numbers(modem_id, NULL);
-  }
+  /* numbers might have changed since the last dialog */
+  if (_code_ui->emergency_trie)
+    connui_cell_emergency_trie_unref(_code_ui->emergency_trie);
+
+  _code_ui->emergency_trie = connui_cell_emergency_get_trie(modem_id);
+  _code_ui->em_len = 0;
+  _code_ui->em_states[0] = CONNUI_EMERGENCY_STATE_START;
 
   g_signal_connect_swapped(G_OBJECT(dialog), "input",
                            (GCallback)connui_cell_code_ui_dialog_input, _code_ui);
@@ -1193,8 +1481,7 @@ connui_cell_code_ui_change_code(connui_sim_security_code_type code_type)
 
   do
   {
-    ok = connui_cell_security_code_change(_code_ui->modem_id,
-                                          code_type, NULL);
+    ok = connui_cell_code_ui_call_change(_code_ui, code_type);
 
     while (_code_ui->sim_status != CONNUI_SIM_STATUS_OK)
     {
@@ -1254,8 +1541,7 @@ connui_cell_code_ui_set_current_code_active(gboolean active)
   _code_ui->get_current_pin = TRUE;
 
   while ((_code_ui->sim_status == CONNUI_SIM_STATUS_OK_PUK_REQUIRED ||
-          !(rv = connui_cell_security_code_set_enabled(_code_ui->modem_id,
-                                                       active, NULL))) &&
+          !(rv = connui_cell_code_ui_call_set_enabled(_code_ui, active))) &&
          !STATE_IS_ERROR(_code_ui->state))
   {
     g_main_context_iteration(NULL, TRUE);
@@ -26,9 +26,14 @@
 #include "context.h"
 
 #include "connmgr.h"
+#include "property.h"
+#include "stats.h"
+#include "traffic.h"
 
 #define DATA "connui_cell_connmgr_data"
 
+#define CONTEXT_TYPE_INTERNET "internet"
+
 typedef struct _cm_data
 {
   connui_cell_context *ctx;
@@ -39,9 +44,28 @@ typedef struct _cm_data
 
   guint idle_id;
   gulong changed_id;
+
+  /* connection contexts by path, see _context_update() */
+  GHashTable *contexts;
+  GCancellable *cancellable;
+  gulong context_added_id;
+  gulong context_removed_id;
+  /* network interface of the active context, if any */
+  gchar *interface;
 }
 cm_data;
 
+typedef struct _cm_context
+{
+  gchar *type;
+  gboolean active;
+  gchar *interface;
+  /* PropertyChanged of this context only */
+  GDBusConnection *connection;
+  guint changed_id;
+}
+cm_context;
+
 static gboolean
 _idle_notify(gpointer user_data)
 {
@@ -83,15 +107,40 @@ _cm_data_destroy(gpointer data)
   if (cmd->idle_id)
     g_source_remove(cmd->idle_id);
 
-  g_signal_handler_disconnect(cmd->proxy, cmd->changed_id);
+  g_cancellable_cancel(cmd->cancellable);
+  g_object_unref(cmd->cancellable);
 
   if (cmd->proxy)
+  {
+    g_signal_handler_disconnect(cmd->proxy, cmd->changed_id);
+
+    if (cmd->context_added_id)
+      g_signal_handler_disconnect(cmd->proxy, cmd->context_added_id);
+
+    if (cmd->context_removed_id)
+      g_signal_handler_disconnect(cmd->proxy, cmd->context_removed_id);
+
     g_object_unref(cmd->proxy);
+  }
 
+  g_hash_table_destroy(cmd->contexts);
+  g_free(cmd->interface);
   g_free(cmd->path);
   g_free(cmd);
 }
 
+static void
+_cm_context_free(gpointer data)
+{
+  cm_context *cc = data;
+
+  g_dbus_connection_signal_unsubscribe(cc->connection, cc->changed_id);
+  g_object_unref(cc->connection);
+  g_free(cc->type);
+  g_free(cc->interface);
+  g_free(cc);
+}
+
 static cm_data *
 _cm_data_create(ConnuiCellConnectionManager *proxy, const gchar *path,
                 connui_cell_context *ctx)
@@ -108,6 +157,9 @@ _cm_data_create(ConnuiCellConnectionManager *proxy, const gchar *path,
   cmd->proxy = proxy;
   cmd->ctx = ctx;
   cmd->status.bearer = CONNUI_CONNMGR_BEARER_UNKNOWN;
+  cmd->contexts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                        _cm_context_free);
+  cmd->cancellable = g_cancellable_new();
 
   return cmd;
 }
@@ -139,47 +191,92 @@ _cm_data_get(const char *path, connui_cell_context *ctx, GError **error)
   return cmd;
 }
 
-static connui_connmgr_bearer
-_bearer(const gchar *bearer)
-{
-  if (!strcmp(bearer, "none"))
-    return CONNUI_CONNMGR_BEARER_NONE;
-  else if (!strcmp(bearer, "gprs"))
-    return CONNUI_CONNMGR_BEARER_GPRS;
-  else if (!strcmp(bearer, "edge"))
-    return CONNUI_CONNMGR_BEARER_EDGE;
-  else if (!strcmp(bearer, "umts"))
-    return CONNUI_CONNMGR_BEARER_UMTS;
-  else if (!strcmp(bearer, "hsdpa"))
-    return CONNUI_CONNMGR_BEARER_HSPDA;
-  else if (!strcmp(bearer, "hsupa"))
-    return CONNUI_CONNMGR_BEARER_HSUPA;
-  else if (!strcmp(bearer, "hspa"))
-    return CONNUI_CONNMGR_BEARER_HSPA;
-  else if (!strcmp(bearer, "lte"))
-    return CONNUI_CONNMGR_BEARER_LTE;
-  else
-    return CONNUI_CONNMGR_BEARER_UNKNOWN;
+static const property_enum_entry bearer_entries[] =
+{
+  {"none", CONNUI_CONNMGR_BEARER_NONE},
+  {"gprs", CONNUI_CONNMGR_BEARER_GPRS},
+  {"edge", CONNUI_CONNMGR_BEARER_EDGE},
+  {"umts", CONNUI_CONNMGR_BEARER_UMTS},
+  {"hsdpa", CONNUI_CONNMGR_BEARER_HSPDA},
+  {"hsupa", CONNUI_CONNMGR_BEARER_HSUPA},
+  {"hspa", CONNUI_CONNMGR_BEARER_HSPA},
+  {"lte", CONNUI_CONNMGR_BEARER_LTE},
+  {NULL, 0}
+};
+
+static property_enum bearer =
+    PROPERTY_ENUM(bearer_entries, CONNUI_CONNMGR_BEARER_UNKNOWN);
+
+static gboolean
+_parse_attached(gpointer data, GVariant *value)
+{
+  cm_data *cmd = data;
+
+  cmd->status.attached = g_variant_get_boolean(value);
+
+  return TRUE;
+}
+
+static gboolean
+_parse_powered(gpointer data, GVariant *value)
+{
+  cm_data *cmd = data;
+
+  cmd->status.powered = g_variant_get_boolean(value);
+
+  return TRUE;
 }
 
+static gboolean
+_parse_suspended(gpointer data, GVariant *value)
+{
+  cm_data *cmd = data;
+
+  cmd->status.suspended = g_variant_get_boolean(value);
+
+  return TRUE;
+}
+
+static gboolean
+_parse_roaming_allowed(gpointer data, GVariant *value)
+{
+  cm_data *cmd = data;
+
+  cmd->status.roaming_allowed = g_variant_get_boolean(value);
+
+  return TRUE;
+}
+
+static gboolean
+_parse_bearer(gpointer data, GVariant *value)
+{
+  cm_data *cmd = data;
+
+  cmd->status.bearer =
+      property_enum_get(&bearer, g_variant_get_string(value, NULL));
+
+  return TRUE;
+}
+
+static const property_entry cm_property_entries[] =
+{
+  {OFONO_CONNMGR_PROPERTY_ATTACHED, _parse_attached},
+  {OFONO_CONNMGR_PROPERTY_POWERED, _parse_powered},
+  {OFONO_CONNMGR_PROPERTY_SUSPENDED, _parse_suspended},
+  {OFONO_CONNMGR_PROPERTY_ROAMING_ALLOWED, _parse_roaming_allowed},
+  {OFONO_CONNMGR_PROPERTY_BEARER, _parse_bearer},
+  {NULL, NULL}
+};
+
+static property_table cm_properties = PROPERTY_TABLE(cm_property_entries);
+
 static void
 _parse_property(cm_data *cmd, const gchar *name, GVariant *value)
 {
-  cell_connection_status *status = &cmd->status;
-
   g_debug("CONNMGR %s parsing property %s, type %s", cmd->path, name,
           g_variant_get_type_string(value));
 
-  if (!strcmp(name, OFONO_CONNMGR_PROPERTY_ATTACHED))
-    status->attached = g_variant_get_boolean(value);
-  else if (!strcmp(name, OFONO_CONNMGR_PROPERTY_POWERED))
-    status->powered = g_variant_get_boolean(value);
-  else if (!strcmp(name, OFONO_CONNMGR_PROPERTY_SUSPENDED))
-    status->suspended = g_variant_get_boolean(value);
-  else if (!strcmp(name, OFONO_CONNMGR_PROPERTY_ROAMING_ALLOWED))
-    status->roaming_allowed = g_variant_get_boolean(value);
-  else if (!strcmp(name, OFONO_CONNMGR_PROPERTY_BEARER))
-    status->bearer = _bearer(g_variant_get_string(value, NULL));
+  property_dispatch(&cm_properties, cmd, name, value);
 }
 
 static void
@@ -197,26 +294,237 @@ _property_changed_cb(ConnuiCellConnectionManager *proxy, const gchar *name,
   g_variant_unref(v);
 }
 
-__attribute__((visibility("hidden"))) void
-connui_cell_modem_add_connection_manager(connui_cell_context *ctx,
-                                         const char *path)
+static gboolean
+_parse_context_type(gpointer data, GVariant *value)
 {
-  ConnuiCellConnectionManager *proxy;
+  cm_context *cc = data;
+
+  g_free(cc->type);
+  cc->type = g_variant_dup_string(value, NULL);
+
+  return TRUE;
+}
+
+static gboolean
+_parse_context_active(gpointer data, GVariant *value)
+{
+  cm_context *cc = data;
+
+  cc->active = g_variant_get_boolean(value);
+
+  return TRUE;
+}
+
+static gboolean
+_parse_context_settings(gpointer data, GVariant *value)
+{
+  cm_context *cc = data;
+  const gchar *interface = NULL;
+
+  g_variant_lookup(value, OFONO_CONNCTX_SETTINGS_INTERFACE, "&s", &interface);
+  g_free(cc->interface);
+  cc->interface = g_strdup(interface);
+
+  return TRUE;
+}
+
+static const property_entry context_property_entries[] =
+{
+  {OFONO_CONNCTX_PROPERTY_TYPE, _parse_context_type},
+  {OFONO_CONNCTX_PROPERTY_ACTIVE, _parse_context_active},
+  {OFONO_CONNCTX_PROPERTY_SETTINGS, _parse_context_settings},
+  {NULL, NULL}
+};
+
+static property_table context_properties =
+    PROPERTY_TABLE(context_property_entries);
+
+/* picks the interface of the active context, internet ones first */
+static void
+_context_update(cm_data *cmd)
+{
+  GHashTableIter iter;
+  cm_context *cc;
+  const gchar *interface = NULL;
+
+  g_hash_table_iter_init(&iter, cmd->contexts);
+
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&cc))
+  {
+    if (!cc->active || !cc->interface)
+      continue;
+
+    if (!interface || !g_strcmp0(cc->type, CONTEXT_TYPE_INTERNET))
+      interface = cc->interface;
+  }
+
+  if (g_strcmp0(interface, cmd->interface))
+  {
+    g_debug("Modem %s data interface changed to %s", cmd->path, interface);
+    g_free(cmd->interface);
+    cmd->interface = g_strdup(interface);
+    connui_cell_traffic_kick(cmd->ctx);
+  }
+}
+
+static void
+_context_changed_cb(GDBusConnection *connection, const gchar *sender_name,
+                    const gchar *object_path, const gchar *interface_name,
+                    const gchar *signal_name, GVariant *parameters,
+                    gpointer user_data)
+{
+  cm_data *cmd = user_data;
+  cm_context *cc = g_hash_table_lookup(cmd->contexts, object_path);
+  const gchar *name;
+  GVariant *v;
+
+  if (!cc)
+    return;
+
+  g_variant_get(parameters, "(&sv)", &name, &v);
+  property_dispatch(&context_properties, cc, name, v);
+  g_variant_unref(v);
+
+  _context_update(cmd);
+}
+
+static void
+_context_add(cm_data *cmd, const gchar *path, GVariant *props)
+{
+  cm_context *cc = g_new0(cm_context, 1);
+  GVariantIter i;
+  gchar *name;
+  GVariant *v;
+
+  g_variant_iter_init(&i, props);
+
+  while (g_variant_iter_loop(&i, "{&sv}", &name, &v))
+    property_dispatch(&context_properties, cc, name, v);
+
+  /* the bus matches on the path, no other modem's contexts wake us up */
+  cc->connection = g_object_ref(
+        g_dbus_proxy_get_connection(G_DBUS_PROXY(cmd->proxy)));
+  cc->changed_id = g_dbus_connection_signal_subscribe(
+        cc->connection, OFONO_SERVICE, OFONO_CONNCTX_INTERFACE_NAME,
+        "PropertyChanged", path, NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+        _context_changed_cb, cmd, NULL);
+
+  g_hash_table_replace(cmd->contexts, g_strdup(path), cc);
+}
+
+static void
+_context_added_cb(ConnuiCellConnectionManager *proxy, const gchar *path,
+                  GVariant *properties, gpointer user_data)
+{
+  cm_data *cmd = user_data;
+
+  g_debug("Modem %s context %s added", cmd->path, path);
+
+  if (g_variant_is_of_type(properties, G_VARIANT_TYPE_VARIANT))
+  {
+    GVariant *props = g_variant_get_variant(properties);
+
+    _context_add(cmd, path, props);
+    g_variant_unref(props);
+  }
+  else
+    _context_add(cmd, path, properties);
+
+  _context_update(cmd);
+}
+
+static void
+_context_removed_cb(ConnuiCellConnectionManager *proxy, const gchar *path,
+                    gpointer user_data)
+{
+  cm_data *cmd = user_data;
+
+  g_debug("Modem %s context %s removed", cmd->path, path);
+
+  g_hash_table_remove(cmd->contexts, path);
+  _context_update(cmd);
+}
+
+static void
+_get_contexts_cb(GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  ConnuiCellConnectionManager *proxy = CONNUI_CELL_CONNECTION_MANAGER(object);
+  GVariant *contexts = NULL;
   GError *error = NULL;
+  cm_data *cmd;
+  GVariantIter i;
+  gchar *path;
+  GVariant *props;
 
-  g_debug("Adding ofono connection manager for %s", path);
+  if (!connui_cell_connection_manager_call_get_contexts_finish(
+        proxy, &contexts, res, &error))
+  {
+    /* cm_data is gone already */
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      cmd = user_data;
+      CONNUI_ERR("Unable to get modem [%s] connection contexts: %s",
+                 cmd->path, error->message);
+    }
 
-  proxy = connui_cell_connection_manager_proxy_new_for_bus_sync(
-        OFONO_BUS_TYPE, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
-        OFONO_SERVICE, path, NULL, &error);
+    g_error_free(error);
+    return;
+  }
 
-  if (proxy)
+  cmd = user_data;
+  g_variant_iter_init(&i, contexts);
+
+  while (g_variant_iter_loop(&i, "(&o@a{sv})", &path, &props))
+    _context_add(cmd, path, props);
+
+  g_variant_unref(contexts);
+  _context_update(cmd);
+}
+
+static void
+_contexts_watch(cm_data *cmd)
+{
+  cmd->context_added_id = g_signal_connect(
+        cmd->proxy, "context-added", G_CALLBACK(_context_added_cb), cmd);
+  cmd->context_removed_id = g_signal_connect(
+        cmd->proxy, "context-removed", G_CALLBACK(_context_removed_cb), cmd);
+
+  connui_cell_connection_manager_call_get_contexts(
+        cmd->proxy, cmd->cancellable, _get_contexts_cb, cmd);
+}
+
+static void
+_get_properties_cb(GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  connui_cell_pending *pending = user_data;
+  ConnuiCellConnectionManager *proxy = CONNUI_CELL_CONNECTION_MANAGER(object);
+  GVariant *props = NULL;
+  GError *error = NULL;
+  gboolean ok;
+
+  ok = connui_cell_connection_manager_call_get_properties_finish(
+        proxy, &props, res, &error);
+  stats_call_end("ConnectionManager.GetProperties", pending->stats_start,
+                 ok, &error);
+
+  if (!ok)
   {
-    cm_data *cmd = _cm_data_create(proxy, path, ctx);
-    GVariant *props;
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      CONNUI_ERR("Unable to get modem [%s] connection manager properties: %s",
+                 pending->path, error->message);
+    }
 
-    if (connui_cell_connection_manager_call_get_properties_sync(proxy, &props,
-                                                              NULL, &error))
+    g_error_free(error);
+  }
+
+  /* interface or modem are gone */
+  if (!g_cancellable_is_cancelled(pending->cancellable))
+  {
+    connui_cell_context *ctx = pending->ctx;
+    cm_data *cmd = _cm_data_create(g_object_ref(proxy), pending->path, ctx);
+
+    if (props)
     {
       GVariantIter i;
       gchar *name;
@@ -226,27 +534,61 @@ connui_cell_modem_add_connection_manager(connui_cell_context *ctx,
 
       while (g_variant_iter_loop(&i, "{&sv}", &name, &v))
         _parse_property(cmd, name, v);
-
-      g_variant_unref(props);
-    }
-    else
-    {
-      CONNUI_ERR("Unable to get modem [%s] network registration properties: %s",
-                 path, error->message);
-      g_error_free(error);
     }
 
     cmd->changed_id = g_signal_connect(proxy, "property-changed",
                                        G_CALLBACK(_property_changed_cb), cmd);
+    _contexts_watch(cmd);
 
     _notify_all(ctx);
   }
-  else
+
+  if (props)
+    g_variant_unref(props);
+
+  connui_cell_pending_free(pending);
+}
+
+static void
+_proxy_ready_cb(GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  connui_cell_pending *pending = user_data;
+  ConnuiCellConnectionManager *proxy;
+  GError *error = NULL;
+
+  proxy = connui_cell_connection_manager_proxy_new_for_bus_finish(res, &error);
+
+  if (!proxy)
   {
-    CONNUI_ERR("Error creating OFONO connection manager proxy for %s [%s]",
-               path, error->message);
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      CONNUI_ERR("Error creating OFONO connection manager proxy for %s [%s]",
+                 pending->path, error->message);
+    }
+
     g_error_free(error);
+    connui_cell_pending_free(pending);
+    return;
   }
+
+  pending->stats_start =
+      stats_call_begin("ConnectionManager.GetProperties");
+  connui_cell_connection_manager_call_get_properties(
+        proxy, pending->cancellable, _get_properties_cb, pending);
+  g_object_unref(proxy);
+}
+
+__attribute__((visibility("hidden"))) void
+connui_cell_modem_add_connection_manager(connui_cell_context *ctx,
+                                         const char *path,
+                                         GCancellable *cancellable)
+{
+  g_debug("Adding ofono connection manager for %s", path);
+
+  connui_cell_connection_manager_proxy_new_for_bus(
+        OFONO_BUS_TYPE, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+        OFONO_SERVICE, path, cancellable, _proxy_ready_cb,
+        connui_cell_pending_new(ctx, path, cancellable));
 }
 
 __attribute__((visibility("hidden"))) void
@@ -255,6 +597,14 @@ connui_cell_modem_remove_connection_manager(ConnuiCellModem *modem)
   g_object_set_data(G_OBJECT(modem), DATA, NULL);
 }
 
+__attribute__((visibility("hidden"))) const gchar *
+connui_cell_connection_get_interface(ConnuiCellModem *modem)
+{
+  cm_data *cmd = g_object_get_data(G_OBJECT(modem), DATA);
+
+  return cmd ? cmd->interface : NULL;
+}
+
 gboolean
 connui_cell_connection_status_register(cell_connection_status_cb cb,
                                     gpointer user_data)
@@ -299,8 +649,11 @@ _set_property(const char *modem_id,const gchar *name, GVariant *value,
 
   if (cmd)
   {
+    gint64 start = stats_call_begin("ConnectionManager.SetProperty");
+
     rv = connui_cell_connection_manager_call_set_property_sync(
           cmd->proxy, name, g_variant_new_variant(value), NULL, error);
+    stats_call_end("ConnectionManager.SetProperty", start, rv, error);
   }
 
   connui_cell_context_destroy(ctx);
@@ -26,9 +26,14 @@
 
 void
 connui_cell_modem_add_connection_manager(connui_cell_context *ctx,
-                                         const char *path);
+                                         const char *path,
+                                         GCancellable *cancellable);
 
 void
 connui_cell_modem_remove_connection_manager(ConnuiCellModem *modem);
 
+/* network interface of the active data context, NULL if none */
+const gchar *
+connui_cell_connection_get_interface(ConnuiCellModem *modem);
+
 #endif /* __CONNUI_INTERNAL_CONNMGR_H_INCLUDED__ */
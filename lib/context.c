@@ -1,9 +1,12 @@
 #include <connui/connui-log.h>
+#include <connui/connui-utils.h>
 
 #include "connui-cell-marshal.h"
 #include "context.h"
 
+#include "call.h"
 #include "modem.h"
+#include "service-call.h"
 
 __attribute__((visibility("hidden"))) void
 destroy_sim_status_data(gpointer mem_block)
@@ -44,34 +47,136 @@ register_marshallers()
   marshallers_registered = TRUE;
 }
 
+#define CONTEXT_LINGER_TIMEOUT 10
+
+static guint linger_timeout = CONTEXT_LINGER_TIMEOUT;
+
+typedef struct _pending_modem
+{
+  connui_cell_context *ctx;
+  GCancellable *cancellable;
+  gchar *path;
+  GVariant *properties;
+  gboolean bootstrap;
+}
+pending_modem;
+
 static void
-_add_modem(connui_cell_context *ctx, const gchar *path, GVariant *properties)
+_pending_modem_free(pending_modem *pm)
 {
-  GError *error = NULL;
-  ConnuiCellModem *modem = connui_cell_modem_proxy_new_for_bus_sync(
-        OFONO_BUS_TYPE, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
-        OFONO_SERVICE, path, NULL, &error);
+  g_object_unref(pm->cancellable);
+  g_variant_unref(pm->properties);
+  g_free(pm->path);
+  g_slice_free(pending_modem, pm);
+}
 
-  g_debug("Adding modem %s", path);
+static void
+_bootstrap_done(connui_cell_context *ctx)
+{
+  g_assert(ctx->bootstrap_pending > 0);
 
-  if (modem)
+  if (--ctx->bootstrap_pending)
+    return;
+
+  ctx->ready = ctx->reachable;
+
+  g_debug("Context bootstrap finished, %s", ctx->ready ? "ready" : "failed");
+
+  connui_utils_notify_notify_BOOLEAN(ctx->ready_cbs, ctx->ready);
+  connui_cell_call_status_notify_pending(ctx);
+
+  /* the bootstrap itself kept the context alive, see if we still need it */
+  connui_cell_context_destroy(ctx);
+}
+
+static void
+_modem_proxy_ready_cb(GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  pending_modem *pm = user_data;
+  connui_cell_context *ctx = pm->ctx;
+  GError *error = NULL;
+  ConnuiCellModem *modem =
+      connui_cell_modem_proxy_new_for_bus_finish(res, &error);
+
+  /* context was destroyed meanwhile */
+  if (g_cancellable_is_cancelled(pm->cancellable))
   {
-    g_hash_table_insert(ctx->modems, g_strdup(path), modem);
-    connui_cell_modem_add(ctx, modem, path, properties);
+    if (modem)
+      g_object_unref(modem);
+    else
+      g_error_free(error);
+
+    _pending_modem_free(pm);
+    return;
   }
-  else
+
+  if (!modem)
   {
-    CONNUI_ERR("Error creating OFONO modem %s proxy [%s]", path,
+    CONNUI_ERR("Error creating OFONO modem %s proxy [%s]", pm->path,
                error->message);
     g_error_free(error);
   }
+
+  /* modem could have been removed while we were waiting for the proxy */
+  if (g_hash_table_lookup(ctx->pending_modems, pm->path) == pm)
+  {
+    g_hash_table_remove(ctx->pending_modems, pm->path);
+
+    if (modem)
+    {
+      g_debug("Adding modem %s", pm->path);
+      g_hash_table_insert(ctx->modems, g_strdup(pm->path), modem);
+      connui_cell_modem_snapshot_invalidate(ctx);
+      connui_cell_modem_add(ctx, modem, pm->path, pm->properties);
+      modem = NULL;
+    }
+  }
+
+  if (modem)
+    g_object_unref(modem);
+
+  if (pm->bootstrap)
+    _bootstrap_done(ctx);
+
+  _pending_modem_free(pm);
+}
+
+static void
+_add_modem(connui_cell_context *ctx, const gchar *path, GVariant *properties,
+           gboolean bootstrap)
+{
+  pending_modem *pm;
+
+  if (g_hash_table_contains(ctx->modems, path) ||
+      g_hash_table_contains(ctx->pending_modems, path))
+  {
+    return;
+  }
+
+  g_debug("Creating proxy for modem %s", path);
+
+  pm = g_slice_new(pending_modem);
+  pm->ctx = ctx;
+  pm->cancellable = g_object_ref(ctx->cancellable);
+  pm->path = g_strdup(path);
+  pm->properties = g_variant_ref(properties);
+  pm->bootstrap = bootstrap;
+
+  if (bootstrap)
+    ctx->bootstrap_pending++;
+
+  g_hash_table_insert(ctx->pending_modems, g_strdup(path), pm);
+
+  connui_cell_modem_proxy_new_for_bus(
+        OFONO_BUS_TYPE, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+        OFONO_SERVICE, path, ctx->cancellable, _modem_proxy_ready_cb, pm);
 }
 
 static void
 _modem_added_cb(ConnuiCellManager *manager, const gchar *path,
                 GVariant *properties, gpointer user_data)
 {
-  _add_modem(user_data, path, properties);
+  _add_modem(user_data, path, properties, FALSE);
 }
 
 static void
@@ -89,6 +194,10 @@ _modem_removed_cb(ConnuiCellManager *manager, const gchar *path,
   gpointer key;
   gpointer value;
 
+  /* proxy is not there yet, _modem_proxy_ready_cb() will drop it */
+  if (g_hash_table_remove(ctx->pending_modems, path))
+    return;
+
   /* keep it alive in case callbacks call connui_cell_context_destroy() */
   g_object_ref(manager);
 
@@ -96,6 +205,8 @@ _modem_removed_cb(ConnuiCellManager *manager, const gchar *path,
    * connui_cell_context_destroy(), because of the registered callbacks */
   if (g_hash_table_steal_extended(ctx->modems, path, &key, &value))
   {
+    connui_cell_modem_snapshot_invalidate(ctx);
+
     /* that should call all the _xxx_data_destroy() functions */
     g_free(key);
     _destroy_modem(value);
@@ -104,53 +215,127 @@ _modem_removed_cb(ConnuiCellManager *manager, const gchar *path,
   g_object_unref(manager);
 }
 
-static gboolean
-create_proxies(connui_cell_context *ctx)
+static void
+_get_modems_cb(GObject *object, GAsyncResult *res, gpointer user_data)
 {
+  connui_cell_context *ctx = user_data;
   GError *error = NULL;
   GVariant *modems, *properties;
   gchar *path;
   GVariantIter iter;
 
-  ctx->manager = connui_cell_manager_proxy_new_for_bus_sync(
-        G_BUS_TYPE_SYSTEM, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
-        "org.ofono", "/", NULL, &error);
-
-  if (!ctx->manager)
+  if (!connui_cell_manager_call_get_modems_finish(
+        CONNUI_CELL_MANAGER(object), &modems, res, &error))
   {
-    CONNUI_ERR("Error creating OFONO manager [%s]", error->message);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      g_error_free(error);
+      return;
+    }
+
+    CONNUI_ERR("Error getting OFONO modems [%s]", error->message);
     g_error_free(error);
-    return FALSE;
   }
+  else
+  {
+    ctx->reachable = TRUE;
+    g_variant_iter_init(&iter, modems);
 
-  ctx->modems = g_hash_table_new_full(
-        g_str_hash, g_str_equal, g_free, _destroy_modem);
+    while (g_variant_iter_loop(&iter, "(&o@a{sv})", &path, &properties))
+      _add_modem(ctx, path, properties, TRUE);
 
-  if (!connui_cell_manager_call_get_modems_sync(
-        ctx->manager, &modems, NULL, &error))
-  {
-    CONNUI_ERR("Error getting OFONO modems [%s]", error->message);
-    g_error_free(error);
-    g_hash_table_unref(ctx->modems);
-    g_object_unref(ctx->manager);
-    return FALSE;
+    g_variant_unref(modems);
   }
 
-  g_variant_iter_init(&iter, modems);
+  _bootstrap_done(ctx);
+}
 
-  while (g_variant_iter_loop(&iter, "(&o@a{sv})", &path, &properties))
-    _add_modem(ctx, path, properties);
+static void
+_manager_proxy_ready_cb(GObject *object, GAsyncResult *res,
+                        gpointer user_data)
+{
+  connui_cell_context *ctx = user_data;
+  GError *error = NULL;
+  ConnuiCellManager *manager =
+      connui_cell_manager_proxy_new_for_bus_finish(res, &error);
 
-  g_variant_unref(modems);
+  if (!manager)
+  {
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      g_error_free(error);
+      return;
+    }
 
+    CONNUI_ERR("Error creating OFONO manager [%s]", error->message);
+    g_error_free(error);
+    _bootstrap_done(ctx);
+    return;
+  }
+
+  ctx->manager = manager;
+
+  /* connect before GetModems, so we don't miss modems added meanwhile */
   ctx->modem_added_id = g_signal_connect(ctx->manager, "modem-added",
                                          G_CALLBACK(_modem_added_cb), ctx);
   ctx->modem_removed_id = g_signal_connect(ctx->manager, "modem-removed",
                                            G_CALLBACK(_modem_removed_cb), ctx);
 
-  return TRUE;
+  connui_cell_manager_call_get_modems(ctx->manager, ctx->cancellable,
+                                      _get_modems_cb, ctx);
 }
 
+static void
+create_proxies(connui_cell_context *ctx)
+{
+  ctx->modems = g_hash_table_new_full(
+        g_str_hash, g_str_equal, g_free, _destroy_modem);
+  ctx->pending_modems = g_hash_table_new_full(
+        g_str_hash, g_str_equal, g_free, NULL);
+  ctx->cancellable = g_cancellable_new();
+  ctx->ready = FALSE;
+  ctx->reachable = FALSE;
+
+  /* manager proxy and GetModems */
+  ctx->bootstrap_pending = 1;
+
+  connui_cell_manager_proxy_new_for_bus(
+        OFONO_BUS_TYPE, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+        OFONO_SERVICE, "/", ctx->cancellable, _manager_proxy_ready_cb, ctx);
+}
+
+/*
+ * ofono lives on the system bus. CONNUI_CELL_OFONO_BUS=session makes us talk
+ * to a stand-in service on the session bus instead, so the library can be run
+ * without a real modem. Only ofono is affected, csd calls still go to the
+ * system bus.
+ */
+__attribute__((visibility("hidden"))) GBusType
+connui_cell_context_bus_type()
+{
+  static GBusType bus_type = G_BUS_TYPE_NONE;
+
+  if (bus_type == G_BUS_TYPE_NONE)
+  {
+    const gchar *bus = g_getenv("CONNUI_CELL_OFONO_BUS");
+
+    if (!g_strcmp0(bus, "session"))
+    {
+      g_debug("Using ofono on the session bus");
+      bus_type = G_BUS_TYPE_SESSION;
+    }
+    else
+      bus_type = G_BUS_TYPE_SYSTEM;
+  }
+
+  return bus_type;
+}
+
+/*
+ * Returns the shared context, starting its bootstrap if needed. Proxies are
+ * created asynchronously, so until the context is ready there are no modems
+ * in it and all the getters return their defaults.
+ */
 __attribute__((visibility("hidden"))) connui_cell_context *
 connui_cell_context_get(GError **error)
 {
@@ -163,48 +348,322 @@ connui_cell_context_get(GError **error)
 
   register_marshallers();
 
-  if (!create_proxies(&context))
-    return NULL;
+  create_proxies(&context);
 
   context.modem_cbs = NULL;
 
   context.sim_status_cbs = NULL;
   context.sec_code_cbs = NULL;
   context.net_status_cbs = NULL;
+  context.net_changed_cbs = NULL;
   context.conn_status_cbs = NULL;
   context.net_list_cbs = NULL;
   context.net_select_cbs = NULL;
   context.call_status_cbs = NULL;
+  context.traffic_cbs = NULL;
+  context.ready_cbs = NULL;
 
   context.initialized = TRUE;
 
   return &context;
 }
 
+static gboolean
+_context_in_use(connui_cell_context *ctx)
+{
+  if (ctx->modem_cbs || ctx->ready_cbs || ctx->bootstrap_pending ||
+      ctx->hold_count)
+  {
+    return TRUE;
+  }
+
+  if (ctx->sim_status_cbs || ctx->sec_code_cbs || ctx->conn_status_cbs ||
+      ctx->net_status_cbs || ctx->net_changed_cbs || ctx->net_list_cbs ||
+      ctx->net_select_cbs || ctx->call_status_cbs || ctx->traffic_cbs ||
+      service_call_count(ctx))
+  {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static void
+_context_teardown(connui_cell_context *ctx)
+{
+  g_debug("Destroy context");
+
+  if (ctx->linger_id)
+  {
+    g_source_remove(ctx->linger_id);
+    ctx->linger_id = 0;
+  }
+
+  if (ctx->ready_notify_id)
+  {
+    g_source_remove(ctx->ready_notify_id);
+    ctx->ready_notify_id = 0;
+  }
+
+  g_slist_free_full(ctx->ready_pending, g_free);
+  ctx->ready_pending = NULL;
+
+  /* that will drop any proxy still being created */
+  g_cancellable_cancel(ctx->cancellable);
+  g_object_unref(ctx->cancellable);
+  ctx->cancellable = NULL;
+  g_hash_table_unref(ctx->pending_modems);
+
+  if (ctx->manager)
+  {
+    g_signal_handler_disconnect(G_OBJECT(ctx->manager), ctx->modem_added_id);
+    g_signal_handler_disconnect(G_OBJECT(ctx->manager),
+                                ctx->modem_removed_id);
+    g_object_unref(G_OBJECT(ctx->manager));
+    ctx->manager = NULL;
+  }
+
+  g_hash_table_unref(ctx->modems);
+  connui_cell_modem_snapshot_invalidate(ctx);
+
+  if (ctx->operator_names)
+  {
+    g_hash_table_unref(ctx->operator_names);
+    ctx->operator_names = NULL;
+  }
+
+  ctx->ready = FALSE;
+  ctx->reachable = FALSE;
+  ctx->initialized = FALSE;
+}
+
+static gboolean
+_linger_timeout_cb(gpointer user_data)
+{
+  connui_cell_context *ctx = user_data;
+
+  ctx->linger_id = 0;
+
+  if (!_context_in_use(ctx))
+    _context_teardown(ctx);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Drops a reference to the context. Once the last user is gone, proxies are
+ * kept for linger_timeout seconds more, so bursts of getter calls do not
+ * re-enumerate ofono every time.
+ */
 __attribute__((visibility("hidden"))) void
 connui_cell_context_destroy(connui_cell_context *ctx)
 {
   if (!ctx->initialized)
     return;
 
-  if (ctx->modem_cbs)
+  if (_context_in_use(ctx))
     return;
 
-  if (ctx->sim_status_cbs || ctx->sec_code_cbs || ctx->conn_status_cbs ||
-      ctx->net_status_cbs || ctx->net_list_cbs || ctx->net_select_cbs ||
-      ctx->service_calls)
+  if (ctx->linger_id)
+    g_source_remove(ctx->linger_id);
+
+  if (linger_timeout)
   {
-    return;
+    ctx->linger_id =
+        g_timeout_add_seconds(linger_timeout, _linger_timeout_cb, ctx);
   }
+  else
+  {
+    ctx->linger_id = 0;
+    _context_teardown(ctx);
+  }
+}
 
-  g_debug("Destroy context");
+/**
+ * connui_cell_context_hold:
+ *
+ * Keeps ofono proxies alive until connui_cell_context_release() is called,
+ * even if there are no callbacks registered. Useful for code that makes many
+ * getter calls in a row. Calls can be nested.
+ */
+void
+connui_cell_context_hold()
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
 
-  g_signal_handler_disconnect(G_OBJECT(ctx->manager), ctx->modem_added_id);
-  g_signal_handler_disconnect(G_OBJECT(ctx->manager), ctx->modem_removed_id);
-  g_hash_table_unref(ctx->modems);
-  g_object_unref(G_OBJECT(ctx->manager));
+  g_return_if_fail(ctx != NULL);
 
-  ctx->initialized = FALSE;
+  ctx->hold_count++;
+}
+
+void
+connui_cell_context_release()
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+
+  g_return_if_fail(ctx != NULL);
+  g_return_if_fail(ctx->hold_count > 0);
+
+  ctx->hold_count--;
+
+  connui_cell_context_destroy(ctx);
+}
+
+/**
+ * connui_cell_context_set_linger:
+ * @seconds: how long to keep ofono proxies after the last user is gone, 0 to
+ * destroy them immediately.
+ */
+void
+connui_cell_context_set_linger(guint seconds)
+{
+  linger_timeout = seconds;
+}
+
+/*
+ * Interfaces set up while the context is bootstrapping delay the ready
+ * notification, so users get complete modem state once they are notified.
+ */
+__attribute__((visibility("hidden"))) connui_cell_pending *
+connui_cell_pending_new(connui_cell_context *ctx, const gchar *path,
+                        GCancellable *cancellable)
+{
+  connui_cell_pending *pending = g_slice_new0(connui_cell_pending);
+
+  pending->ctx = ctx;
+  pending->path = g_strdup(path);
+  pending->cancellable = g_object_ref(cancellable);
+  pending->bootstrap = ctx->bootstrap_pending > 0;
+
+  if (pending->bootstrap)
+    ctx->bootstrap_pending++;
+
+  return pending;
+}
+
+__attribute__((visibility("hidden"))) void
+connui_cell_pending_free(connui_cell_pending *pending)
+{
+  connui_cell_context *ctx = pending->ctx;
+  gboolean bootstrap = pending->bootstrap;
+
+  g_object_unref(pending->cancellable);
+  g_free(pending->path);
+  g_slice_free(connui_cell_pending, pending);
+
+  if (bootstrap)
+    _bootstrap_done(ctx);
+}
+
+typedef struct _ready_pending_cb
+{
+  cell_context_ready_cb cb;
+  gpointer user_data;
+}
+ready_pending_cb;
+
+/* only callbacks registered after bootstrap, the others were notified */
+static gboolean
+_ready_idle_notify(gpointer user_data)
+{
+  connui_cell_context *ctx = user_data;
+
+  ctx->ready_notify_id = 0;
+
+  while (ctx->ready_pending)
+  {
+    ready_pending_cb *rp = ctx->ready_pending->data;
+
+    ctx->ready_pending = g_slist_delete_link(ctx->ready_pending,
+                                             ctx->ready_pending);
+    rp->cb(ctx->ready, rp->user_data);
+    g_free(rp);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * connui_cell_context_ready_register:
+ * @cb: callback to be called when bootstrap finishes
+ * @user_data: user data passed to @cb
+ *
+ * Starts building the ofono proxies in the background if not already started
+ * and registers @cb to be called once that is done. @cb receives %TRUE if
+ * ofono was reachable, %FALSE otherwise. If the context is already
+ * bootstrapped, @cb is called from an idle callback.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+connui_cell_context_ready_register(cell_context_ready_cb cb,
+                                   gpointer user_data)
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+
+  g_return_val_if_fail(ctx != NULL, FALSE);
+
+  ctx->ready_cbs = connui_utils_notify_add(ctx->ready_cbs, cb, user_data);
+
+  if (!ctx->bootstrap_pending)
+  {
+    ready_pending_cb *rp = g_new(ready_pending_cb, 1);
+
+    rp->cb = cb;
+    rp->user_data = user_data;
+    ctx->ready_pending = g_slist_append(ctx->ready_pending, rp);
+
+    if (!ctx->ready_notify_id)
+      ctx->ready_notify_id = g_idle_add(_ready_idle_notify, ctx);
+  }
+
+  return TRUE;
+}
+
+void
+connui_cell_context_ready_close(cell_context_ready_cb cb)
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+  GSList *l;
+
+  g_return_if_fail(ctx != NULL);
+
+  ctx->ready_cbs = connui_utils_notify_remove(ctx->ready_cbs, cb);
+
+  for (l = ctx->ready_pending; l; )
+  {
+    ready_pending_cb *rp = l->data;
+
+    l = l->next;
+
+    if (rp->cb == cb)
+    {
+      ctx->ready_pending = g_slist_remove(ctx->ready_pending, rp);
+      g_free(rp);
+    }
+  }
+
+  connui_cell_context_destroy(ctx);
+}
+
+/**
+ * connui_cell_context_is_ready:
+ *
+ * Returns: %TRUE if ofono proxies are already built, i.e. getters return
+ *          real values instead of defaults.
+ */
+gboolean
+connui_cell_context_is_ready()
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+  gboolean ready;
+
+  g_return_val_if_fail(ctx != NULL, FALSE);
+
+  ready = ctx->ready;
+  connui_cell_context_destroy(ctx);
+
+  return ready;
 }
 
 #define CONNUI_ERROR_(error) OFONO_SERVICE ".Error." error
@@ -19,6 +19,8 @@ struct _connui_cell_context
   GSList *sec_code_cbs;
   DBusGProxyCall *get_sim_status_call_1;
   GSList *net_status_cbs;
+  GSList *net_changed_cbs;
+  guint net_changed_dispatching;
   GSList *conn_status_cbs;
   DBusGProxyCall *get_registration_status_call;
   GSList *net_list_cbs;
@@ -27,11 +29,23 @@ struct _connui_cell_context
   DBusGProxyCall *select_network_call;
   /* Move this above dbus stuff? */
   cell_network network;
-  /* Move this above dbus stuff? */
+  /* in-flight service calls by id, see service-call.c */
   GHashTable *service_calls;
-  /* Move this above dbus stuff? */
-  int service_call_id;
+  guint service_call_id;
+  struct _service_call_data *service_call_pool;
+  guint service_call_pool_size;
   GSList *call_status_cbs;
+  guint call_status_idle_id;
+  /* registered, waiting for their first notification */
+  GSList *call_status_pending;
+  guint call_status_pending_id;
+  /* GetCalls in flight */
+  guint get_calls_pending;
+  /* calls on all modems, see call.c */
+  guint active_calls;
+  GSList *traffic_cbs;
+  /* interface sampler, see traffic.c */
+  struct _traffic_sampler *traffic;
 
   /* sim.c properties */
   gulong ofono_sim_present_changed_valid_id;
@@ -41,9 +55,31 @@ struct _connui_cell_context
   ///////////////////////////////////////////////////////
   ConnuiCellManager *manager;
   GHashTable *modems;
+  /* see connui_cell_modem_get_snapshot() */
+  struct _connui_cell_modems *modems_snapshot;
+  guint modems_generation;
   GSList *modem_cbs;
   gulong modem_added_id;
   gulong modem_removed_id;
+
+  /* async bootstrap */
+  GCancellable *cancellable;
+  GHashTable *pending_modems;
+  guint bootstrap_pending;
+  gboolean ready;
+  /* GetModems succeeded */
+  gboolean reachable;
+  GSList *ready_cbs;
+  /* registered after bootstrap, waiting for their first notification */
+  GSList *ready_pending;
+  guint ready_notify_id;
+
+  /* operator names by MCC/MNC */
+  GHashTable *operator_names;
+
+  /* keep-alive */
+  guint hold_count;
+  guint linger_id;
 };
 
 typedef struct _connui_cell_context connui_cell_context;
@@ -56,9 +92,28 @@ struct _sim_status_data
 
 typedef struct _sim_status_data sim_status_data;
 
+/* in-flight async proxy/properties setup of a modem interface */
+struct _connui_cell_pending
+{
+  connui_cell_context *ctx;
+  gchar *path;
+  GCancellable *cancellable;
+  gboolean bootstrap;
+  /* GetProperties, see stats_call_begin() */
+  gint64 stats_start;
+};
+
+typedef struct _connui_cell_pending connui_cell_pending;
+
 connui_cell_context *connui_cell_context_get(GError **error);
 void connui_cell_context_destroy(connui_cell_context *ctx);
+GBusType connui_cell_context_bus_type(void);
 void destroy_sim_status_data(gpointer mem_block);
 
+connui_cell_pending *connui_cell_pending_new(connui_cell_context *ctx,
+                                             const gchar *path,
+                                             GCancellable *cancellable);
+void connui_cell_pending_free(connui_cell_pending *pending);
+
 
 #endif /* __CONNUI_CELL_CONTEXT_H__ */
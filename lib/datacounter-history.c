@@ -0,0 +1,547 @@
+/*
+ * datacounter-history.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Hourly usage history, one file per scope in the user data dir.
+ *
+ * The first HISTORY_PAGE_SIZE bytes hold history_header, followed by a ring
+ * of page_count pages. Each page starts with history_page and holds records
+ * of three varints: hours since the previous record (or since first_hour for
+ * the first one), rx bytes and tx bytes used in that hour. Hours without
+ * traffic are not stored. The hour being accumulated lives in the header
+ * until a later hour shows up.
+ *
+ * Totals are not always fed as traffic happens, e.g. ICd updates GConf only
+ * every now and then. Usage seen after a gap is spread evenly over the hours
+ * since the previous update, at most HISTORY_SPREAD_MAX of them, as there is
+ * no way to know when exactly it happened.
+ *
+ * Pages are in time order, so a range query binary searches page headers and
+ * only reads the pages overlapping the range.
+ */
+
+#include <connui/connui-log.h>
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "datacounter-history.h"
+
+#define HISTORY_MAGIC 0x48445543 /* "CUDH" */
+#define HISTORY_VERSION 1
+#define HISTORY_PAGE_SIZE 1024
+
+/* ring is sized for this many months of records of average size */
+#define HISTORY_RETENTION_MONTHS 13
+#define HISTORY_RECORD_AVG 10
+
+#define HOUR 3600
+
+/* hours usage after a gap is spread over */
+#define HISTORY_SPREAD_MAX 24
+
+typedef struct _history_header
+{
+  guint32 magic;
+  guint32 version;
+  guint32 page_size;
+  guint32 page_count;
+  /* ring index of the oldest page and number of pages in use */
+  guint32 first;
+  guint32 used;
+  /* totals seen by the last update */
+  guint64 last_rx;
+  guint64 last_tx;
+  /* hour being accumulated */
+  guint64 pending_hour;
+  guint64 pending_rx;
+  guint64 pending_tx;
+  /* time of the last update, 0 in files written before it was added */
+  guint64 last_time;
+}
+history_header;
+
+typedef struct _history_page
+{
+  guint64 first_hour;
+  guint64 last_hour;
+  guint16 count;
+  guint16 used;
+  guint32 reserved;
+  guint8 data[HISTORY_PAGE_SIZE - 24];
+}
+history_page;
+
+G_STATIC_ASSERT(sizeof(history_page) == HISTORY_PAGE_SIZE);
+
+static const gchar *scope_names[DATACOUNTER_SCOPE_COUNT] =
+{
+  "home",
+  "roaming"
+};
+
+static int history_fds[DATACOUNTER_SCOPE_COUNT] = {-1, -1};
+
+static guint
+_varint_put(guint8 *p, guint64 v)
+{
+  guint len = 0;
+
+  while (v >= 0x80)
+  {
+    p[len++] = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+
+  p[len++] = v;
+
+  return len;
+}
+
+static guint
+_varint_get(const guint8 *p, guint avail, guint64 *v)
+{
+  guint len = 0;
+  guint shift = 0;
+
+  *v = 0;
+
+  while (len < avail && shift < 64)
+  {
+    guint8 b = p[len++];
+
+    *v |= (guint64)(b & 0x7f) << shift;
+
+    if (!(b & 0x80))
+      return len;
+
+    shift += 7;
+  }
+
+  return 0;
+}
+
+static gboolean
+_read_at(int fd, gpointer buf, gsize size, off_t offset)
+{
+  return pread(fd, buf, size, offset) == (ssize_t)size;
+}
+
+static gboolean
+_write_at(int fd, gconstpointer buf, gsize size, off_t offset)
+{
+  return pwrite(fd, buf, size, offset) == (ssize_t)size;
+}
+
+static off_t
+_page_offset(const history_header *h, guint i)
+{
+  return (off_t)((h->first + i) % h->page_count + 1) * HISTORY_PAGE_SIZE;
+}
+
+static gboolean
+_header_valid(const history_header *h)
+{
+  return h->magic == HISTORY_MAGIC && h->version == HISTORY_VERSION &&
+      h->page_size == HISTORY_PAGE_SIZE && h->page_count &&
+      h->first < h->page_count && h->used <= h->page_count;
+}
+
+static int
+_history_open(datacounter_scope scope)
+{
+  gchar *dir;
+  gchar *name;
+  gchar *path;
+  int fd;
+
+  if (history_fds[scope] != -1)
+    return history_fds[scope];
+
+  dir = g_build_filename(g_get_user_data_dir(), "connui-cellular", NULL);
+  name = g_strconcat("datacounter-history-", scope_names[scope], NULL);
+  path = g_build_filename(dir, name, NULL);
+
+  if (g_mkdir_with_parents(dir, 0755) ||
+      (fd = g_open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) == -1)
+  {
+    CONNUI_ERR("Unable to open data counter history %s [%s]", path,
+               g_strerror(errno));
+    fd = -1;
+  }
+
+  g_free(path);
+  g_free(name);
+  g_free(dir);
+
+  return history_fds[scope] = fd;
+}
+
+/* called with the file locked, @created is NULL if not to be created */
+static gboolean
+_header_get(int fd, history_header *h, gboolean *created)
+{
+  if (_read_at(fd, h, sizeof(*h), 0) && _header_valid(h))
+    return TRUE;
+
+  if (!created)
+    return FALSE;
+
+  *created = TRUE;
+
+  memset(h, 0, sizeof(*h));
+  h->magic = HISTORY_MAGIC;
+  h->version = HISTORY_VERSION;
+  h->page_size = HISTORY_PAGE_SIZE;
+  h->page_count = HISTORY_RETENTION_MONTHS * 31 * 24 * HISTORY_RECORD_AVG /
+      sizeof(((history_page *)NULL)->data) + 1;
+
+  if (ftruncate(fd, 0) ||
+      ftruncate(fd, (off_t)(h->page_count + 1) * HISTORY_PAGE_SIZE))
+  {
+    CONNUI_ERR("Unable to create data counter history [%s]",
+               g_strerror(errno));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* drops pages that are completely past retention */
+static void
+_expire(int fd, history_header *h, guint64 hour)
+{
+  guint64 keep = HISTORY_RETENTION_MONTHS * 31 * 24;
+  history_page page;
+
+  while (h->used > 1 && hour > keep &&
+         _read_at(fd, &page, G_STRUCT_OFFSET(history_page, data),
+                  _page_offset(h, 0)) &&
+         page.last_hour < hour - keep)
+  {
+    h->first = (h->first + 1) % h->page_count;
+    h->used--;
+  }
+}
+
+static gboolean
+_append(int fd, history_header *h)
+{
+  guint8 rec[30];
+  guint len;
+  history_page page;
+  off_t offset;
+  guint64 delta;
+
+  if (h->used)
+  {
+    offset = _page_offset(h, h->used - 1);
+
+    if (!_read_at(fd, &page, sizeof(page), offset))
+      return FALSE;
+  }
+
+  if (h->used && page.count)
+    delta = h->pending_hour - page.last_hour;
+  else
+    delta = 0;
+
+  len = _varint_put(rec, delta);
+  len += _varint_put(rec + len, h->pending_rx);
+  len += _varint_put(rec + len, h->pending_tx);
+
+  /* start a new page, overwriting the oldest one if the ring is full */
+  if (!h->used || page.used + len > sizeof(page.data))
+  {
+    if (h->used == h->page_count)
+    {
+      h->first = (h->first + 1) % h->page_count;
+      h->used--;
+    }
+
+    h->used++;
+    offset = _page_offset(h, h->used - 1);
+    memset(&page, 0, sizeof(page));
+    page.first_hour = h->pending_hour;
+    len = _varint_put(rec, 0);
+    len += _varint_put(rec + len, h->pending_rx);
+    len += _varint_put(rec + len, h->pending_tx);
+  }
+
+  memcpy(page.data + page.used, rec, len);
+  page.used += len;
+  page.count++;
+  page.last_hour = h->pending_hour;
+
+  return _write_at(fd, &page, sizeof(page), offset);
+}
+
+/* adds usage to @hour, appending the pending hour if that is an older one */
+static gboolean
+_add(int fd, history_header *h, guint64 hour, guint64 rx, guint64 tx)
+{
+  if (!rx && !tx)
+    return TRUE;
+
+  if (hour != h->pending_hour && (h->pending_rx || h->pending_tx))
+  {
+    /* clock went back, keep the history ordered */
+    if (hour < h->pending_hour)
+      hour = h->pending_hour;
+    else
+    {
+      _expire(fd, h, hour);
+
+      if (!_append(fd, h))
+        return FALSE;
+
+      h->pending_rx = 0;
+      h->pending_tx = 0;
+    }
+  }
+
+  h->pending_hour = hour;
+  h->pending_rx += rx;
+  h->pending_tx += tx;
+
+  return TRUE;
+}
+
+/* splits usage between @from and @to by the time spent in each hour */
+static gboolean
+_spread(int fd, history_header *h, guint64 from, guint64 to, guint64 rx,
+        guint64 tx)
+{
+  guint64 span = to - from;
+  guint64 t = from;
+
+  while (t / HOUR < to / HOUR)
+  {
+    guint64 end = (t / HOUR + 1) * HOUR;
+    guint64 r = rx * (end - t) / span;
+    guint64 x = tx * (end - t) / span;
+
+    if (!_add(fd, h, t / HOUR, r, x))
+      return FALSE;
+
+    rx -= r;
+    tx -= x;
+    span -= end - t;
+    t = end;
+  }
+
+  return _add(fd, h, to / HOUR, rx, tx);
+}
+
+__attribute__((visibility("hidden"))) gboolean
+datacounter_history_record(datacounter_scope scope, guint64 rx_bytes,
+                           guint64 tx_bytes, time_t now)
+{
+  int fd;
+  history_header h;
+  guint64 from = now;
+  guint64 rx;
+  guint64 tx;
+  gboolean created = FALSE;
+  gboolean rv = FALSE;
+
+  g_return_val_if_fail(scope < DATACOUNTER_SCOPE_COUNT, FALSE);
+
+  if ((fd = _history_open(scope)) == -1)
+    return FALSE;
+
+  flock(fd, LOCK_EX);
+
+  if (!_header_get(fd, &h, &created))
+    goto out;
+
+  /* what was counted before the history existed is not of this hour */
+  if (created)
+  {
+    rx = 0;
+    tx = 0;
+  }
+  else
+  {
+    /* a counter went back, it was reset and all of it is new */
+    rx = rx_bytes >= h.last_rx ? rx_bytes - h.last_rx : rx_bytes;
+    tx = tx_bytes >= h.last_tx ? tx_bytes - h.last_tx : tx_bytes;
+  }
+
+  if (h.last_time && h.last_time < (guint64)now)
+  {
+    from = MAX(h.last_time,
+               (guint64)now - MIN((guint64)now, HISTORY_SPREAD_MAX * HOUR));
+  }
+
+  h.last_rx = rx_bytes;
+  h.last_tx = tx_bytes;
+  h.last_time = now;
+
+  if (!_spread(fd, &h, from, now, rx, tx))
+  {
+    CONNUI_ERR("Unable to write data counter history [%s]",
+               g_strerror(errno));
+    goto out;
+  }
+
+  rv = _write_at(fd, &h, sizeof(h), 0);
+
+out:
+  flock(fd, LOCK_UN);
+
+  return rv;
+}
+
+static void
+_query_add(guint64 hour, guint64 rx, guint64 tx, time_t from, guint step,
+           guint n, guint64 *rx_out, guint64 *tx_out)
+{
+  guint64 t = hour * HOUR;
+  guint64 i;
+
+  if (t < (guint64)from)
+    return;
+
+  i = (t - from) / step;
+
+  if (i < n)
+  {
+    rx_out[i] += rx;
+    tx_out[i] += tx;
+  }
+}
+
+/* returns the first page that may contain @hour */
+static guint
+_page_find(int fd, const history_header *h, guint64 hour)
+{
+  guint lo = 0;
+  guint hi = h->used;
+
+  while (hi - lo > 1)
+  {
+    guint mid = lo + (hi - lo) / 2;
+    history_page page;
+
+    if (!_read_at(fd, &page, G_STRUCT_OFFSET(history_page, data),
+                  _page_offset(h, mid)))
+    {
+      break;
+    }
+
+    if (page.first_hour <= hour)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+__attribute__((visibility("hidden"))) gboolean
+datacounter_history_query(datacounter_scope scope, time_t from, guint step,
+                          guint n, guint64 *rx, guint64 *tx)
+{
+  int fd;
+  history_header h;
+  guint64 from_hour = from / HOUR;
+  guint64 to_hour = ((guint64)from + (guint64)step * n + HOUR - 1) / HOUR;
+  guint i;
+
+  g_return_val_if_fail(scope < DATACOUNTER_SCOPE_COUNT, FALSE);
+  g_return_val_if_fail(step > 0, FALSE);
+
+  memset(rx, 0, n * sizeof(*rx));
+  memset(tx, 0, n * sizeof(*tx));
+
+  if ((fd = _history_open(scope)) == -1)
+    return FALSE;
+
+  flock(fd, LOCK_SH);
+
+  if (!_header_get(fd, &h, NULL))
+  {
+    /* nothing recorded yet */
+    flock(fd, LOCK_UN);
+    return TRUE;
+  }
+
+  for (i = h.used ? _page_find(fd, &h, from_hour) : 0; i < h.used; i++)
+  {
+    history_page page;
+    guint64 hour;
+    guint pos = 0;
+    guint c;
+
+    if (!_read_at(fd, &page, sizeof(page), _page_offset(&h, i)))
+      break;
+
+    if (page.first_hour >= to_hour)
+      break;
+
+    if (page.last_hour < from_hour || page.used > sizeof(page.data))
+      continue;
+
+    hour = page.first_hour;
+
+    for (c = 0; c < page.count; c++)
+    {
+      guint64 delta;
+      guint64 r;
+      guint64 t;
+      guint len;
+
+      if (!(len = _varint_get(page.data + pos, page.used - pos, &delta)))
+        break;
+
+      pos += len;
+
+      if (!(len = _varint_get(page.data + pos, page.used - pos, &r)))
+        break;
+
+      pos += len;
+
+      if (!(len = _varint_get(page.data + pos, page.used - pos, &t)))
+        break;
+
+      pos += len;
+      hour += delta;
+
+      if (hour >= to_hour)
+        break;
+
+      _query_add(hour, r, t, from, step, n, rx, tx);
+    }
+  }
+
+  if (h.pending_rx || h.pending_tx)
+  {
+    _query_add(h.pending_hour, h.pending_rx, h.pending_tx, from, step, n, rx,
+               tx);
+  }
+
+  flock(fd, LOCK_UN);
+
+  return TRUE;
+}
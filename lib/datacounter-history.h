@@ -0,0 +1,38 @@
+/*
+ * datacounter-history.h
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __CONNUI_INTERNAL_DATACOUNTER_HISTORY_H_INCLUDED__
+#define __CONNUI_INTERNAL_DATACOUNTER_HISTORY_H_INCLUDED__
+
+#include "datacounter-store.h"
+
+/* feeds current totals, usage is the difference to the last ones seen */
+__attribute__((visibility("hidden"))) gboolean
+datacounter_history_record(datacounter_scope scope, guint64 rx_bytes,
+                           guint64 tx_bytes, time_t now);
+
+/*
+ * sums usage in @n buckets of @step seconds starting at @from, into @rx and
+ * @tx. Usage is kept per hour, each hour goes to the bucket its start is in.
+ */
+__attribute__((visibility("hidden"))) gboolean
+datacounter_history_query(datacounter_scope scope, time_t from, guint step,
+                          guint n, guint64 *rx, guint64 *tx);
+
+#endif /* __CONNUI_INTERNAL_DATACOUNTER_HISTORY_H_INCLUDED__ */
@@ -0,0 +1,392 @@
+/*
+ * datacounter-store.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Data counters live in a small file in the user data dir, mmap-ed shared by
+ * every process, so an update is a couple of memory stores instead of GConf
+ * string writes.
+ *
+ * File layout (host byte order, it never leaves the device):
+ *   datacounter_store_file, with two slots
+ * Besides the counters, a slot keeps the values last known to be in the
+ * GConf compat keys, so a process starting later can tell what ICd wrote
+ * while nobody was watching from what was mirrored there by us.
+ * Writers hold flock() on the file, copy the current slot into the other
+ * one, modify it, bump its sequence number and checksum it. Readers take the
+ * slot with the highest sequence and a good checksum, without locking, and
+ * retry on a checksum mismatch. A crash halfway through a write leaves the
+ * previous slot intact.
+ */
+
+#include <connui/connui-log.h>
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "datacounter-store.h"
+
+#define DATACOUNTER_STORE_MAGIC 0x43445543 /* "CUDC" */
+#define DATACOUNTER_STORE_VERSION 2
+#define DATACOUNTER_STORE_NAME "datacounter"
+
+#define READ_RETRIES 8
+
+typedef struct _datacounter_store_slot
+{
+  guint64 seq;
+  datacounter_counters counters[DATACOUNTER_SCOPE_COUNT];
+  datacounter_counters gconf[DATACOUNTER_SCOPE_COUNT];
+  guint32 checksum;
+  guint32 reserved;
+}
+datacounter_store_slot;
+
+typedef struct _datacounter_store_file
+{
+  guint32 magic;
+  guint32 version;
+  datacounter_store_slot slots[2];
+}
+datacounter_store_file;
+
+/* version 1, without the GConf values */
+typedef struct _datacounter_store_slot_v1
+{
+  guint64 seq;
+  datacounter_counters counters[DATACOUNTER_SCOPE_COUNT];
+  guint32 checksum;
+  guint32 reserved;
+}
+datacounter_store_slot_v1;
+
+typedef struct _datacounter_store_file_v1
+{
+  guint32 magic;
+  guint32 version;
+  datacounter_store_slot_v1 slots[2];
+}
+datacounter_store_file_v1;
+
+static int store_fd = -1;
+static datacounter_store_file *store;
+
+/* FNV-1a */
+static guint32
+_fnv1a(gconstpointer data, gsize len)
+{
+  const guint8 *p = data;
+  guint32 hash = 2166136261U;
+
+  while (len--)
+  {
+    hash ^= *p++;
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
+/* over everything before the checksum */
+static guint32
+_checksum(const datacounter_store_slot *slot)
+{
+  return _fnv1a(slot, G_STRUCT_OFFSET(datacounter_store_slot, checksum));
+}
+
+/*
+ * keeps the counters of a version 1 file, GConf was kept in sync with them
+ * by the mirror, so take those as what is there
+ */
+static gboolean
+_migrate_v1(const datacounter_store_file_v1 *old)
+{
+  const datacounter_store_slot_v1 *current = NULL;
+  datacounter_store_slot slot;
+  int i;
+
+  if (old->magic != DATACOUNTER_STORE_MAGIC || old->version != 1)
+    return FALSE;
+
+  for (i = 0; i < 2; i++)
+  {
+    const datacounter_store_slot_v1 *s = &old->slots[i];
+
+    if (s->checksum == _fnv1a(s, G_STRUCT_OFFSET(datacounter_store_slot_v1,
+                                                 checksum)) &&
+        (!current || s->seq > current->seq))
+    {
+      current = s;
+    }
+  }
+
+  if (!current)
+    return FALSE;
+
+  memset(&slot, 0, sizeof(slot));
+  slot.seq = current->seq;
+  memcpy(slot.counters, current->counters, sizeof(slot.counters));
+  memcpy(slot.gconf, current->counters, sizeof(slot.gconf));
+  slot.checksum = _checksum(&slot);
+  store->slots[0] = slot;
+
+  return TRUE;
+}
+
+static const datacounter_store_slot *
+_slot_current()
+{
+  const datacounter_store_slot *a = &store->slots[0];
+  const datacounter_store_slot *b = &store->slots[1];
+  gboolean a_ok = a->checksum == _checksum(a);
+  gboolean b_ok = b->checksum == _checksum(b);
+
+  if (a_ok && b_ok)
+    return a->seq >= b->seq ? a : b;
+
+  if (a_ok)
+    return a;
+
+  if (b_ok)
+    return b;
+
+  return NULL;
+}
+
+__attribute__((visibility("hidden"))) gboolean
+datacounter_store_open(gboolean *created)
+{
+  gchar *dir;
+  gchar *path;
+  datacounter_store_file_v1 old;
+  gboolean v1 = FALSE;
+  struct stat st;
+  gpointer map;
+  int fd;
+
+  *created = FALSE;
+
+  if (store)
+    return TRUE;
+
+  dir = g_build_filename(g_get_user_data_dir(), "connui-cellular", NULL);
+  path = g_build_filename(dir, DATACOUNTER_STORE_NAME, NULL);
+
+  if (g_mkdir_with_parents(dir, 0755) ||
+      (fd = g_open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) == -1)
+  {
+    CONNUI_ERR("Unable to open data counter store %s [%s]", path,
+               g_strerror(errno));
+    g_free(path);
+    g_free(dir);
+
+    return FALSE;
+  }
+
+  flock(fd, LOCK_EX);
+
+  if (fstat(fd, &st) || st.st_size != sizeof(datacounter_store_file))
+  {
+    v1 = st.st_size == sizeof(old) &&
+        pread(fd, &old, sizeof(old), 0) == sizeof(old);
+
+    if (ftruncate(fd, 0) || ftruncate(fd, sizeof(datacounter_store_file)))
+      goto err;
+
+    *created = TRUE;
+  }
+
+  map = mmap(NULL, sizeof(datacounter_store_file), PROT_READ | PROT_WRITE,
+             MAP_SHARED, fd, 0);
+
+  if (map == MAP_FAILED)
+    goto err;
+
+  store = map;
+
+  if (store->magic != DATACOUNTER_STORE_MAGIC ||
+      store->version != DATACOUNTER_STORE_VERSION)
+  {
+    g_debug("Initializing data counter store %s", path);
+    memset(store, 0, sizeof(*store));
+    store->magic = DATACOUNTER_STORE_MAGIC;
+    store->version = DATACOUNTER_STORE_VERSION;
+
+    if (v1 && _migrate_v1(&old))
+      g_debug("Migrated data counter store %s from version 1", path);
+    else
+      *created = TRUE;
+  }
+
+  flock(fd, LOCK_UN);
+  store_fd = fd;
+
+  g_free(path);
+  g_free(dir);
+
+  return TRUE;
+
+err:
+  CONNUI_ERR("Unable to map data counter store %s [%s]", path,
+             g_strerror(errno));
+  flock(fd, LOCK_UN);
+  close(fd);
+  g_free(path);
+  g_free(dir);
+
+  return FALSE;
+}
+
+static gboolean
+_store_read(datacounter_scope scope, datacounter_counters *counters,
+            datacounter_counters *gconf)
+{
+  int i;
+
+  g_return_val_if_fail(scope < DATACOUNTER_SCOPE_COUNT, FALSE);
+
+  if (!store)
+    return FALSE;
+
+  /* a writer might reuse the slot while we copy it */
+  for (i = 0; i < READ_RETRIES; i++)
+  {
+    const datacounter_store_slot *current = _slot_current();
+    datacounter_store_slot slot;
+
+    if (!current)
+    {
+      memset(counters, 0, sizeof(*counters));
+
+      if (gconf)
+        memset(gconf, 0, sizeof(*gconf));
+
+      return TRUE;
+    }
+
+    memcpy(&slot, current, sizeof(slot));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    if (slot.checksum == _checksum(&slot))
+    {
+      *counters = slot.counters[scope];
+
+      if (gconf)
+        *gconf = slot.gconf[scope];
+
+      return TRUE;
+    }
+  }
+
+  CONNUI_ERR("Data counter store keeps changing, giving up");
+
+  return FALSE;
+}
+
+__attribute__((visibility("hidden"))) gboolean
+datacounter_store_read(datacounter_scope scope, datacounter_counters *counters)
+{
+  return _store_read(scope, counters, NULL);
+}
+
+__attribute__((visibility("hidden"))) gboolean
+datacounter_store_read_full(datacounter_scope scope,
+                            datacounter_counters *counters,
+                            datacounter_counters *gconf)
+{
+  return _store_read(scope, counters, gconf);
+}
+
+static gboolean
+_store_update(datacounter_scope scope, const datacounter_counters *set,
+              const datacounter_counters *gconf, guint64 rx_bytes,
+              guint64 tx_bytes)
+{
+  const datacounter_store_slot *current;
+  datacounter_store_slot *next;
+  datacounter_store_slot slot;
+
+  g_return_val_if_fail(scope < DATACOUNTER_SCOPE_COUNT, FALSE);
+
+  if (!store)
+    return FALSE;
+
+  flock(store_fd, LOCK_EX);
+
+  current = _slot_current();
+
+  if (current)
+  {
+    memcpy(&slot, current, sizeof(slot));
+    next = current == &store->slots[0] ? &store->slots[1] : &store->slots[0];
+  }
+  else
+  {
+    memset(&slot, 0, sizeof(slot));
+    next = &store->slots[0];
+  }
+
+  if (gconf)
+    slot.gconf[scope] = *gconf;
+
+  if (set)
+    slot.counters[scope] = *set;
+  else if (!gconf)
+  {
+    slot.counters[scope].rx_bytes += rx_bytes;
+    slot.counters[scope].tx_bytes += tx_bytes;
+  }
+
+  slot.seq++;
+  slot.checksum = _checksum(&slot);
+
+  memcpy(next, &slot, sizeof(slot));
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  flock(store_fd, LOCK_UN);
+
+  return TRUE;
+}
+
+__attribute__((visibility("hidden"))) gboolean
+datacounter_store_set(datacounter_scope scope,
+                      const datacounter_counters *counters)
+{
+  return _store_update(scope, counters, NULL, 0, 0);
+}
+
+__attribute__((visibility("hidden"))) gboolean
+datacounter_store_set_full(datacounter_scope scope,
+                           const datacounter_counters *counters,
+                           const datacounter_counters *gconf)
+{
+  return _store_update(scope, counters, gconf, 0, 0);
+}
+
+__attribute__((visibility("hidden"))) gboolean
+datacounter_store_add(datacounter_scope scope, guint64 rx_bytes,
+                      guint64 tx_bytes)
+{
+  return _store_update(scope, NULL, NULL, rx_bytes, tx_bytes);
+}
@@ -0,0 +1,68 @@
+/*
+ * datacounter-store.h
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __CONNUI_INTERNAL_DATACOUNTER_STORE_H_INCLUDED__
+#define __CONNUI_INTERNAL_DATACOUNTER_STORE_H_INCLUDED__
+
+typedef enum
+{
+  DATACOUNTER_SCOPE_HOME,
+  DATACOUNTER_SCOPE_ROAMING,
+  DATACOUNTER_SCOPE_COUNT
+}
+datacounter_scope;
+
+typedef struct _datacounter_counters
+{
+  guint64 rx_bytes;
+  guint64 tx_bytes;
+  guint64 reset_time;
+}
+datacounter_counters;
+
+/* maps the store, @created is set if it was (re)initialized empty */
+__attribute__((visibility("hidden"))) gboolean
+datacounter_store_open(gboolean *created);
+
+__attribute__((visibility("hidden"))) gboolean
+datacounter_store_read(datacounter_scope scope, datacounter_counters *counters);
+
+__attribute__((visibility("hidden"))) gboolean
+datacounter_store_set(datacounter_scope scope,
+                      const datacounter_counters *counters);
+
+/*
+ * @gconf are the values last known to be in the GConf compat keys, either
+ * pointer can be NULL to keep what is stored
+ */
+__attribute__((visibility("hidden"))) gboolean
+datacounter_store_read_full(datacounter_scope scope,
+                            datacounter_counters *counters,
+                            datacounter_counters *gconf);
+
+__attribute__((visibility("hidden"))) gboolean
+datacounter_store_set_full(datacounter_scope scope,
+                           const datacounter_counters *counters,
+                           const datacounter_counters *gconf);
+
+__attribute__((visibility("hidden"))) gboolean
+datacounter_store_add(datacounter_scope scope, guint64 rx_bytes,
+                      guint64 tx_bytes);
+
+#endif /* __CONNUI_INTERNAL_DATACOUNTER_STORE_H_INCLUDED__ */
@@ -10,49 +10,158 @@
 #include <time.h>
 
 #include "context.h"
+#include "datacounter-store.h"
+#include "datacounter-history.h"
+
+/* how often counters added by us are mirrored to the GConf compat keys */
+#define DATACOUNTER_MIRROR_INTERVAL 10
+
+/* seconds between usage history snapshots while a scope is open */
+#define DATACOUNTER_RECORD_INTERVAL 900
+
+/* ms to wait for related key changes (rx and tx come separately) */
+#define DATACOUNTER_BATCH_WINDOW 50
+
+typedef struct _datacounter_keys
+{
+  const gchar *rx_bytes;
+  const gchar *tx_bytes;
+  const gchar *reset_time;
+  const gchar *warning_limit;
+  const gchar *notification_enabled;
+  const gchar *notification_period;
+  const gchar *last_notification;
+}
+datacounter_keys;
+
+static const datacounter_keys scope_keys[DATACOUNTER_SCOPE_COUNT] =
+{
+  {
+    GPRS_HOME_RX_BYTES, GPRS_HOME_TX_BYTES, GPRS_HOME_RST_TIME,
+    GPRS_HOME_WARNING_LIMIT, GPRS_HOME_NTFY_ENABLE, GPRS_HOME_NTFY_PERIOD,
+    GPRS_HOME_LAST_NTFY
+  },
+  {
+    GPRS_ROAM_RX_BYTES, GPRS_ROAM_TX_BYTES, GPRS_ROAM_RST_TIME,
+    GPRS_ROAM_WARNING_LIMIT, GPRS_ROAM_NTFY_ENABLE, GPRS_ROAM_NTFY_PERIOD,
+    GPRS_ROAM_LAST_NTFY
+  }
+};
 
 struct _connui_cell_datacounter
 {
   gboolean initialized;
+  datacounter_scope scope;
+  const datacounter_keys *keys;
   GSList *notifiers;
-  GConfClient *gconf;
-  guint gconf_cnid;
   guint64 rx_bytes;
   guint64 tx_bytes;
   time_t reset_time;
-  gboolean home;
   gchar *warning_limit;
   gboolean notification_enabled;
 };
 
 typedef struct _connui_cell_datacounter connui_cell_datacounter;
 
-static connui_cell_datacounter datacounter;
+typedef struct _datacounter_subscriber
+{
+  cell_datacounter_cb cb;
+  gpointer user_data;
+  connui_cell_datacounter *dc;
+  guint interval;
+  gint64 time;
+  guint timeout_id;
+}
+datacounter_subscriber;
+
+/* shared by all scopes */
+typedef struct _datacounter_shared
+{
+  GConfClient *gconf;
+  guint gconf_cnid;
+  gboolean store_ok;
+  guint mirror_id;
+  guint record_id;
+}
+datacounter_shared;
+
+static datacounter_shared shared;
+static connui_cell_datacounter datacounters[DATACOUNTER_SCOPE_COUNT] =
+{
+  {FALSE, DATACOUNTER_SCOPE_HOME, &scope_keys[DATACOUNTER_SCOPE_HOME]},
+  {FALSE, DATACOUNTER_SCOPE_ROAMING, &scope_keys[DATACOUNTER_SCOPE_ROAMING]}
+};
+
+#define SCOPE(home) \
+  ((home) ? DATACOUNTER_SCOPE_HOME : DATACOUNTER_SCOPE_ROAMING)
+
+static void
+connui_cell_datacounter_deliver(datacounter_subscriber *sub)
+{
+  const connui_cell_datacounter *dc = sub->dc;
+
+  sub->time = g_get_monotonic_time();
+  sub->cb(dc->rx_bytes, dc->tx_bytes, dc->reset_time,
+          dc->notification_enabled, dc->warning_limit, sub->user_data);
+}
+
+static gboolean
+connui_cell_datacounter_notify_cb(gpointer user_data)
+{
+  datacounter_subscriber *sub = user_data;
+
+  sub->timeout_id = 0;
+  connui_cell_datacounter_deliver(sub);
+
+  return G_SOURCE_REMOVE;
+}
 
+/* schedules one snapshot per subscriber, at most once per its interval */
 static void
 connui_cell_datacounter_notify(const connui_cell_datacounter *data)
 {
-  if (data && data->initialized)
+  GSList *l;
+
+  if (!data || !data->initialized)
+    return;
+
+  for (l = data->notifiers; l; l = l->next)
   {
-    connui_utils_notify_notify_UINT64_UINT64_TIMET_BOOLEAN_POINTER(
-          data->notifiers,
-          data->rx_bytes,
-          data->tx_bytes,
-          data->reset_time,
-          data->notification_enabled,
-          data->warning_limit);
+    datacounter_subscriber *sub = l->data;
+    gint64 elapsed;
+    guint delay = DATACOUNTER_BATCH_WINDOW;
+
+    if (sub->timeout_id)
+      continue;
+
+    elapsed = (g_get_monotonic_time() - sub->time) / 1000;
+
+    if (elapsed < sub->interval)
+      delay = MAX(delay, sub->interval - elapsed);
+
+    sub->timeout_id =
+        g_timeout_add(delay, connui_cell_datacounter_notify_cb, sub);
   }
 }
 
+static void
+connui_cell_datacounter_subscriber_free(datacounter_subscriber *sub)
+{
+  if (sub->timeout_id)
+    g_source_remove(sub->timeout_id);
+
+  g_free(sub);
+}
+
 static guint64
-connui_cell_datacounter_read_gconf_setting(
-    const connui_cell_datacounter *counter, const gchar *name)
+connui_cell_datacounter_read_gconf_setting(GConfClient *gconf,
+                                           const gchar *name)
 {
   gchar *s;
   guint64 rv;
   GError *error = NULL;
 
-  s = gconf_client_get_string(counter->gconf, name, &error);
+  s = gconf_client_get_string(gconf, name, &error);
 
   if ( error )
   {
@@ -70,16 +179,186 @@ connui_cell_datacounter_read_gconf_setting(
   return rv;
 }
 
+static void
+connui_cell_datacounter_write_gconf_setting(const gchar *dc_name,
+                                            unsigned long long int val)
+{
+  gchar *s = g_strdup_printf("%llu", val);
+  GError *error = NULL;
+
+  gconf_client_set_string(shared.gconf, dc_name, s, &error);
+
+  if (error)
+  {
+    CONNUI_ERR("%s: %s", dc_name, error->message);
+    g_clear_error(&error);
+  }
+
+  g_free(s);
+}
+
+static void
+connui_cell_datacounter_unset_gconf_setting(const gchar *dc_name)
+{
+  GError *error = NULL;
+
+  gconf_client_unset(shared.gconf, dc_name, &error);
+
+  if (error)
+  {
+    CONNUI_ERR("Unable to unset %s: %s", dc_name, error->message);
+    g_clear_error(&error);
+  }
+}
+
+static void
+connui_cell_datacounter_read_counters(GConfClient *gconf,
+                                      const datacounter_keys *keys,
+                                      datacounter_counters *c)
+{
+  c->rx_bytes =
+      connui_cell_datacounter_read_gconf_setting(gconf, keys->rx_bytes);
+  c->tx_bytes =
+      connui_cell_datacounter_read_gconf_setting(gconf, keys->tx_bytes);
+  c->reset_time =
+      connui_cell_datacounter_read_gconf_setting(gconf, keys->reset_time);
+}
+
+static void
+connui_cell_datacounter_load(connui_cell_datacounter *dc)
+{
+  datacounter_counters c;
+
+  if (shared.store_ok && datacounter_store_read(dc->scope, &c))
+  {
+    dc->rx_bytes = c.rx_bytes;
+    dc->tx_bytes = c.tx_bytes;
+    dc->reset_time = c.reset_time;
+  }
+}
+
+/* hands current totals of @scope to the usage history */
+static void
+connui_cell_datacounter_record(datacounter_scope scope)
+{
+  datacounter_counters c;
+
+  if (shared.store_ok && datacounter_store_read(scope, &c))
+    datacounter_history_record(scope, c.rx_bytes, c.tx_bytes, time(NULL));
+}
+
+/* counters are still written to GConf by ICd, pick those up */
+static gboolean
+connui_cell_datacounter_import(datacounter_scope scope, const gchar *key,
+                               guint64 val)
+{
+  const datacounter_keys *keys = &scope_keys[scope];
+  datacounter_counters c;
+  datacounter_counters g;
+  guint64 *written;
+  guint64 *stored;
+  glong offset;
+
+  if (!g_strcmp0(key, keys->rx_bytes))
+    offset = G_STRUCT_OFFSET(datacounter_counters, rx_bytes);
+  else if (!g_strcmp0(key, keys->tx_bytes))
+    offset = G_STRUCT_OFFSET(datacounter_counters, tx_bytes);
+  else if (!g_strcmp0(key, keys->reset_time))
+    offset = G_STRUCT_OFFSET(datacounter_counters, reset_time);
+  else
+    return FALSE;
+
+  if (!shared.store_ok)
+  {
+    connui_cell_datacounter *dc = &datacounters[scope];
+
+    if (offset == G_STRUCT_OFFSET(datacounter_counters, rx_bytes))
+      dc->rx_bytes = val;
+    else if (offset == G_STRUCT_OFFSET(datacounter_counters, tx_bytes))
+      dc->tx_bytes = val;
+    else
+      dc->reset_time = val;
+
+    return TRUE;
+  }
+
+  if (!datacounter_store_read_full(scope, &c, &g))
+    return TRUE;
+
+  written = G_STRUCT_MEMBER_P(&g, offset);
+  stored = G_STRUCT_MEMBER_P(&c, offset);
+
+  /* not what the mirror put there */
+  if (val != *written)
+  {
+    gboolean changed = val != *stored;
+
+    *stored = val;
+    *written = val;
+    datacounter_store_set_full(scope, &c, &g);
+
+    if (changed)
+      connui_cell_datacounter_record(scope);
+  }
+
+  connui_cell_datacounter_load(&datacounters[scope]);
+
+  return TRUE;
+}
+
+/*
+ * Opens the store, once per process. GConf is not watched while nobody uses
+ * the counters, so take over whatever ICd wrote meanwhile.
+ */
+static gboolean
+connui_cell_datacounter_store_init()
+{
+  GConfClient *gconf;
+  datacounter_scope scope;
+  gboolean created;
+
+  if (shared.store_ok)
+    return TRUE;
+
+  if (!datacounter_store_open(&created))
+    return FALSE;
+
+  shared.store_ok = TRUE;
+
+  if (!(gconf = gconf_client_get_default()))
+    return TRUE;
+
+  for (scope = 0; scope < DATACOUNTER_SCOPE_COUNT; scope++)
+  {
+    const datacounter_keys *keys = &scope_keys[scope];
+    datacounter_counters c;
+
+    connui_cell_datacounter_read_counters(gconf, keys, &c);
+
+    /* first run with the store, GConf has it all */
+    if (created)
+      datacounter_store_set_full(scope, &c, &c);
+    else
+    {
+      connui_cell_datacounter_import(scope, keys->rx_bytes, c.rx_bytes);
+      connui_cell_datacounter_import(scope, keys->tx_bytes, c.tx_bytes);
+      connui_cell_datacounter_import(scope, keys->reset_time, c.reset_time);
+    }
+  }
+
+  g_object_unref(gconf);
+
+  return TRUE;
+}
+
 static void
 connui_cell_datacounter_gconf_changed(GConfClient *client, guint cnxn_id,
                                       GConfEntry *entry, gpointer user_data)
 {
-  connui_cell_datacounter *dc = user_data;
   GConfValue *val;
   const char *key;
   unsigned long long int counter;
-
-  g_return_if_fail(dc != NULL && dc->initialized);
+  datacounter_scope scope;
 
   val = gconf_entry_get_value(entry);
   key = gconf_entry_get_key(entry);
@@ -89,80 +368,52 @@ connui_cell_datacounter_gconf_changed(GConfClient *client, guint cnxn_id,
   else
     counter = 0LL;
 
-  if (dc->home)
+  for (scope = 0; scope < DATACOUNTER_SCOPE_COUNT; scope++)
   {
-    if (!g_strcmp0(key, GPRS_HOME_RX_BYTES))
-      dc->rx_bytes = counter;
-    else if (!g_strcmp0(key, GPRS_HOME_TX_BYTES))
-      dc->tx_bytes = counter;
-    else if (!g_strcmp0(key, GPRS_HOME_RST_TIME))
-      dc->reset_time = counter;
-    else if (!g_strcmp0(key, GPRS_HOME_WARNING_LIMIT))
+    connui_cell_datacounter *dc = &datacounters[scope];
+    const datacounter_keys *keys = &scope_keys[scope];
+
+    if (connui_cell_datacounter_import(scope, key, counter))
+      ;
+    else if (!dc->initialized)
+      continue;
+    else if (!g_strcmp0(key, keys->warning_limit))
     {
-      if (dc->warning_limit)
-        g_free(dc->warning_limit);
-
+      g_free(dc->warning_limit);
       dc->warning_limit = g_strdup_printf("%llu", counter);
     }
-    else if (!g_strcmp0(key, GPRS_HOME_NTFY_ENABLE))
+    else if (!g_strcmp0(key, keys->notification_enabled))
     {
-      dc->notification_enabled = gconf_value_get_bool(val);
+      dc->notification_enabled =
+          val && val->type == GCONF_VALUE_BOOL && gconf_value_get_bool(val);
     }
-  }
-  else
-  {
-    if (!g_strcmp0(key, GPRS_ROAM_RX_BYTES))
-      dc->rx_bytes = counter;
-    else if (g_strcmp0(key, GPRS_ROAM_TX_BYTES))
-      dc->tx_bytes = counter;
-    else if (!g_strcmp0(key, GPRS_ROAM_RST_TIME))
-      dc->reset_time = counter;
-    else if (!g_strcmp0(key, GPRS_ROAM_WARNING_LIMIT))
-    {
-      if (dc->warning_limit)
-        g_free(dc->warning_limit);
+    else
+      continue;
 
-      dc->warning_limit = g_strdup_printf("%llu", counter);
-    }
-    else if (!g_strcmp0(key, GPRS_ROAM_NTFY_ENABLE))
-    {
-      dc->notification_enabled = gconf_value_get_bool(val);
-    }
+    connui_cell_datacounter_notify(dc);
+    break;
   }
-
-  connui_cell_datacounter_notify(dc);
-  return;
 }
 
-static connui_cell_datacounter *
-connui_cell_datacounter_get(gboolean home)
+static gboolean
+connui_cell_datacounter_gconf_init()
 {
-  gchar *s;
   GError *error = NULL;
 
-  if (datacounter.initialized)
-    return &datacounter;
-
-  datacounter.gconf = NULL;
-  datacounter.notifiers = NULL;
-  datacounter.gconf_cnid = (guint)datacounter.initialized;
-  datacounter.rx_bytes = 0;
-  datacounter.tx_bytes = 0;
-  datacounter.reset_time = 0;
-  datacounter.home = home;
-  datacounter.warning_limit = NULL;
-  datacounter.notification_enabled = FALSE;
-  datacounter.gconf = gconf_client_get_default();
-
-  if (!datacounter.gconf)
+  if (shared.gconf)
+    return TRUE;
+
+  shared.gconf = gconf_client_get_default();
+
+  if (!shared.gconf)
   {
     CONNUI_ERR("Unable to get default GConf client");
-    return NULL;
+    return FALSE;
   }
 
-  datacounter.gconf_cnid = gconf_client_notify_add(
-        datacounter.gconf, ICD_GCONF_NETWORK_MAPPING_GPRS,
-        connui_cell_datacounter_gconf_changed, &datacounter, NULL, &error);
+  shared.gconf_cnid = gconf_client_notify_add(
+        shared.gconf, ICD_GCONF_NETWORK_MAPPING_GPRS,
+        connui_cell_datacounter_gconf_changed, NULL, NULL, &error);
 
   if (error)
   {
@@ -170,7 +421,7 @@ connui_cell_datacounter_get(gboolean home)
     g_clear_error(&error);
   }
 
-  gconf_client_add_dir(datacounter.gconf, ICD_GCONF_NETWORK_MAPPING_GPRS,
+  gconf_client_add_dir(shared.gconf, ICD_GCONF_NETWORK_MAPPING_GPRS,
                        GCONF_CLIENT_PRELOAD_ONELEVEL, &error);
   if (error)
   {
@@ -178,285 +429,438 @@ connui_cell_datacounter_get(gboolean home)
     g_clear_error(&error);
   }
 
-  if (datacounter.home)
+  connui_cell_datacounter_store_init();
+
+  return TRUE;
+}
+
+static void
+connui_cell_datacounter_gconf_release()
+{
+  datacounter_scope scope;
+
+  if (!shared.gconf || shared.mirror_id)
+    return;
+
+  for (scope = 0; scope < DATACOUNTER_SCOPE_COUNT; scope++)
   {
-    datacounter.rx_bytes =
-        connui_cell_datacounter_read_gconf_setting(&datacounter, GPRS_HOME_RX_BYTES);
-    datacounter.tx_bytes =
-        connui_cell_datacounter_read_gconf_setting(&datacounter, GPRS_HOME_TX_BYTES);
-    datacounter.reset_time =
-        connui_cell_datacounter_read_gconf_setting(&datacounter, GPRS_HOME_RST_TIME);
-    s = gconf_client_get_string(datacounter.gconf, GPRS_HOME_WARNING_LIMIT, &error);
-    datacounter.warning_limit = g_strdup(s);
+    if (datacounters[scope].initialized)
+      return;
+  }
 
-    if (error)
-    {
-      CONNUI_ERR(GPRS_HOME_WARNING_LIMIT ": %s", error->message);
-      g_clear_error(&error);
-    }
+  gconf_client_remove_dir(shared.gconf, ICD_GCONF_NETWORK_MAPPING_GPRS, NULL);
+  gconf_client_notify_remove(shared.gconf, shared.gconf_cnid);
+  g_object_unref(shared.gconf);
+  shared.gconf = NULL;
+  shared.gconf_cnid = 0;
+}
 
-    datacounter.notification_enabled =
-        gconf_client_get_bool(datacounter.gconf, GPRS_HOME_NTFY_ENABLE, &error);
+/*
+ * Totals are handed to the history when they change, but ICd updates GConf
+ * only now and then, so pick those up periodically too. The history spreads
+ * whatever shows up over the time since the previous snapshot.
+ */
+static gboolean
+connui_cell_datacounter_record_cb(gpointer user_data)
+{
+  datacounter_scope scope;
 
-    if (error)
-    {
-      CONNUI_ERR(GPRS_HOME_NTFY_ENABLE ": %s", error->message);
-      g_clear_error(&error);
-    }
+  for (scope = 0; scope < DATACOUNTER_SCOPE_COUNT; scope++)
+  {
+    if (datacounters[scope].initialized)
+      connui_cell_datacounter_record(scope);
   }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static connui_cell_datacounter *
+connui_cell_datacounter_get(datacounter_scope scope)
+{
+  connui_cell_datacounter *dc = &datacounters[scope];
+  const datacounter_keys *keys = &scope_keys[scope];
+  GError *error = NULL;
+  datacounter_counters c;
+
+  if (dc->initialized)
+    return dc;
+
+  if (!connui_cell_datacounter_gconf_init())
+    return NULL;
+
+  dc->notifiers = NULL;
+
+  if (shared.store_ok)
+    connui_cell_datacounter_load(dc);
   else
   {
-    datacounter.rx_bytes =
-        connui_cell_datacounter_read_gconf_setting(&datacounter, GPRS_ROAM_RX_BYTES);
-    datacounter.tx_bytes =
-        connui_cell_datacounter_read_gconf_setting(&datacounter, GPRS_ROAM_TX_BYTES);
-    datacounter.reset_time =
-        connui_cell_datacounter_read_gconf_setting(&datacounter, GPRS_ROAM_RST_TIME);
-    s = gconf_client_get_string(datacounter.gconf, GPRS_ROAM_WARNING_LIMIT, &error);
-    datacounter.warning_limit = g_strdup(s);
+    connui_cell_datacounter_read_counters(shared.gconf, keys, &c);
+    dc->rx_bytes = c.rx_bytes;
+    dc->tx_bytes = c.tx_bytes;
+    dc->reset_time = c.reset_time;
+  }
 
-    if (error)
-    {
-      CONNUI_ERR(GPRS_ROAM_WARNING_LIMIT ": %s", error->message);
-      g_clear_error(&error);
-    }
+  dc->warning_limit =
+      gconf_client_get_string(shared.gconf, keys->warning_limit, &error);
 
-    datacounter.notification_enabled =
-        gconf_client_get_bool(datacounter.gconf, GPRS_ROAM_NTFY_ENABLE, &error);
+  if (error)
+  {
+    CONNUI_ERR("%s: %s", keys->warning_limit, error->message);
+    g_clear_error(&error);
+  }
 
-    if (error)
-    {
-      CONNUI_ERR(GPRS_ROAM_NTFY_ENABLE ": %s", error->message);
-      g_clear_error(&error);
-    }
+  dc->notification_enabled =
+      gconf_client_get_bool(shared.gconf, keys->notification_enabled, &error);
+
+  if (error)
+  {
+    CONNUI_ERR("%s: %s", keys->notification_enabled, error->message);
+    g_clear_error(&error);
   }
 
-  datacounter.initialized = TRUE;
+  dc->initialized = TRUE;
+
+  if (shared.store_ok && !shared.record_id)
+  {
+    shared.record_id = g_timeout_add_seconds(
+          DATACOUNTER_RECORD_INTERVAL, connui_cell_datacounter_record_cb,
+          NULL);
+  }
 
-  return &datacounter;
+  return dc;
+}
+
+/* drops the scope and GConf connection once nobody listens anymore */
+static void
+connui_cell_datacounter_release(connui_cell_datacounter *dc)
+{
+  if (dc->initialized && !dc->notifiers)
+  {
+    g_free(dc->warning_limit);
+    dc->warning_limit = NULL;
+    dc->initialized = FALSE;
+  }
+
+  if (shared.record_id &&
+      !datacounters[DATACOUNTER_SCOPE_HOME].initialized &&
+      !datacounters[DATACOUNTER_SCOPE_ROAMING].initialized)
+  {
+    g_source_remove(shared.record_id);
+    shared.record_id = 0;
+  }
+
+  connui_cell_datacounter_gconf_release();
 }
 
 void
 connui_cell_datacounter_close(cell_datacounter_cb cb)
 {
-  connui_cell_datacounter *data = connui_cell_datacounter_get(TRUE);
+  datacounter_scope scope;
+
+  for (scope = 0; scope < DATACOUNTER_SCOPE_COUNT; scope++)
+  {
+    connui_cell_datacounter *dc = &datacounters[scope];
 
-  g_return_if_fail(data != NULL && data->initialized);
+    if (!dc->initialized)
+      continue;
 
-  if (cb)
-    data->notifiers = connui_utils_notify_remove(data->notifiers, cb);
+    if (cb)
+    {
+      GSList *l = dc->notifiers;
 
-  if (!data->notifiers)
-  {
-    gconf_client_remove_dir(data->gconf, ICD_GCONF_NETWORK_MAPPING_GPRS, NULL);
-    gconf_client_notify_remove(data->gconf, data->gconf_cnid);
-    g_object_unref(data->gconf);
-    data->gconf = NULL;
-    g_free(data->warning_limit);
-    data->initialized = FALSE;
-    data->warning_limit = NULL;
+      while (l)
+      {
+        datacounter_subscriber *sub = l->data;
+
+        l = l->next;
+
+        if (sub->cb == cb)
+        {
+          dc->notifiers = g_slist_remove(dc->notifiers, sub);
+          connui_cell_datacounter_subscriber_free(sub);
+        }
+      }
+    }
+
+    connui_cell_datacounter_release(dc);
   }
 }
 
-static void
-connui_cell_datacounter_write_gconf_setting(connui_cell_datacounter *dc,
-                                            const gchar *dc_name,
-                                            unsigned long long int val)
+void
+connui_cell_datacounter_reset_scope(gboolean home)
 {
-  gchar *s = g_strdup_printf("%llu", val);
-  GError *error = NULL;
+  connui_cell_datacounter *dc = connui_cell_datacounter_get(SCOPE(home));
+  const datacounter_keys *keys;
+  datacounter_counters c = {0, 0, time(NULL)};
 
-  gconf_client_set_string(dc->gconf, dc_name, s, &error);
+  g_return_if_fail(dc != NULL && dc->initialized);
 
-  if (error)
+  keys = dc->keys;
+
+  if (shared.store_ok)
   {
-    CONNUI_ERR("%s: %s", dc_name, error->message);
-    g_clear_error(&error);
+    /* rx and tx are unset below, so read back as 0 */
+    datacounter_store_set_full(dc->scope, &c, &c);
+    connui_cell_datacounter_record(dc->scope);
+    connui_cell_datacounter_load(dc);
   }
 
-  g_free(s);
+  connui_cell_datacounter_write_gconf_setting(keys->reset_time, c.reset_time);
+  connui_cell_datacounter_unset_gconf_setting(keys->rx_bytes);
+  connui_cell_datacounter_unset_gconf_setting(keys->tx_bytes);
+  connui_cell_datacounter_unset_gconf_setting(keys->last_notification);
+
+  connui_cell_datacounter_notify(dc);
+  connui_cell_datacounter_release(dc);
+}
+
+/* legacy API without scope, use whichever one is being listened to */
+static gboolean
+connui_cell_datacounter_default_home()
+{
+  return datacounters[DATACOUNTER_SCOPE_HOME].notifiers ||
+      !datacounters[DATACOUNTER_SCOPE_ROAMING].notifiers;
 }
 
 void
 connui_cell_datacounter_reset()
 {
-  connui_cell_datacounter *dc = connui_cell_datacounter_get(TRUE);
-  GError *error = NULL;
+  connui_cell_datacounter_reset_scope(connui_cell_datacounter_default_home());
+}
 
-  if (dc->home)
+gboolean
+connui_cell_datacounter_register_full(cell_datacounter_cb cb, gboolean home,
+                                      guint interval, gpointer user_data)
+{
+  connui_cell_datacounter *dc;
+  datacounter_subscriber *sub;
+
+  g_return_val_if_fail(cb != NULL, FALSE);
+
+  dc = connui_cell_datacounter_get(SCOPE(home));
+
+  g_return_val_if_fail(dc != NULL && dc->initialized, FALSE);
+
+  sub = g_new0(datacounter_subscriber, 1);
+  sub->cb = cb;
+  sub->user_data = user_data;
+  sub->dc = dc;
+  sub->interval = interval;
+
+  dc->notifiers = g_slist_append(dc->notifiers, sub);
+  connui_cell_datacounter_deliver(sub);
+
+  return TRUE;
+}
+
+gboolean
+connui_cell_datacounter_register(cell_datacounter_cb cb, gboolean home,
+                                 gpointer user_data)
+{
+  return connui_cell_datacounter_register_full(cb, home, 0, user_data);
+}
+
+static gboolean
+connui_cell_datacounter_mirror_cb(gpointer user_data)
+{
+  datacounter_scope scope;
+
+  shared.mirror_id = 0;
+
+  if (!shared.gconf)
+    return G_SOURCE_REMOVE;
+
+  for (scope = 0; scope < DATACOUNTER_SCOPE_COUNT; scope++)
   {
-    connui_cell_datacounter_write_gconf_setting(dc, GPRS_HOME_RST_TIME, time(NULL));
-    gconf_client_unset(dc->gconf, GPRS_HOME_RX_BYTES, &error);
+    const datacounter_keys *keys = &scope_keys[scope];
+    datacounter_counters c;
+    datacounter_counters g;
+    gboolean rx;
+    gboolean tx;
 
-    if (error)
-    {
-      CONNUI_ERR("Unable to unset home RX bytes: %s", error->message);
-      g_clear_error(&error);
-    }
+    if (!datacounter_store_read_full(scope, &c, &g))
+      continue;
 
-    gconf_client_unset(dc->gconf, GPRS_HOME_TX_BYTES, &error);
+    rx = c.rx_bytes != g.rx_bytes;
+    tx = c.tx_bytes != g.tx_bytes;
 
-    if (error)
-    {
-      CONNUI_ERR("Unable to unset home TX bytes: %s", error->message);
-      g_clear_error(&error);
-    }
+    if (!rx && !tx)
+      continue;
 
-    gconf_client_unset(dc->gconf, GPRS_HOME_LAST_NTFY, &error);
+    /* before writing, so the change notify does not import it back */
+    g.rx_bytes = c.rx_bytes;
+    g.tx_bytes = c.tx_bytes;
+    datacounter_store_set_full(scope, NULL, &g);
 
-    if (error)
-    {
-      CONNUI_ERR("Unable to unset last home notification: %s",
-                 error->message);
-      g_clear_error(&error);
-    }
+    if (rx)
+      connui_cell_datacounter_write_gconf_setting(keys->rx_bytes, c.rx_bytes);
+
+    if (tx)
+      connui_cell_datacounter_write_gconf_setting(keys->tx_bytes, c.tx_bytes);
   }
-  else
-  {
-    connui_cell_datacounter_write_gconf_setting(dc, GPRS_ROAM_RST_TIME, time(NULL));
-    gconf_client_unset(dc->gconf, GPRS_ROAM_RX_BYTES, &error);
 
-    if (error)
-    {
-      CONNUI_ERR("Unable to unset roaming RX bytes: %s", error->message);
-      g_clear_error(&error);
-    }
+  connui_cell_datacounter_gconf_release();
 
-    gconf_client_unset(dc->gconf, GPRS_ROAM_TX_BYTES, &error);
+  return G_SOURCE_REMOVE;
+}
 
-    if (error)
-    {
-      CONNUI_ERR("Unable to unset roaming TX bytes: %s", error->message);
-      g_clear_error(&error);
-    }
+void
+connui_cell_datacounter_add(gboolean home, guint64 rx_bytes, guint64 tx_bytes)
+{
+  connui_cell_datacounter *dc = connui_cell_datacounter_get(SCOPE(home));
 
-    gconf_client_unset(dc->gconf, GPRS_ROAM_LAST_NTFY, &error);
+  g_return_if_fail(dc != NULL && dc->initialized);
 
-    if (error)
+  if (shared.store_ok &&
+      datacounter_store_add(dc->scope, rx_bytes, tx_bytes))
+  {
+    connui_cell_datacounter_record(dc->scope);
+    connui_cell_datacounter_load(dc);
+    connui_cell_datacounter_notify(dc);
+
+    if (!shared.mirror_id)
     {
-      CONNUI_ERR("Unable to unset last roaming notification: %s",
-                 error->message);
-      g_clear_error(&error);
+      shared.mirror_id = g_timeout_add_seconds(
+            DATACOUNTER_MIRROR_INTERVAL, connui_cell_datacounter_mirror_cb,
+            NULL);
     }
   }
 
-  connui_cell_datacounter_close(NULL);
+  connui_cell_datacounter_release(dc);
 }
 
 gboolean
-connui_cell_datacounter_register(cell_datacounter_cb cb, gboolean home,
-                                 gpointer user_data)
+connui_cell_datacounter_get_counters(gboolean home, guint64 *rx_bytes,
+                                     guint64 *tx_bytes, time_t *reset_time)
 {
-  connui_cell_datacounter *dc = connui_cell_datacounter_get(home);
+  connui_cell_datacounter *dc;
+  datacounter_counters c;
+
+  /* a plain read of the store, GConf changes are imported by subscribers */
+  if (connui_cell_datacounter_store_init() &&
+      datacounter_store_read(SCOPE(home), &c))
+  {
+    if (rx_bytes)
+      *rx_bytes = c.rx_bytes;
+
+    if (tx_bytes)
+      *tx_bytes = c.tx_bytes;
+
+    if (reset_time)
+      *reset_time = c.reset_time;
+
+    return TRUE;
+  }
+
+  dc = connui_cell_datacounter_get(SCOPE(home));
 
   g_return_val_if_fail(dc != NULL && dc->initialized, FALSE);
 
-  dc->notifiers = connui_utils_notify_add(dc->notifiers, cb, user_data);
-  connui_cell_datacounter_notify(dc);
+  if (rx_bytes)
+    *rx_bytes = dc->rx_bytes;
+
+  if (tx_bytes)
+    *tx_bytes = dc->tx_bytes;
+
+  if (reset_time)
+    *reset_time = dc->reset_time;
+
+  connui_cell_datacounter_release(dc);
 
   return TRUE;
 }
 
-void
-connui_cell_datacounter_save(gboolean notification_enabled,
-                             const gchar *warning_limit)
+gboolean
+connui_cell_datacounter_get_usage_series(gboolean home, time_t from,
+                                         guint step, guint n,
+                                         guint64 *rx_bytes, guint64 *tx_bytes)
 {
-  connui_cell_datacounter *dc = connui_cell_datacounter_get(TRUE);
-  GError *error = NULL;
+  g_return_val_if_fail(rx_bytes != NULL && tx_bytes != NULL, FALSE);
 
-  if (dc->home)
-  {
-    gconf_client_set_bool(dc->gconf, GPRS_HOME_NTFY_ENABLE, notification_enabled,
-                          &error);
+  return datacounter_history_query(SCOPE(home), from, step, n, rx_bytes,
+                                   tx_bytes);
+}
 
-    if (error)
-    {
-      CONNUI_ERR(GPRS_HOME_NTFY_ENABLE ": %s", error->message);
-      g_clear_error(&error);
-    }
+gboolean
+connui_cell_datacounter_get_usage(gboolean home, time_t from, time_t to,
+                                  guint64 *rx_bytes, guint64 *tx_bytes)
+{
+  guint64 rx;
+  guint64 tx;
 
-    if (warning_limit)
-    {
-      gconf_client_set_string(dc->gconf, GPRS_HOME_WARNING_LIMIT, warning_limit,
-                              &error);
+  g_return_val_if_fail(to > from, FALSE);
 
-      if (error)
-      {
-        CONNUI_ERR(GPRS_HOME_WARNING_LIMIT ": %s", error->message);
-        g_clear_error(&error);
-      }
+  if (!datacounter_history_query(SCOPE(home), from, to - from, 1, &rx, &tx))
+    return FALSE;
 
-      if (notification_enabled)
-      {
-        /* WTF ? */
-        gchar *s = g_strconcat(warning_limit, "000000", NULL);
+  if (rx_bytes)
+    *rx_bytes = rx;
 
-        gconf_client_set_string(dc->gconf, GPRS_HOME_NTFY_PERIOD, s, &error);
+  if (tx_bytes)
+    *tx_bytes = tx;
 
-        if (error)
-        {
-          CONNUI_ERR(GPRS_HOME_NTFY_PERIOD ": %s", error->message);
-          g_clear_error(&error);
-        }
+  return TRUE;
+}
 
-        g_free(s);
-      }
-      else
-      {
-        gconf_client_set_string(dc->gconf, GPRS_HOME_NTFY_PERIOD, "0", &error);
+void
+connui_cell_datacounter_save_scope(gboolean home, gboolean notification_enabled,
+                                   const gchar *warning_limit)
+{
+  connui_cell_datacounter *dc = connui_cell_datacounter_get(SCOPE(home));
+  const datacounter_keys *keys;
+  GError *error = NULL;
 
-        if (error)
-        {
-          CONNUI_ERR(GPRS_HOME_NTFY_PERIOD ": %s", error->message);
-          g_clear_error(&error);
-        }
-      }
-    }
+  g_return_if_fail(dc != NULL && dc->initialized);
+
+  keys = dc->keys;
+
+  gconf_client_set_bool(shared.gconf, keys->notification_enabled,
+                        notification_enabled, &error);
+
+  if (error)
+  {
+    CONNUI_ERR("%s: %s", keys->notification_enabled, error->message);
+    g_clear_error(&error);
   }
-  else
+
+  if (warning_limit)
   {
-    gconf_client_set_bool(dc->gconf, GPRS_ROAM_NTFY_ENABLE, notification_enabled,
-                          &error);
+    gchar *s;
+
+    gconf_client_set_string(shared.gconf, keys->warning_limit, warning_limit,
+                            &error);
+
     if (error)
     {
-      CONNUI_ERR(GPRS_ROAM_NTFY_ENABLE ": %s", error->message);
+      CONNUI_ERR("%s: %s", keys->warning_limit, error->message);
       g_clear_error(&error);
     }
 
-    if (warning_limit)
-    {
-      gconf_client_set_string(dc->gconf, GPRS_ROAM_WARNING_LIMIT, warning_limit,
-                              &error);
-      if (error)
-      {
-        CONNUI_ERR(GPRS_ROAM_WARNING_LIMIT ": %s", error->message);
-        g_clear_error(&error);
-      }
+    /* WTF ? */
+    if (notification_enabled)
+      s = g_strconcat(warning_limit, "000000", NULL);
+    else
+      s = g_strdup("0");
 
-      if (notification_enabled)
-      {
-        gchar *s = g_strconcat(warning_limit, "000000", NULL);
+    gconf_client_set_string(shared.gconf, keys->notification_period, s,
+                            &error);
 
-        gconf_client_set_string(dc->gconf, GPRS_ROAM_NTFY_PERIOD, s, &error);
+    if (error)
+    {
+      CONNUI_ERR("%s: %s", keys->notification_period, error->message);
+      g_clear_error(&error);
+    }
 
-        if (error)
-        {
-          CONNUI_ERR(GPRS_HOME_NTFY_PERIOD ": %s", error->message);
-          g_clear_error(&error);
-        }
+    g_free(s);
+  }
 
-        g_free(s);
-      }
-      else
-      {
-        gconf_client_set_string(dc->gconf, GPRS_ROAM_NTFY_PERIOD, "0", &error);
+  connui_cell_datacounter_release(dc);
+}
 
-        if (error)
-        {
-          CONNUI_ERR(GPRS_HOME_NTFY_PERIOD ": %s", error->message);
-          g_clear_error(&error);
-        }
-      }
-    }
-  }
+void
+connui_cell_datacounter_save(gboolean notification_enabled,
+                             const gchar *warning_limit)
+{
+  connui_cell_datacounter_save_scope(connui_cell_datacounter_default_home(),
+                                     notification_enabled, warning_limit);
 }
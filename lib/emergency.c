@@ -2,8 +2,136 @@
 #include <dbus/dbus-glib.h>
 #include <connui/connui-log.h>
 
+#include <string.h>
+
 #include "context.h"
 
+#include "emergency.h"
+
+typedef struct _emergency_trie_node
+{
+  /* 0 if none, the root is never a child */
+  guint16 next[10];
+  gboolean number;
+}
+emergency_trie_node;
+
+struct _connui_emergency_trie
+{
+  gint ref_count;
+  guint count;
+  emergency_trie_node nodes[];
+};
+
+static gboolean
+_is_number(const gchar *s)
+{
+  if (!*s)
+    return FALSE;
+
+  for (; *s; s++)
+  {
+    if (!g_ascii_isdigit(*s))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+__attribute__((visibility("hidden"))) connui_emergency_trie *
+connui_cell_emergency_trie_new(const gchar *const *numbers)
+{
+  connui_emergency_trie *trie;
+  const gchar *const *n;
+  gsize count = 1;
+
+  g_return_val_if_fail(numbers != NULL, NULL);
+
+  for (n = numbers; *n; n++)
+    count += strlen(*n);
+
+  g_return_val_if_fail(count < CONNUI_EMERGENCY_STATE_INVALID, NULL);
+
+  trie = g_malloc0(sizeof(*trie) + count * sizeof(emergency_trie_node));
+  trie->ref_count = 1;
+  trie->count = 1;
+
+  for (n = numbers; *n; n++)
+  {
+    guint16 state = CONNUI_EMERGENCY_STATE_START;
+    const gchar *p;
+
+    if (!_is_number(*n))
+    {
+      g_debug("Ignoring emergency number '%s'", *n);
+      continue;
+    }
+
+    for (p = *n; *p; p++)
+    {
+      guint16 *next = &trie->nodes[state].next[*p - '0'];
+
+      if (!*next)
+        *next = trie->count++;
+
+      state = *next;
+    }
+
+    trie->nodes[state].number = TRUE;
+  }
+
+  return trie;
+}
+
+__attribute__((visibility("hidden"))) connui_emergency_trie *
+connui_cell_emergency_trie_ref(connui_emergency_trie *trie)
+{
+  g_return_val_if_fail(trie != NULL, NULL);
+
+  trie->ref_count++;
+
+  return trie;
+}
+
+__attribute__((visibility("hidden"))) void
+connui_cell_emergency_trie_unref(connui_emergency_trie *trie)
+{
+  g_return_if_fail(trie != NULL);
+
+  if (!--trie->ref_count)
+    g_free(trie);
+}
+
+__attribute__((visibility("hidden"))) guint16
+connui_cell_emergency_trie_next(const connui_emergency_trie *trie,
+                                guint16 state, gchar digit)
+{
+  guint16 next;
+
+  if (!trie || state == CONNUI_EMERGENCY_STATE_INVALID ||
+      !g_ascii_isdigit(digit))
+  {
+    return CONNUI_EMERGENCY_STATE_INVALID;
+  }
+
+  next = trie->nodes[state].next[digit - '0'];
+
+  return next ? next : CONNUI_EMERGENCY_STATE_INVALID;
+}
+
+__attribute__((visibility("hidden"))) connui_emergency_match
+connui_cell_emergency_trie_match(const connui_emergency_trie *trie,
+                                 guint16 state)
+{
+  if (!trie || state == CONNUI_EMERGENCY_STATE_INVALID)
+    return CONNUI_EMERGENCY_MATCH_NONE;
+
+  if (trie->nodes[state].number)
+    return CONNUI_EMERGENCY_MATCH_FULL;
+
+  return CONNUI_EMERGENCY_MATCH_PREFIX;
+}
+
 gboolean
 connui_cell_emergency_call()
 {
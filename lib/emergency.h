@@ -0,0 +1,62 @@
+/*
+ * emergency.h
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __CONNUI_INTERNAL_EMERGENCY_H_INCLUDED__
+#define __CONNUI_INTERNAL_EMERGENCY_H_INCLUDED__
+
+typedef enum
+{
+  CONNUI_EMERGENCY_MATCH_NONE,
+  /* more digits might make an emergency number */
+  CONNUI_EMERGENCY_MATCH_PREFIX,
+  CONNUI_EMERGENCY_MATCH_FULL
+}
+connui_emergency_match;
+
+/* digit trie of emergency numbers, immutable once built */
+typedef struct _connui_emergency_trie connui_emergency_trie;
+
+/* state of an empty input */
+#define CONNUI_EMERGENCY_STATE_START 0
+/* input is not a prefix of any number */
+#define CONNUI_EMERGENCY_STATE_INVALID G_MAXUINT16
+
+connui_emergency_trie *
+connui_cell_emergency_trie_new(const gchar *const *numbers);
+
+connui_emergency_trie *
+connui_cell_emergency_trie_ref(connui_emergency_trie *trie);
+
+void
+connui_cell_emergency_trie_unref(connui_emergency_trie *trie);
+
+/* state after @digit is appended, @trie can be NULL */
+guint16
+connui_cell_emergency_trie_next(const connui_emergency_trie *trie,
+                                guint16 state, gchar digit);
+
+connui_emergency_match
+connui_cell_emergency_trie_match(const connui_emergency_trie *trie,
+                                 guint16 state);
+
+/* returns:(transfer full): NULL until the numbers are known */
+connui_emergency_trie *
+connui_cell_emergency_get_trie(const char *modem_id);
+
+#endif /* __CONNUI_INTERNAL_EMERGENCY_H_INCLUDED__ */
@@ -0,0 +1,542 @@
+/*
+ * mbpi.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Parsing serviceproviders.xml takes hundreds of milliseconds, so it is
+ * parsed only once and compiled to an index sorted by (MCC, MNC). The index
+ * is stored in the user cache dir and mmap-ed, so every process shares the
+ * same pages. It is rebuilt if the database mtime or size changes.
+ *
+ * Index layout (host byte order, it never leaves the device):
+ *   mbpi_index_header
+ *   mbpi_index_entry[count], sorted by key
+ *   string table, starting with an empty string, so offset 0 means "none"
+ */
+
+#include <connui/connui-log.h>
+#include <libxml/parser.h>
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "mbpi.h"
+
+#define MBPI_INDEX_MAGIC 0x4950424d /* "MBPI" */
+#define MBPI_INDEX_VERSION 2
+#define MBPI_INDEX_NAME "mbpi.idx"
+
+/* "01" and "001" are different networks, so the MNC digits are in the key */
+#define MBPI_KEY(mcc, mnc, digits) \
+  (((guint32)(mcc) << 16) | ((guint32)(digits) << 12) | ((mnc) & 0xfff))
+
+typedef struct _mbpi_index_header
+{
+  guint32 magic;
+  guint32 version;
+  gint64 mtime;
+  guint64 size;
+  guint32 count;
+  guint32 strings;
+}
+mbpi_index_header;
+
+typedef struct _mbpi_index_entry
+{
+  guint32 key;
+  guint32 name;
+  guint32 apn;
+  guint32 username;
+  guint32 password;
+}
+mbpi_index_entry;
+
+typedef struct _mbpi_builder
+{
+  GArray *entries;
+  GByteArray *strings;
+  GHashTable *offsets;
+  GHashTable *keys;
+}
+mbpi_builder;
+
+static GBytes *mbpi_index;
+
+/* database the last failed build was tried on, not to parse it again */
+static struct
+{
+  gboolean failed;
+  gint64 mtime;
+  guint64 size;
+}
+mbpi_build;
+
+static guint32
+_builder_add_string(mbpi_builder *b, const xmlChar *s)
+{
+  gpointer offset;
+
+  if (!s || !*s)
+    return 0;
+
+  if (!g_hash_table_lookup_extended(b->offsets, s, NULL, &offset))
+  {
+    offset = GUINT_TO_POINTER(b->strings->len);
+    g_byte_array_append(b->strings, s, strlen((const char *)s) + 1);
+    g_hash_table_insert(b->offsets, g_strdup((const gchar *)s), offset);
+  }
+
+  return GPOINTER_TO_UINT(offset);
+}
+
+static xmlNodePtr
+_child(xmlNodePtr node, const char *name)
+{
+  for (node = node->children; node; node = node->next)
+  {
+    if (node->type == XML_ELEMENT_NODE &&
+        !strcmp((const char *)node->name, name))
+    {
+      return node;
+    }
+  }
+
+  return NULL;
+}
+
+static guint32
+_child_content(mbpi_builder *b, xmlNodePtr node, const char *name)
+{
+  xmlNodePtr child = _child(node, name);
+  xmlChar *content;
+  guint32 offset;
+
+  if (!child)
+    return 0;
+
+  content = xmlNodeGetContent(child);
+  offset = _builder_add_string(b, content);
+  xmlFree(content);
+
+  return offset;
+}
+
+/* prefer the APN used for internet, fallback to the first one */
+static xmlNodePtr
+_gsm_get_apn(xmlNodePtr gsm)
+{
+  xmlNodePtr apn = NULL;
+  xmlNodePtr node;
+
+  for (node = gsm->children; node; node = node->next)
+  {
+    xmlNodePtr usage;
+
+    if (node->type != XML_ELEMENT_NODE ||
+        strcmp((const char *)node->name, "apn"))
+    {
+      continue;
+    }
+
+    if (!apn)
+      apn = node;
+
+    if ((usage = _child(node, "usage")))
+    {
+      xmlChar *type = xmlGetProp(usage, BAD_CAST "type");
+      gboolean internet = type && !strcmp((const char *)type, "internet");
+
+      xmlFree(type);
+
+      if (internet)
+        return node;
+    }
+  }
+
+  return apn;
+}
+
+static gboolean
+_mnc_valid(const xmlChar *mnc)
+{
+  size_t len = strspn((const char *)mnc, "0123456789");
+
+  return len >= MBPI_MNC_DIGITS_MIN && len <= MBPI_MNC_DIGITS_MAX &&
+      !mnc[len];
+}
+
+static void
+_builder_add_provider(mbpi_builder *b, xmlNodePtr provider)
+{
+  xmlNodePtr gsm = _child(provider, "gsm");
+  xmlNodePtr node;
+  mbpi_index_entry entry = {0, };
+
+  if (!gsm)
+    return;
+
+  entry.name = _child_content(b, provider, "name");
+
+  if ((node = _gsm_get_apn(gsm)))
+  {
+    xmlChar *value = xmlGetProp(node, BAD_CAST "value");
+
+    entry.apn = _builder_add_string(b, value);
+    xmlFree(value);
+    entry.username = _child_content(b, node, "username");
+    entry.password = _child_content(b, node, "password");
+  }
+
+  for (node = gsm->children; node; node = node->next)
+  {
+    xmlChar *mcc;
+    xmlChar *mnc;
+
+    if (node->type != XML_ELEMENT_NODE ||
+        strcmp((const char *)node->name, "network-id"))
+    {
+      continue;
+    }
+
+    mcc = xmlGetProp(node, BAD_CAST "mcc");
+    mnc = xmlGetProp(node, BAD_CAST "mnc");
+
+    if (mcc && mnc && _mnc_valid(mnc))
+    {
+      entry.key = MBPI_KEY(strtoul((const char *)mcc, NULL, 10),
+                           strtoul((const char *)mnc, NULL, 10),
+                           strlen((const char *)mnc));
+
+      /* the first provider in the database wins */
+      if (g_hash_table_add(b->keys, GUINT_TO_POINTER(entry.key)))
+        g_array_append_val(b->entries, entry);
+    }
+
+    xmlFree(mcc);
+    xmlFree(mnc);
+  }
+}
+
+static gint
+_entry_compare(gconstpointer a, gconstpointer b)
+{
+  const mbpi_index_entry *e1 = a;
+  const mbpi_index_entry *e2 = b;
+
+  if (e1->key != e2->key)
+    return e1->key < e2->key ? -1 : 1;
+
+  return 0;
+}
+
+static GBytes *
+_index_build(const struct stat *st)
+{
+  mbpi_builder b;
+  mbpi_index_header hdr = {0, };
+  xmlDocPtr doc;
+  xmlNodePtr root;
+  xmlNodePtr country;
+  GByteArray *index;
+
+  if (!(doc = xmlParseFile(MBPI_DATABASE)))
+  {
+    CONNUI_ERR("Unable to parse '" MBPI_DATABASE "'");
+    return NULL;
+  }
+
+  if (!(root = xmlDocGetRootElement(doc)))
+  {
+    CONNUI_ERR("'" MBPI_DATABASE "' is empty");
+    xmlFreeDoc(doc);
+    return NULL;
+  }
+
+  b.entries = g_array_new(FALSE, FALSE, sizeof(mbpi_index_entry));
+  b.strings = g_byte_array_new();
+  b.offsets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  b.keys = g_hash_table_new(g_direct_hash, g_direct_equal);
+  g_byte_array_append(b.strings, (const guint8 *)"", 1);
+
+  for (country = root->children; country; country = country->next)
+  {
+    xmlNodePtr provider;
+
+    if (country->type != XML_ELEMENT_NODE)
+      continue;
+
+    for (provider = country->children; provider; provider = provider->next)
+    {
+      if (provider->type == XML_ELEMENT_NODE &&
+          !strcmp((const char *)provider->name, "provider"))
+      {
+        _builder_add_provider(&b, provider);
+      }
+    }
+  }
+
+  xmlFreeDoc(doc);
+
+  g_array_sort(b.entries, _entry_compare);
+
+  hdr.count = b.entries->len;
+  index = g_byte_array_sized_new(sizeof(hdr) +
+                                 hdr.count * sizeof(mbpi_index_entry) +
+                                 b.strings->len);
+  g_byte_array_append(index, (const guint8 *)&hdr, sizeof(hdr));
+  g_byte_array_append(index, (const guint8 *)b.entries->data,
+                      hdr.count * sizeof(mbpi_index_entry));
+
+  hdr.magic = MBPI_INDEX_MAGIC;
+  hdr.version = MBPI_INDEX_VERSION;
+  hdr.mtime = st->st_mtime;
+  hdr.size = st->st_size;
+  hdr.strings = index->len;
+  memcpy(index->data, &hdr, sizeof(hdr));
+
+  g_byte_array_append(index, b.strings->data, b.strings->len);
+
+  g_debug("MBPI index built, %u networks", hdr.count);
+
+  g_hash_table_destroy(b.keys);
+  g_hash_table_destroy(b.offsets);
+  g_byte_array_free(b.strings, TRUE);
+  g_array_free(b.entries, TRUE);
+
+  return g_byte_array_free_to_bytes(index);
+}
+
+static gboolean
+_index_valid(GBytes *index, const struct stat *st)
+{
+  gsize size;
+  const guint8 *data = g_bytes_get_data(index, &size);
+  const mbpi_index_header *hdr = (const mbpi_index_header *)data;
+
+  if (size <= sizeof(*hdr) || hdr->magic != MBPI_INDEX_MAGIC ||
+      hdr->version != MBPI_INDEX_VERSION)
+  {
+    return FALSE;
+  }
+
+  if (hdr->mtime != (gint64)st->st_mtime || hdr->size != (guint64)st->st_size)
+    return FALSE;
+
+  return TRUE;
+}
+
+/*
+ * the file in the cache dir could be truncated or corrupted, check that all
+ * string offsets stay within the string table
+ */
+static gboolean
+_index_check(GBytes *index)
+{
+  gsize size;
+  const guint8 *data = g_bytes_get_data(index, &size);
+  const mbpi_index_header *hdr = (const mbpi_index_header *)data;
+  const mbpi_index_entry *entries;
+  guint64 strings_len;
+  guint32 i;
+
+  /* strings must follow the entries and be NUL terminated */
+  if (hdr->strings != sizeof(*hdr) +
+      (guint64)hdr->count * sizeof(mbpi_index_entry) ||
+      hdr->strings >= size || data[size - 1])
+  {
+    return FALSE;
+  }
+
+  entries = (const mbpi_index_entry *)(data + sizeof(*hdr));
+  strings_len = size - hdr->strings;
+
+  for (i = 0; i < hdr->count; i++)
+  {
+    const mbpi_index_entry *e = &entries[i];
+
+    if (e->name >= strings_len || e->apn >= strings_len ||
+        e->username >= strings_len || e->password >= strings_len)
+    {
+      return FALSE;
+    }
+
+    if (i && e->key < entries[i - 1].key)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static GBytes *
+_index_load(const gchar *path, const struct stat *st)
+{
+  GMappedFile *file = g_mapped_file_new(path, FALSE, NULL);
+  GBytes *index;
+
+  if (!file)
+    return NULL;
+
+  index = g_mapped_file_get_bytes(file);
+  g_mapped_file_unref(file);
+
+  if (!_index_valid(index, st) || !_index_check(index))
+  {
+    CONNUI_ERR("Ignoring invalid MBPI index %s", path);
+    g_bytes_unref(index);
+    index = NULL;
+  }
+
+  return index;
+}
+
+static GBytes *
+_index_get()
+{
+  struct stat st;
+  gchar *dir;
+  gchar *path;
+  GBytes *index;
+
+  if (g_stat(MBPI_DATABASE, &st))
+  {
+    CONNUI_ERR("Unable to stat '" MBPI_DATABASE "'");
+    return NULL;
+  }
+
+  if (mbpi_index && _index_valid(mbpi_index, &st))
+    return mbpi_index;
+
+  if (mbpi_index)
+  {
+    g_bytes_unref(mbpi_index);
+    mbpi_index = NULL;
+  }
+
+  if (mbpi_build.failed && mbpi_build.mtime == (gint64)st.st_mtime &&
+      mbpi_build.size == (guint64)st.st_size)
+  {
+    return NULL;
+  }
+
+  dir = g_build_filename(g_get_user_cache_dir(), "connui-cellular", NULL);
+  path = g_build_filename(dir, MBPI_INDEX_NAME, NULL);
+
+  /* another process might have built it already */
+  if (!(index = _index_load(path, &st)) && (index = _index_build(&st)))
+  {
+    GError *error = NULL;
+    gconstpointer data;
+    gsize size;
+
+    data = g_bytes_get_data(index, &size);
+
+    /* atomic replace, processes using the old one keep their mapping */
+    if (g_mkdir_with_parents(dir, 0755) ||
+        !g_file_set_contents(path, data, size, &error))
+    {
+      /* not fatal, we just keep using the in-memory copy */
+      CONNUI_ERR("Unable to save MBPI index to %s [%s]", path,
+                 error ? error->message : g_strerror(errno));
+
+      if (error)
+        g_error_free(error);
+    }
+    else
+    {
+      GBytes *mapped = _index_load(path, &st);
+
+      if (mapped)
+      {
+        g_bytes_unref(index);
+        index = mapped;
+      }
+    }
+  }
+  else if (!index)
+  {
+    mbpi_build.failed = TRUE;
+    mbpi_build.mtime = st.st_mtime;
+    mbpi_build.size = st.st_size;
+  }
+
+  g_free(path);
+  g_free(dir);
+
+  mbpi_index = index;
+
+  return index;
+}
+
+static const gchar *
+_index_string(const guint8 *data, const mbpi_index_header *hdr,
+              guint32 offset)
+{
+  if (!offset)
+    return NULL;
+
+  return (const gchar *)data + hdr->strings + offset;
+}
+
+__attribute__((visibility("hidden"))) gboolean
+connui_cell_mbpi_lookup(guint mcc, guint mnc, guint mnc_digits,
+                        mbpi_network *network)
+{
+  GBytes *index;
+  const guint8 *data;
+  const mbpi_index_header *hdr;
+  const mbpi_index_entry *entries;
+  guint32 key = MBPI_KEY(mcc, mnc, mnc_digits);
+  guint32 lo = 0;
+  guint32 hi;
+
+  g_return_val_if_fail(mnc_digits >= MBPI_MNC_DIGITS_MIN &&
+                       mnc_digits <= MBPI_MNC_DIGITS_MAX, FALSE);
+
+  if (!(index = _index_get()))
+    return FALSE;
+
+  data = g_bytes_get_data(index, NULL);
+  hdr = (const mbpi_index_header *)data;
+  entries = (const mbpi_index_entry *)(data + sizeof(*hdr));
+  hi = hdr->count;
+
+  while (lo < hi)
+  {
+    guint32 mid = lo + (hi - lo) / 2;
+
+    if (entries[mid].key < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == hdr->count || entries[lo].key != key)
+    return FALSE;
+
+  if (network)
+  {
+    network->name = _index_string(data, hdr, entries[lo].name);
+    network->apn = _index_string(data, hdr, entries[lo].apn);
+    network->username = _index_string(data, hdr, entries[lo].username);
+    network->password = _index_string(data, hdr, entries[lo].password);
+  }
+
+  return TRUE;
+}
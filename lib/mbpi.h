@@ -0,0 +1,47 @@
+/*
+ * mbpi.h
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __CONNUI_INTERNAL_MBPI_H_INCLUDED__
+#define __CONNUI_INTERNAL_MBPI_H_INCLUDED__
+
+typedef struct _mbpi_network
+{
+  const gchar *name;
+  const gchar *apn;
+  const gchar *username;
+  const gchar *password;
+}
+mbpi_network;
+
+#define MBPI_MNC_DIGITS_MIN 1
+#define MBPI_MNC_DIGITS_MAX 3
+
+/* digits of @mnc when only the number is known, like '%02u' */
+#define MBPI_MNC_DIGITS(mnc) ((mnc) > 99 ? 3 : 2)
+
+/*
+ * @mnc_digits is how many digits the MNC has, including the leading zeroes,
+ * "01" and "001" are different networks. Strings in @network are valid until
+ * the next call.
+ */
+gboolean
+connui_cell_mbpi_lookup(guint mcc, guint mnc, guint mnc_digits,
+                        mbpi_network *network);
+
+#endif /* __CONNUI_INTERNAL_MBPI_H_INCLUDED__ */
@@ -36,7 +36,11 @@
 #include "net.h"
 #include "sim.h"
 #include "sups.h"
+#include "call.h"
+#include "emergency.h"
 #include "connmgr.h"
+#include "property.h"
+#include "stats.h"
 
 #include "org.ofono.VoiceCallManager.h"
 
@@ -58,12 +62,49 @@ typedef struct _modem_data
   gchar *revision;
   gchar *serial;
   ConnuiCellVoiceCallManager *vcm;
+  gulong vcm_changed_id;
+  GStrv emergency_numbers;
+  /* built on first use */
+  connui_emergency_trie *emergency_trie;
 
   gulong properties_changed_id;
   guint notify_id;
 }
 modem_data;
 
+static void
+_cancel_interface(gpointer cancellable)
+{
+  g_cancellable_cancel(cancellable);
+  g_object_unref(cancellable);
+}
+
+static void
+_emergency_numbers_clear(modem_data *md)
+{
+  g_strfreev(md->emergency_numbers);
+  md->emergency_numbers = NULL;
+
+  if (md->emergency_trie)
+  {
+    connui_cell_emergency_trie_unref(md->emergency_trie);
+    md->emergency_trie = NULL;
+  }
+}
+
+static void
+_vcm_clear(modem_data *md)
+{
+  if (md->vcm)
+  {
+    g_signal_handler_disconnect(md->vcm, md->vcm_changed_id);
+    g_object_unref(md->vcm);
+    md->vcm = NULL;
+  }
+
+  _emergency_numbers_clear(md);
+}
+
 static void
 _modem_data_destroy(gpointer data)
 {
@@ -81,6 +122,7 @@ _modem_data_destroy(gpointer data)
   g_free(md->serial);
 
   g_hash_table_unref(md->interfaces);
+  _vcm_clear(md);
 
   connui_utils_notify_notify(md->ctx->modem_cbs, md->path, &status, NULL);
 
@@ -96,7 +138,7 @@ _modem_data_create(ConnuiCellModem *proxy, const gchar *path,
 
   md->ctx = ctx;
   md->interfaces = g_hash_table_new_full(g_str_hash, g_str_equal,
-                                         g_free, NULL);
+                                         g_free, _cancel_interface);
   md->proxy = proxy;
   md->path = g_strdup(path);
 
@@ -222,6 +264,130 @@ connui_cell_modem_get_modems(GError **error)
   return modems;
 }
 
+__attribute__((visibility("hidden"))) void
+connui_cell_modem_snapshot_invalidate(connui_cell_context *ctx)
+{
+  ctx->modems_generation++;
+
+  if (ctx->modems_snapshot)
+  {
+    connui_cell_modems_unref(ctx->modems_snapshot);
+    ctx->modems_snapshot = NULL;
+  }
+}
+
+static gint
+_compare_ids(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  return strcmp(*(const gchar **)a, *(const gchar **)b);
+}
+
+static connui_cell_modems *
+_modems_snapshot_new(connui_cell_context *ctx)
+{
+  guint count = g_hash_table_size(ctx->modems);
+  connui_cell_modems *modems;
+  const gchar **ids;
+  GHashTableIter iter;
+  gpointer path;
+  guint i = 0;
+
+  /* ids live right after the struct, one block for both */
+  modems = g_malloc(sizeof(*modems) + (count + 1) * sizeof(gchar *));
+  ids = (const gchar **)(modems + 1);
+
+  g_hash_table_iter_init(&iter, ctx->modems);
+
+  while (g_hash_table_iter_next(&iter, &path, NULL))
+    ids[i++] = g_intern_string(path);
+
+  ids[i] = NULL;
+  g_qsort_with_data(ids, count, sizeof(*ids), _compare_ids, NULL);
+
+  modems->generation = ctx->modems_generation;
+  modems->count = count;
+  modems->ids = ids;
+  modems->ref_count = 1;
+
+  return modems;
+}
+
+connui_cell_modems *
+connui_cell_modem_get_snapshot(void)
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+  connui_cell_modems *modems;
+
+  g_return_val_if_fail(ctx != NULL, NULL);
+
+  if (!ctx->modems_snapshot)
+    ctx->modems_snapshot = _modems_snapshot_new(ctx);
+
+  modems = connui_cell_modems_ref(ctx->modems_snapshot);
+
+  connui_cell_context_destroy(ctx);
+
+  return modems;
+}
+
+connui_cell_modems *
+connui_cell_modems_ref(connui_cell_modems *modems)
+{
+  g_return_val_if_fail(modems != NULL, NULL);
+
+  modems->ref_count++;
+
+  return modems;
+}
+
+void
+connui_cell_modems_unref(connui_cell_modems *modems)
+{
+  g_return_if_fail(modems != NULL);
+
+  if (!--modems->ref_count)
+    g_free(modems);
+}
+
+guint
+connui_cell_modem_get_generation(void)
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+  guint generation;
+
+  g_return_val_if_fail(ctx != NULL, 0);
+
+  generation = ctx->modems_generation;
+
+  connui_cell_context_destroy(ctx);
+
+  return generation;
+}
+
+gint
+connui_cell_modems_find(const connui_cell_modems *modems,
+                        const char *modem_id)
+{
+  GQuark q;
+  guint i;
+
+  g_return_val_if_fail(modems != NULL && modem_id != NULL, -1);
+
+  /* ids are interned, one that never was is not in any snapshot */
+  if (!(q = g_quark_try_string(modem_id)))
+    return -1;
+
+  modem_id = g_quark_to_string(q);
+
+  for (i = 0; i < modems->count; i++)
+  {
+    if (modems->ids[i] == modem_id)
+      return i;
+  }
+
+  return -1;
+}
+
 #define GET(x, type, default) \
   connui_cell_context *ctx; \
   modem_data *md; \
@@ -274,11 +440,141 @@ connui_cell_modem_get_manufacturer(const char *modem_id, GError **error)
   GET(manufacturer, const gchar *, NULL)
 }
 
+static gboolean
+_parse_emergency_numbers(gpointer data, GVariant *value)
+{
+  modem_data *md = data;
+
+  _emergency_numbers_clear(md);
+  md->emergency_numbers = g_variant_dup_strv(value, NULL);
+
+  return TRUE;
+}
+
+static const property_entry vcm_property_entries[] =
+{
+  {OFONO_VCM_PROPERTY_EMERGENCY_NUMBERS, _parse_emergency_numbers},
+  {NULL, NULL}
+};
+
+static property_table vcm_properties = PROPERTY_TABLE(vcm_property_entries);
+
+static void
+_vcm_property_changed_cb(ConnuiCellVoiceCallManager *proxy,
+                         const gchar *name, GVariant *value,
+                         gpointer user_data)
+{
+  modem_data *md = user_data;
+  GVariant *v = g_variant_get_variant(value);
+
+  g_debug("Modem %s voice call manager property %s changed", md->path, name);
+
+  property_dispatch(&vcm_properties, md, name, v);
+
+  g_variant_unref(v);
+}
+
+static void
+_vcm_get_properties_cb(GObject *object, GAsyncResult *res,
+                       gpointer user_data)
+{
+  connui_cell_pending *pending = user_data;
+  GVariant *props = NULL;
+  GError *error = NULL;
+  gboolean ok;
+
+  ok = connui_cell_voice_call_manager_call_get_properties_finish(
+        CONNUI_CELL_VOICE_CALL_MANAGER(object), &props, res, &error);
+  stats_call_end("VoiceCallManager.GetProperties", pending->stats_start, ok,
+                 &error);
+
+  if (!ok)
+  {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      CONNUI_ERR("Unable to get modem [%s] voice call manager properties: %s",
+                 pending->path, error->message);
+    }
+
+    g_error_free(error);
+  }
+  /* interface or modem are gone */
+  else if (!g_cancellable_is_cancelled(pending->cancellable))
+  {
+    ConnuiCellModem *modem = g_hash_table_lookup(pending->ctx->modems,
+                                                 pending->path);
+    modem_data *md = g_object_get_data(G_OBJECT(modem), DATA);
+    GVariantIter i;
+    gchar *name;
+    GVariant *v;
+
+    g_variant_iter_init(&i, props);
+
+    while (g_variant_iter_loop(&i, "{&sv}", &name, &v))
+      property_dispatch(&vcm_properties, md, name, v);
+  }
+
+  if (props)
+    g_variant_unref(props);
+
+  connui_cell_pending_free(pending);
+}
+
+static void
+_vcm_proxy_ready_cb(GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  connui_cell_pending *pending = user_data;
+  ConnuiCellVoiceCallManager *proxy;
+  GError *error = NULL;
+
+  proxy = connui_cell_voice_call_manager_proxy_new_for_bus_finish(res, &error);
+
+  if (!proxy)
+  {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      CONNUI_ERR("Error creating OFONO voice call manager proxy for %s [%s]",
+                 pending->path, error->message);
+    }
+
+    g_error_free(error);
+  }
+  else if (g_cancellable_is_cancelled(pending->cancellable))
+    g_object_unref(proxy);
+  else
+  {
+    ConnuiCellModem *modem = g_hash_table_lookup(pending->ctx->modems,
+                                                 pending->path);
+    modem_data *md = g_object_get_data(G_OBJECT(modem), DATA);
+
+    g_assert(md->vcm == NULL);
+
+    md->vcm = proxy;
+    connui_cell_modem_add_calls(pending->ctx, pending->path, proxy);
+
+    /* EmergencyNumbers are kept current from then on */
+    md->vcm_changed_id = g_signal_connect(
+          proxy, "property-changed", G_CALLBACK(_vcm_property_changed_cb), md);
+    pending->stats_start = stats_call_begin("VoiceCallManager.GetProperties");
+    connui_cell_voice_call_manager_call_get_properties(
+          proxy, pending->cancellable, _vcm_get_properties_cb, pending);
+
+    return;
+  }
+
+  connui_cell_pending_free(pending);
+}
+
+/*
+ * Every interface gets its own cancellable, so proxies still being created
+ * for an interface that went away are dropped. All interfaces are set up
+ * concurrently.
+ */
 static void
 _parse_interfaces(modem_data *md, GVariant *value)
 {
   GHashTable *interfaces = g_hash_table_new_full(g_str_hash, g_str_equal,
-                                                 g_free, NULL);
+                                                 g_free, _cancel_interface);
   GVariantIter vi;
   gchar *iface;
   GHashTableIter hi;
@@ -286,50 +582,54 @@ _parse_interfaces(modem_data *md, GVariant *value)
   g_variant_iter_init(&vi, value);
 
   while (g_variant_iter_loop(&vi, "s", &iface))
-    g_hash_table_add(interfaces, g_strdup(iface));
-
-  g_hash_table_iter_init (&hi, interfaces);
-
-  while (g_hash_table_iter_next (&hi, (gpointer *)&iface, NULL))
   {
-    if (g_hash_table_lookup(md->interfaces, iface))
+    gpointer key;
+    GCancellable *cancellable;
+
+    if (g_hash_table_steal_extended(md->interfaces, iface, &key,
+                                    (gpointer *)&cancellable))
+    {
+      g_hash_table_insert(interfaces, key, cancellable);
       continue;
+    }
 
     g_debug("Modem %s new interface %s", md->path, iface);
 
+    cancellable = g_cancellable_new();
+    g_hash_table_insert(interfaces, g_strdup(iface), cancellable);
+
     if (!strcmp(iface, OFONO_SIMMGR_INTERFACE_NAME))
-      connui_cell_modem_add_simmgr(md->ctx, md->path);
+      connui_cell_modem_add_simmgr(md->ctx, md->path, cancellable);
     else if (!strcmp(iface, OFONO_NETREG_INTERFACE_NAME))
-      connui_cell_modem_add_netreg(md->ctx, md->path);
+      connui_cell_modem_add_netreg(md->ctx, md->path, cancellable);
     else if (!strcmp(iface, OFONO_SUPPLSVCS_INTERFACE_NAME))
-      connui_cell_modem_add_supplementary_services(md->ctx, md->path);
+    {
+      connui_cell_modem_add_supplementary_services(md->ctx, md->path,
+                                                   cancellable);
+    }
+    else if (!strcmp(iface, OFONO_CALL_FORWARDING_INTERFACE_NAME))
+      connui_cell_modem_add_call_forwarding(md->ctx, md->path, cancellable);
+    else if (!strcmp(iface, OFONO_CALL_SETTINGS_INTERFACE_NAME))
+      connui_cell_modem_add_call_settings(md->ctx, md->path, cancellable);
     else if (!strcmp(iface, OFONO_CONNMGR_INTERFACE_NAME))
-      connui_cell_modem_add_connection_manager(md->ctx, md->path);
+    {
+      connui_cell_modem_add_connection_manager(md->ctx, md->path,
+                                               cancellable);
+    }
     else if (!strcmp(iface, OFONO_VOICECALL_MANAGER_INTERFACE_NAME))
     {
-      GError *error = NULL;
-
-      md->vcm = connui_cell_voice_call_manager_proxy_new_for_bus_sync(
+      connui_cell_voice_call_manager_proxy_new_for_bus(
             OFONO_BUS_TYPE, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
-            OFONO_SERVICE, md->path, NULL, &error);
-
-      if (error)
-      {
-        CONNUI_ERR(
-              "Error creating OFONO voice call manager proxy for %s [%s]",
-              md->path, error->message);
-        g_error_free(error);
-      }
+            OFONO_SERVICE, md->path, cancellable, _vcm_proxy_ready_cb,
+            connui_cell_pending_new(md->ctx, md->path, cancellable));
     }
   }
 
+  /* whatever is left is gone */
   g_hash_table_iter_init (&hi, md->interfaces);
 
   while (g_hash_table_iter_next (&hi, (gpointer *)&iface, NULL))
   {
-    if (g_hash_table_lookup(interfaces, iface))
-      continue;
-
     g_debug("Modem %s interface %s removed", md->path, iface);
 
     if (!strcmp(iface, OFONO_SIMMGR_INTERFACE_NAME))
@@ -338,12 +638,16 @@ _parse_interfaces(modem_data *md, GVariant *value)
       connui_cell_modem_remove_netreg(md->proxy);
     else if (!strcmp(iface, OFONO_SUPPLSVCS_INTERFACE_NAME))
       connui_cell_modem_remove_supplementary_services(md->proxy);
+    else if (!strcmp(iface, OFONO_CALL_FORWARDING_INTERFACE_NAME))
+      connui_cell_modem_remove_call_forwarding(md->proxy);
+    else if (!strcmp(iface, OFONO_CALL_SETTINGS_INTERFACE_NAME))
+      connui_cell_modem_remove_call_settings(md->proxy);
     else if (!strcmp(iface, OFONO_CONNMGR_INTERFACE_NAME))
       connui_cell_modem_remove_connection_manager(md->proxy);
     else if (!strcmp(iface, OFONO_VOICECALL_MANAGER_INTERFACE_NAME))
     {
-      g_object_unref(md->vcm);
-      md->vcm = NULL;
+      connui_cell_modem_remove_calls(md->proxy);
+      _vcm_clear(md);
     }
   }
 
@@ -351,26 +655,100 @@ _parse_interfaces(modem_data *md, GVariant *value)
   md->interfaces = interfaces;
 }
 
+static gboolean
+_parse_powered(gpointer data, GVariant *value)
+{
+  modem_data *md = data;
+
+  md->powered = g_variant_get_boolean(value);
+
+  return TRUE;
+}
+
+static gboolean
+_parse_online(gpointer data, GVariant *value)
+{
+  modem_data *md = data;
+
+  md->online = g_variant_get_boolean(value);
+
+  return TRUE;
+}
+
+static gboolean
+_parse_manufacturer(gpointer data, GVariant *value)
+{
+  modem_data *md = data;
+
+  g_free(md->manufacturer);
+  md->manufacturer = g_strdup(g_variant_get_string(value, NULL));
+
+  return TRUE;
+}
+
+static gboolean
+_parse_model(gpointer data, GVariant *value)
+{
+  modem_data *md = data;
+
+  g_free(md->model);
+  md->model = g_strdup(g_variant_get_string(value, NULL));
+
+  return TRUE;
+}
+
+static gboolean
+_parse_revision(gpointer data, GVariant *value)
+{
+  modem_data *md = data;
+
+  g_free(md->revision);
+  md->revision = g_strdup(g_variant_get_string(value, NULL));
+
+  return TRUE;
+}
+
+static gboolean
+_parse_serial(gpointer data, GVariant *value)
+{
+  modem_data *md = data;
+
+  g_free(md->serial);
+  md->serial = g_strdup(g_variant_get_string(value, NULL));
+
+  return TRUE;
+}
+
+static gboolean
+_parse_interfaces_property(gpointer data, GVariant *value)
+{
+  _parse_interfaces(data, value);
+
+  return TRUE;
+}
+
+static const property_entry modem_property_entries[] =
+{
+  {OFONO_MODEM_PROPERTY_POWERED, _parse_powered},
+  {OFONO_MODEM_PROPERTY_ONLINE, _parse_online},
+  {OFONO_MODEM_PROPERTY_MANUFACTURER, _parse_manufacturer},
+  {OFONO_MODEM_PROPERTY_MODEL, _parse_model},
+  {OFONO_MODEM_PROPERTY_REVISION, _parse_revision},
+  {OFONO_MODEM_PROPERTY_SERIAL, _parse_serial},
+  {OFONO_MODEM_PROPERTY_INTERFACES, _parse_interfaces_property},
+  {NULL, NULL}
+};
+
+static property_table modem_properties =
+    PROPERTY_TABLE(modem_property_entries);
+
 static void
 _parse_property(modem_data *md, const gchar *name, GVariant *value)
 {
   g_debug("Modem %s parsing property %s, type %s", md->path, name,
           g_variant_get_type_string(value));
 
-  if (!strcmp(name, OFONO_MODEM_PROPERTY_POWERED))
-    md->powered = g_variant_get_boolean(value);
-  else if (!strcmp(name, OFONO_MODEM_PROPERTY_ONLINE))
-    md->online = g_variant_get_boolean(value);
-  else if (!strcmp(name, OFONO_MODEM_PROPERTY_MANUFACTURER))
-    md->manufacturer = g_strdup(g_variant_get_string(value, NULL));
-  else if (!strcmp(name, OFONO_MODEM_PROPERTY_MODEL))
-    md->model = g_strdup(g_variant_get_string(value, NULL));
-  else if (!strcmp(name, OFONO_MODEM_PROPERTY_REVISION))
-    md->revision = g_strdup(g_variant_get_string(value, NULL));
-  else if (!strcmp(name, OFONO_MODEM_PROPERTY_SERIAL))
-    md->serial = g_strdup(g_variant_get_string(value, NULL));
-  else if (!strcmp(name, OFONO_MODEM_PROPERTY_INTERFACES))
-    _parse_interfaces(md, value);
+  property_dispatch(&modem_properties, md, name, value);
 }
 
 static void
@@ -435,36 +813,42 @@ connui_cell_emergency_get_numbers(const char *modem_id, GError **error)
   ctx = connui_cell_context_get(error);
   g_return_val_if_fail(ctx != NULL, NULL);
 
-  md = _modem_get_data(modem_id, error);
+  /* voice call manager properties might not be there yet */
+  if ((md = _modem_get_data(modem_id, error)))
+    numbers = g_strdupv(md->emergency_numbers);
 
-  if (md)
-  {
-    GVariant *props;
+  connui_cell_context_destroy(ctx);
 
-    if (connui_cell_voice_call_manager_call_get_properties_sync(
-          md->vcm, &props, NULL, error))
+  return numbers;
+}
+
+__attribute__((visibility("hidden"))) connui_emergency_trie *
+connui_cell_emergency_get_trie(const char *modem_id)
+{
+  connui_cell_context *ctx;
+  connui_emergency_trie *trie = NULL;
+  modem_data *md;
+
+  g_return_val_if_fail(modem_id != NULL, NULL);
+
+  ctx = connui_cell_context_get(NULL);
+  g_return_val_if_fail(ctx != NULL, NULL);
+
+  md = _modem_get_data(modem_id, NULL);
+
+  if (md && md->emergency_numbers)
+  {
+    if (!md->emergency_trie)
     {
-      gchar *name;
-      GVariant *v;
-      GVariantIter i;
-
-      g_variant_iter_init(&i, props);
-
-      while (g_variant_iter_loop(&i, "{&sv}", &name, &v))
-      {
-        if (!strcmp(name, "EmergencyNumbers"))
-        {
-          numbers = g_variant_dup_strv(v, NULL);
-          g_variant_unref(v);
-          break;
-        }
-      }
-
-      g_variant_unref(props);
+      md->emergency_trie = connui_cell_emergency_trie_new(
+            (const gchar *const *)md->emergency_numbers);
     }
+
+    if (md->emergency_trie)
+      trie = connui_cell_emergency_trie_ref(md->emergency_trie);
   }
 
   connui_cell_context_destroy(ctx);
 
-  return numbers;
+  return trie;
 }
@@ -30,4 +30,8 @@ connui_cell_modem_add(connui_cell_context *ctx, ConnuiCellModem *proxy,
 __attribute__((visibility("hidden"))) void
 connui_cell_modem_remove(ConnuiCellModem *proxy);
 
+/* call after adding or removing modems from ctx->modems */
+__attribute__((visibility("hidden"))) void
+connui_cell_modem_snapshot_invalidate(connui_cell_context *ctx);
+
 #endif /* __CONNUI_INTERNAL_MODEM_H_INCLUDED__ */
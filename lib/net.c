@@ -6,14 +6,16 @@
 #include <connui/connui-dbus.h>
 #include <telepathy-glib/telepathy-glib.h>
 #include <gio/gio.h>
-#include <libxml/xpath.h>
 
 #include <string.h>
 
 #include "context.h"
 #include "service-call.h"
+#include "property.h"
+#include "stats.h"
 
 #include "net.h"
+#include "mbpi.h"
 
 struct _service_call
 {
@@ -44,14 +46,67 @@ typedef struct _net_data
 
   cell_network_state state;
   connui_net_selection_mode selection_mode;
+  /* MCC/MNC changed, but Name is not updated yet */
+  gboolean operator_name_stale;
 
+  /* connui_net_changed bits since the last notification */
+  guint changed;
   guint idle_id;
+
+  /* signal strength filter */
+  gdouble strength;
+  gboolean strength_valid;
+  guint strength_bar;
+  guchar strength_pending;
+  guint strength_pending_bar;
+  gint64 strength_time;
+  guint strength_timeout_id;
   gulong properties_changed_id;
 }
 net_data;
 
 #define DATA "connui_cell_net_data"
 
+#define PLMN_KEY(mcc, mnc) \
+  GUINT_TO_POINTER(((guint)(mcc) << 16) | ((guint)(mnc) & 0xffff))
+
+static connui_net_strength_filter strength_filter =
+{
+  {0, 20, 40, 60, 80},
+  {0, 3, 3, 3, 3},
+  1000,
+  100
+};
+
+static connui_net_strength_stats strength_stats;
+
+typedef struct _net_changed_cb
+{
+  cell_network_state_changed_cb cb;
+  gpointer user_data;
+  guint mask;
+  /* initial notification */
+  guint idle_id;
+}
+net_changed_cb;
+
+typedef struct _operator_name
+{
+  gchar *name;
+  /* from the Name property of the network we are registered to */
+  gboolean registered;
+}
+operator_name;
+
+typedef struct _operator_name_call
+{
+  guint mcc;
+  guint mnc;
+  guint pending;
+  guint idle_id;
+}
+operator_name_call;
+
 static net_data *
 _net_data_get(const char *path, GError **error)
 {
@@ -86,6 +141,60 @@ init_net_state(cell_network_state *state)
   state->network_edge_allocated = FALSE;
 }
 
+static void
+_net_changed_cb_free(connui_cell_context *ctx, net_changed_cb *ncb)
+{
+  if (ncb->idle_id)
+    g_source_remove(ncb->idle_id);
+
+  ctx->net_changed_cbs = g_slist_remove(ctx->net_changed_cbs, ncb);
+  g_free(ncb);
+}
+
+/* frees the callbacks closed while dispatching, once nobody is dispatching */
+static void
+_net_changed_cbs_sweep(connui_cell_context *ctx)
+{
+  GSList *l = ctx->net_changed_cbs;
+
+  if (ctx->net_changed_dispatching)
+    return;
+
+  while (l)
+  {
+    net_changed_cb *ncb = l->data;
+
+    l = l->next;
+
+    if (!ncb->cb)
+      _net_changed_cb_free(ctx, ncb);
+  }
+}
+
+static void
+_notify_changed(connui_cell_context *ctx, const gchar *path,
+                const cell_network_state *state, guint changed)
+{
+  GSList *l;
+
+  if (!changed)
+    return;
+
+  /* callbacks might close themselves or others, just mark those */
+  ctx->net_changed_dispatching++;
+
+  for (l = ctx->net_changed_cbs; l; l = l->next)
+  {
+    net_changed_cb *ncb = l->data;
+
+    if (ncb->cb && (ncb->mask & changed))
+      ncb->cb(path, state, changed, ncb->user_data);
+  }
+
+  ctx->net_changed_dispatching--;
+  _net_changed_cbs_sweep(ctx);
+}
+
 static void
 _net_data_destroy(gpointer data)
 {
@@ -95,6 +204,9 @@ _net_data_destroy(gpointer data)
   if (nd->idle_id)
     g_source_remove(nd->idle_id);
 
+  if (nd->strength_timeout_id)
+    g_source_remove(nd->strength_timeout_id);
+
   g_signal_handler_disconnect(nd->proxy, nd->properties_changed_id);
   g_object_unref(nd->proxy);
 
@@ -105,6 +217,7 @@ _net_data_destroy(gpointer data)
   init_net_state(state);
 
   connui_utils_notify_notify(nd->ctx->net_status_cbs, nd->path, state, NULL);
+  _notify_changed(nd->ctx, nd->path, state, CONNUI_NET_CHANGED_ALL);
 
   g_free(nd->path);
   g_free(nd);
@@ -134,14 +247,187 @@ _net_data_create(ConnuiCellNetworkRegistration *proxy, const gchar *path,
   return nd;
 }
 
+static const property_enum_entry reg_status_entries[] =
+{
+  {"unregistered", CONNUI_NET_REG_STATUS_UNREGISTERED},
+  {"registered", CONNUI_NET_REG_STATUS_HOME},
+  {"searching", CONNUI_NET_REG_STATUS_SEARCHING},
+  {"denied", CONNUI_NET_REG_STATUS_DENIED},
+  {"roaming", CONNUI_NET_REG_STATUS_ROAMING},
+  {NULL, 0}
+};
+
+static property_enum reg_status =
+    PROPERTY_ENUM(reg_status_entries, CONNUI_NET_REG_STATUS_UNKNOWN);
+
+/* RAT in the low byte, hsdpa/edge allocated flags above it */
+#define TECH_RAT(id) ((id) & 0xff)
+#define TECH_HSDPA 0x100
+#define TECH_EDGE 0x200
+
+static const property_enum_entry technology_entries[] =
+{
+  {"gsm", CONNUI_NET_RAT_GSM},
+  {"edge", CONNUI_NET_RAT_GSM | TECH_EDGE},
+  {"umts", CONNUI_NET_RAT_UMTS},
+  {"hspa", CONNUI_NET_RAT_UMTS | TECH_HSDPA},
+  {"lte", CONNUI_NET_RAT_LTE},
+  {"nr", CONNUI_NET_RAT_NR},
+  {NULL, 0}
+};
+
+static property_enum technology =
+    PROPERTY_ENUM(technology_entries, CONNUI_NET_RAT_UNKNOWN);
+
+static const property_enum_entry selection_mode_entries[] =
+{
+  {"manual", CONNUI_NET_SELECT_MODE_MANUAL},
+  {"auto", CONNUI_NET_SELECT_MODE_AUTO},
+  {"auto-only", CONNUI_NET_SELECT_MODE_AUTO_ONLY},
+  {NULL, 0}
+};
+
+static property_enum selection_mode =
+    PROPERTY_ENUM(selection_mode_entries, CONNUI_NET_SELECT_MODE_UNKNOWN);
+
+static gchar *
+_mbpi_get_name(guint mcc, guint mnc)
+{
+  mbpi_network network;
+
+  if (!connui_cell_mbpi_lookup(mcc, mnc, MBPI_MNC_DIGITS(mnc), &network))
+    return NULL;
+
+  return g_strdup(network.name);
+}
+
+static void
+_operator_name_free(gpointer data)
+{
+  operator_name *on = data;
+
+  g_free(on->name);
+  g_free(on);
+}
+
+static void
+_operator_name_cache_add(connui_cell_context *ctx, const gchar *mcc,
+                         const gchar *mnc, const gchar *name,
+                         gboolean registered)
+{
+  operator_name *on;
+
+  if (!mcc || !mnc || !name || !*name)
+    return;
+
+  if (!ctx->operator_names)
+  {
+    ctx->operator_names = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                                NULL, _operator_name_free);
+  }
+
+  if (!registered)
+  {
+    on = g_hash_table_lookup(ctx->operator_names,
+                             PLMN_KEY(g_ascii_strtoll(mcc, NULL, 10),
+                                      g_ascii_strtoll(mnc, NULL, 10)));
+
+    /* what the network tells us about itself wins */
+    if (on && on->registered)
+      return;
+  }
+
+  on = g_new(operator_name, 1);
+  on->name = g_strdup(name);
+  on->registered = registered;
+
+  g_hash_table_replace(ctx->operator_names,
+                       PLMN_KEY(g_ascii_strtoll(mcc, NULL, 10),
+                                g_ascii_strtoll(mnc, NULL, 10)), on);
+}
+
+static void
+_operator_name_cache_add_operators(connui_cell_context *ctx,
+                                   GVariant *operators)
+{
+  GVariantIter i;
+  GVariant *dict;
+
+  g_variant_iter_init(&i, operators);
+
+  while (g_variant_iter_next(&i, "(&o@a{sv})", NULL, &dict))
+  {
+    const gchar *mcc = NULL;
+    const gchar *mnc = NULL;
+    const gchar *name = NULL;
+
+    g_variant_lookup(dict, "MobileCountryCode", "&s", &mcc);
+    g_variant_lookup(dict, "MobileNetworkCode", "&s", &mnc);
+    g_variant_lookup(dict, "Name", "&s", &name);
+    _operator_name_cache_add(ctx, mcc, mnc, name, FALSE);
+    g_variant_unref(dict);
+  }
+}
+
+static void
+_operator_name_cache_update(net_data *nd)
+{
+  cell_network *network = nd->state.network;
+
+  if (!nd->operator_name_stale)
+  {
+    _operator_name_cache_add(nd->ctx, network->country_code,
+                             network->operator_code, nd->state.operator_name,
+                             TRUE);
+  }
+}
+
+/* names learned while registered are not valid once we move to other PLMN */
+static void
+_operator_name_cache_invalidate(net_data *nd)
+{
+  cell_network *network = nd->state.network;
+  gpointer key;
+  operator_name *on;
+
+  nd->operator_name_stale = TRUE;
+
+  if (!nd->ctx->operator_names ||
+      !network->country_code || !network->operator_code)
+  {
+    return;
+  }
+
+  key = PLMN_KEY(g_ascii_strtoll(network->country_code, NULL, 10),
+                 g_ascii_strtoll(network->operator_code, NULL, 10));
+  on = g_hash_table_lookup(nd->ctx->operator_names, key);
+
+  if (on && on->registered)
+    g_hash_table_remove(nd->ctx->operator_names, key);
+}
+
 static gboolean
 _idle_notify(gpointer user_data)
 {
   net_data *nd = user_data;
+  guint changed = nd->changed;
+
   nd->idle_id = 0;
+  nd->changed = 0;
+
+  /*
+   * MCC, MNC and name come in separate signals, those are dispatched before
+   * we get here, so this is the whole registration change. A MCC/MNC that
+   * changed after the name makes it stale, so we never cache a name with
+   * half of the old PLMN.
+   */
+  if (changed &
+      (CONNUI_NET_CHANGED_OPERATOR_NAME | CONNUI_NET_CHANGED_NETWORK))
+    _operator_name_cache_update(nd);
 
   connui_utils_notify_notify(nd->ctx->net_status_cbs, nd->path, &nd->state,
                              NULL);
+  _notify_changed(nd->ctx, nd->path, &nd->state, changed);
 
   return G_SOURCE_REMOVE;
 }
@@ -165,128 +451,311 @@ _notify_all(connui_cell_context *ctx)
     _notify(g_object_get_data(G_OBJECT(modem), DATA));
 }
 
-static connui_net_registration_status
-_reg_status(const gchar *status)
+static gchar *
+_operator_name_lookup(connui_cell_context *ctx, guint mcc, guint mnc)
 {
-  if (!strcmp(status, "unregistered"))
-    return CONNUI_NET_REG_STATUS_UNREGISTERED;
-  else if (!strcmp(status, "registered"))
-    return CONNUI_NET_REG_STATUS_HOME;
-  else if (!strcmp(status, "searching"))
-    return CONNUI_NET_REG_STATUS_SEARCHING;
-  else if (!strcmp(status, "denied"))
-    return CONNUI_NET_REG_STATUS_DENIED;
-  else if (!strcmp(status, "roaming"))
-    return CONNUI_NET_REG_STATUS_ROAMING;
-  else
-    return CONNUI_NET_REG_STATUS_UNKNOWN;
+  operator_name *on = NULL;
+  gchar *name;
+
+  if (ctx->operator_names)
+    on = g_hash_table_lookup(ctx->operator_names, PLMN_KEY(mcc, mnc));
+
+  if (on)
+    return g_strdup(on->name);
+
+  name = _mbpi_get_name(mcc, mnc);
+
+  if (name && !*name)
+  {
+    g_free(name);
+    name = NULL;
+  }
+
+  return name;
+}
+
+/* records what changed, returns TRUE if that is worth a notification */
+static gboolean
+_changed(net_data *nd, guint what, gboolean changed)
+{
+  if (changed)
+    nd->changed |= what;
+
+  return changed;
 }
 
 static guint
-_rat_name(const gchar *tech)
-{
-  if (!strcmp(tech, "gsm") || !strcmp(tech, "edge"))
-    return CONNUI_NET_RAT_GSM;
-  else if (!strcmp(tech, "umts") || !strcmp(tech, "hspa"))
-    return CONNUI_NET_RAT_UMTS;
-  else if (!strcmp(tech, "lte"))
-    return CONNUI_NET_RAT_LTE;
-  else if (!strcmp(tech, "nr"))
-    return CONNUI_NET_RAT_NR;
-  else
-    return CONNUI_NET_RAT_UNKNOWN;
+_strength_bar(guint strength, guint bar)
+{
+  guint new_bar = 0;
+  int i;
+
+  for (i = 0; i < CONNUI_NET_SIGNAL_BARS; i++)
+  {
+    guint threshold = strength_filter.thresholds[i];
+    guint hysteresis = strength_filter.hysteresis[i];
+
+    /* stay above the threshold until we are clearly below it */
+    if (bar > i)
+    {
+      if (strength + hysteresis > threshold)
+        new_bar = i + 1;
+    }
+    else if (strength > threshold + hysteresis)
+      new_bar = i + 1;
+  }
+
+  return new_bar;
 }
 
 static gboolean
-_hspda(const gchar *tech)
+_strength_apply(net_data *nd, guchar strength)
 {
-  return !strcmp(tech, "hspa");
+  gboolean changed = nd->state.network_signals_bar != strength;
+
+  nd->state.network_signals_bar = strength;
+  nd->strength_time = g_get_monotonic_time();
+
+  if (!_changed(nd, CONNUI_NET_CHANGED_STRENGTH, changed) ||
+      nd->state.rat_name == CONNUI_NET_RAT_UNKNOWN)
+  {
+    return FALSE;
+  }
+
+  strength_stats.notified++;
+
+  return TRUE;
 }
 
 static gboolean
-_edge(const gchar *tech)
+_strength_timeout_cb(gpointer user_data)
 {
-  return !strcmp(tech, "edge");
+  net_data *nd = user_data;
+
+  nd->strength_timeout_id = 0;
+  nd->strength_bar = nd->strength_pending_bar;
+
+  if (_strength_apply(nd, nd->strength_pending))
+    _notify(nd);
+
+  return G_SOURCE_REMOVE;
 }
 
 static gboolean
-_parse_property(net_data *nd, const gchar *name, GVariant *value)
+_parse_strength(gpointer data, GVariant *value)
 {
-  gboolean notify = FALSE;
-  cell_network_state *state = &nd->state;
-  cell_network *network = state->network;
-
-  g_debug("NET %s parsing property %s, type %s", nd->path, name,
-          g_variant_get_type_string(value));
+  net_data *nd = data;
+  guint weight = MIN(strength_filter.ewma_weight, 100);
+  guint current;
+  guint bar;
+  guchar strength;
+  gint64 elapsed;
 
-  if (!strcmp(name, OFONO_NETREG_PROPERTY_STRENGTH))
-  {
-    nd->state.network_signals_bar = g_variant_get_byte(value);
+  strength_stats.received++;
 
-    if (state->rat_name)
-      notify = TRUE;
-  }
-  else if (!strcmp(name, OFONO_NETREG_PROPERTY_NAME))
-  {
-    g_free(state->operator_name);
-    state->operator_name = g_strdup(g_variant_get_string(value, NULL));
-    g_free(network->operator_name);
-    network->operator_name = g_strdup(state->operator_name);
-    notify = TRUE;
-  }
-  else if (!strcmp(name, OFONO_NETREG_PROPERTY_MCC))
+  if (nd->strength_valid && weight)
   {
-    g_free(network->country_code);
-    network->country_code = g_strdup(g_variant_get_string(value, NULL));
-    notify = TRUE;
+    nd->strength = (weight * g_variant_get_byte(value) +
+                    (100 - weight) * nd->strength) / 100.0;
   }
-  else if (!strcmp(name, OFONO_NETREG_PROPERTY_MNC))
+  else
+    nd->strength = g_variant_get_byte(value);
+
+  nd->strength_valid = TRUE;
+  strength = nd->strength + 0.5;
+  current = nd->strength_timeout_id ? nd->strength_pending_bar :
+                                      nd->strength_bar;
+  bar = _strength_bar(strength, current);
+
+  if (bar == current && nd->state.network_signals_bar)
   {
-    g_free(network->operator_code);
-    network->operator_code = g_strdup(g_variant_get_string(value, NULL));
-    notify = TRUE;
+    strength_stats.suppressed++;
+    return FALSE;
   }
-  else if (!strcmp(name, OFONO_NETREG_PROPERTY_LOCATION_AREA_CODE))
+
+  /* back to what subscribers already have */
+  if (nd->strength_timeout_id && bar == nd->strength_bar)
   {
-    state->lac = g_variant_get_uint16(value);
-    notify = TRUE;
+    g_source_remove(nd->strength_timeout_id);
+    nd->strength_timeout_id = 0;
+    strength_stats.suppressed++;
+    return FALSE;
   }
-  else if (!strcmp(name, OFONO_NETREG_PROPERTY_CELL_ID))
+
+  elapsed = (g_get_monotonic_time() - nd->strength_time) / 1000;
+
+  if (nd->strength_time && elapsed < strength_filter.min_interval)
   {
-    state->cell_id = g_variant_get_uint32(value);
-    notify = TRUE;
+    nd->strength_pending = strength;
+    nd->strength_pending_bar = bar;
+    strength_stats.coalesced++;
+
+    if (!nd->strength_timeout_id)
+    {
+      nd->strength_timeout_id =
+          g_timeout_add(strength_filter.min_interval - elapsed,
+                        _strength_timeout_cb, nd);
+    }
+
+    return FALSE;
   }
-  else if (!strcmp(name, OFONO_NETREG_PROPERTY_STATUS))
+
+  if (nd->strength_timeout_id)
   {
-    state->reg_status = _reg_status(g_variant_get_string(value, NULL));
-    notify = TRUE;
+    g_source_remove(nd->strength_timeout_id);
+    nd->strength_timeout_id = 0;
   }
-  else if (!strcmp(name, OFONO_NETREG_PROPERTY_TECHNOLOGY))
-  {
-    const gchar *tech = g_variant_get_string(value, NULL);
 
-    state->rat_name = _rat_name(tech);
-    state->network_hsdpa_allocated = _hspda(tech);
-    state->network_edge_allocated = _edge(tech);
-    notify = TRUE;
-  }
-  else if (!strcmp(name, OFONO_NETREG_PROPERTY_MODE))
-  {
-    const gchar *mode = g_variant_get_string(value, NULL);
-
-    if (!strcmp(mode, "manual"))
-      nd->selection_mode = CONNUI_NET_SELECT_MODE_MANUAL;
-    else if (!strcmp(mode, "auto"))
-      nd->selection_mode = CONNUI_NET_SELECT_MODE_AUTO;
-    else if (!strcmp(mode, "auto-only"))
-      nd->selection_mode = CONNUI_NET_SELECT_MODE_AUTO_ONLY;
-    else
-      nd->selection_mode = CONNUI_NET_SELECT_MODE_UNKNOWN;
+  nd->strength_bar = bar;
 
-    notify = TRUE;
-  }
+  return _strength_apply(nd, strength);
+}
+
+static gboolean
+_parse_name(gpointer data, GVariant *value)
+{
+  net_data *nd = data;
+  cell_network_state *state = &nd->state;
+  cell_network *network = state->network;
+  const gchar *name = g_variant_get_string(value, NULL);
+  gboolean changed = g_strcmp0(state->operator_name, name);
+
+  g_free(state->operator_name);
+  state->operator_name = g_strdup(name);
+  g_free(network->operator_name);
+  network->operator_name = g_strdup(state->operator_name);
+  nd->operator_name_stale = FALSE;
+
+  return _changed(nd, CONNUI_NET_CHANGED_OPERATOR_NAME, changed);
+}
+
+static gboolean
+_parse_mcc(gpointer data, GVariant *value)
+{
+  net_data *nd = data;
+  cell_network *network = nd->state.network;
+  const gchar *mcc = g_variant_get_string(value, NULL);
+  gboolean changed = g_strcmp0(network->country_code, mcc);
+
+  if (changed)
+    _operator_name_cache_invalidate(nd);
+
+  g_free(network->country_code);
+  network->country_code = g_strdup(mcc);
+
+  return _changed(nd, CONNUI_NET_CHANGED_NETWORK, changed);
+}
+
+static gboolean
+_parse_mnc(gpointer data, GVariant *value)
+{
+  net_data *nd = data;
+  cell_network *network = nd->state.network;
+  const gchar *mnc = g_variant_get_string(value, NULL);
+  gboolean changed = g_strcmp0(network->operator_code, mnc);
+
+  if (changed)
+    _operator_name_cache_invalidate(nd);
+
+  g_free(network->operator_code);
+  network->operator_code = g_strdup(mnc);
+
+  return _changed(nd, CONNUI_NET_CHANGED_NETWORK, changed);
+}
+
+static gboolean
+_parse_lac(gpointer data, GVariant *value)
+{
+  net_data *nd = data;
+  guint lac = g_variant_get_uint16(value);
+  gboolean changed = nd->state.lac != lac;
+
+  nd->state.lac = lac;
+
+  return _changed(nd, CONNUI_NET_CHANGED_LAC, changed);
+}
+
+static gboolean
+_parse_cell_id(gpointer data, GVariant *value)
+{
+  net_data *nd = data;
+  guint cell_id = g_variant_get_uint32(value);
+  gboolean changed = nd->state.cell_id != cell_id;
+
+  nd->state.cell_id = cell_id;
+
+  return _changed(nd, CONNUI_NET_CHANGED_CELL_ID, changed);
+}
+
+static gboolean
+_parse_status(gpointer data, GVariant *value)
+{
+  net_data *nd = data;
+  connui_net_registration_status status =
+      property_enum_get(&reg_status, g_variant_get_string(value, NULL));
+  gboolean changed = nd->state.reg_status != status;
+
+  nd->state.reg_status = status;
+
+  return _changed(nd, CONNUI_NET_CHANGED_REG_STATUS, changed);
+}
+
+static gboolean
+_parse_technology(gpointer data, GVariant *value)
+{
+  net_data *nd = data;
+  cell_network_state *state = &nd->state;
+  gint id = property_enum_get(&technology, g_variant_get_string(value, NULL));
+  gboolean hsdpa = !!(id & TECH_HSDPA);
+  gboolean edge = !!(id & TECH_EDGE);
+  gboolean changed = state->rat_name != TECH_RAT(id) ||
+      state->network_hsdpa_allocated != hsdpa ||
+      state->network_edge_allocated != edge;
+
+  state->rat_name = TECH_RAT(id);
+  state->network_hsdpa_allocated = hsdpa;
+  state->network_edge_allocated = edge;
+
+  return _changed(nd, CONNUI_NET_CHANGED_RAT, changed);
+}
+
+static gboolean
+_parse_mode(gpointer data, GVariant *value)
+{
+  net_data *nd = data;
+  connui_net_selection_mode mode =
+      property_enum_get(&selection_mode, g_variant_get_string(value, NULL));
+  gboolean changed = nd->selection_mode != mode;
+
+  nd->selection_mode = mode;
+
+  return _changed(nd, CONNUI_NET_CHANGED_SELECTION_MODE, changed);
+}
+
+/* Strength first, it is by far the most frequent one */
+static const property_entry net_property_entries[] =
+{
+  {OFONO_NETREG_PROPERTY_STRENGTH, _parse_strength},
+  {OFONO_NETREG_PROPERTY_NAME, _parse_name},
+  {OFONO_NETREG_PROPERTY_MCC, _parse_mcc},
+  {OFONO_NETREG_PROPERTY_MNC, _parse_mnc},
+  {OFONO_NETREG_PROPERTY_LOCATION_AREA_CODE, _parse_lac},
+  {OFONO_NETREG_PROPERTY_CELL_ID, _parse_cell_id},
+  {OFONO_NETREG_PROPERTY_STATUS, _parse_status},
+  {OFONO_NETREG_PROPERTY_TECHNOLOGY, _parse_technology},
+  {OFONO_NETREG_PROPERTY_MODE, _parse_mode},
+  {NULL, NULL}
+};
+
+static property_table net_properties = PROPERTY_TABLE(net_property_entries);
+
+static gboolean
+_parse_property(net_data *nd, const gchar *name, GVariant *value)
+{
+  g_debug("NET %s parsing property %s, type %s", nd->path, name,
+          g_variant_get_type_string(value));
 
-  return notify;
+  return property_dispatch(&net_properties, nd, name, value);
 }
 
 static void
@@ -304,23 +773,39 @@ _property_changed_cb(ConnuiCellNetworkRegistration *proxy, const gchar *name,
   g_variant_unref(v);
 }
 
-__attribute__((visibility("hidden"))) void
-connui_cell_modem_add_netreg(connui_cell_context *ctx, const char *path)
+static void
+_get_properties_cb(GObject *object, GAsyncResult *res, gpointer user_data)
 {
-  ConnuiCellNetworkRegistration *proxy;
+  connui_cell_pending *pending = user_data;
+  ConnuiCellNetworkRegistration *proxy =
+      CONNUI_CELL_NETWORK_REGISTRATION(object);
+  GVariant *props = NULL;
   GError *error = NULL;
+  gboolean ok;
 
-  proxy = connui_cell_network_registration_proxy_new_for_bus_sync(
-        OFONO_BUS_TYPE, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
-        OFONO_SERVICE, path, NULL, &error);
+  ok = connui_cell_network_registration_call_get_properties_finish(
+        proxy, &props, res, &error);
+  stats_call_end("NetworkRegistration.GetProperties", pending->stats_start,
+                 ok, &error);
 
-  if (proxy)
+  if (!ok)
+  {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      CONNUI_ERR("Unable to get modem [%s] network registration properties: %s",
+                 pending->path, error->message);
+    }
+
+    g_error_free(error);
+  }
+
+  /* interface or modem are gone */
+  if (!g_cancellable_is_cancelled(pending->cancellable))
   {
-    net_data *nd = _net_data_create(proxy, path, ctx);
-    GVariant *props;
+    connui_cell_context *ctx = pending->ctx;
+    net_data *nd = _net_data_create(g_object_ref(proxy), pending->path, ctx);
 
-    if (connui_cell_network_registration_call_get_properties_sync(proxy, &props,
-                                                                NULL, &error))
+    if (props)
     {
       GVariantIter i;
       gchar *name;
@@ -331,27 +816,67 @@ connui_cell_modem_add_netreg(connui_cell_context *ctx, const char *path)
       while (g_variant_iter_loop(&i, "{&sv}", &name, &v))
         _parse_property(nd, name, v);
 
-      g_variant_unref(props);
-    }
-    else
-    {
-      CONNUI_ERR("Unable to get modem [%s] network registration properties: %s",
-                 path, error->message);
-      g_error_free(error);
+      /* that's a consistent snapshot, no matter the order of properties */
+      nd->operator_name_stale = FALSE;
+      _operator_name_cache_update(nd);
     }
 
+    /* a new modem, everything is news to the subscribers */
+    nd->changed = CONNUI_NET_CHANGED_ALL;
+
     nd->properties_changed_id =
         g_signal_connect(proxy, "property-changed",
                          G_CALLBACK(_property_changed_cb), nd);
 
     _notify_all(ctx);
   }
-  else
+
+  if (props)
+    g_variant_unref(props);
+
+  connui_cell_pending_free(pending);
+}
+
+static void
+_proxy_ready_cb(GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  connui_cell_pending *pending = user_data;
+  ConnuiCellNetworkRegistration *proxy;
+  GError *error = NULL;
+
+  proxy = connui_cell_network_registration_proxy_new_for_bus_finish(res,
+                                                                    &error);
+
+  if (!proxy)
   {
-    CONNUI_ERR("Error creating OFONO network registration proxy for %s [%s]",
-               path, error->message);
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      CONNUI_ERR("Error creating OFONO network registration proxy for %s [%s]",
+                 pending->path, error->message);
+    }
+
     g_error_free(error);
+    connui_cell_pending_free(pending);
+    return;
   }
+
+  pending->stats_start =
+      stats_call_begin("NetworkRegistration.GetProperties");
+  connui_cell_network_registration_call_get_properties(
+        proxy, pending->cancellable, _get_properties_cb, pending);
+  g_object_unref(proxy);
+}
+
+__attribute__((visibility("hidden"))) void
+connui_cell_modem_add_netreg(connui_cell_context *ctx, const char *path,
+                             GCancellable *cancellable)
+{
+  g_debug("Adding ofono network registration for %s", path);
+
+  connui_cell_network_registration_proxy_new_for_bus(
+        OFONO_BUS_TYPE, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+        OFONO_SERVICE, path, cancellable, _proxy_ready_cb,
+        connui_cell_pending_new(ctx, path, cancellable));
 }
 
 __attribute__((visibility("hidden"))) void
@@ -360,6 +885,39 @@ connui_cell_modem_remove_netreg(ConnuiCellModem *modem)
   g_object_set_data(G_OBJECT(modem), DATA, NULL);
 }
 
+__attribute__((visibility("hidden"))) property_table *
+connui_cell_net_properties(void)
+{
+  return &net_properties;
+}
+
+__attribute__((visibility("hidden"))) gpointer
+connui_cell_net_data_new_detached(connui_cell_context *ctx)
+{
+  net_data *nd = g_new0(net_data, 1);
+
+  nd->ctx = ctx;
+  nd->state.network = g_new0(cell_network, 1);
+  nd->selection_mode = CONNUI_NET_SELECT_MODE_UNKNOWN;
+
+  init_net_state(&nd->state);
+
+  return nd;
+}
+
+__attribute__((visibility("hidden"))) void
+connui_cell_net_data_free_detached(gpointer data)
+{
+  net_data *nd = data;
+
+  if (nd->strength_timeout_id)
+    g_source_remove(nd->strength_timeout_id);
+
+  connui_cell_network_free(nd->state.network);
+  g_free(nd->state.operator_name);
+  g_free(nd);
+}
+
 #if 0
 static void
 net_reg_status_change_cb(DBusGProxy *proxy, guchar reg_status,
@@ -419,132 +977,313 @@ connui_cell_net_status_register(cell_network_state_cb cb, gpointer user_data)
   return TRUE;
 }
 
-static gchar *
-_mbpi_get_name(guint mcc, guint mnc)
+static gboolean
+_changed_initial_idle(gpointer user_data)
 {
-  xmlDocPtr doc;
-  gchar *name = NULL;
+  net_changed_cb *ncb = user_data;
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+  GHashTableIter iter;
+  gpointer modem;
 
-  doc = xmlParseFile(MBPI_DATABASE);
+  ncb->idle_id = 0;
+  g_hash_table_iter_init(&iter, ctx->modems);
+  ctx->net_changed_dispatching++;
 
-  if (doc)
+  while (g_hash_table_iter_next(&iter, NULL, &modem) && ncb->cb)
   {
-    /* Create xpath evaluation context */
-    xmlXPathContextPtr ctx = xmlXPathNewContext(doc);
+    net_data *nd = g_object_get_data(G_OBJECT(modem), DATA);
 
-    if (ctx)
-    {
-      gchar *xpath = g_strdup_printf(
-        "//network-id[@mcc='%03u' and @mnc='%02u']/../../name/text()", mcc,
-        mnc);
-      xmlXPathObjectPtr obj = xmlXPathEvalExpression(BAD_CAST xpath, ctx);
+    if (nd)
+      ncb->cb(nd->path, &nd->state, CONNUI_NET_CHANGED_ALL, ncb->user_data);
+  }
 
-      if (obj && obj->nodesetval)
-      {
-        xmlNodeSetPtr nodes = obj->nodesetval;
+  ctx->net_changed_dispatching--;
 
-        if (nodes->nodeNr)
-        {
-          xmlChar *content = xmlNodeGetContent(nodes->nodeTab[0]);
+  /* @ncb or others might have been closed from the callback */
+  _net_changed_cbs_sweep(ctx);
+  connui_cell_context_destroy(ctx);
 
-          name = g_strdup((const gchar *)content);
+  return G_SOURCE_REMOVE;
+}
 
-          xmlFree(content);
-        }
+/**
+ * connui_cell_net_status_changed_register:
+ * @mask: connui_net_changed bits @cb is interested in
+ * @cb: callback
+ * @user_data: user data passed to @cb
+ *
+ * Like connui_cell_net_status_register(), but @cb is called only when
+ * something in @mask has changed, and it gets all the changed bits. Right
+ * after registering, @cb gets the current state of every modem with
+ * CONNUI_NET_CHANGED_ALL.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+connui_cell_net_status_changed_register(guint mask,
+                                        cell_network_state_changed_cb cb,
+                                        gpointer user_data)
+{
+  connui_cell_context *ctx;
+  net_changed_cb *ncb;
 
-        xmlXPathFreeObject(obj);
-      }
-      else
-        CONNUI_ERR("Unable to evaluate xpath expression '%s'", xpath);
+  g_return_val_if_fail(cb != NULL, FALSE);
 
-      g_free(xpath);
-      xmlXPathFreeContext(ctx);
-    }
-    else
-      CONNUI_ERR("Unable to create new XPath context");
+  ctx = connui_cell_context_get(NULL);
+  g_return_val_if_fail(ctx != NULL, FALSE);
 
-    xmlFreeDoc(doc);
+  ncb = g_new0(net_changed_cb, 1);
+  ncb->cb = cb;
+  ncb->user_data = user_data;
+  ncb->mask = mask;
+  ncb->idle_id = g_idle_add(_changed_initial_idle, ncb);
+
+  ctx->net_changed_cbs = g_slist_append(ctx->net_changed_cbs, ncb);
+
+  return TRUE;
+}
+
+void
+connui_cell_net_status_changed_close(cell_network_state_changed_cb cb)
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+  GSList *l;
+
+  g_return_if_fail(ctx != NULL);
+
+  for (l = ctx->net_changed_cbs; l; l = l->next)
+  {
+    net_changed_cb *ncb = l->data;
+
+    if (ncb->cb == cb)
+    {
+      ncb->cb = NULL;
+
+      if (!ctx->net_changed_dispatching)
+        _net_changed_cb_free(ctx, ncb);
+
+      break;
+    }
   }
-  else
-    CONNUI_ERR("Unable to parse '" MBPI_DATABASE "'");
 
-  return name;
+  connui_cell_context_destroy(ctx);
+}
+
+/**
+ * connui_cell_net_set_strength_filter:
+ * @filter: new filter parameters
+ *
+ * Applies to Strength changes received from now on.
+ */
+void
+connui_cell_net_set_strength_filter(const connui_net_strength_filter *filter)
+{
+  g_return_if_fail(filter != NULL);
+
+  strength_filter = *filter;
+}
+
+void
+connui_cell_net_get_strength_filter(connui_net_strength_filter *filter)
+{
+  g_return_if_fail(filter != NULL);
+
+  *filter = strength_filter;
 }
 
+void
+connui_cell_net_get_strength_stats(connui_net_strength_stats *stats)
+{
+  g_return_if_fail(stats != NULL);
+
+  *stats = strength_stats;
+}
+
+/**
+ * connui_cell_net_get_operator_name:
+ * @network: network to get the name of
+ * @error: return location for error
+ *
+ * Does not block on ofono, name comes either from the names seen so far (the
+ * networks we registered to and operator lists), or from the
+ * mobile-broadband-provider-info database. Use
+ * connui_cell_net_get_operator_name_async() to query the modems as well.
+ *
+ * Returns:(transfer full): operator name or %NULL if not known.
+ */
 gchar *
 connui_cell_net_get_operator_name(cell_network *network, GError **error)
 {
-  gchar *name = NULL;
+  gchar *name;
   connui_cell_context *ctx;
-  GHashTableIter iter;
-  gpointer modem;
-  guint mcc;
-  guint mnc;
 
   g_return_val_if_fail(network != NULL, NULL);
 
   ctx = connui_cell_context_get(error);
   g_return_val_if_fail(ctx != NULL, NULL);
 
-  mcc = g_ascii_strtoll(network->country_code, NULL, 10);
-  mnc = g_ascii_strtoll(network->operator_code, NULL, 10);
+  name = _operator_name_lookup(ctx,
+                               g_ascii_strtoll(network->country_code, NULL, 10),
+                               g_ascii_strtoll(network->operator_code, NULL, 10));
 
-  g_hash_table_iter_init (&iter, ctx->modems);
+  connui_cell_context_destroy(ctx);
+
+  return name;
+}
+
+static void
+_operator_name_call_finish(service_call_data *scd)
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+  operator_name_call *onc = scd->async_data;
+  gchar *name = NULL;
+
+  g_assert(ctx);
+
+  if (!scd->error)
+    name = _operator_name_lookup(ctx, onc->mcc, onc->mnc);
+
+  service_call_take(ctx, scd->id);
+  ((cell_operator_name_cb)scd->callback)(name, scd->error, scd->user_data);
 
-  while (!name && g_hash_table_iter_next(&iter, NULL, &modem))
+  g_free(name);
+  g_free(onc);
+  service_call_destroy(ctx, scd);
+
+  connui_cell_context_destroy(ctx);
+}
+
+static gboolean
+_operator_name_idle(gpointer user_data)
+{
+  service_call_data *scd = user_data;
+  operator_name_call *onc = scd->async_data;
+
+  onc->idle_id = 0;
+  _operator_name_call_finish(scd);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+_operator_name_call_cancel(service_call_data *scd)
+{
+  operator_name_call *onc = scd->async_data;
+
+  g_source_remove(onc->idle_id);
+  onc->idle_id = 0;
+  g_set_error(&scd->error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+              "Operation was cancelled.");
+  _operator_name_call_finish(scd);
+}
+
+static void
+_get_operators_cb(GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  service_call_data *scd = user_data;
+  operator_name_call *onc = scd->async_data;
+  GVariant *operators;
+  GError *error = NULL;
+  gboolean ok = connui_cell_network_registration_call_get_operators_finish(
+        CONNUI_CELL_NETWORK_REGISTRATION(object), &operators, res, &error);
+
+  stats_call_end("NetworkRegistration.GetOperators", scd->stats_start, ok,
+                 &error);
+
+  if (ok)
   {
-    net_data *nd = g_object_get_data(G_OBJECT(modem), DATA);
+    connui_cell_context *ctx = connui_cell_context_get(NULL);
 
-    if (nd)
+    _operator_name_cache_add_operators(ctx, operators);
+    g_variant_unref(operators);
+    connui_cell_context_destroy(ctx);
+  }
+  else
+  {
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
     {
-      GVariant *operators;
-
-      if (connui_cell_network_registration_call_get_operators_sync(
-            nd->proxy, &operators, NULL, NULL))
-      {
-        GVariantIter i;
-        GVariant *dict;
-
-        g_variant_iter_init(&i, operators);
-
-        while (!name && g_variant_iter_next (&i, "(&o@a{sv})", NULL, &dict))
-        {
-          const gchar *s;
-
-          if (g_variant_lookup(dict, "MobileCountryCode", "&s", &s) &&
-              mcc == g_ascii_strtoll(s, NULL, 10) &&
-              g_variant_lookup(dict, "MobileNetworkCode", "&s", &s) &&
-              mnc == g_ascii_strtoll(s, NULL, 10) &&
-              g_variant_lookup(dict, "Name", "&s", &s))
-          {
-            name = g_strdup(s);
-          }
-        }
-
-        g_variant_unref(operators);
-      }
+      if (!scd->error)
+        scd->error = g_error_copy(error);
     }
+    else
+      CONNUI_ERR("Unable to get operators [%s]", error->message);
+
+    g_error_free(error);
   }
 
-  if (name && *name)
+  if (!--onc->pending)
+    _operator_name_call_finish(scd);
+}
+
+/**
+ * connui_cell_net_get_operator_name_async:
+ * @network: network to get the name of
+ * @cb: callback to call with the result
+ * @user_data: user data passed to @cb
+ *
+ * Like connui_cell_net_get_operator_name(), but if the name is not known,
+ * operator lists are fetched from all modems before giving up.
+ *
+ * Returns: id of the service call, can be used with
+ *          connui_cell_cancel_service_call(), 0 on error.
+ */
+guint
+connui_cell_net_get_operator_name_async(const cell_network *network,
+                                        cell_operator_name_cb cb,
+                                        gpointer user_data)
+{
+  connui_cell_context *ctx;
+  operator_name_call *onc;
+  service_call_data *scd;
+  GHashTableIter iter;
+  gpointer modem;
+  guint id;
+
+  g_return_val_if_fail(network != NULL, 0);
+  g_return_val_if_fail(cb != NULL, 0);
+
+  ctx = connui_cell_context_get(NULL);
+  g_return_val_if_fail(ctx != NULL, 0);
+
+  onc = g_new0(operator_name_call, 1);
+  onc->mcc = g_ascii_strtoll(network->country_code, NULL, 10);
+  onc->mnc = g_ascii_strtoll(network->operator_code, NULL, 10);
+
+  scd = service_call_add(ctx, (GCallback)cb, user_data);
+  id = scd->id;
+  scd->async_data = onc;
+
+  if (!ctx->operator_names ||
+      !g_hash_table_contains(ctx->operator_names,
+                             PLMN_KEY(onc->mcc, onc->mnc)))
   {
-    connui_cell_context_destroy(ctx);
-    return name;
-  }
+    scd->cancellable = g_cancellable_new();
+    g_hash_table_iter_init(&iter, ctx->modems);
 
-  g_free(name);
+    while (g_hash_table_iter_next(&iter, NULL, &modem))
+    {
+      net_data *nd = g_object_get_data(G_OBJECT(modem), DATA);
 
-  name = _mbpi_get_name(mcc, mnc);
+      if (nd)
+      {
+        onc->pending++;
+        /* close enough, they are all sent at once */
+        service_call_begin(scd, "NetworkRegistration.GetOperators");
+        connui_cell_network_registration_call_get_operators(
+              nd->proxy, scd->cancellable, _get_operators_cb, scd);
+      }
+    }
+  }
 
-  if (name && !*name)
+  if (!onc->pending)
   {
-    g_free(name);
-    name = NULL;
+    scd->cancel = _operator_name_call_cancel;
+    onc->idle_id = g_idle_add(_operator_name_idle, scd);
   }
 
   connui_cell_context_destroy(ctx);
 
-  return name;
+  return id;
 }
 
 connui_net_selection_mode
@@ -595,34 +1334,6 @@ connui_cell_net_get_radio_access_mode(const char *modem_id,
   return rat;
 }
 
-static service_call *
-add_service_call(connui_cell_context *ctx, guint call_id, DBusGProxy *proxy,
-                 DBusGProxyCall *proxy_call, service_call_cb_f cb,
-                 gpointer user_data)
-{
-  service_call *call = g_new0(service_call, 1);
-
-  call->proxy = proxy;
-  call->proxy_call = proxy_call;
-  call->cb = cb;
-  call->data = user_data;
-
-  if (!ctx->service_calls)
-    ctx->service_calls = g_hash_table_new(g_direct_hash, g_direct_equal);
-
-  g_hash_table_insert(ctx->service_calls, GUINT_TO_POINTER(call_id), call);
-
-  return call;
-}
-
-static guint
-get_next_call_id(connui_cell_context *ctx)
-{
-  ctx->service_call_id++;
-
-  return ctx->service_call_id;
-}
-
 typedef void (*net_divert_reply_f)(DBusGProxy *, GError *, gpointer);
 
 #if 0
@@ -741,8 +1452,7 @@ connui_cell_net_set_call_forwarding_enabled(gboolean enabled,
                                             gpointer user_data)
 {
   connui_cell_context *ctx = connui_cell_context_get(NULL);
-  DBusGProxy *proxy;
-  DBusGProxyCall *proxy_call;
+  service_call_data *scd;
   guint call_id;
   sim_status_data *data;
 
@@ -753,7 +1463,8 @@ connui_cell_net_set_call_forwarding_enabled(gboolean enabled,
 
   g_return_val_if_fail(ctx != NULL, 0);
 
-  call_id = get_next_call_id(ctx);
+  scd = service_call_add(ctx, (GCallback)cb, user_data);
+  call_id = scd->id;
   data = g_slice_new(sim_status_data);
   data->data = GUINT_TO_POINTER(call_id);
 
@@ -783,8 +1494,6 @@ connui_cell_net_set_call_forwarding_enabled(gboolean enabled,
 #endif
   }
 
-  add_service_call(ctx, call_id, proxy, proxy_call, cb, user_data);
-
   connui_cell_context_destroy(ctx);
 
   return call_id;
@@ -833,6 +1542,8 @@ net_list_cb(DBusGProxy *proxy, GArray *status_array,
       net->operator_code = g_array_index(operator_code_array, gchar *, i);
       net->operator_name = g_array_index(operator_name_array, gchar *, i);
       net->umts_avail = g_array_index(umts_avail_array, guchar, i);
+      _operator_name_cache_add(ctx, net->country_code, net->operator_code,
+                               net->operator_name, FALSE);
       l = g_slist_append(l, net);
     }
 
@@ -1272,10 +1983,9 @@ connui_cell_net_get_caller_id_anonymity(cell_get_anonymity_cb cb,
 
   if (manager)
   {
-    gint id = service_call_next_id(ctx);
     service_call_data *scd;
 
-    scd = service_call_add(ctx, id, (GCallback)cb, user_data);
+    scd = service_call_add(ctx, (GCallback)cb, user_data);
     tp_proxy_prepare_async(manager, NULL, _cid_get_cb, scd);
     g_object_unref(manager);
     rv = TRUE;
@@ -1288,6 +1998,18 @@ connui_cell_net_get_caller_id_anonymity(cell_get_anonymity_cb cb,
   return rv;
 }
 
+static void
+_cid_set_done(service_call_data *scd)
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+
+  if (scd->callback)
+    ((cell_set_cb)scd->callback)(scd->error, scd->user_data);
+
+  service_call_remove(ctx, scd->id);
+  connui_cell_context_destroy(ctx);
+}
+
 static void
 _cid_update_parameter_cb(GObject *object, GAsyncResult *res, gpointer user_data)
 {
@@ -1303,10 +2025,7 @@ _cid_update_parameter_cb(GObject *object, GAsyncResult *res, gpointer user_data)
 
   g_strfreev(reconnect_required);
 
-  if (scd->callback)
-    ((cell_set_cb)scd->callback)(scd->error, scd->user_data);
-
-  service_call_destroy(scd);
+  _cid_set_done(scd);
 }
 
 static void
@@ -1331,17 +2050,17 @@ _cid_set_cb(GObject *object, GAsyncResult *res, gpointer user_data)
       tp_account_update_parameters_async(
             ring_account, set, unset, _cid_update_parameter_cb, user_data);
       g_object_unref(ring_account);
+
+      return;
     }
+
+    g_set_error(&scd->error, CONNUI_ERROR, CONNUI_ERROR_NOT_FOUND,
+                "No ring account");
   }
   else
-  {
     CONNUI_ERR("Error preparing TpAccountManager: %s", scd->error->message);
 
-    if (scd->callback)
-      ((cell_set_cb)scd->callback)(scd->error, scd->user_data);
-
-    service_call_destroy(scd);
-  }
+  _cid_set_done(scd);
 }
 
 gboolean
@@ -1349,6 +2068,7 @@ connui_cell_net_set_caller_id_anonymity(guint anonimity, cell_set_cb cb,
                                         gpointer user_data)
 {
   TpAccountManager *manager = tp_account_manager_dup();
+  connui_cell_context *ctx;
   service_call_data *scd;
 
   if (!manager)
@@ -1357,13 +2077,13 @@ connui_cell_net_set_caller_id_anonymity(guint anonimity, cell_set_cb cb,
     return FALSE;
   }
 
-  scd = g_new0(service_call_data, 1);
-  scd->callback = G_CALLBACK(cb);
-  scd->user_data = user_data;
+  ctx = connui_cell_context_get(NULL);
+  scd = service_call_add(ctx, G_CALLBACK(cb), user_data);
   scd->async_data = GUINT_TO_POINTER(anonimity);
 
   tp_proxy_prepare_async(manager, NULL, _cid_set_cb, scd);
   g_object_unref(manager);
+  connui_cell_context_destroy(ctx);
 
   return TRUE;
 }
@@ -21,13 +21,29 @@
 #define __CONNUI_INTERNAL_NET_H_INCLUDED__
 
 #include "ofono.h"
+#include "property.h"
 #include "org.ofono.Modem.h"
 #include "org.ofono.NetworkRegistration.h"
 
 void
-connui_cell_modem_add_netreg(connui_cell_context *ctx, const char *path);
+connui_cell_modem_add_netreg(connui_cell_context *ctx, const char *path,
+                             GCancellable *cancellable);
 
 void
 connui_cell_modem_remove_netreg(ConnuiCellModem *modem);
 
+/* NetworkRegistration PropertyChanged handlers, by property name */
+property_table *
+connui_cell_net_properties(void);
+
+/*
+ * state the handlers work on, not attached to a modem and never notified,
+ * for tests/bench-property
+ */
+gpointer
+connui_cell_net_data_new_detached(connui_cell_context *ctx);
+
+void
+connui_cell_net_data_free_detached(gpointer data);
+
 #endif /* __CONNUI_NET_INTERNAL_H_INCLUDED__ */
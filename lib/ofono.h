@@ -19,7 +19,7 @@
 
 /* partially borrowed from libgofono */
 
-#define OFONO_BUS_TYPE                            G_BUS_TYPE_SYSTEM
+#define OFONO_BUS_TYPE                            connui_cell_context_bus_type()
 
 #ifndef __CONNUI_INTERNAL_OFONO_H_INCLUDED__
 #define __CONNUI_INTERNAL_OFONO_H_INCLUDED__
@@ -89,6 +89,11 @@
 #define OFONO_SIMMGR_PROPERTY_SPN                "ServiceProviderName"
 #define OFONO_SIMMGR_PROPERTY_PIN_REQUIRED       "PinRequired"
 #define OFONO_SIMMGR_PROPERTY_LOCKED_PINS        "LockedPins"
+#define OFONO_SIMMGR_PROPERTY_RETRIES            "Retries"
+#define OFONO_SIMMGR_PROPERTY_CARD_IDENTIFIER    "CardIdentifier"
+#define OFONO_SIMMGR_PROPERTY_SUBSCRIBER_NUMBERS "SubscriberNumbers"
+#define OFONO_SIMMGR_PROPERTY_FIXED_DIALING      "FixedDialing"
+#define OFONO_SIMMGR_PROPERTY_BARRED_DIALING     "BarredDialing"
 
 /* org.ofono.ConnectionManager */
 #define OFONO_CONNMGR_PROPERTY_ATTACHED          "Attached"
@@ -120,6 +125,18 @@
 #define OFONO_CONNCTX_SETTINGS_DNS               "DomainNameServers"
 #define OFONO_CONNCTX_SETTINGS_PCSCF             "ProxyCSCF" /* Since 2.0.12 */
 
+/* org.ofono.VoiceCallManager */
+#define OFONO_VCM_PROPERTY_EMERGENCY_NUMBERS     "EmergencyNumbers"
+
+/* org.ofono.CallForwarding */
+#define OFONO_CALLFWD_PROPERTY_UNCONDITIONAL     "VoiceUnconditional"
+#define OFONO_CALLFWD_PROPERTY_BUSY              "VoiceBusy"
+#define OFONO_CALLFWD_PROPERTY_NO_REPLY          "VoiceNoReply"
+#define OFONO_CALLFWD_PROPERTY_NOT_REACHABLE     "VoiceNotReachable"
+
+/* org.ofono.CallSettings */
+#define OFONO_CALLSET_PROPERTY_CALL_WAITING      "VoiceCallWaiting"
+
 /* org.ofono.NetworkRegistration */
 #define OFONO_NETREG_PROPERTY_STATUS             "Status"
 #define OFONO_NETREG_PROPERTY_MODE               "Mode"
@@ -0,0 +1,100 @@
+/*
+ * property.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <glib.h>
+
+#include "property.h"
+
+/*
+ * Both tables are keyed by interned property names/values, so a lookup is
+ * g_quark_try_string() plus a direct hash, no matter the size of the table.
+ * Strings that were never interned are not in any table, so they are rejected
+ * without touching it at all.
+ */
+
+static GHashTable *
+_index_new()
+{
+  return g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+static void
+_index_add(GHashTable *index, const gchar *s, gconstpointer data)
+{
+  g_hash_table_insert(index,
+                      GUINT_TO_POINTER(g_quark_from_static_string(s)),
+                      (gpointer)data);
+}
+
+static gpointer
+_index_lookup(GHashTable *index, const gchar *s)
+{
+  GQuark q = g_quark_try_string(s);
+
+  if (!q)
+    return NULL;
+
+  return g_hash_table_lookup(index, GUINT_TO_POINTER(q));
+}
+
+__attribute__((visibility("hidden"))) gboolean
+property_dispatch(property_table *table, gpointer data, const gchar *name,
+                  GVariant *value)
+{
+  const property_entry *entry;
+
+  if (G_UNLIKELY(!table->index))
+  {
+    table->index = _index_new();
+
+    for (entry = table->entries; entry->name; entry++)
+      _index_add(table->index, entry->name, entry);
+  }
+
+  entry = _index_lookup(table->index, name);
+
+  if (!entry)
+    return FALSE;
+
+  return entry->handler(data, value);
+}
+
+__attribute__((visibility("hidden"))) gint
+property_enum_get(property_enum *e, const gchar *value)
+{
+  const property_enum_entry *entry;
+
+  if (G_UNLIKELY(!e->index))
+  {
+    e->index = _index_new();
+
+    for (entry = e->entries; entry->value; entry++)
+      _index_add(e->index, entry->value, entry);
+  }
+
+  if (!value)
+    return e->unknown;
+
+  entry = _index_lookup(e->index, value);
+
+  if (!entry)
+    return e->unknown;
+
+  return entry->id;
+}
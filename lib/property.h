@@ -0,0 +1,68 @@
+/*
+ * property.h
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __CONNUI_INTERNAL_PROPERTY_H_INCLUDED__
+#define __CONNUI_INTERNAL_PROPERTY_H_INCLUDED__
+
+/* returns TRUE if the change has to be notified */
+typedef gboolean (*property_handler)(gpointer data, GVariant *value);
+
+typedef struct _property_entry
+{
+  const gchar *name;
+  property_handler handler;
+}
+property_entry;
+
+/* maps ofono property names to handlers, index is built on first use */
+typedef struct _property_table
+{
+  const property_entry *entries;
+  GHashTable *index;
+}
+property_table;
+
+#define PROPERTY_TABLE(entries) { entries, NULL }
+
+typedef struct _property_enum_entry
+{
+  const gchar *value;
+  gint id;
+}
+property_enum_entry;
+
+/* maps enumerated string values of a property to ids */
+typedef struct _property_enum
+{
+  const property_enum_entry *entries;
+  gint unknown;
+  GHashTable *index;
+}
+property_enum;
+
+#define PROPERTY_ENUM(entries, unknown) { entries, unknown, NULL }
+
+gboolean
+property_dispatch(property_table *table, gpointer data, const gchar *name,
+                  GVariant *value);
+
+gint
+property_enum_get(property_enum *e, const gchar *value);
+
+#endif /* __CONNUI_INTERNAL_PROPERTY_H_INCLUDED__ */
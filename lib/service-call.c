@@ -19,37 +19,71 @@
 
 #include <connui/connui-log.h>
 
+#include <string.h>
+
 #include "context.h"
 #include "service-call.h"
+#include "stats.h"
 
-__attribute__((visibility("hidden"))) guint
-service_call_next_id(connui_cell_context *ctx)
+/* free records kept for reuse */
+#define SERVICE_CALL_POOL_MAX 16
+
+/*
+ * The registry is created on first use and kept for the lifetime of the
+ * process, as is the id counter, so an id is never handed out twice (unless
+ * the counter wraps) and late callbacks of cancelled calls cannot match a
+ * newer call.
+ */
+static GHashTable *
+service_call_registry(connui_cell_context *ctx)
 {
-  ++ctx->service_call_id;
+  if (!ctx->service_calls)
+    ctx->service_calls = g_hash_table_new(g_direct_hash, g_direct_equal);
 
-  return ctx->service_call_id;
+  return ctx->service_calls;
 }
 
 __attribute__((visibility("hidden"))) service_call_data *
-service_call_add(connui_cell_context *ctx, guint id, GCallback cb,
-                 gpointer user_data)
+service_call_add(connui_cell_context *ctx, GCallback cb, gpointer user_data)
 {
-  service_call_data *scd = g_new0(service_call_data, 1);
+  GHashTable *calls = service_call_registry(ctx);
+  service_call_data *scd = ctx->service_call_pool;
+  guint id;
+
+  if (scd)
+  {
+    ctx->service_call_pool = scd->next;
+    ctx->service_call_pool_size--;
+    memset(scd, 0, sizeof(*scd));
+  }
+  else
+    scd = g_slice_new0(service_call_data);
+
+  do
+  {
+    id = ++ctx->service_call_id;
+  }
+  while (!id || g_hash_table_contains(calls, GUINT_TO_POINTER(id)));
 
   scd->callback = cb;
   scd->user_data = user_data;
   scd->id = id;
+  scd->start_time = g_get_monotonic_time();
 
-  if (!ctx->service_calls)
-    ctx->service_calls = g_hash_table_new(g_direct_hash, g_direct_equal);
-
-  g_hash_table_insert(ctx->service_calls, GUINT_TO_POINTER(id), scd);
+  g_hash_table_insert(calls, GUINT_TO_POINTER(id), scd);
 
   return scd;
 }
 
 __attribute__((visibility("hidden"))) void
-service_call_destroy(service_call_data *scd)
+service_call_begin(service_call_data *scd, const gchar *method)
+{
+  scd->method = method;
+  scd->stats_start = stats_call_begin(method);
+}
+
+__attribute__((visibility("hidden"))) void
+service_call_destroy(connui_cell_context *ctx, service_call_data *scd)
 {
   if (!scd)
     return;
@@ -59,17 +93,32 @@ service_call_destroy(service_call_data *scd)
   if (scd->cancellable)
     g_object_unref(scd->cancellable);
 
-  g_free(scd);
+  if (ctx->service_call_pool_size < SERVICE_CALL_POOL_MAX)
+  {
+    scd->next = ctx->service_call_pool;
+    ctx->service_call_pool = scd;
+    ctx->service_call_pool_size++;
+  }
+  else
+    g_slice_free(service_call_data, scd);
+}
+
+static service_call_data *
+service_call_lookup(connui_cell_context *ctx, guint id)
+{
+  if (!ctx->service_calls)
+    return NULL;
+
+  return g_hash_table_lookup(ctx->service_calls, GUINT_TO_POINTER(id));
 }
 
 static service_call_data *
 service_call_find(connui_cell_context *ctx, guint id)
 {
-  service_call_data *call =
-      g_hash_table_lookup(ctx->service_calls, GUINT_TO_POINTER(id));
+  service_call_data *call = service_call_lookup(ctx, id);
 
   if (!call)
-    CONNUI_ERR("Unable to find call ID %d", id);
+    CONNUI_ERR("Unable to find call ID %u", id);
 
   return call;
 }
@@ -80,50 +129,39 @@ service_call_remove(connui_cell_context *ctx, guint id)
   service_call_data *scd = service_call_take(ctx, id);
 
   if (scd)
-    service_call_destroy(scd);
+    service_call_destroy(ctx, scd);
 }
 
 __attribute__((visibility("hidden"))) service_call_data *
 service_call_take(connui_cell_context *ctx, guint id)
 {
-  service_call_data *scd;
-
-  if (!ctx->service_calls)
-  {
-    CONNUI_ERR("Unable to find any service calls to take");
-    return NULL;
-  }
-
-  scd = service_call_find(ctx, id);
+  service_call_data *scd = service_call_find(ctx, id);
 
   if (scd)
-  {
     g_hash_table_remove(ctx->service_calls, GUINT_TO_POINTER(id));
 
-    if (!g_hash_table_size(ctx->service_calls))
-    {
-      g_hash_table_destroy(ctx->service_calls);
-      ctx->service_call_id = 0;
-      ctx->service_calls = NULL;
-    }
-  }
-
   return scd;
 }
 
+__attribute__((visibility("hidden"))) guint
+service_call_count(connui_cell_context *ctx)
+{
+  return ctx->service_calls ? g_hash_table_size(ctx->service_calls) : 0;
+}
+
 void
 connui_cell_cancel_service_call(guint id)
 {
   connui_cell_context *ctx = connui_cell_context_get(NULL);
+  service_call_data *scd;
 
   g_return_if_fail(ctx != NULL);
 
-  if (ctx->service_calls && id)
-  {
-    service_call_data *scd = service_call_find(ctx, id);
-
-    g_return_if_fail(scd != NULL);
+  /* the call might have completed already, nothing to cancel then */
+  scd = id ? service_call_lookup(ctx, id) : NULL;
 
+  if (scd)
+  {
     if (scd->cancellable)
       g_cancellable_cancel(scd->cancellable);
     else if (scd->cancel)
@@ -134,3 +172,86 @@ connui_cell_cancel_service_call(guint id)
 
   connui_cell_context_destroy(ctx);
 }
+
+static gint
+_service_call_info_cmp(gconstpointer a, gconstpointer b)
+{
+  const connui_cell_service_call_info *ia = a;
+  const connui_cell_service_call_info *ib = b;
+
+  if (ia->age == ib->age)
+    return 0;
+
+  return ia->age > ib->age ? -1 : 1;
+}
+
+/**
+ * connui_cell_service_calls_get:
+ *
+ * Lists the service calls still in flight, to help debugging stuck
+ * operations.
+ *
+ * Returns:(transfer full): list of connui_cell_service_call_info, oldest
+ * first, free with g_list_free_full(list, g_free)
+ */
+GList *
+connui_cell_service_calls_get()
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+  gint64 now = g_get_monotonic_time();
+  GList *l = NULL;
+  GHashTableIter iter;
+  service_call_data *scd;
+
+  g_return_val_if_fail(ctx != NULL, NULL);
+
+  if (!ctx->service_calls)
+  {
+    connui_cell_context_destroy(ctx);
+    return NULL;
+  }
+
+  g_hash_table_iter_init(&iter, ctx->service_calls);
+
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&scd))
+  {
+    connui_cell_service_call_info *info =
+        g_new(connui_cell_service_call_info, 1);
+
+    info->id = scd->id;
+    info->method = scd->method;
+    info->age = now - scd->start_time;
+    info->cancelled = scd->cancellable &&
+        g_cancellable_is_cancelled(scd->cancellable);
+    l = g_list_prepend(l, info);
+  }
+
+  connui_cell_context_destroy(ctx);
+
+  return g_list_sort(l, _service_call_info_cmp);
+}
+
+/**
+ * connui_cell_service_calls_dump:
+ *
+ * Logs the service calls still in flight.
+ */
+void
+connui_cell_service_calls_dump()
+{
+  GList *calls = connui_cell_service_calls_get();
+  GList *l;
+
+  g_message("%u service calls in flight", g_list_length(calls));
+
+  for (l = calls; l; l = l->next)
+  {
+    connui_cell_service_call_info *info = l->data;
+
+    g_message("%u: %s for %" G_GINT64_FORMAT "ms%s", info->id,
+              info->method ? info->method : "(unnamed)", info->age / 1000,
+              info->cancelled ? ", cancelled" : "");
+  }
+
+  g_list_free_full(calls, g_free);
+}
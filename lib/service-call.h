@@ -34,20 +34,31 @@ typedef struct _service_call_data
   GCancellable *cancellable;
   void (*cancel)(struct _service_call_data *scd);
   GError *error;
+
+  /* see stats_call_begin() */
+  gint64 stats_start;
+
+  /* for connui_cell_service_calls_get() */
+  const gchar *method;
+  gint64 start_time;
+
+  /* next free record in the pool */
+  struct _service_call_data *next;
 }
 service_call_data;
 
-guint
-service_call_next_id(connui_cell_context *ctx);
-
 service_call_data *
-service_call_add(connui_cell_context *ctx, guint id, GCallback cb,
-                 gpointer user_data);
+service_call_add(connui_cell_context *ctx, GCallback cb, gpointer user_data);
+/* names the ofono method the call waits for and starts its stats */
+void
+service_call_begin(service_call_data *scd, const gchar *method);
 void
-service_call_destroy(service_call_data *scd);
+service_call_destroy(connui_cell_context *ctx, service_call_data *scd);
 void
 service_call_remove(connui_cell_context *ctx, guint id);
 service_call_data *
 service_call_take(connui_cell_context *ctx, guint id);
+guint
+service_call_count(connui_cell_context *ctx);
 
 #endif /* __CONNUI_INTERNAL_SERVICE_CALL_H_INCLUDED__ */
@@ -3,7 +3,6 @@
 #include <libosso.h>
 #include <connui/connui-utils.h>
 #include <connui/connui-log.h>
-#include <libxml/xpath.h>
 
 #include <string.h>
 
@@ -11,7 +10,40 @@
 
 #include "connui-cellular-sim.h"
 
+#include "service-call.h"
 #include "sim.h"
+#include "mbpi.h"
+#include "property.h"
+#include "stats.h"
+
+/* all ofono pin types, first ones match connui_sim_security_code_type */
+typedef enum
+{
+  SIM_LOCK_NONE = CONNUI_SIM_SECURITY_CODE_NONE,
+  SIM_LOCK_PIN = CONNUI_SIM_SECURITY_CODE_PIN,
+  SIM_LOCK_PUK = CONNUI_SIM_SECURITY_CODE_PUK,
+  SIM_LOCK_PIN2 = CONNUI_SIM_SECURITY_CODE_PIN2,
+  SIM_LOCK_PUK2 = CONNUI_SIM_SECURITY_CODE_PUK2,
+  SIM_LOCK_PHONE,
+  SIM_LOCK_FIRSTPHONE,
+  SIM_LOCK_NETWORK,
+  SIM_LOCK_NETSUB,
+  SIM_LOCK_SERVICE,
+  SIM_LOCK_CORP,
+  SIM_LOCK_FIRSTPHONEPUK,
+  SIM_LOCK_NETWORKPUK,
+  SIM_LOCK_NETSUBPUK,
+  SIM_LOCK_SERVICEPUK,
+  SIM_LOCK_CORPPUK,
+  SIM_LOCK_COUNT
+}
+sim_lock;
+
+#define SIM_LOCK_BIT(l) (1 << (l))
+
+/* phone and network personalisation, aka simlock */
+#define SIM_LOCK_SIMLOCK_MASK \
+  ((SIM_LOCK_BIT(SIM_LOCK_COUNT) - 1) & ~(SIM_LOCK_BIT(SIM_LOCK_PHONE) - 1))
 
 typedef struct _sim_data
 {
@@ -26,11 +58,20 @@ typedef struct _sim_data
   gchar *spn;
   connui_sim_security_code_type pin_required;
   gchar *pin_required_s;
-  gboolean locked_pin[4];
+  guint locked_pins;
+  guint retries_valid;
+  guchar retries[SIM_LOCK_COUNT];
+  gchar *card_identifier;
+  gchar **subscriber_numbers;
+  gboolean fixed_dialing;
+  gboolean barred_dialing;
 
   gulong properties_changed_id;
   guint idle_status_id;
   guint idle_security_code_id;
+  /* a code query or verification is running a nested main loop */
+  gboolean verifying;
+  gboolean security_code_pending;
 }
 sim_data;
 
@@ -77,6 +118,8 @@ _sim_data_destroy(gpointer data)
   g_free(sd->imsi);
   g_free(sd->spn);
   g_free(sd->pin_required_s);
+  g_free(sd->card_identifier);
+  g_strfreev(sd->subscriber_numbers);
 
   if (sd->idle_status_id)
     g_source_remove(sd->idle_status_id);
@@ -153,6 +196,12 @@ _idle_notify_security_code(gpointer user_data)
 
   sd->idle_security_code_id = 0;
 
+  if (sd->verifying)
+  {
+    sd->security_code_pending = TRUE;
+    return G_SOURCE_REMOVE;
+  }
+
   if (status == CONNUI_SIM_STATUS_OK_PIN_REQUIRED ||
       status == CONNUI_SIM_STATUS_OK_PUK_REQUIRED)
   {
@@ -165,7 +214,13 @@ _idle_notify_security_code(gpointer user_data)
 static void
 _notify_security_code(sim_data *sd)
 {
-  if (sd && !sd->idle_security_code_id)
+  if (!sd)
+    return;
+
+  /* do not stack another query on the one in progress, re-check after it */
+  if (sd->verifying)
+    sd->security_code_pending = TRUE;
+  else if (!sd->idle_security_code_id)
     sd->idle_security_code_id = g_idle_add(_idle_notify_security_code, sd);
 }
 
@@ -181,22 +236,23 @@ _notify_security_code_all(connui_cell_context *ctx)
     _notify_security_code(g_object_get_data(G_OBJECT(modem), DATA));
 }
 
+static const property_enum_entry code_type_entries[] =
+{
+  {"none", CONNUI_SIM_SECURITY_CODE_NONE},
+  {"pin", CONNUI_SIM_SECURITY_CODE_PIN},
+  {"puk", CONNUI_SIM_SECURITY_CODE_PUK},
+  {"pin2", CONNUI_SIM_SECURITY_CODE_PIN2},
+  {"puk2", CONNUI_SIM_SECURITY_CODE_PUK2},
+  {NULL, 0}
+};
+
+static property_enum code_type =
+    PROPERTY_ENUM(code_type_entries, CONNUI_SIM_SECURITY_CODE_UNSUPPORTED);
+
 static connui_sim_security_code_type
 _get_code_type(const gchar *type)
 {
-
-  if (!strcmp(type, "none"))
-    return CONNUI_SIM_SECURITY_CODE_NONE;
-  else if (!strcmp(type, "pin"))
-    return  CONNUI_SIM_SECURITY_CODE_PIN;
-  else if (!strcmp(type, "puk"))
-    return CONNUI_SIM_SECURITY_CODE_PUK;
-  else if (!strcmp(type, "pin2"))
-    return CONNUI_SIM_SECURITY_CODE_PIN2;
-  else if (!strcmp(type, "puk2"))
-    return CONNUI_SIM_SECURITY_CODE_PUK2;
-  else
-    return CONNUI_SIM_SECURITY_CODE_UNSUPPORTED;
+  return property_enum_get(&code_type, type);
 }
 
 static void
@@ -213,68 +269,216 @@ _get_pin_required(sim_data *sd, GVariant *value)
   sd->pin_required = _get_code_type(pin_required);
 }
 
+static const property_enum_entry lock_type_entries[] =
+{
+  {"none", SIM_LOCK_NONE},
+  {"pin", SIM_LOCK_PIN},
+  {"puk", SIM_LOCK_PUK},
+  {"pin2", SIM_LOCK_PIN2},
+  {"puk2", SIM_LOCK_PUK2},
+  {"phone", SIM_LOCK_PHONE},
+  {"firstphone", SIM_LOCK_FIRSTPHONE},
+  {"network", SIM_LOCK_NETWORK},
+  {"netsub", SIM_LOCK_NETSUB},
+  {"service", SIM_LOCK_SERVICE},
+  {"corp", SIM_LOCK_CORP},
+  {"firstphonepuk", SIM_LOCK_FIRSTPHONEPUK},
+  {"networkpuk", SIM_LOCK_NETWORKPUK},
+  {"netsubpuk", SIM_LOCK_NETSUBPUK},
+  {"servicepuk", SIM_LOCK_SERVICEPUK},
+  {"corppuk", SIM_LOCK_CORPPUK},
+  {NULL, 0}
+};
+
+static property_enum lock_type =
+    PROPERTY_ENUM(lock_type_entries, SIM_LOCK_COUNT);
+
 static void
 _get_locked_pins(sim_data *sd, GVariant *value)
 {
-  const gchar **pins;
-  const gchar **pin;
-  int i;
+  GVariantIter iter;
+  const gchar *pin;
 
-  for (i = 0; i < G_N_ELEMENTS(sd->locked_pin); i++)
-    sd->locked_pin[i] = FALSE;
+  sd->locked_pins = 0;
 
-  pins = g_variant_get_strv(value, NULL);
+  g_variant_iter_init(&iter, value);
 
-  if (!pins)
-    return;
+  while (g_variant_iter_next(&iter, "&s", &pin))
+  {
+    sim_lock lock = property_enum_get(&lock_type, pin);
+
+    if (lock != SIM_LOCK_COUNT)
+      sd->locked_pins |= SIM_LOCK_BIT(lock);
+  }
+}
 
-  for (pin = pins; *pin; pin++)
+static void
+_get_retries(sim_data *sd, GVariant *value)
+{
+  GVariantIter iter;
+  const gchar *pin;
+  guchar retries;
+
+  sd->retries_valid = 0;
+
+  g_variant_iter_init(&iter, value);
+
+  while (g_variant_iter_next(&iter, "{&sy}", &pin, &retries))
   {
-    int idx = _get_code_type(*pin) - 1;
+    sim_lock lock = property_enum_get(&lock_type, pin);
 
-    if (idx >= 0 && idx < G_N_ELEMENTS(sd->locked_pin))
-      sd->locked_pin[idx] = TRUE;
+    if (lock != SIM_LOCK_COUNT)
+    {
+      sd->retries[lock] = retries;
+      sd->retries_valid |= SIM_LOCK_BIT(lock);
+    }
   }
+}
+
+static gboolean
+_parse_present(gpointer data, GVariant *value)
+{
+  sim_data *sd = data;
+
+  sd->present = g_variant_get_boolean(value);
+
+  return TRUE;
+}
+
+static gboolean
+_parse_mcc(gpointer data, GVariant *value)
+{
+  sim_data *sd = data;
 
-  g_free(pins);
+  sd->mcc = atoi(g_variant_get_string(value, NULL));
+
+  return FALSE;
 }
 
 static gboolean
-_parse_property(sim_data *sd, const gchar *name, GVariant *value)
+_parse_mnc(gpointer data, GVariant *value)
+{
+  sim_data *sd = data;
+
+  sd->mnc = atoi(g_variant_get_string(value, NULL));
+
+  return FALSE;
+}
+
+static gboolean
+_parse_imsi(gpointer data, GVariant *value)
+{
+  sim_data *sd = data;
+
+  g_free(sd->imsi);
+  sd->imsi = g_strdup((g_variant_get_string(value, NULL)));
+
+  return FALSE;
+}
+
+static gboolean
+_parse_spn(gpointer data, GVariant *value)
+{
+  sim_data *sd = data;
+
+  g_free(sd->spn);
+  sd->spn = g_strdup((g_variant_get_string(value, NULL)));
+
+  return FALSE;
+}
+
+static gboolean
+_parse_pin_required(gpointer data, GVariant *value)
+{
+  _get_pin_required(data, value);
+
+  return TRUE;
+}
+
+static gboolean
+_parse_locked_pins(gpointer data, GVariant *value)
+{
+  _get_locked_pins(data, value);
+
+  return FALSE;
+}
+
+static gboolean
+_parse_retries(gpointer data, GVariant *value)
+{
+  _get_retries(data, value);
+
+  return FALSE;
+}
+
+static gboolean
+_parse_card_identifier(gpointer data, GVariant *value)
+{
+  sim_data *sd = data;
+
+  g_free(sd->card_identifier);
+  sd->card_identifier = g_variant_dup_string(value, NULL);
+
+  return FALSE;
+}
+
+static gboolean
+_parse_subscriber_numbers(gpointer data, GVariant *value)
+{
+  sim_data *sd = data;
+
+  g_strfreev(sd->subscriber_numbers);
+  sd->subscriber_numbers = g_variant_dup_strv(value, NULL);
+
+  return FALSE;
+}
+
+static gboolean
+_parse_fixed_dialing(gpointer data, GVariant *value)
 {
-  gboolean notify = FALSE;
+  sim_data *sd = data;
 
+  sd->fixed_dialing = g_variant_get_boolean(value);
+
+  return FALSE;
+}
+
+static gboolean
+_parse_barred_dialing(gpointer data, GVariant *value)
+{
+  sim_data *sd = data;
+
+  sd->barred_dialing = g_variant_get_boolean(value);
+
+  return FALSE;
+}
+
+static const property_entry sim_property_entries[] =
+{
+  {OFONO_SIMMGR_PROPERTY_PRESENT, _parse_present},
+  {OFONO_SIMMGR_PROPERTY_MCC, _parse_mcc},
+  {OFONO_SIMMGR_PROPERTY_MNC, _parse_mnc},
+  {OFONO_SIMMGR_PROPERTY_IMSI, _parse_imsi},
+  {OFONO_SIMMGR_PROPERTY_SPN, _parse_spn},
+  {OFONO_SIMMGR_PROPERTY_PIN_REQUIRED, _parse_pin_required},
+  {OFONO_SIMMGR_PROPERTY_LOCKED_PINS, _parse_locked_pins},
+  {OFONO_SIMMGR_PROPERTY_RETRIES, _parse_retries},
+  {OFONO_SIMMGR_PROPERTY_CARD_IDENTIFIER, _parse_card_identifier},
+  {OFONO_SIMMGR_PROPERTY_SUBSCRIBER_NUMBERS, _parse_subscriber_numbers},
+  {OFONO_SIMMGR_PROPERTY_FIXED_DIALING, _parse_fixed_dialing},
+  {OFONO_SIMMGR_PROPERTY_BARRED_DIALING, _parse_barred_dialing},
+  {NULL, NULL}
+};
+
+static property_table sim_properties = PROPERTY_TABLE(sim_property_entries);
+
+static gboolean
+_parse_property(sim_data *sd, const gchar *name, GVariant *value)
+{
   g_debug("SIM %s parsing property %s, type %s", sd->path, name,
           g_variant_get_type_string(value));
 
-  if (!strcmp(name, OFONO_SIMMGR_PROPERTY_PRESENT))
-  {
-    sd->present = g_variant_get_boolean(value);
-    notify = TRUE;
-  }
-  else if (!strcmp(name, OFONO_SIMMGR_PROPERTY_MCC))
-    sd->mcc = atoi(g_variant_get_string(value, NULL));
-  else if (!strcmp(name, OFONO_SIMMGR_PROPERTY_MNC))
-    sd->mnc = atoi(g_variant_get_string(value, NULL));
-  else if (!strcmp(name, OFONO_SIMMGR_PROPERTY_IMSI))
-  {
-    g_free(sd->imsi);
-    sd->imsi = g_strdup((g_variant_get_string(value, NULL)));
-  }
-  else if (!strcmp(name, OFONO_SIMMGR_PROPERTY_SPN))
-  {
-    g_free(sd->spn);
-    sd->spn = g_strdup((g_variant_get_string(value, NULL)));
-  }
-  else if (!strcmp(name, OFONO_SIMMGR_PROPERTY_PIN_REQUIRED))
-  {
-    _get_pin_required(sd, value);
-    notify = TRUE;
-  }
-  else if (!strcmp(name, OFONO_SIMMGR_PROPERTY_LOCKED_PINS))
-    _get_locked_pins(sd, value);
-
-  return notify;
+  return property_dispatch(&sim_properties, sd, name, value);
 }
 
 static void
@@ -295,25 +499,38 @@ _property_changed_cb(ConnuiCellSimManager *proxy, const gchar *name,
   g_variant_unref(v);
 }
 
-__attribute__((visibility("hidden"))) void
-connui_cell_modem_add_simmgr(connui_cell_context *ctx, const char *path)
+static void
+_get_properties_cb(GObject *object, GAsyncResult *res, gpointer user_data)
 {
-  ConnuiCellSimManager *proxy;
+  connui_cell_pending *pending = user_data;
+  ConnuiCellSimManager *proxy = CONNUI_CELL_SIM_MANAGER(object);
+  GVariant *props = NULL;
   GError *error = NULL;
+  gboolean ok;
 
-  g_debug("Adding ofono sim manager for %s", path);
+  ok = connui_cell_sim_manager_call_get_properties_finish(proxy, &props, res,
+                                                       &error);
+  stats_call_end("SimManager.GetProperties", pending->stats_start,
+                 ok, &error);
 
-  proxy = connui_cell_sim_manager_proxy_new_for_bus_sync(
-        OFONO_BUS_TYPE, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
-        OFONO_SERVICE, path, NULL, &error);
+  if (!ok)
+  {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      CONNUI_ERR("Unable to get modem [%s] sim manager properties: %s",
+                 pending->path, error->message);
+    }
+
+    g_error_free(error);
+  }
 
-  if (proxy)
+  /* interface or modem are gone */
+  if (!g_cancellable_is_cancelled(pending->cancellable))
   {
-    sim_data *sd = _sim_data_create(proxy, path, ctx);
-    GVariant *props;
+    connui_cell_context *ctx = pending->ctx;
+    sim_data *sd = _sim_data_create(g_object_ref(proxy), pending->path, ctx);
 
-    if (connui_cell_sim_manager_call_get_properties_sync(proxy, &props, NULL,
-                                                       &error))
+    if (props)
     {
       GVariantIter i;
       gchar *name;
@@ -323,14 +540,6 @@ connui_cell_modem_add_simmgr(connui_cell_context *ctx, const char *path)
 
       while (g_variant_iter_loop(&i, "{&sv}", &name, &v))
         _parse_property(sd, name, v);
-
-      g_variant_unref(props);
-    }
-    else
-    {
-      CONNUI_ERR("Unable to get modem [%s] sim manager properties: %s",
-                 path, error->message);
-      g_error_free(error);
     }
 
     sd->properties_changed_id =
@@ -340,12 +549,52 @@ connui_cell_modem_add_simmgr(connui_cell_context *ctx, const char *path)
     _notify_status_all(ctx);
     _notify_security_code_all(ctx);
   }
-  else
+
+  if (props)
+    g_variant_unref(props);
+
+  connui_cell_pending_free(pending);
+}
+
+static void
+_proxy_ready_cb(GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  connui_cell_pending *pending = user_data;
+  ConnuiCellSimManager *proxy;
+  GError *error = NULL;
+
+  proxy = connui_cell_sim_manager_proxy_new_for_bus_finish(res, &error);
+
+  if (!proxy)
   {
-    CONNUI_ERR("Error creating OFONO sim manager proxy for %s [%s]", path,
-               error->message);
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      CONNUI_ERR("Error creating OFONO sim manager proxy for %s [%s]",
+                 pending->path, error->message);
+    }
+
     g_error_free(error);
+    connui_cell_pending_free(pending);
+    return;
   }
+
+  pending->stats_start =
+      stats_call_begin("SimManager.GetProperties");
+  connui_cell_sim_manager_call_get_properties(proxy, pending->cancellable,
+                                              _get_properties_cb, pending);
+  g_object_unref(proxy);
+}
+
+__attribute__((visibility("hidden"))) void
+connui_cell_modem_add_simmgr(connui_cell_context *ctx, const char *path,
+                             GCancellable *cancellable)
+{
+  g_debug("Adding ofono sim manager for %s", path);
+
+  connui_cell_sim_manager_proxy_new_for_bus(
+        OFONO_BUS_TYPE, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+        OFONO_SERVICE, path, cancellable, _proxy_ready_cb,
+        connui_cell_pending_new(ctx, path, cancellable));
 }
 
 __attribute__((visibility("hidden"))) void
@@ -399,19 +648,210 @@ connui_cell_sim_get_status(const char *modem_id, GError **error)
   return _get_status(sd);
 }
 
-static GVariant *
-_get_property(sim_data *sd, const char *name, GError **error)
+typedef enum
+{
+  SIM_CALL_ENTER_PIN,
+  SIM_CALL_CHANGE_PIN,
+  SIM_CALL_RESET_PIN,
+  SIM_CALL_LOCK_PIN,
+  SIM_CALL_UNLOCK_PIN
+}
+sim_call_type;
+
+typedef gboolean (*sim_call_finish_fn)(ConnuiCellSimManager *proxy,
+                                       GAsyncResult *res, GError **error);
+
+static const struct
+{
+  const gchar *name;
+  sim_call_finish_fn finish;
+}
+sim_calls[] =
+{
+  {"SimManager.EnterPin", connui_cell_sim_manager_call_enter_pin_finish},
+  {"SimManager.ChangePin", connui_cell_sim_manager_call_change_pin_finish},
+  {"SimManager.ResetPin", connui_cell_sim_manager_call_reset_pin_finish},
+  {"SimManager.LockPin", connui_cell_sim_manager_call_lock_pin_finish},
+  {"SimManager.UnlockPin", connui_cell_sim_manager_call_unlock_pin_finish}
+};
+
+typedef struct _sim_call
+{
+  gchar *path;
+  sim_call_type type;
+  guint timeout_id;
+  gboolean timed_out;
+}
+sim_call;
+
+/* seconds, 0 disables the timeout */
+static guint sim_call_timeout = 30;
+
+static void
+_sim_call_cb(GObject *object, GAsyncResult *res, gpointer user_data)
 {
-  GVariant *prop, *v = NULL;
+  service_call_data *scd = user_data;
+  sim_call *call = scd->async_data;
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+  gboolean ok;
+
+  ok = sim_calls[call->type].finish(CONNUI_CELL_SIM_MANAGER(object), res,
+                                    &scd->error);
+  stats_call_end(sim_calls[call->type].name, scd->stats_start, ok,
+                 &scd->error);
+
+  if (call->timeout_id)
+    g_source_remove(call->timeout_id);
+
+  if (call->timed_out)
+  {
+    g_clear_error(&scd->error);
+    g_set_error(&scd->error, CONNUI_ERROR, CONNUI_ERROR_TIMED_OUT,
+                "%s timed out", sim_calls[call->type].name);
+  }
 
-  if (connui_cell_sim_manager_call_get_properties_sync(
-        sd->proxy, &prop, NULL, error))
+  service_call_take(ctx, scd->id);
+
+  if (scd->callback)
   {
-    v = g_variant_lookup_value(prop, name, NULL);
-    g_variant_unref(prop);
+    ((cell_sim_code_cb)scd->callback)(call->path, scd->error,
+                                      scd->user_data);
   }
 
-  return v;
+  g_free(call->path);
+  g_free(call);
+  service_call_destroy(ctx, scd);
+  connui_cell_context_destroy(ctx);
+}
+
+static gboolean
+_sim_call_timeout_cb(gpointer user_data)
+{
+  service_call_data *scd = user_data;
+  sim_call *call = scd->async_data;
+
+  CONNUI_ERR("%s on %s timed out", sim_calls[call->type].name, call->path);
+
+  call->timeout_id = 0;
+  call->timed_out = TRUE;
+  g_cancellable_cancel(scd->cancellable);
+
+  return G_SOURCE_REMOVE;
+}
+
+static guint
+_sim_call(sim_data *sd, sim_call_type type, const gchar *code_type,
+          const gchar *code, const gchar *new_code, cell_sim_code_cb cb,
+          gpointer user_data)
+{
+  connui_cell_context *ctx = sd->ctx;
+  service_call_data *scd = service_call_add(ctx, G_CALLBACK(cb), user_data);
+  sim_call *call = g_new0(sim_call, 1);
+
+  call->path = g_strdup(sd->path);
+  call->type = type;
+
+  scd->async_data = call;
+  scd->cancellable = g_cancellable_new();
+  service_call_begin(scd, sim_calls[type].name);
+
+  if (sim_call_timeout)
+  {
+    call->timeout_id =
+        g_timeout_add_seconds(sim_call_timeout, _sim_call_timeout_cb, scd);
+  }
+
+  switch (type)
+  {
+    case SIM_CALL_ENTER_PIN:
+      connui_cell_sim_manager_call_enter_pin(
+            sd->proxy, code_type, code, scd->cancellable, _sim_call_cb, scd);
+      break;
+    case SIM_CALL_CHANGE_PIN:
+      connui_cell_sim_manager_call_change_pin(
+            sd->proxy, code_type, code, new_code, scd->cancellable,
+            _sim_call_cb, scd);
+      break;
+    case SIM_CALL_RESET_PIN:
+      connui_cell_sim_manager_call_reset_pin(
+            sd->proxy, code_type, code, new_code, scd->cancellable,
+            _sim_call_cb, scd);
+      break;
+    case SIM_CALL_LOCK_PIN:
+      connui_cell_sim_manager_call_lock_pin(
+            sd->proxy, code_type, code, scd->cancellable, _sim_call_cb, scd);
+      break;
+    case SIM_CALL_UNLOCK_PIN:
+      connui_cell_sim_manager_call_unlock_pin(
+            sd->proxy, code_type, code, scd->cancellable, _sim_call_cb, scd);
+      break;
+  }
+
+  return scd->id;
+}
+
+typedef struct _sim_call_wait
+{
+  gboolean done;
+  GError *error;
+}
+sim_call_wait;
+
+static void
+_sim_call_wait_cb(const char *modem_id, GError *error, gpointer user_data)
+{
+  sim_call_wait *wait = user_data;
+
+  if (error)
+    wait->error = g_error_copy(error);
+
+  wait->done = TRUE;
+}
+
+/*
+ * Runs the call while still dispatching the main context, so UI stays alive.
+ * As the modem might be gone on return, callers shall not use their sim_data
+ * after that, but look it up again by @path.
+ *
+ * Only a compatibility shim for the synchronous public API that returns the
+ * result of the call, everything else shall use _sim_call() and a callback.
+ */
+static gboolean
+_sim_call_sync(const gchar *path, sim_call_type type, const gchar *code_type,
+               const gchar *code, const gchar *new_code, GError **error)
+{
+  sim_call_wait wait = {FALSE, NULL};
+  sim_data *sd = _sim_data_get(path, error);
+
+  if (!sd)
+    return FALSE;
+
+  _sim_call(sd, type, code_type, code, new_code, _sim_call_wait_cb, &wait);
+
+  while (!wait.done)
+    g_main_context_iteration(NULL, TRUE);
+
+  if (wait.error)
+  {
+    g_propagate_error(error, wait.error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static const gchar *
+_code_type_name(connui_sim_security_code_type code_type)
+{
+  const property_enum_entry *e;
+
+  for (e = code_type_entries; e->value; e++)
+  {
+    if (e->id == code_type)
+      return e->value;
+  }
+
+  return NULL;
 }
 
 static gboolean
@@ -439,49 +879,37 @@ sec_code_cb(code_query_callback_data *cbd, const char *modem_id,
 }
 
 static gboolean
-verify_code(sim_data *sd, connui_sim_security_code_type code_type,
+verify_code(const gchar *path, connui_sim_security_code_type code_type,
             gchar *old_code, gchar *new_code, code_query_callback_data *cbd,
             GError **error)
 {
   gboolean ok = FALSE;
   const gchar *type;
   GError *local_error = NULL;
-  GVariant *v;
 
-  switch (code_type)
-  {
-    case CONNUI_SIM_SECURITY_CODE_PIN:
-      type = "pin";
-      break;
-    case CONNUI_SIM_SECURITY_CODE_PUK:
-      type = "puk";
-      break;
-    case CONNUI_SIM_SECURITY_CODE_PIN2:
-      type = "pin2";
-      break;
-    case CONNUI_SIM_SECURITY_CODE_PUK2:
-      type = "puk2";
-      break;
-    default:
-      g_assert_not_reached();
-  }
+  g_assert(code_type >= CONNUI_SIM_SECURITY_CODE_PIN &&
+           code_type <= CONNUI_SIM_SECURITY_CODE_PUK2);
+
+  type = _code_type_name(code_type);
 
-  /* check how pin reset works */
   if (!new_code)
   {
-      ok = connui_cell_sim_manager_call_enter_pin_sync(
-            sd->proxy, type, old_code, NULL, &local_error);
+    ok = _sim_call_sync(path, SIM_CALL_ENTER_PIN, type, old_code, NULL,
+                        &local_error);
   }
-   else
+  else if (code_type == CONNUI_SIM_SECURITY_CODE_PUK ||
+           code_type == CONNUI_SIM_SECURITY_CODE_PUK2)
   {
-      ok = connui_cell_sim_manager_call_change_pin_sync(
-            sd->proxy, type, old_code, new_code, NULL, &local_error);
+    ok = _sim_call_sync(path, SIM_CALL_RESET_PIN, type, old_code, new_code,
+                        &local_error);
+  }
+  else
+  {
+    ok = _sim_call_sync(path, SIM_CALL_CHANGE_PIN, type, old_code, new_code,
+                        &local_error);
   }
 
-  v = _get_property(sd, OFONO_SIMMGR_PROPERTY_PIN_REQUIRED, NULL);
-  _get_pin_required(sd, v);
-
-  sec_code_cb(cbd, sd->path, code_type, ok, local_error);
+  sec_code_cb(cbd, path, code_type, ok, local_error);
 
   if (local_error)
   {
@@ -491,11 +919,63 @@ verify_code(sim_data *sd, connui_sim_security_code_type code_type,
     g_error_free(local_error);
   }
 
-  g_variant_unref(v);
-
   return ok;
 }
 
+/*
+ * Security code changes seen while verifying were held back, query again if
+ * the SIM still wants a code.
+ */
+static void
+_verify_required_pin_done(const gchar *path)
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+  ConnuiCellModem *modem;
+  sim_data *sd = NULL;
+
+  g_return_if_fail(ctx != NULL);
+
+  modem = g_hash_table_lookup(ctx->modems, path);
+
+  if (modem)
+    sd = g_object_get_data(G_OBJECT(modem), DATA);
+
+  if (sd)
+  {
+    sd->verifying = FALSE;
+
+    if (sd->security_code_pending)
+    {
+      sd->security_code_pending = FALSE;
+      _notify_security_code(sd);
+    }
+  }
+
+  connui_cell_context_destroy(ctx);
+}
+
+typedef struct _required_pin_call
+{
+  code_query_callback_data cbd;
+  connui_sim_security_code_type type;
+}
+required_pin_call;
+
+static void
+_required_pin_cb(const char *modem_id, GError *error, gpointer user_data)
+{
+  required_pin_call *call = user_data;
+
+  sec_code_cb(&call->cbd, modem_id, call->type, !error, error);
+  _verify_required_pin_done(modem_id);
+  g_free(call);
+}
+
+/*
+ * Queries the code from the registered callbacks and enters it. Only the
+ * query is synchronous, SIM status changes meanwhile are held back until the
+ * SIM replies, see _notify_security_code().
+ */
 static void
 verify_required_pin(sim_data *sd)
 {
@@ -504,34 +984,62 @@ verify_required_pin(sim_data *sd)
   gchar *old = NULL;
   gboolean code_queried = FALSE;
   connui_sim_security_code_type type = sd->pin_required;
+  connui_cell_context *ctx = sd->ctx;
+  /* the code query might run the main loop, @sd might go away */
+  gchar *path = g_strdup(sd->path);
+  required_pin_call *call;
 
   g_assert(type != CONNUI_SIM_SECURITY_CODE_UNKNOWN &&
            type != CONNUI_SIM_SECURITY_CODE_NONE &&
            type != CONNUI_SIM_SECURITY_CODE_UNSUPPORTED);
 
+  sd->verifying = TRUE;
+  sd->security_code_pending = FALSE;
+
   if (type == CONNUI_SIM_SECURITY_CODE_PUK ||
       type == CONNUI_SIM_SECURITY_CODE_PUK2)
   {
-    if (sec_code_query(sd->ctx, sd->path, type, &old, &new, &cbd))
+    if (sec_code_query(ctx, path, type, &old, &new, &cbd))
       code_queried = TRUE;
   }
 
-  if (!code_queried)
+  if (!code_queried && !sec_code_query(ctx, path, type, &old, NULL, &cbd))
+  {
+    g_free(old);
+    _verify_required_pin_done(path);
+    g_free(path);
+    return;
+  }
+
+  if ((sd = _sim_data_get(path, NULL)))
   {
-    if (!sec_code_query(sd->ctx, sd->path, type, &old, NULL, &cbd))
+    const gchar *name = _code_type_name(type);
+
+    call = g_new(required_pin_call, 1);
+    call->cbd = cbd;
+    call->type = type;
+
+    if (!new)
     {
-      g_free(old);
-      return;
+      _sim_call(sd, SIM_CALL_ENTER_PIN, name, old, NULL, _required_pin_cb,
+                call);
+    }
+    else if (type == CONNUI_SIM_SECURITY_CODE_PUK ||
+             type == CONNUI_SIM_SECURITY_CODE_PUK2)
+    {
+      _sim_call(sd, SIM_CALL_RESET_PIN, name, old, new, _required_pin_cb,
+                call);
     }
     else
-      code_queried = TRUE;
+    {
+      _sim_call(sd, SIM_CALL_CHANGE_PIN, name, old, new, _required_pin_cb,
+                call);
+    }
   }
 
-  if (code_queried)
-    verify_code(sd, type, old, new, &cbd, NULL);
-
   g_free(old);
   g_free(new);
+  g_free(path);
 }
 
 void
@@ -570,40 +1078,7 @@ connui_cell_sim_status_register(cell_sim_status_cb cb, gpointer user_data)
 gboolean
 connui_cell_sim_is_network_in_service_provider_info(guint mnc, guint mcc)
 {
-  xmlDocPtr doc = xmlParseFile(MBPI_DATABASE);
-  gboolean rv = FALSE;
-
-  if (doc)
-  {
-    /* Create xpath evaluation context */
-    xmlXPathContextPtr ctx = xmlXPathNewContext(doc);
-
-    if (ctx)
-    {
-      gchar *xpath = g_strdup_printf(
-            "//network-id[@mcc='%03u' and @mnc='%02u']", mcc, mnc);
-      xmlXPathObjectPtr obj = xmlXPathEvalExpression(BAD_CAST xpath, ctx);
-
-      if (obj)
-      {
-        if (obj->nodesetval)
-          rv = TRUE;
-
-        xmlXPathFreeObject(obj);
-      }
-
-      g_free(xpath);
-      xmlXPathFreeContext(ctx);
-    }
-    else
-      CONNUI_ERR("Unable to create new XPath context");
-
-    xmlFreeDoc(doc);
-  }
-  else
-    CONNUI_ERR("Unable to parse '" MBPI_DATABASE "'");
-
-  return rv;
+  return connui_cell_mbpi_lookup(mcc, mnc, MBPI_MNC_DIGITS(mnc), NULL);
 }
 
 gboolean
@@ -640,48 +1115,7 @@ connui_cell_sim_is_locked(const char *modem_id, GError **error)
   sd = _sim_data_get(modem_id, error);
 
   if (sd)
-  {
-    GVariant *v = _get_property(sd, "LockedPins", error);
-
-    if (v)
-    {
-      GHashTable *pins = g_hash_table_new(g_str_hash, g_str_equal);
-      GVariantIter i;
-      char *locked_pin;
-
-      g_variant_iter_init(&i, v);
-
-      g_hash_table_add(pins, "phone");
-      g_hash_table_add(pins, "firstphone");
-      g_hash_table_add(pins, "network");
-      g_hash_table_add(pins, "netsub");
-      g_hash_table_add(pins, "service");
-      g_hash_table_add(pins, "corp");
-      g_hash_table_add(pins, "firstphonepuk");
-      g_hash_table_add(pins, "networkpuk");
-      g_hash_table_add(pins, "netsubpuk");
-      g_hash_table_add(pins, "servicepuk");
-      g_hash_table_add(pins, "corppuk");
-
-      while (g_variant_iter_loop(&i, "s", &locked_pin))
-      {
-        if (g_hash_table_contains(pins, locked_pin))
-        {
-          locked = TRUE;
-          g_free(locked_pin);
-          break;
-        }
-      }
-
-      g_hash_table_unref(pins);
-      g_variant_unref(v);
-    }
-    else
-    {
-      g_set_error(error, CONNUI_ERROR, CONNUI_ERROR_NOT_FOUND,
-                  "No LockedPins property");
-    }
-  }
+    locked = (sd->locked_pins & SIM_LOCK_SIMLOCK_MASK) != 0;
 
   connui_cell_context_destroy(ctx);
 
@@ -702,8 +1136,8 @@ connui_cell_sim_deactivate_lock(const char *modem_id, const gchar *pin_code,
 
   if (sd)
   {
-    ok = connui_cell_sim_manager_call_unlock_pin_sync(
-          sd->proxy, sd->pin_required_s, pin_code, NULL, error);
+    ok = _sim_call_sync(modem_id, SIM_CALL_UNLOCK_PIN, sd->pin_required_s,
+                        pin_code, NULL, error);
   }
 
   connui_cell_context_destroy(ctx);
@@ -726,44 +1160,21 @@ connui_cell_sim_verify_attempts_left(const char *modem_id,
 
   if (sd)
   {
-    GVariant *v = _get_property(sd, "Retries", error);
-
-    if (v)
+    if (code_type < CONNUI_SIM_SECURITY_CODE_PIN ||
+        code_type > CONNUI_SIM_SECURITY_CODE_PUK2)
     {
-      GVariant *v2;
-
-      switch (code_type)
-      {
-        case CONNUI_SIM_SECURITY_CODE_PIN:
-          v2 = g_variant_lookup_value(v, "pin", G_VARIANT_TYPE_BYTE);
-          break;
-        case CONNUI_SIM_SECURITY_CODE_PUK:
-          v2 = g_variant_lookup_value(v, "puk", G_VARIANT_TYPE_BYTE);
-          break;
-        case CONNUI_SIM_SECURITY_CODE_PIN2:
-          v2 = g_variant_lookup_value(v, "pin2", G_VARIANT_TYPE_BYTE);
-          break;
-        case CONNUI_SIM_SECURITY_CODE_PUK2:
-          v2 = g_variant_lookup_value(v, "puk2", G_VARIANT_TYPE_BYTE);
-          break;
-        default:
-          g_set_error(error, CONNUI_ERROR, CONNUI_ERROR_INVALID_ARGS,
-                      "Invalid code_type %d", code_type);
-          goto cleanup;
-      }
-
-      g_variant_get(v2, "y", &attempts_left);
-      g_variant_unref(v2);
-      g_variant_unref(v);
+      g_set_error(error, CONNUI_ERROR, CONNUI_ERROR_INVALID_ARGS,
+                  "Invalid code_type %d", code_type);
     }
+    else if (sd->retries_valid & SIM_LOCK_BIT(code_type))
+      attempts_left = sd->retries[code_type];
     else
     {
       g_set_error(error, CONNUI_ERROR, CONNUI_ERROR_NOT_FOUND,
-                  "No Retries property");
+                  "No retries for %s", _code_type_name(code_type));
     }
   }
 
-cleanup:
   connui_cell_context_destroy(ctx);
 
   return (guint)attempts_left;
@@ -840,7 +1251,7 @@ connui_cell_security_code_get_enabled(const char *modem_id,
   sd = _sim_data_get(modem_id, error);
 
   if (sd)
-    rv = sd->locked_pin[code_type - 1];
+    rv = (sd->locked_pins & SIM_LOCK_BIT(code_type)) != 0;
 
   connui_cell_context_destroy(ctx);
 
@@ -884,10 +1295,8 @@ connui_cell_security_code_set_active(const char *modem_id,
 
   if (sec_code_query(sd->ctx, modem_id, code_type, &code, NULL, &cbd))
   {
-    rv = connui_cell_sim_manager_call_lock_pin_sync(
-          sd->proxy, code_type == CONNUI_SIM_SECURITY_CODE_PIN ?
-            "pin" : "pin2", code, NULL,
-          &local_error);
+    rv = _sim_call_sync(modem_id, SIM_CALL_LOCK_PIN,
+                        _code_type_name(code_type), code, NULL, &local_error);
   }
   else
   {
@@ -936,16 +1345,9 @@ connui_cell_security_code_set_enabled(const char *modem_id, gboolean active,
 
   if (sec_code_query(ctx, modem_id, type, &code, NULL, &cbd))
   {
-    if (active)
-    {
-      rv = connui_cell_sim_manager_call_lock_pin_sync(
-            sd->proxy, "pin", code, NULL, &local_error);
-    }
-    else
-    {
-      rv = connui_cell_sim_manager_call_unlock_pin_sync(
-            sd->proxy, "pin", code, NULL, &local_error);
-    }
+    rv = _sim_call_sync(modem_id,
+                        active ? SIM_CALL_LOCK_PIN : SIM_CALL_UNLOCK_PIN,
+                        "pin", code, NULL, &local_error);
   }
   else
   {
@@ -1011,25 +1413,23 @@ connui_cell_security_code_change(const char *modem_id,
           modem_id, &local_error) == CONNUI_SIM_SECURITY_CODE_PIN ||
         code_type != CONNUI_SIM_SECURITY_CODE_PIN)
     {
-      rv = verify_code(sd, code_type, old, new, &cbd, &local_error);
+      rv = verify_code(modem_id, code_type, old, new, &cbd, &local_error);
     }
-    else if (connui_cell_sim_manager_call_lock_pin_sync(sd->proxy, "pin", old,
-                                                      NULL, &local_error))
+    else if (_sim_call_sync(modem_id, SIM_CALL_LOCK_PIN, "pin", old, NULL,
+                            &local_error))
     {
-      rv = verify_code(sd, CONNUI_SIM_SECURITY_CODE_PIN, old, new,
+      rv = verify_code(modem_id, CONNUI_SIM_SECURITY_CODE_PIN, old, new,
                        &cbd, &local_error);
 
       if (rv)
       {
-        rv = connui_cell_sim_manager_call_unlock_pin_sync(sd->proxy, "pin",
-                                                        new, NULL,
-                                                        &local_error);
+        rv = _sim_call_sync(modem_id, SIM_CALL_UNLOCK_PIN, "pin", new, NULL,
+                            &local_error);
       }
       else
       {
-        rv = connui_cell_sim_manager_call_unlock_pin_sync(sd->proxy, "pin",
-                                                        old, NULL,
-                                                        &local_error);
+        rv = _sim_call_sync(modem_id, SIM_CALL_UNLOCK_PIN, "pin", old, NULL,
+                            &local_error);
       }
     }
   }
@@ -1056,6 +1456,88 @@ connui_cell_security_code_change(const char *modem_id,
   return rv;
 }
 
+static guint
+_sim_call_async(const char *modem_id, sim_call_type type,
+                const gchar *code_type, const gchar *code,
+                const gchar *new_code, cell_sim_code_cb cb, gpointer user_data)
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+  sim_data *sd;
+  guint id = 0;
+
+  g_return_val_if_fail(ctx != NULL, 0);
+
+  if ((sd = _sim_data_get(modem_id, NULL)))
+    id = _sim_call(sd, type, code_type, code, new_code, cb, user_data);
+
+  connui_cell_context_destroy(ctx);
+
+  return id;
+}
+
+guint
+connui_cell_sim_enter_code(const char *modem_id,
+                           connui_sim_security_code_type code_type,
+                           const gchar *code, const gchar *new_pin,
+                           cell_sim_code_cb cb, gpointer user_data)
+{
+  g_return_val_if_fail(modem_id != NULL && code != NULL, 0);
+  g_return_val_if_fail(code_type >= CONNUI_SIM_SECURITY_CODE_PIN &&
+                       code_type <= CONNUI_SIM_SECURITY_CODE_PUK2, 0);
+
+  if (code_type == CONNUI_SIM_SECURITY_CODE_PUK ||
+      code_type == CONNUI_SIM_SECURITY_CODE_PUK2)
+  {
+    g_return_val_if_fail(new_pin != NULL, 0);
+
+    return _sim_call_async(modem_id, SIM_CALL_RESET_PIN,
+                           _code_type_name(code_type), code, new_pin,
+                           cb, user_data);
+  }
+
+  return _sim_call_async(modem_id, SIM_CALL_ENTER_PIN,
+                         _code_type_name(code_type), code, NULL,
+                         cb, user_data);
+}
+
+guint
+connui_cell_sim_change_code(const char *modem_id,
+                            connui_sim_security_code_type code_type,
+                            const gchar *old_code, const gchar *new_code,
+                            cell_sim_code_cb cb, gpointer user_data)
+{
+  g_return_val_if_fail(modem_id != NULL, 0);
+  g_return_val_if_fail(old_code != NULL && new_code != NULL, 0);
+  g_return_val_if_fail(code_type == CONNUI_SIM_SECURITY_CODE_PIN ||
+                       code_type == CONNUI_SIM_SECURITY_CODE_PIN2, 0);
+
+  return _sim_call_async(modem_id, SIM_CALL_CHANGE_PIN,
+                         _code_type_name(code_type), old_code, new_code,
+                         cb, user_data);
+}
+
+guint
+connui_cell_sim_set_code_enabled(const char *modem_id,
+                                 connui_sim_security_code_type code_type,
+                                 gboolean enabled, const gchar *code,
+                                 cell_sim_code_cb cb, gpointer user_data)
+{
+  g_return_val_if_fail(modem_id != NULL && code != NULL, 0);
+  g_return_val_if_fail(code_type == CONNUI_SIM_SECURITY_CODE_PIN ||
+                       code_type == CONNUI_SIM_SECURITY_CODE_PIN2, 0);
+
+  return _sim_call_async(modem_id,
+                         enabled ? SIM_CALL_LOCK_PIN : SIM_CALL_UNLOCK_PIN,
+                         _code_type_name(code_type), code, NULL,
+                         cb, user_data);
+}
+
+void
+connui_cell_sim_set_code_timeout(guint timeout)
+{
+  sim_call_timeout = timeout;
+}
+
 #define GET(x, type, default) \
   connui_cell_context *ctx; \
   sim_data *sd; \
@@ -1089,3 +1571,27 @@ connui_cell_sim_get_present(const char *modem_id, GError **error)
 {
   GET(present, gboolean, FALSE);
 }
+
+const gchar *
+connui_cell_sim_get_card_identifier(const char *modem_id, GError **error)
+{
+  GET(card_identifier, const gchar *, NULL);
+}
+
+const gchar * const *
+connui_cell_sim_get_subscriber_numbers(const char *modem_id, GError **error)
+{
+  GET(subscriber_numbers, const gchar * const *, NULL);
+}
+
+gboolean
+connui_cell_sim_get_fixed_dialing(const char *modem_id, GError **error)
+{
+  GET(fixed_dialing, gboolean, FALSE);
+}
+
+gboolean
+connui_cell_sim_get_barred_dialing(const char *modem_id, GError **error)
+{
+  GET(barred_dialing, gboolean, FALSE);
+}
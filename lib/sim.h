@@ -25,7 +25,8 @@
 #include "org.ofono.SimManager.h"
 
 void
-connui_cell_modem_add_simmgr(connui_cell_context *ctx, const char *path);
+connui_cell_modem_add_simmgr(connui_cell_context *ctx, const char *path,
+                             GCancellable *cancellable);
 
 void
 connui_cell_modem_remove_simmgr(ConnuiCellModem *modem);
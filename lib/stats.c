@@ -0,0 +1,261 @@
+/*
+ * stats.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <gio/gio.h>
+#include <signal.h>
+#include <string.h>
+
+#include "connui-cellular.h"
+
+#include "stats.h"
+
+/* set CONNUI_CELL_STATS to enable stats and the SIGUSR1 dump at startup */
+#define STATS_ENV "CONNUI_CELL_STATS"
+
+static gint stats_enabled = -1;
+static GHashTable *stats;
+
+static gboolean
+_stats_signal_cb(gpointer user_data)
+{
+  connui_cell_service_calls_dump();
+
+  return connui_cell_stats_dump();
+}
+
+static void
+_stats_init()
+{
+  stats_enabled = g_getenv(STATS_ENV) != NULL;
+
+  if (stats_enabled)
+    g_unix_signal_add(SIGUSR1, _stats_signal_cb, NULL);
+}
+
+static connui_cell_stats_method *
+_stats_get(const gchar *method)
+{
+  connui_cell_stats_method *m;
+
+  if (!stats)
+    stats = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+
+  m = g_hash_table_lookup(stats, method);
+
+  if (!m)
+  {
+    m = g_new0(connui_cell_stats_method, 1);
+    m->method = method;
+    g_hash_table_insert(stats, (gpointer)method, m);
+  }
+
+  return m;
+}
+
+static guint
+_stats_bucket(guint64 us)
+{
+  guint64 limit = 1000;
+  guint i;
+
+  for (i = 0; i < CONNUI_CELL_STATS_BUCKETS - 1; i++, limit *= 4)
+  {
+    if (us < limit)
+      break;
+  }
+
+  return i;
+}
+
+static gboolean
+_stats_timed_out(const GError *error)
+{
+  return g_error_matches(error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT) ||
+      g_error_matches(error, G_DBUS_ERROR, G_DBUS_ERROR_NO_REPLY) ||
+      g_error_matches(error, G_DBUS_ERROR, G_DBUS_ERROR_TIMEOUT) ||
+      g_error_matches(error, G_DBUS_ERROR, G_DBUS_ERROR_TIMED_OUT);
+}
+
+__attribute__((visibility("hidden"))) gint64
+stats_call_begin(const gchar *method)
+{
+  if (G_UNLIKELY(stats_enabled < 0))
+    _stats_init();
+
+  if (G_LIKELY(!stats_enabled))
+    return 0;
+
+  _stats_get(method)->in_flight++;
+
+  return g_get_monotonic_time();
+}
+
+__attribute__((visibility("hidden"))) void
+stats_call_end(const gchar *method, gint64 start, gboolean ok,
+               GError **error)
+{
+  connui_cell_stats_method *m;
+  guint64 us;
+
+  if (G_LIKELY(!start))
+    return;
+
+  us = g_get_monotonic_time() - start;
+  m = _stats_get(method);
+
+  /* stats might have been reset while the call was in flight */
+  if (m->in_flight)
+    m->in_flight--;
+
+  m->calls++;
+  m->total_time += us;
+
+  if (us > m->max_time)
+    m->max_time = us;
+
+  m->histogram[_stats_bucket(us)]++;
+
+  if (!ok)
+  {
+    m->errors++;
+
+    if (error && _stats_timed_out(*error))
+      m->timeouts++;
+  }
+}
+
+/**
+ * connui_cell_stats_set_enabled:
+ * @enabled: whether to collect stats of ofono calls
+ *
+ * Stats are disabled by default, unless CONNUI_CELL_STATS environment
+ * variable is set. In that case connui_cell_stats_dump() and
+ * connui_cell_service_calls_dump() are also called on SIGUSR1.
+ */
+void
+connui_cell_stats_set_enabled(gboolean enabled)
+{
+  if (G_UNLIKELY(stats_enabled < 0))
+    _stats_init();
+
+  stats_enabled = !!enabled;
+}
+
+gboolean
+connui_cell_stats_get_enabled()
+{
+  if (G_UNLIKELY(stats_enabled < 0))
+    _stats_init();
+
+  return stats_enabled;
+}
+
+/**
+ * connui_cell_stats_get:
+ *
+ * Returns:(transfer full): list of connui_cell_stats_method copies, free with
+ * g_list_free_full(list, g_free)
+ */
+GList *
+connui_cell_stats_get()
+{
+  GList *l = NULL;
+  GHashTableIter iter;
+  gpointer m;
+
+  if (!stats)
+    return NULL;
+
+  g_hash_table_iter_init(&iter, stats);
+
+  while (g_hash_table_iter_next(&iter, NULL, &m))
+  {
+    connui_cell_stats_method *copy = g_new(connui_cell_stats_method, 1);
+
+    *copy = *(connui_cell_stats_method *)m;
+    l = g_list_prepend(l, copy);
+  }
+
+  return l;
+}
+
+void
+connui_cell_stats_reset()
+{
+  GHashTableIter iter;
+  connui_cell_stats_method *m;
+
+  if (!stats)
+    return;
+
+  g_hash_table_iter_init(&iter, stats);
+
+  /* keep in-flight calls, they will end eventually */
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&m))
+  {
+    guint in_flight = m->in_flight;
+    const gchar *method = m->method;
+
+    memset(m, 0, sizeof(*m));
+    m->method = method;
+    m->in_flight = in_flight;
+  }
+}
+
+/**
+ * connui_cell_stats_dump:
+ *
+ * Logs the stats of all methods called so far.
+ *
+ * Returns: %G_SOURCE_CONTINUE, so it can be used as a signal handler
+ */
+gboolean
+connui_cell_stats_dump()
+{
+  GHashTableIter iter;
+  connui_cell_stats_method *m;
+
+  g_message("ofono call stats (%s):", stats_enabled > 0 ? "enabled" :
+                                                          "disabled");
+
+  if (!stats)
+    return G_SOURCE_CONTINUE;
+
+  g_hash_table_iter_init(&iter, stats);
+
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&m))
+  {
+    GString *hist = g_string_new(NULL);
+    int i;
+
+    for (i = 0; i < CONNUI_CELL_STATS_BUCKETS; i++)
+      g_string_append_printf(hist, " %u", m->histogram[i]);
+
+    g_message("%s: calls %u errors %u timeouts %u in-flight %u "
+              "avg %" G_GUINT64_FORMAT "us max %" G_GUINT64_FORMAT "us "
+              "histogram%s", m->method, m->calls, m->errors, m->timeouts,
+              m->in_flight, m->calls ? m->total_time / m->calls : 0,
+              m->max_time, hist->str);
+    g_string_free(hist, TRUE);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
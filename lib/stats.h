@@ -0,0 +1,41 @@
+/*
+ * stats.h
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __CONNUI_INTERNAL_STATS_H_INCLUDED__
+#define __CONNUI_INTERNAL_STATS_H_INCLUDED__
+
+/*
+ * Brackets an ofono call:
+ *
+ *   gint64 start = stats_call_begin("SimManager.EnterPin");
+ *   ok = connui_cell_sim_manager_call_enter_pin_sync(..., error);
+ *   stats_call_end("SimManager.EnterPin", start, ok, error);
+ *
+ * begin returns 0 when stats are disabled and end ignores it, so that costs
+ * a branch only. @method must be a string literal.
+ */
+gint64
+stats_call_begin(const gchar *method);
+
+/* @error might be NULL, as with the GError ** passed to the call */
+void
+stats_call_end(const gchar *method, gint64 start, gboolean ok,
+               GError **error);
+
+#endif /* __CONNUI_INTERNAL_STATS_H_INCLUDED__ */
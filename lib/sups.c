@@ -30,10 +30,52 @@
 
 #include "context.h"
 
+#include "connui-cellular-sim.h"
+
 #include "sups.h"
 #include "service-call.h"
+#include "stats.h"
 
 #define DATA "connui_cell_sups_data"
+#define CF_DATA "connui_cell_call_forwarding_data"
+#define CS_DATA "connui_cell_call_settings_data"
+
+#define INITIATE "SupplementaryServices.Initiate"
+#define CF_GET_PROPERTIES "CallForwarding.GetProperties"
+#define CS_GET_PROPERTIES "CallSettings.GetProperties"
+#define CS_SET_PROPERTY "CallSettings.SetProperty"
+/* not an ofono method, for service calls replied from the cache */
+#define SUPS_CACHE "cache"
+
+typedef enum
+{
+  SUPS_CACHE_NONE = -1,
+  SUPS_CACHE_CALL_WAITING,
+  SUPS_CACHE_CALL_FORWARDING,
+  SUPS_CACHE_COUNT
+}
+sups_cache_id;
+
+/* last known Initiate result, valid for the SIM it was read from */
+typedef struct _sups_cache
+{
+  GVariant *result;
+  gchar *imsi;
+  gint64 time;
+}
+sups_cache;
+
+/* ofono handles one Initiate at a time, InProgress errors are retried */
+#define SUPS_RETRY_MAX 5
+/* ms, doubled on every retry */
+#define SUPS_RETRY_DELAY 250
+
+typedef enum
+{
+  SUPS_PRIORITY_QUERY,
+  SUPS_PRIORITY_SET
+}
+sups_priority;
 
 typedef struct _sups_data
 {
@@ -41,27 +83,198 @@ typedef struct _sups_data
   ConnuiCellSupplementaryServices *proxy;
   gchar *path;
 
-  GHashTable *pending;
+  /* sups_request by priority, FIFO within the same priority */
+  GSList *requests;
+  /* the one Initiate in flight */
+  struct _sups_request *active;
+  connui_sups_queue_stats stats;
+
+  sups_cache cache[SUPS_CACHE_COUNT];
+  /* built from properties by the cached getters, keeps @cf numbers alive */
+  GVariant *peek[SUPS_CACHE_COUNT];
 }
 sups_data;
 
-static void _call_waiting_get_cb(GObject *object, GAsyncResult* res,
-                                 gpointer data);
-static void _call_waiting_set_cb(GObject *object, GAsyncResult* res,
-                                 gpointer data);
+/* CallForwarding or CallSettings, ofono keeps those current */
+typedef struct _sups_props
+{
+  GDBusProxy *proxy;
+  gchar *path;
+  /* property name -> value, updated on PropertyChanged */
+  GHashTable *props;
+  gulong changed_id;
+}
+sups_props;
+
+/* seconds */
+static guint sups_cache_ttl = 600;
+
+/* @result is the reply of Initiate, NULL on error, see scd->error */
+typedef void (*sups_reply_fn)(service_call_data *scd, const gchar *path,
+                              GVariant *result);
+
+/* builds what Initiate would have returned, NULL if not known */
+typedef GVariant *(*sups_props_fn)(sups_props *sp);
+
+typedef struct _sups_request_type
+{
+  /* expected result name */
+  const gchar *name;
+  sups_reply_fn reply;
+  /* share the reply between identical queries in flight */
+  gboolean coalesce;
+  /* where the result is cached */
+  sups_cache_id cache;
+  /* cache dropped on success */
+  sups_cache_id invalidates;
+  sups_priority priority;
+
+  /* property interface used instead of Initiate when the modem has it */
+  const gchar *props;
+  sups_props_fn from_props;
+  /* CallSettings property sets change */
+  const gchar *property;
+}
+sups_request_type;
+
+/* one Initiate call, shared by all service calls in @waiters */
+typedef struct _sups_request
+{
+  sups_data *sd;
+  gchar *path;
+  const sups_request_type *type;
+  gchar *command;
+  /* for SetProperty */
+  GVariant *value;
+  GCancellable *cancellable;
+  gint64 stats_start;
+  GSList *waiters;
+  /* where the reply comes from, see connui_cell_service_calls_get() */
+  const gchar *method;
+
+  sups_priority priority;
+  gint64 queued_time;
+  guint retries;
+  guint retry_id;
+
+  /* served from the cache */
+  GVariant *result;
+  guint idle_id;
+}
+sups_request;
+
+static void _queue_dispatch(sups_data *sd);
+static gboolean _request_retry_cb(gpointer user_data);
+static void _request_complete(sups_request *req, GVariant *result,
+                              const GError *error);
+
+static sups_props *
+_props_get(connui_cell_context *ctx, const gchar *path, const gchar *key)
+{
+  ConnuiCellModem *modem;
+
+  if (!key || !(modem = g_hash_table_lookup(ctx->modems, path)))
+    return NULL;
+
+  return g_object_get_data(G_OBJECT(modem), key);
+}
+
+static void
+_cache_clear(sups_cache *cache)
+{
+  if (cache->result)
+  {
+    g_variant_unref(cache->result);
+    cache->result = NULL;
+  }
+
+  g_free(cache->imsi);
+  cache->imsi = NULL;
+  cache->time = 0;
+}
+
+static void
+_cache_set(sups_data *sd, sups_cache_id id, GVariant *result)
+{
+  sups_cache *cache = &sd->cache[id];
+  const gchar *imsi = connui_cell_sim_get_imsi(sd->path, NULL);
+
+  _cache_clear(cache);
+
+  if (!sups_cache_ttl || !imsi)
+    return;
+
+  cache->result = g_variant_ref(result);
+  cache->imsi = g_strdup(imsi);
+  cache->time = g_get_monotonic_time();
+}
+
+/* returns NULL if nothing is cached for the current SIM */
+static GVariant *
+_cache_get(sups_data *sd, sups_cache_id id, gboolean *stale)
+{
+  sups_cache *cache = &sd->cache[id];
+  const gchar *imsi;
+
+  if (!cache->result)
+    return NULL;
+
+  imsi = connui_cell_sim_get_imsi(sd->path, NULL);
 
-static void _forwarding_get_cb(GObject *object, GAsyncResult *res,
-                                 gpointer data);
-static void _do_call(sups_data *sd, service_call_data *scd);
+  if (!imsi || strcmp(imsi, cache->imsi))
+  {
+    g_debug("SIM changed on %s, dropping sups cache", sd->path);
+    _cache_clear(cache);
+    return NULL;
+  }
+
+  if (stale)
+  {
+    *stale = g_get_monotonic_time() - cache->time >
+        (gint64)sups_cache_ttl * G_USEC_PER_SEC;
+  }
+
+  return cache->result;
+}
 
 static void
 _sups_data_destroy(gpointer data)
 {
   sups_data *sd = data;
+  int i;
 
-  /* FIXME - cancel pending calls */
   g_debug("Removing ofono call settings for %s", sd->path);
 
+  while (sd->requests)
+  {
+    sups_request *req = sd->requests->data;
+
+    sd->requests = g_slist_delete_link(sd->requests, sd->requests);
+    req->sd = NULL;
+
+    /* sent ones complete with G_IO_ERROR_CANCELLED */
+    if (req->cancellable && !req->retry_id)
+      g_cancellable_cancel(req->cancellable);
+    else if (req->result)
+      _request_complete(req, req->result, NULL);
+    else
+    {
+      GError *error = g_error_new(CONNUI_ERROR, CONNUI_ERROR_NOT_FOUND,
+                                  "Modem [%s] removed", sd->path);
+
+      _request_complete(req, NULL, error);
+      g_error_free(error);
+    }
+  }
+
+  for (i = 0; i < SUPS_CACHE_COUNT; i++)
+  {
+    _cache_clear(&sd->cache[i]);
+
+    if (sd->peek[i])
+      g_variant_unref(sd->peek[i]);
+  }
+
   if (sd->proxy)
     g_object_unref(sd->proxy);
 
@@ -92,391 +305,1013 @@ _sups_data_get(const char *path, connui_cell_context *ctx, GError **error)
                            _sups_data_destroy);
     sd->path = g_strdup(path);
     sd->ctx = ctx;
-    sd->pending = g_hash_table_new(g_direct_hash, g_direct_equal);
   }
 
   return sd;
 }
 
-__attribute__((visibility("hidden"))) void
-connui_cell_modem_add_supplementary_services(connui_cell_context *ctx,
-                                             const char *path)
+static void
+_proxy_ready_cb(GObject *object, GAsyncResult *res, gpointer user_data)
 {
-  sups_data *sd = _sups_data_get(path, ctx, NULL);
+  connui_cell_pending *pending = user_data;
   ConnuiCellSupplementaryServices *proxy;
   GError *error = NULL;
 
-  g_assert(sd->proxy == NULL);
+  proxy = connui_cell_supplementary_services_proxy_new_for_bus_finish(res,
+                                                                      &error);
 
+  if (!proxy)
+  {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      CONNUI_ERR(
+            "Error creating OFONO supplementary services proxy for %s [%s]",
+            pending->path, error->message);
+    }
+
+    g_error_free(error);
+  }
+  else if (g_cancellable_is_cancelled(pending->cancellable))
+    g_object_unref(proxy);
+  else
+  {
+    sups_data *sd = _sups_data_get(pending->path, pending->ctx, NULL);
+
+    g_assert(sd->proxy == NULL);
+
+    sd->proxy = proxy;
+    _queue_dispatch(sd);
+  }
+
+  connui_cell_pending_free(pending);
+}
+
+__attribute__((visibility("hidden"))) void
+connui_cell_modem_add_supplementary_services(connui_cell_context *ctx,
+                                             const char *path,
+                                             GCancellable *cancellable)
+{
   g_debug("Adding ofono supplementary services for %s", path);
 
-  proxy = connui_cell_supplementary_services_proxy_new_for_bus_sync(
+  connui_cell_supplementary_services_proxy_new_for_bus(
         OFONO_BUS_TYPE, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
-        OFONO_SERVICE, path, NULL, &error);
+        OFONO_SERVICE, path, cancellable, _proxy_ready_cb,
+        connui_cell_pending_new(ctx, path, cancellable));
+}
 
-  if (proxy)
+__attribute__((visibility("hidden"))) void
+connui_cell_modem_remove_supplementary_services(ConnuiCellModem *modem)
+{
+  g_object_set_data(G_OBJECT(modem), DATA, NULL);
+}
+
+static void
+_props_destroy(gpointer data)
+{
+  sups_props *sp = data;
+
+  g_debug("Removing ofono %s for %s",
+          g_dbus_proxy_get_interface_name(sp->proxy), sp->path);
+
+  g_signal_handler_disconnect(sp->proxy, sp->changed_id);
+  g_object_unref(sp->proxy);
+  g_hash_table_unref(sp->props);
+  g_free(sp->path);
+  g_free(sp);
+}
+
+static void
+_props_changed_cb(GDBusProxy *proxy, const gchar *name, GVariant *value,
+                  gpointer user_data)
+{
+  sups_props *sp = user_data;
+
+  g_debug("Modem %s %s property %s changed", sp->path,
+          g_dbus_proxy_get_interface_name(proxy), name);
+
+  g_hash_table_insert(sp->props, g_strdup(name),
+                      g_variant_get_variant(value));
+}
+
+/* takes @error */
+static void
+_props_ready(connui_cell_pending *pending, GDBusProxy *proxy,
+             const gchar *key, GVariant *props, GError *error)
+{
+  if (!props)
   {
-    sd->proxy = proxy;
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      CONNUI_ERR("Unable to get modem [%s] %s properties: %s", pending->path,
+                 g_dbus_proxy_get_interface_name(proxy), error->message);
+    }
+
+    g_error_free(error);
+  }
+  /* interface or modem are gone */
+  else if (!g_cancellable_is_cancelled(pending->cancellable))
+  {
+    ConnuiCellModem *modem = g_hash_table_lookup(pending->ctx->modems,
+                                                 pending->path);
+    sups_props *sp = g_new0(sups_props, 1);
+    sups_data *sd;
+    GVariantIter i;
+    gchar *name;
+    GVariant *v;
+
+    g_assert(modem);
 
-    GHashTableIter iter;
-    service_call_data *scd;
+    sp->proxy = g_object_ref(proxy);
+    sp->path = g_strdup(pending->path);
+    sp->props = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                      (GDestroyNotify)g_variant_unref);
 
-    g_hash_table_iter_init(&iter, sd->pending);
+    g_variant_iter_init(&i, props);
 
-    while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&scd))
-      _do_call(sd, scd);
+    while (g_variant_iter_loop(&i, "{sv}", &name, &v))
+      g_hash_table_insert(sp->props, g_strdup(name), g_variant_ref(v));
 
-    g_hash_table_unref(sd->pending);
-    sd->pending = NULL;
+    sp->changed_id = g_signal_connect(proxy, "property-changed",
+                                      G_CALLBACK(_props_changed_cb), sp);
+    g_object_set_data_full(G_OBJECT(modem), key, sp, _props_destroy);
+
+    /* sets might be waiting for it */
+    if ((sd = g_object_get_data(G_OBJECT(modem), DATA)))
+      _queue_dispatch(sd);
   }
-  else
+
+  if (props)
+    g_variant_unref(props);
+
+  connui_cell_pending_free(pending);
+}
+
+static void
+_cf_get_properties_cb(GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  connui_cell_pending *pending = user_data;
+  GVariant *props = NULL;
+  GError *error = NULL;
+  gboolean ok;
+
+  ok = connui_cell_call_forwarding_call_get_properties_finish(
+        CONNUI_CELL_CALL_FORWARDING(object), &props, res, &error);
+  stats_call_end(CF_GET_PROPERTIES, pending->stats_start, ok, &error);
+
+  _props_ready(pending, G_DBUS_PROXY(object), CF_DATA, props, error);
+}
+
+static void
+_cf_proxy_ready_cb(GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  connui_cell_pending *pending = user_data;
+  ConnuiCellCallForwarding *proxy;
+  GError *error = NULL;
+
+  proxy = connui_cell_call_forwarding_proxy_new_for_bus_finish(res, &error);
+
+  if (!proxy)
   {
-    CONNUI_ERR("Error creating OFONO supplementary services proxy for %s [%s]",
-               path, error->message);
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      CONNUI_ERR("Error creating OFONO call forwarding proxy for %s [%s]",
+                 pending->path, error->message);
+    }
+
     g_error_free(error);
+    connui_cell_pending_free(pending);
+    return;
   }
+
+  pending->stats_start = stats_call_begin(CF_GET_PROPERTIES);
+  connui_cell_call_forwarding_call_get_properties(
+        proxy, pending->cancellable, _cf_get_properties_cb, pending);
+  g_object_unref(proxy);
 }
 
 __attribute__((visibility("hidden"))) void
-connui_cell_modem_remove_supplementary_services(ConnuiCellModem *modem)
+connui_cell_modem_add_call_forwarding(connui_cell_context *ctx,
+                                      const char *path,
+                                      GCancellable *cancellable)
 {
-  g_object_set_data(G_OBJECT(modem), DATA, NULL);
+  g_debug("Adding ofono call forwarding for %s", path);
+
+  connui_cell_call_forwarding_proxy_new_for_bus(
+        OFONO_BUS_TYPE, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+        OFONO_SERVICE, path, cancellable, _cf_proxy_ready_cb,
+        connui_cell_pending_new(ctx, path, cancellable));
+}
+
+__attribute__((visibility("hidden"))) void
+connui_cell_modem_remove_call_forwarding(ConnuiCellModem *modem)
+{
+  g_object_set_data(G_OBJECT(modem), CF_DATA, NULL);
+}
+
+static void
+_cs_get_properties_cb(GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  connui_cell_pending *pending = user_data;
+  GVariant *props = NULL;
+  GError *error = NULL;
+  gboolean ok;
+
+  ok = connui_cell_call_settings_call_get_properties_finish(
+        CONNUI_CELL_CALL_SETTINGS(object), &props, res, &error);
+  stats_call_end(CS_GET_PROPERTIES, pending->stats_start, ok, &error);
+
+  _props_ready(pending, G_DBUS_PROXY(object), CS_DATA, props, error);
 }
 
 static void
-_do_call(sups_data *sd, service_call_data *scd)
+_cs_proxy_ready_cb(GObject *object, GAsyncResult *res, gpointer user_data)
 {
-  if (!sd->proxy)
+  connui_cell_pending *pending = user_data;
+  ConnuiCellCallSettings *proxy;
+  GError *error = NULL;
+
+  proxy = connui_cell_call_settings_proxy_new_for_bus_finish(res, &error);
+
+  if (!proxy)
   {
-    g_hash_table_insert(sd->pending, GUINT_TO_POINTER(scd->id), scd);
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      CONNUI_ERR("Error creating OFONO call settings proxy for %s [%s]",
+                 pending->path, error->message);
+    }
+
+    g_error_free(error);
+    connui_cell_pending_free(pending);
     return;
   }
 
-  scd->cancellable = g_cancellable_new();
+  pending->stats_start = stats_call_begin(CS_GET_PROPERTIES);
+  connui_cell_call_settings_call_get_properties(
+        proxy, pending->cancellable, _cs_get_properties_cb, pending);
+  g_object_unref(proxy);
+}
+
+__attribute__((visibility("hidden"))) void
+connui_cell_modem_add_call_settings(connui_cell_context *ctx,
+                                    const char *path,
+                                    GCancellable *cancellable)
+{
+  g_debug("Adding ofono call settings for %s", path);
+
+  connui_cell_call_settings_proxy_new_for_bus(
+        OFONO_BUS_TYPE, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+        OFONO_SERVICE, path, cancellable, _cs_proxy_ready_cb,
+        connui_cell_pending_new(ctx, path, cancellable));
+}
+
+__attribute__((visibility("hidden"))) void
+connui_cell_modem_remove_call_settings(ConnuiCellModem *modem)
+{
+  g_object_set_data(G_OBJECT(modem), CS_DATA, NULL);
+}
+
+static void
+_remove_call(service_call_data *scd)
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+
+  g_assert(ctx);
 
-  if (scd->async_cb == _call_waiting_get_cb)
+  service_call_remove(ctx, scd->id);
+  connui_cell_context_destroy(ctx);
+}
+
+static void
+_request_free(sups_request *req)
+{
+  g_assert(req->waiters == NULL);
+
+  if (req->cancellable)
+    g_object_unref(req->cancellable);
+
+  if (req->idle_id)
+    g_source_remove(req->idle_id);
+
+  if (req->retry_id)
+    g_source_remove(req->retry_id);
+
+  if (req->result)
+    g_variant_unref(req->result);
+
+  if (req->value)
+    g_variant_unref(req->value);
+
+  g_free(req->command);
+  g_free(req->path);
+  g_free(req);
+}
+
+static void
+_request_complete(sups_request *req, GVariant *result, const GError *error)
+{
+  if (req->sd)
   {
-    connui_cell_supplementary_services_call_initiate(
-          sd->proxy, "*#43#", scd->cancellable, scd->async_cb, scd);
+    req->sd->requests = g_slist_remove(req->sd->requests, req);
+
+    if (req->sd->active == req)
+      req->sd->active = NULL;
   }
-  else if (scd->async_cb == _call_waiting_set_cb)
+
+  /* one by one, callbacks might cancel the remaining waiters */
+  while (req->waiters)
   {
-    gboolean enable = GPOINTER_TO_UINT(scd->data);
-    const char *cmd = enable ? "*43#" : "#43#";
+    service_call_data *scd = req->waiters->data;
 
-    connui_cell_supplementary_services_call_initiate(
-          sd->proxy, cmd, scd->cancellable, scd->async_cb, scd);
+    req->waiters = g_slist_delete_link(req->waiters, req->waiters);
+
+    if (error)
+      scd->error = g_error_copy(error);
+
+    req->type->reply(scd, req->path, result);
+    _remove_call(scd);
   }
-  else if (scd->async_cb == _forwarding_get_cb)
+
+  _request_free(req);
+}
+
+/* takes @error */
+static void
+_request_done(sups_request *req, GVariant *result, GError *error)
+{
+  sups_data *sd = req->sd;
+
+  if (g_error_matches(error, CONNUI_ERROR, CONNUI_ERROR_BUSY) && sd &&
+      req->waiters && req->retries < SUPS_RETRY_MAX)
   {
-    connui_cell_supplementary_services_call_initiate(
-          sd->proxy, "*#004**11#", scd->cancellable, scd->async_cb, scd);
+    guint delay = SUPS_RETRY_DELAY << req->retries;
+
+    g_debug("%s on %s busy, retrying in %ums", req->command, req->path,
+            delay);
+    req->retries++;
+    sd->stats.retries++;
+    req->retry_id = g_timeout_add(delay, _request_retry_cb, req);
+    g_error_free(error);
+
+    return;
   }
-  else
-    g_assert_not_reached();
+
+  if (!error && sd)
+  {
+    if (result && req->type->cache != SUPS_CACHE_NONE)
+      _cache_set(sd, req->type->cache, result);
+
+    if (req->type->invalidates != SUPS_CACHE_NONE)
+      _cache_clear(&sd->cache[req->type->invalidates]);
+  }
+
+  _request_complete(req, result, error);
+
+  g_clear_error(&error);
+
+  if (sd)
+    _queue_dispatch(sd);
 }
 
 static void
-_remove_call(service_call_data *scd)
+_request_cb(GObject *object, GAsyncResult *res, gpointer user_data)
 {
-  connui_cell_context *ctx = connui_cell_context_get(NULL);
+  sups_request *req = user_data;
+  gchar *result_name = NULL;
+  GVariant *value = NULL;
+  GVariant *result = NULL;
+  GError *error = NULL;
+  gboolean ok;
 
-  g_assert(ctx);
+  ok = connui_cell_supplementary_services_call_initiate_finish(
+        CONNUI_CELL_SUPPLEMENTARY_SERVICES(object), &result_name, &value, res,
+        &error);
+  stats_call_end(INITIATE, req->stats_start, ok, &error);
 
-  service_call_remove(ctx, scd->id);
-  connui_cell_context_destroy(ctx);
+  if (ok)
+  {
+    if (strcmp(result_name, req->type->name))
+    {
+      CONNUI_ERR("Unexpected result %s, ignoring", result_name);
+      g_set_error(&error, CONNUI_ERROR, CONNUI_ERROR_NOT_RECOGNIZED,
+                  "%s", result_name);
+    }
+    else
+      g_variant_get(value, "v", &result);
+
+    g_free(result_name);
+    g_variant_unref(value);
+  }
+
+  _request_done(req, result, error);
+
+  if (result)
+    g_variant_unref(result);
+}
+
+static void
+_request_set_property_cb(GObject *object, GAsyncResult *res,
+                         gpointer user_data)
+{
+  sups_request *req = user_data;
+  GError *error = NULL;
+  gboolean ok;
+
+  ok = connui_cell_call_settings_call_set_property_finish(
+        CONNUI_CELL_CALL_SETTINGS(object), res, &error);
+  stats_call_end(CS_SET_PROPERTY, req->stats_start, ok, &error);
+
+  _request_done(req, NULL, error);
 }
 
-#if 0
 static gboolean
-_sups_data_error(service_call_data *scd)
+_request_cached_idle(gpointer user_data)
+{
+  sups_request *req = user_data;
+
+  req->idle_id = 0;
+  _request_complete(req, req->result, NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* CallSettings proxy if @req can be sent as SetProperty */
+static ConnuiCellCallSettings *
+_request_settings_proxy(sups_request *req)
+{
+  sups_props *sp;
+
+  if (!req->value)
+    return NULL;
+
+  if (!(sp = _props_get(req->sd->ctx, req->path, CS_DATA)))
+    return NULL;
+
+  return CONNUI_CELL_CALL_SETTINGS(sp->proxy);
+}
+
+static void
+_request_set_method(sups_request *req, const gchar *method)
+{
+  GSList *l;
+
+  req->method = method;
+
+  for (l = req->waiters; l; l = l->next)
+    ((service_call_data *)l->data)->method = method;
+}
+
+static void
+_request_initiate(sups_request *req)
 {
-  if (scd->async_cb == _call_waiting_get_cb)
+  ConnuiCellCallSettings *proxy = _request_settings_proxy(req);
+
+  if (proxy)
   {
-    ((call_waiting_get_cb)scd->callback)(
-          FALSE, scd->error, scd->user_data);
+    _request_set_method(req, CS_SET_PROPERTY);
+    req->stats_start = stats_call_begin(CS_SET_PROPERTY);
+    connui_cell_call_settings_call_set_property(
+          proxy, req->type->property, g_variant_new_variant(req->value),
+          req->cancellable, _request_set_property_cb, req);
   }
-  else if (scd->async_cb == _noreply_query_cb ||
-           scd->async_cb == _unreachable_query_cb ||
-           scd->async_cb == _busy_query_cb)
+  else
   {
-    ((call_forwarding_get_cb)scd->callback)(
-          FALSE, NULL, scd->user_data, scd->error);
+    _request_set_method(req, INITIATE);
+    req->stats_start = stats_call_begin(INITIATE);
+    connui_cell_supplementary_services_call_initiate(
+          req->sd->proxy, req->command, req->cancellable, _request_cb, req);
   }
-  else
-    g_assert_not_reached();
+}
+
+static gboolean
+_request_retry_cb(gpointer user_data)
+{
+  sups_request *req = user_data;
+
+  req->retry_id = 0;
+  _request_initiate(req);
 
   return G_SOURCE_REMOVE;
 }
 
-/* takes ownership of the error */
+/* requests waiting to be sent */
+static guint
+_queue_depth(sups_data *sd)
+{
+  guint depth = 0;
+  GSList *l;
+
+  for (l = sd->requests; l; l = l->next)
+  {
+    sups_request *req = l->data;
+
+    if (!req->cancellable && !req->result)
+      depth++;
+  }
+
+  return depth;
+}
+
 static void
-_sups_data_error_idle(gpointer fn, gpointer cb, gpointer user_data,
-                      GError *error)
+_queue_insert(sups_data *sd, sups_request *req)
 {
-  service_call_data *scd = g_new0(service_call_data, 1);
+  GSList *l;
+  gint pos = 0;
 
-  scd->error = error;
-  scd->callback = cb;
-  scd->user_data = user_data;
-  scd->async_cb = fn;
+  for (l = sd->requests; l; l = l->next, pos++)
+  {
+    if (((sups_request *)l->data)->priority < req->priority)
+      break;
+  }
 
-  g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, (GSourceFunc)_sups_data_error,
-                  scd, (GDestroyNotify)service_call_destroy);
+  sd->requests = g_slist_insert(sd->requests, req, pos);
 }
-#endif
 
+static void
+_queue_dispatch(sups_data *sd)
+{
+  GSList *l;
+
+  if (sd->active)
+    return;
+
+  for (l = sd->requests; l; l = l->next)
+  {
+    sups_request *req = l->data;
+
+    if (!req->cancellable && !req->result &&
+        (sd->proxy || _request_settings_proxy(req)))
+    {
+      gint64 wait = g_get_monotonic_time() - req->queued_time;
+
+      sd->stats.sent++;
+      sd->stats.total_wait += wait;
+
+      if (wait > sd->stats.max_wait)
+        sd->stats.max_wait = wait;
+
+      sd->active = req;
+      req->cancellable = g_cancellable_new();
+      _request_initiate(req);
+      break;
+    }
+  }
+}
+
+static sups_request *
+_request_find(sups_data *sd, const sups_request_type *type,
+              const gchar *command)
+{
+  GSList *l;
+
+  for (l = sd->requests; l; l = l->next)
+  {
+    sups_request *req = l->data;
+
+    if (req->type == type && !strcmp(req->command, command) &&
+        !(req->cancellable && g_cancellable_is_cancelled(req->cancellable)))
+    {
+      return req;
+    }
+  }
+
+  return NULL;
+}
+
+/* drops one waiter, the request itself is cancelled with the last one */
 static void
 _sups_service_call_cancel(service_call_data *scd)
 {
-  scd->async_cb(NULL, NULL, scd);
+  sups_request *req = scd->async_data;
+
+  /* being completed */
+  if (!g_slist_find(req->waiters, scd))
+    return;
+
+  req->waiters = g_slist_remove(req->waiters, scd);
+
+  g_set_error(&scd->error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+              "Operation was cancelled.");
+  req->type->reply(scd, req->path, NULL);
+  _remove_call(scd);
+
+  if (!req->waiters)
+  {
+    if (req->cancellable && !req->retry_id)
+      g_cancellable_cancel(req->cancellable);
+    else
+    {
+      sups_data *sd = req->sd;
+
+      if (sd)
+      {
+        sd->requests = g_slist_remove(sd->requests, req);
+
+        if (sd->active == req)
+          sd->active = NULL;
+      }
+
+      _request_free(req);
+
+      if (sd)
+        _queue_dispatch(sd);
+    }
+  }
 }
 
+/* @value is set through CallSettings, if available, instead of @command */
 static guint
 _sups_service_call(const char *modem_id,
-                   GAsyncReadyCallback async_cb,
+                   const sups_request_type *type,
+                   const gchar *command,
+                   GVariant *value,
                    gpointer cb,
-                   gpointer data,
                    gpointer user_data)
 {
   GError *error = NULL;
   connui_cell_context *ctx;
   guint id;
   service_call_data *scd;
+  sups_request *req = NULL;
   sups_data *sd;
 
+  if (value)
+    g_variant_ref_sink(value);
+
   if (!(ctx = connui_cell_context_get(&error)))
-    return 0;
+    goto err;
 
   if (!(sd = _sups_data_get(modem_id, ctx, &error)))
   {
     connui_cell_context_destroy(ctx);
-    return 0;
+    goto err;
   }
 
-  id = service_call_next_id(ctx);
-  scd = service_call_add(ctx, id, (GCallback)cb, user_data);
-  scd->data = data;
-  scd->async_cb = async_cb;
-  scd->async_data = sd;
+  if (type->coalesce)
+    req = _request_find(sd, type, command);
+
+  if (req)
+    g_debug("Coalescing %s on %s", command, sd->path);
+  else
+  {
+    GVariant *result = NULL;
+    gboolean stale = TRUE;
+    sups_props *sp;
+
+    req = g_new0(sups_request, 1);
+    req->sd = sd;
+    req->path = g_strdup(sd->path);
+    req->type = type;
+    req->command = g_strdup(command);
+    req->priority = type->priority;
+    req->queued_time = g_get_monotonic_time();
+
+    if (value)
+      req->value = g_variant_ref(value);
+
+    /* might change to SetProperty once CallSettings shows up */
+    req->method = _request_settings_proxy(req) ? CS_SET_PROPERTY : INITIATE;
+
+    if (type->from_props && (sp = _props_get(ctx, sd->path, type->props)))
+      req->result = type->from_props(sp);
+
+    if (req->result)
+    {
+      g_debug("Using %s properties for %s on %s", type->props, command,
+              sd->path);
+      req->method = !strcmp(type->props, CS_DATA) ? CS_GET_PROPERTIES :
+                                                    CF_GET_PROPERTIES;
+      req->idle_id = g_idle_add(_request_cached_idle, req);
+    }
+    else if (type->cache != SUPS_CACHE_NONE)
+      result = _cache_get(sd, type->cache, &stale);
+
+    if (result && !stale)
+    {
+      g_debug("Using cached result for %s on %s", command, sd->path);
+      req->result = g_variant_ref(result);
+      req->method = SUPS_CACHE;
+      req->idle_id = g_idle_add(_request_cached_idle, req);
+    }
+
+    _queue_insert(sd, req);
+
+    if (!req->result)
+    {
+      guint depth = _queue_depth(sd);
+
+      if (depth > sd->stats.max_depth)
+        sd->stats.max_depth = depth;
+
+      _queue_dispatch(sd);
+    }
+  }
+
+  scd = service_call_add(ctx, (GCallback)cb, user_data);
+  id = scd->id;
+  scd->method = req->method;
+  scd->async_data = req;
   scd->cancel = _sups_service_call_cancel;
+  req->waiters = g_slist_append(req->waiters, scd);
 
-  _do_call(sd, scd);
+  if (value)
+    g_variant_unref(value);
 
   connui_cell_context_destroy(ctx);
 
   return id;
-}
 
+err:
+  if (value)
+    g_variant_unref(value);
 
-static gboolean
-_sups_check_cancelled(GAsyncResult *res, service_call_data *scd)
-{
-  if (!res)
-  {
-    sups_data *sd = scd->async_data;
+  g_error_free(error);
+
+  return 0;
+}
 
-    g_set_error(&scd->error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
-                "Operation was cancelled.");
+static GVariant *
+_call_waiting_from_props(sups_props *sp)
+{
+  GVariant *v = g_hash_table_lookup(sp->props,
+                                    OFONO_CALLSET_PROPERTY_CALL_WAITING);
+  GVariantBuilder b;
 
-    if (sd && sd->pending)
-      g_hash_table_remove(sd->pending, GUINT_TO_POINTER(scd->id));
+  if (!v)
+    return NULL;
 
-    return TRUE;
-  }
+  g_variant_builder_init(&b, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add(&b, "{sv}", OFONO_CALLSET_PROPERTY_CALL_WAITING, v);
 
-  return FALSE;
+  return g_variant_ref_sink(g_variant_new("(sa{sv})", "", &b));
 }
 
-static void
-_call_waiting_get_cb(GObject *object, GAsyncResult *res, gpointer data)
+static gboolean
+_call_waiting_parse(GVariant *result)
 {
-  ConnuiCellSupplementaryServices *proxy =
-      CONNUI_CELL_SUPPLEMENTARY_SERVICES(object);
-  gchar *result_name;
-  GVariant *value;
-  service_call_data *scd = data;
-  sups_data *sd = scd->async_data;
   gboolean enabled = FALSE;
+  GVariant *dict;
+  const gchar *s;
 
-  if (!_sups_check_cancelled(res, scd)&&
-      connui_cell_supplementary_services_call_initiate_finish(
-        proxy, &result_name, &value, res, &scd->error))
-  {
-    if (strcmp(result_name, "CallWaiting"))
-    {
-      CONNUI_ERR("Unexpected result %s, ignoring", result_name);
-      g_set_error(&scd->error, CONNUI_ERROR, CONNUI_ERROR_NOT_RECOGNIZED,
-                  "%s", result_name);
-    }
-    else
-    {
-      GVariant *cw;
-      GVariant *dict;
-      GVariant *v;
+  g_variant_get(result, "(&s@a{sv})", NULL, &dict);
 
-      g_variant_get(value, "v", &cw);
-      g_variant_get(cw, "(&s@a{sv})", NULL, &dict);
-      v = g_variant_lookup_value(dict, "VoiceCallWaiting", NULL);
+  if (g_variant_lookup(dict, "VoiceCallWaiting", "&s", &s))
+    enabled = !strcmp(s, "enabled");
 
-      if (v)
-      {
-        enabled = !strcmp(g_variant_get_string(v, NULL), "enabled");
-        g_variant_unref(v);
-      }
+  g_variant_unref(dict);
 
-      g_variant_unref(cw);
-    }
+  return enabled;
+}
 
-    g_free(result_name);
-    g_variant_unref(value);
-  }
+static void
+_call_waiting_get_reply(service_call_data *scd, const gchar *path,
+                        GVariant *result)
+{
+  gboolean enabled = FALSE;
 
-  ((call_waiting_get_cb)scd->callback)(
-        sd->path, enabled, scd->error, scd->user_data);
+  if (result)
+    enabled = _call_waiting_parse(result);
 
-  _remove_call(scd);
+  ((call_waiting_get_cb)scd->callback)(
+        path, enabled, scd->error, scd->user_data);
 }
 
+static const sups_request_type call_waiting_get =
+{
+  "CallWaiting", _call_waiting_get_reply, TRUE,
+  SUPS_CACHE_CALL_WAITING, SUPS_CACHE_NONE, SUPS_PRIORITY_QUERY,
+  CS_DATA, _call_waiting_from_props, NULL
+};
+
 guint
 connui_cell_sups_get_call_waiting_enabled(const char *modem_id,
                                           call_waiting_get_cb cb,
                                           gpointer user_data)
 {
-  return _sups_service_call(modem_id, _call_waiting_get_cb,
-                            cb, NULL, user_data);
+  return _sups_service_call(modem_id, &call_waiting_get, "*#43#", NULL,
+                            cb, user_data);
 }
 
 static void
-_call_waiting_set_cb(GObject *object, GAsyncResult *res, gpointer data)
+_call_waiting_set_reply(service_call_data *scd, const gchar *path,
+                        GVariant *result)
 {
-  ConnuiCellSupplementaryServices *proxy =
-      CONNUI_CELL_SUPPLEMENTARY_SERVICES(object);
-  gchar *result_name;
-  GVariant *value;
-  service_call_data *scd = data;
-  sups_data *sd = scd->async_data;
+  ((call_waiting_set_cb)scd->callback)(path, scd->error, scd->user_data);
+}
+
+static const sups_request_type call_waiting_set =
+{
+  "CallWaiting", _call_waiting_set_reply, FALSE,
+  SUPS_CACHE_NONE, SUPS_CACHE_CALL_WAITING, SUPS_PRIORITY_SET,
+  CS_DATA, NULL, OFONO_CALLSET_PROPERTY_CALL_WAITING
+};
+
+guint
+connui_cell_sups_set_call_waiting_enabled(const char *modem_id,
+                                          gboolean enabled,
+                                          call_waiting_set_cb cb,
+                                          gpointer user_data)
+{
+  return _sups_service_call(
+        modem_id, &call_waiting_set, enabled ? "*43#" : "#43#",
+        g_variant_new_string(enabled ? "enabled" : "disabled"), cb, user_data);
+}
+
+static const gchar *
+_forwarding_number(GVariant *dict, const gchar *key)
+{
+  const char *s;
+
+  if (g_variant_lookup(dict, key, "&s", &s) && *s)
+    return s;
 
-  if (!_sups_check_cancelled(res, scd) &&
-      connui_cell_supplementary_services_call_initiate_finish(
-        proxy, &result_name, &value, res, &scd->error))
+  return NULL;
+}
+
+static GVariant *
+_forwarding_from_props(sups_props *sp)
+{
+  static const gchar *names[] =
+  {
+    OFONO_CALLFWD_PROPERTY_BUSY,
+    OFONO_CALLFWD_PROPERTY_NO_REPLY,
+    OFONO_CALLFWD_PROPERTY_NOT_REACHABLE
+  };
+  GVariantBuilder b;
+  int i;
+
+  g_variant_builder_init(&b, G_VARIANT_TYPE_VARDICT);
+
+  for (i = 0; i < G_N_ELEMENTS(names); i++)
   {
-    if (strcmp(result_name, "CallWaiting"))
+    GVariant *v = g_hash_table_lookup(sp->props, names[i]);
+
+    if (!v)
     {
-      CONNUI_ERR("Unexpected result %s, ignoring", result_name);
-      g_set_error(&scd->error, CONNUI_ERROR, CONNUI_ERROR_NOT_RECOGNIZED,
-                  "%s", result_name);
+      g_variant_builder_clear(&b);
+      return NULL;
     }
 
-    g_free(result_name);
-    g_variant_unref(value);
+    g_variant_builder_add(&b, "{sv}", names[i], v);
   }
 
-  ((call_waiting_set_cb)scd->callback)(sd->path, scd->error, scd->user_data);
-
-  _remove_call(scd);
+  return g_variant_ref_sink(g_variant_new("(ssa{sv})", "", "", &b));
 }
 
-guint
-connui_cell_sups_set_call_waiting_enabled(const char *modem_id,
-                                          gboolean enabled,
-                                          call_waiting_set_cb cb,
-                                          gpointer user_data)
+/* numbers in @cf point into @result */
+static void
+_forwarding_parse(GVariant *result, connui_sups_call_forward *cf)
 {
-  return _sups_service_call(modem_id, _call_waiting_set_cb, cb,
-                            GINT_TO_POINTER(enabled), user_data);
+  GVariant *dict;
+
+  g_variant_get(result, "(&s&s@a{sv})", NULL, NULL, &dict);
+
+  cf->cond.busy.number = _forwarding_number(dict, "VoiceBusy");
+  cf->cond.no_reply.number = _forwarding_number(dict, "VoiceNoReply");
+  cf->cond.unreachable.number = _forwarding_number(dict, "VoiceNotReachable");
+
+  /* OFONO API is broken, no way to get disabled phone */
+  cf->cond.busy.enabled = !!cf->cond.busy.number;
+  cf->cond.no_reply.enabled = !!cf->cond.no_reply.number;
+  cf->cond.unreachable.enabled = !!cf->cond.unreachable.number;
+
+  g_variant_unref(dict);
 }
 
 static void
-_forwarding_get_cb(GObject *object, GAsyncResult *res, gpointer data)
+_forwarding_get_reply(service_call_data *scd, const gchar *path,
+                      GVariant *result)
 {
-  ConnuiCellSupplementaryServices *proxy =
-      CONNUI_CELL_SUPPLEMENTARY_SERVICES(object);
-  gchar *result_name;
-  GVariant *value;
-  service_call_data *scd = data;
-  sups_data *sd = scd->async_data;
-  GVariant *busy = NULL;
-  GVariant *nr = NULL;
-  GVariant *ur = NULL;
   connui_sups_call_forward scf;
   const connui_sups_call_forward *pscf = NULL;
 
-  if (!_sups_check_cancelled(res, scd) &&
-      connui_cell_supplementary_services_call_initiate_finish(
-        proxy, &result_name, &value, res, &scd->error))
+  if (result)
   {
-    if (strcmp(result_name, "CallForwarding"))
-    {
-      CONNUI_ERR("Unexpected result %s, ignoring", result_name);
-      g_set_error(&scd->error, CONNUI_ERROR, CONNUI_ERROR_NOT_RECOGNIZED,
-                  "%s", result_name);
-    }
-    else
-    {
-      GVariant *cf;
-      GVariant *dict;
-      const char *s;
+    _forwarding_parse(result, &scf);
+    pscf = &scf;
+  }
 
-      g_variant_get(value, "v", &cf);
-      g_variant_get(cf, "(&s&s@a{sv})", NULL, NULL, &dict);
+  ((call_forwarding_get_cb)scd->callback)(
+        path, pscf, scd->user_data, scd->error);
+}
 
-      if((busy = g_variant_lookup_value(dict, "VoiceBusy", NULL)) &&
-         (s = g_variant_get_string(busy, NULL)) && *s)
-      {
-        scf.cond.busy.number = s;
-      }
-      else
-        scf.cond.busy.number = NULL;
+static const sups_request_type forwarding_get =
+{
+  "CallForwarding", _forwarding_get_reply, TRUE,
+  SUPS_CACHE_CALL_FORWARDING, SUPS_CACHE_NONE, SUPS_PRIORITY_QUERY,
+  CF_DATA, _forwarding_from_props, NULL
+};
 
-      if ((nr = g_variant_lookup_value(dict, "VoiceNoReply", NULL)) &&
-          (s = g_variant_get_string(nr, NULL)) && *s)
-      {
-        scf.cond.no_reply.number = s;
-      }
-      else
-        scf.cond.no_reply.number = NULL;
+guint
+connui_cell_sups_get_call_forwarding_enabled(const char *modem_id,
+                                             call_forwarding_get_cb cb,
+                                             gpointer user_data)
+{
+  return _sups_service_call(modem_id, &forwarding_get, "*#004**11#", NULL,
+                            cb, user_data);
+}
 
-      if ((ur = g_variant_lookup_value(dict, "VoiceNotReachable", NULL)) &&
-          (s = g_variant_get_string(ur, NULL)) && *s)
-      {
-        scf.cond.unreachable.number = s;
-      }
-      else
-        scf.cond.unreachable.number = NULL;
+/*
+ * Current property values if the modem has the interface, the cached result
+ * otherwise. Neither is stored in the cache, so peeking does not extend its
+ * lifetime.
+ */
+static GVariant *
+_sups_cache_peek(connui_cell_context *ctx, sups_data *sd,
+                 const sups_request_type *type, gboolean *stale)
+{
+  sups_props *sp = _props_get(ctx, sd->path, type->props);
+  GVariant *result;
 
-      g_variant_unref(cf);
+  if (sp && (result = type->from_props(sp)))
+  {
+    if (sd->peek[type->cache])
+      g_variant_unref(sd->peek[type->cache]);
 
-      /* OFONO API is broken, no way to get disabled phone */
-      scf.cond.busy.enabled = !!scf.cond.busy.number;
-      scf.cond.no_reply.enabled = !!scf.cond.no_reply.number;
-      scf.cond.unreachable.enabled = !!scf.cond.unreachable.number;
-      pscf = &scf;
-    }
+    sd->peek[type->cache] = result;
 
-    g_free(result_name);
-    g_variant_unref(value);
+    if (stale)
+      *stale = FALSE;
+
+    return result;
   }
 
-  ((call_forwarding_get_cb)scd->callback)(
-        sd->path, pscf, scd->user_data, scd->error);
+  return _cache_get(sd, type->cache, stale);
+}
 
-  if (busy)
-    g_variant_unref(busy);
+gboolean
+connui_cell_sups_get_cached_call_waiting(const char *modem_id,
+                                         gboolean *enabled, gboolean *stale)
+{
+  connui_cell_context *ctx;
+  GVariant *result = NULL;
+  sups_data *sd;
 
-  if (nr)
-    g_variant_unref(nr);
+  g_return_val_if_fail(modem_id != NULL && enabled != NULL, FALSE);
 
-  if(ur)
-    g_variant_unref(ur);
+  ctx = connui_cell_context_get(NULL);
+  g_return_val_if_fail(ctx != NULL, FALSE);
 
-  _remove_call(scd);
+  if ((sd = _sups_data_get(modem_id, ctx, NULL)) &&
+      (result = _sups_cache_peek(ctx, sd, &call_waiting_get, stale)))
+  {
+    *enabled = _call_waiting_parse(result);
+  }
+
+  connui_cell_context_destroy(ctx);
+
+  return result != NULL;
 }
 
-guint
-connui_cell_sups_get_call_forwarding_enabled(const char *modem_id,
-                                             call_forwarding_get_cb cb,
-                                             gpointer user_data)
+gboolean
+connui_cell_sups_get_cached_call_forwarding(const char *modem_id,
+                                            connui_sups_call_forward *cf,
+                                            gboolean *stale)
+{
+  connui_cell_context *ctx;
+  GVariant *result = NULL;
+  sups_data *sd;
+
+  g_return_val_if_fail(modem_id != NULL && cf != NULL, FALSE);
+
+  ctx = connui_cell_context_get(NULL);
+  g_return_val_if_fail(ctx != NULL, FALSE);
+
+  if ((sd = _sups_data_get(modem_id, ctx, NULL)) &&
+      (result = _sups_cache_peek(ctx, sd, &forwarding_get, stale)))
+  {
+    _forwarding_parse(result, cf);
+  }
+
+  connui_cell_context_destroy(ctx);
+
+  return result != NULL;
+}
+
+gboolean
+connui_cell_sups_get_queue_stats(const char *modem_id,
+                                 connui_sups_queue_stats *stats)
+{
+  connui_cell_context *ctx;
+  sups_data *sd;
+
+  g_return_val_if_fail(modem_id != NULL && stats != NULL, FALSE);
+
+  ctx = connui_cell_context_get(NULL);
+  g_return_val_if_fail(ctx != NULL, FALSE);
+
+  if ((sd = _sups_data_get(modem_id, ctx, NULL)))
+  {
+    *stats = sd->stats;
+    stats->depth = _queue_depth(sd);
+  }
+
+  connui_cell_context_destroy(ctx);
+
+  return sd != NULL;
+}
+
+void
+connui_cell_sups_set_cache_ttl(guint ttl)
 {
-  return _sups_service_call(modem_id, _forwarding_get_cb, cb, NULL, user_data);
+  sups_cache_ttl = ttl;
 }
@@ -23,12 +23,31 @@
 #include "ofono.h"
 #include "org.ofono.Modem.h"
 #include "org.ofono.SupplementaryServices.h"
+#include "org.ofono.CallForwarding.h"
+#include "org.ofono.CallSettings.h"
 
 void
 connui_cell_modem_add_supplementary_services(connui_cell_context *ctx,
-                                             const char *path);
+                                             const char *path,
+                                             GCancellable *cancellable);
 
 void
 connui_cell_modem_remove_supplementary_services(ConnuiCellModem *modem);
 
+void
+connui_cell_modem_add_call_forwarding(connui_cell_context *ctx,
+                                      const char *path,
+                                      GCancellable *cancellable);
+
+void
+connui_cell_modem_remove_call_forwarding(ConnuiCellModem *modem);
+
+void
+connui_cell_modem_add_call_settings(connui_cell_context *ctx,
+                                    const char *path,
+                                    GCancellable *cancellable);
+
+void
+connui_cell_modem_remove_call_settings(ConnuiCellModem *modem);
+
 #endif /* __CONNUI_INTERNAL_SUPS_H_INCLUDED__ */
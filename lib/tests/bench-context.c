@@ -0,0 +1,276 @@
+/*
+ * bench-context.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Context startup time, PropertyChanged to callback latency and callbacks
+ * per second with N modems, against ofono-mock.py. Run through run-mock.sh.
+ */
+
+#include <stdlib.h>
+
+#include "connui-cellular.h"
+
+#include "ofono-mock.h"
+
+#define TIMEOUT 30000
+
+/* never sent by the mock by itself */
+#define CELL_ID_BASE 0x100000
+#define CELL_ID_DONE 0xfffffff
+
+static gint modems = 4;
+static gint samples = 200;
+static gint storm = 1000;
+
+static GOptionEntry entries[] =
+{
+  {"modems", 'n', 0, G_OPTION_ARG_INT, &modems, "Number of modems", "N"},
+  {"samples", 's', 0, G_OPTION_ARG_INT, &samples, "Latency samples", "N"},
+  {"storm", 'c', 0, G_OPTION_ARG_INT, &storm,
+   "PropertyChanged signals per modem in the storm", "N"},
+  {NULL}
+};
+
+typedef struct _bench
+{
+  gboolean ready;
+  gboolean done;
+  GHashTable *registered;
+  GHashTable *finished;
+  guint callbacks;
+  guint expected_cell_id;
+  gint64 callback_time;
+}
+bench;
+
+static bench b;
+
+static void
+_ready_cb(gboolean ready, gpointer user_data)
+{
+  b.ready = ready;
+}
+
+static void
+_net_changed_cb(const char *modem_id, const cell_network_state *state,
+                guint changed, gpointer user_data)
+{
+  gint64 now = g_get_monotonic_time();
+
+  b.callbacks++;
+
+  if (state->reg_status == CONNUI_NET_REG_STATUS_HOME &&
+      !g_hash_table_contains(b.registered, modem_id))
+  {
+    g_hash_table_add(b.registered, g_strdup(modem_id));
+    b.done = g_hash_table_size(b.registered) == (guint)modems;
+  }
+
+  if (!(changed & CONNUI_NET_CHANGED_CELL_ID))
+    return;
+
+  if (b.expected_cell_id && state->cell_id == b.expected_cell_id)
+  {
+    b.callback_time = now;
+    b.done = TRUE;
+  }
+  else if (state->cell_id == CELL_ID_DONE &&
+           !g_hash_table_contains(b.finished, modem_id))
+  {
+    g_hash_table_add(b.finished, g_strdup(modem_id));
+    b.callback_time = now;
+    b.done = g_hash_table_size(b.finished) == (guint)modems;
+  }
+}
+
+static gint
+_cmp_time(gconstpointer a, gconstpointer b)
+{
+  gint64 t1 = *(const gint64 *)a;
+  gint64 t2 = *(const gint64 *)b;
+
+  return t1 < t2 ? -1 : t1 > t2;
+}
+
+static gboolean
+_bench_startup()
+{
+  gint64 start = g_get_monotonic_time();
+
+  connui_cell_context_ready_register(_ready_cb, NULL);
+  connui_cell_net_status_changed_register(CONNUI_NET_CHANGED_ALL,
+                                          _net_changed_cb, NULL);
+
+  if (!ofono_mock_run_until(&b.ready, TIMEOUT))
+  {
+    g_printerr("context did not get ready\n");
+    return FALSE;
+  }
+
+  g_print("startup: ready after %.3f ms\n",
+          (g_get_monotonic_time() - start) / 1000.0);
+
+  if (!ofono_mock_run_until(&b.done, TIMEOUT))
+  {
+    g_printerr("only %u of %d modems registered\n",
+               g_hash_table_size(b.registered), modems);
+    return FALSE;
+  }
+
+  g_print("startup: %d modems registered after %.3f ms\n", modems,
+          (g_get_monotonic_time() - start) / 1000.0);
+
+  return TRUE;
+}
+
+static gboolean
+_bench_latency()
+{
+  gchar *path = ofono_mock_modem_path(0);
+  gint64 *latency = g_new(gint64, samples);
+  gint64 total = 0;
+  gint i;
+
+  for (i = 0; i < samples; i++)
+  {
+    gint64 emitted;
+
+    b.done = FALSE;
+    b.expected_cell_id = CELL_ID_BASE + i;
+    emitted = ofono_mock_set_property(path, "NetworkRegistration", "CellId",
+                                      g_variant_new_uint32(b.expected_cell_id));
+
+    if (!ofono_mock_run_until(&b.done, TIMEOUT))
+    {
+      g_printerr("no callback for CellId %u\n", b.expected_cell_id);
+      break;
+    }
+
+    latency[i] = b.callback_time - emitted;
+    total += latency[i];
+  }
+
+  b.expected_cell_id = 0;
+
+  if (i == samples)
+  {
+    qsort(latency, samples, sizeof(*latency), _cmp_time);
+    g_print("latency: %d samples, avg %.1f us, p50 %" G_GINT64_FORMAT
+            " us, p99 %" G_GINT64_FORMAT " us, max %" G_GINT64_FORMAT " us\n",
+            samples, (gdouble)total / samples, latency[samples / 2],
+            latency[samples * 99 / 100], latency[samples - 1]);
+  }
+
+  g_free(latency);
+  g_free(path);
+
+  return i == samples;
+}
+
+static gboolean
+_bench_storm()
+{
+  GVariant *values[] =
+  {
+    g_variant_new_uint32(CELL_ID_BASE - 1),
+    g_variant_new_uint32(CELL_ID_BASE - 2)
+  };
+  guint callbacks = b.callbacks;
+  gint64 start;
+  gdouble elapsed;
+  gint i;
+
+  b.done = FALSE;
+  start = ofono_mock_storm(NULL, "NetworkRegistration", "CellId", values,
+                           G_N_ELEMENTS(values), storm);
+
+  /* a last value that can't be coalesced away tells when it is all done */
+  for (i = 0; i < modems; i++)
+  {
+    gchar *path = ofono_mock_modem_path(i);
+
+    ofono_mock_set_property(path, "NetworkRegistration", "CellId",
+                            g_variant_new_uint32(CELL_ID_DONE));
+    g_free(path);
+  }
+
+  if (!ofono_mock_run_until(&b.done, TIMEOUT))
+  {
+    g_printerr("storm did not finish, %u of %d modems\n",
+               g_hash_table_size(b.finished), modems);
+    return FALSE;
+  }
+
+  elapsed = (b.callback_time - start) / 1000000.0;
+  callbacks = b.callbacks - callbacks;
+
+  g_print("storm: %d signals on %d modems in %.3f ms, %.0f signals/s, "
+          "%u callbacks, %.0f callbacks/s\n", (storm + 1) * modems, modems,
+          elapsed * 1000, (storm + 1) * modems / elapsed, callbacks,
+          callbacks / elapsed);
+
+  return TRUE;
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context = g_option_context_new("- connui-cellular context");
+  GError *error = NULL;
+  gboolean ok;
+  gint i;
+
+  g_option_context_add_main_entries(context, entries, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error) || modems < 1 ||
+      samples < 1 || storm < 1)
+  {
+    g_printerr("%s\n", error ? error->message : "invalid arguments");
+    return 1;
+  }
+
+  g_option_context_free(context);
+
+  if (!ofono_mock_wait(TIMEOUT))
+  {
+    g_printerr("ofono mock is not running\n");
+    return 1;
+  }
+
+  /* the mock starts with one modem */
+  for (i = 1; i < modems; i++)
+  {
+    gchar *path = ofono_mock_modem_path(i);
+
+    ofono_mock_add_modem(path, NULL);
+    g_free(path);
+  }
+
+  b.registered = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  b.finished = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  ok = _bench_startup() && _bench_latency() && _bench_storm();
+
+  connui_cell_net_status_changed_close(_net_changed_cb);
+  connui_cell_context_ready_close(_ready_cb);
+  g_hash_table_destroy(b.registered);
+  g_hash_table_destroy(b.finished);
+
+  return ok ? 0 : 1;
+}
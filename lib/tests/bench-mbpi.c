@@ -0,0 +1,226 @@
+/*
+ * bench-mbpi.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * MBPI network name lookups through the mmap-ed index, compared to parsing
+ * the XML database and running XPath on it, like it was done before.
+ */
+
+#include <glib.h>
+#include <libxml/parser.h>
+#include <libxml/xpath.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mbpi.h"
+
+/* exit code for skipped tests */
+#define SKIP 77
+
+static gint lookups = 100000;
+static gint xml_lookups = 3;
+
+static GOptionEntry entries[] =
+{
+  {"lookups", 'l', 0, G_OPTION_ARG_INT, &lookups, "Index lookups", "N"},
+  {"xml-lookups", 'x', 0, G_OPTION_ARG_INT, &xml_lookups, "XML lookups",
+   "N"},
+  {NULL}
+};
+
+typedef struct _plmn
+{
+  guint mcc;
+  guint mnc;
+  guint mnc_digits;
+}
+plmn;
+
+static gchar *
+_xml_get_name(guint mcc, guint mnc, guint mnc_digits)
+{
+  xmlDocPtr doc = xmlParseFile(MBPI_DATABASE);
+  xmlXPathContextPtr ctx;
+  xmlXPathObjectPtr obj;
+  gchar *xpath;
+  gchar *name = NULL;
+
+  if (!doc)
+    return NULL;
+
+  ctx = xmlXPathNewContext(doc);
+  xpath = g_strdup_printf(
+        "//network-id[@mcc='%03u' and @mnc='%0*u']/../../name/text()", mcc,
+        mnc_digits, mnc);
+  obj = xmlXPathEvalExpression(BAD_CAST xpath, ctx);
+
+  if (obj && obj->nodesetval && obj->nodesetval->nodeNr)
+  {
+    xmlChar *content = xmlNodeGetContent(obj->nodesetval->nodeTab[0]);
+
+    name = g_strdup((const gchar *)content);
+    xmlFree(content);
+  }
+
+  if (obj)
+    xmlXPathFreeObject(obj);
+
+  g_free(xpath);
+  xmlXPathFreeContext(ctx);
+  xmlFreeDoc(doc);
+
+  return name;
+}
+
+/* all the networks in the database, so lookups hit the whole index */
+static GArray *
+_xml_get_networks()
+{
+  GArray *networks = g_array_new(FALSE, FALSE, sizeof(plmn));
+  xmlDocPtr doc = xmlParseFile(MBPI_DATABASE);
+  xmlXPathContextPtr ctx;
+  xmlXPathObjectPtr obj;
+  int i;
+
+  if (!doc)
+    return networks;
+
+  ctx = xmlXPathNewContext(doc);
+  obj = xmlXPathEvalExpression(BAD_CAST "//network-id", ctx);
+
+  for (i = 0; obj && obj->nodesetval && i < obj->nodesetval->nodeNr; i++)
+  {
+    xmlNodePtr node = obj->nodesetval->nodeTab[i];
+    xmlChar *mcc = xmlGetProp(node, BAD_CAST "mcc");
+    xmlChar *mnc = xmlGetProp(node, BAD_CAST "mnc");
+
+    if (mcc && mnc)
+    {
+      plmn p = {atoi((const char *)mcc), atoi((const char *)mnc),
+                strlen((const char *)mnc)};
+
+      g_array_append_val(networks, p);
+    }
+
+    xmlFree(mcc);
+    xmlFree(mnc);
+  }
+
+  if (obj)
+    xmlXPathFreeObject(obj);
+
+  xmlXPathFreeContext(ctx);
+  xmlFreeDoc(doc);
+
+  return networks;
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context = g_option_context_new("- MBPI lookups");
+  GError *error = NULL;
+  GArray *networks;
+  mbpi_network network;
+  guint found = 0;
+  guint mismatches = 0;
+  gint64 start;
+  gint64 elapsed;
+  gint i;
+
+  g_option_context_add_main_entries(context, entries, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error) ||
+      lookups < 1 || xml_lookups < 1)
+  {
+    g_printerr("%s\n", error ? error->message : "invalid arguments");
+    return 1;
+  }
+
+  g_option_context_free(context);
+
+  if (!g_file_test(MBPI_DATABASE, G_FILE_TEST_EXISTS))
+  {
+    g_print("%s is missing\n", MBPI_DATABASE);
+    return SKIP;
+  }
+
+  networks = _xml_get_networks();
+
+  if (!networks->len)
+  {
+    g_printerr("no networks in %s\n", MBPI_DATABASE);
+    return 1;
+  }
+
+  /* builds the index, or maps the one in the cache dir */
+  start = g_get_monotonic_time();
+  connui_cell_mbpi_lookup(0, 0, 2, &network);
+  g_print("index: first lookup %.3f ms\n",
+          (g_get_monotonic_time() - start) / 1000.0);
+
+  start = g_get_monotonic_time();
+
+  for (i = 0; i < lookups; i++)
+  {
+    plmn *p = &g_array_index(networks, plmn, i % networks->len);
+
+    if (connui_cell_mbpi_lookup(p->mcc, p->mnc, p->mnc_digits, &network))
+      found++;
+  }
+
+  elapsed = g_get_monotonic_time() - start;
+  g_print("index: %d lookups of %u networks, %u found, %.1f ns/lookup\n",
+          lookups, networks->len, found, elapsed * 1000.0 / lookups);
+
+  if (found != (guint)lookups)
+  {
+    g_printerr("index is missing networks\n");
+    return 1;
+  }
+
+  elapsed = 0;
+
+  for (i = 0; i < xml_lookups; i++)
+  {
+    plmn *p = &g_array_index(networks, plmn,
+                             (i * networks->len) / xml_lookups);
+    gchar *name;
+
+    start = g_get_monotonic_time();
+    name = _xml_get_name(p->mcc, p->mnc, p->mnc_digits);
+    elapsed += g_get_monotonic_time() - start;
+
+    connui_cell_mbpi_lookup(p->mcc, p->mnc, p->mnc_digits, &network);
+
+    /* both should take the first provider with that network */
+    if (g_strcmp0(name, network.name))
+      mismatches++;
+
+    g_free(name);
+  }
+
+  g_print("xml: %d lookups, %.3f ms/lookup, %u names differ from index\n",
+          xml_lookups, elapsed / 1000.0 / xml_lookups, mismatches);
+
+  g_array_free(networks, TRUE);
+
+  return 0;
+}
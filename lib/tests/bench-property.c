@@ -0,0 +1,242 @@
+/*
+ * bench-property.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Replays a PropertyChanged trace through net.c's NetworkRegistration
+ * handlers, selected by property_dispatch() and by a strcmp() chain over the
+ * same table, like net.c used to have, reports ns/event.
+ */
+
+#include <string.h>
+
+#include "../context.h"
+#include "../net.h"
+
+static gchar *trace;
+static gint passes = 2000;
+
+static GOptionEntry entries[] =
+{
+  {"trace", 't', 0, G_OPTION_ARG_FILENAME, &trace,
+   "Trace file, tests/netreg.trace by default", "FILE"},
+  {"passes", 'p', 0, G_OPTION_ARG_INT, &passes, "Times to replay it", "N"},
+  {NULL}
+};
+
+typedef struct _event
+{
+  gchar *name;
+  GVariant *value;
+}
+event;
+
+/* same handlers, selected the way net.c did before property_dispatch() */
+static gboolean
+_strcmp_dispatch(const property_table *table, gpointer data,
+                 const gchar *name, GVariant *value, gboolean *found)
+{
+  const property_entry *entry;
+
+  for (entry = table->entries; entry->name; entry++)
+  {
+    if (!strcmp(entry->name, name))
+    {
+      *found = TRUE;
+      return entry->handler(data, value);
+    }
+  }
+
+  *found = FALSE;
+
+  return FALSE;
+}
+
+static GArray *
+_trace_load(const gchar *path)
+{
+  GArray *events = g_array_new(FALSE, FALSE, sizeof(event));
+  GError *error = NULL;
+  gchar *contents;
+  gchar **lines;
+  gchar **line;
+
+  if (!g_file_get_contents(path, &contents, NULL, &error))
+  {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    return events;
+  }
+
+  lines = g_strsplit(contents, "\n", -1);
+
+  for (line = lines; *line; line++)
+  {
+    gchar *sep = strchr(*line, ' ');
+    event e;
+
+    if (**line == '#' || !sep)
+      continue;
+
+    *sep = 0;
+
+    /* names come from D-Bus messages, not from the interned ones */
+    e.name = g_strdup(*line);
+    e.value = g_variant_parse(NULL, sep + 1, NULL, NULL, &error);
+
+    if (!e.value)
+    {
+      g_printerr("%s: %s\n", path, error->message);
+      g_clear_error(&error);
+      g_free(e.name);
+      continue;
+    }
+
+    g_array_append_val(events, e);
+  }
+
+  g_strfreev(lines);
+  g_free(contents);
+
+  return events;
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context = g_option_context_new("- property dispatch");
+  GError *error = NULL;
+  /* no operator names to invalidate, nobody to notify */
+  connui_cell_context *ctx = g_new0(connui_cell_context, 1);
+  property_table *table = connui_cell_net_properties();
+  GArray *events;
+  gpointer nd1;
+  gpointer nd2;
+  guint notify1 = 0;
+  guint notify2 = 0;
+  guint unknown = 0;
+  gboolean found;
+  guint total;
+  gint64 start;
+  gint64 table_time;
+  gint64 strcmp_time;
+  gint p;
+  guint i;
+
+  g_option_context_add_main_entries(context, entries, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error) || passes < 1)
+  {
+    g_printerr("%s\n", error ? error->message : "invalid arguments");
+    return 1;
+  }
+
+  g_option_context_free(context);
+
+  if (!trace)
+  {
+    const gchar *srcdir = g_getenv("srcdir");
+
+    trace = g_build_filename(srcdir ? srcdir : ".", "tests", "netreg.trace",
+                             NULL);
+  }
+
+  events = _trace_load(trace);
+
+  if (!events->len)
+  {
+    g_printerr("no events in %s\n", trace);
+    return 1;
+  }
+
+  total = events->len * passes;
+
+  /* warm up, builds the indexes, the trace has only known properties */
+  nd1 = connui_cell_net_data_new_detached(ctx);
+
+  for (i = 0; i < events->len; i++)
+  {
+    event *e = &g_array_index(events, event, i);
+
+    property_dispatch(table, nd1, e->name, e->value);
+    _strcmp_dispatch(table, nd1, e->name, e->value, &found);
+
+    if (!found)
+      unknown++;
+  }
+
+  connui_cell_net_data_free_detached(nd1);
+
+  nd1 = connui_cell_net_data_new_detached(ctx);
+  nd2 = connui_cell_net_data_new_detached(ctx);
+  start = g_get_monotonic_time();
+
+  for (p = 0; p < passes; p++)
+  {
+    for (i = 0; i < events->len; i++)
+    {
+      event *e = &g_array_index(events, event, i);
+
+      notify1 += property_dispatch(table, nd1, e->name, e->value);
+    }
+  }
+
+  table_time = g_get_monotonic_time() - start;
+  start = g_get_monotonic_time();
+
+  for (p = 0; p < passes; p++)
+  {
+    for (i = 0; i < events->len; i++)
+    {
+      event *e = &g_array_index(events, event, i);
+
+      notify2 += _strcmp_dispatch(table, nd2, e->name, e->value, &found);
+    }
+  }
+
+  strcmp_time = g_get_monotonic_time() - start;
+
+  /* the strength filter is time based, so notifications may differ a bit */
+  g_print("%u events, %d passes of %s\n", events->len, passes, trace);
+  g_print("table: %.1f ns/event, %u notifications\n",
+          table_time * 1000.0 / total, notify1);
+  g_print("strcmp: %.1f ns/event, %u notifications\n",
+          strcmp_time * 1000.0 / total, notify2);
+
+  for (i = 0; i < events->len; i++)
+  {
+    event *e = &g_array_index(events, event, i);
+
+    g_free(e->name);
+    g_variant_unref(e->value);
+  }
+
+  g_array_free(events, TRUE);
+  connui_cell_net_data_free_detached(nd1);
+  connui_cell_net_data_free_detached(nd2);
+  g_free(ctx);
+  g_free(trace);
+
+  if (unknown)
+  {
+    g_printerr("%u events of properties net.c does not handle\n", unknown);
+    return 1;
+  }
+
+  return 0;
+}
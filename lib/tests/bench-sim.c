@@ -0,0 +1,214 @@
+/*
+ * bench-sim.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * SIM state queries against ofono-mock.py. Those are served from the state
+ * kept from PropertyChanged, so they must not call SimManager.GetProperties
+ * at all. For comparison, it also times the GetProperties round-trip every
+ * query used to make.
+ */
+
+#include "connui-cellular.h"
+
+#include "ofono-mock.h"
+
+#define TIMEOUT 10000
+
+static gint queries = 10000;
+
+static GOptionEntry entries[] =
+{
+  {"queries", 'q', 0, G_OPTION_ARG_INT, &queries, "Queries of each kind",
+   "N"},
+  {NULL}
+};
+
+static gboolean sim_ok;
+
+static void
+_sim_status_cb(const char *modem_id, const connui_sim_status *status,
+               gpointer user_data)
+{
+  if (!g_strcmp0(modem_id, user_data) && *status == CONNUI_SIM_STATUS_OK)
+    sim_ok = TRUE;
+}
+
+static gdouble
+_bench_queries(const gchar *path)
+{
+  gint64 start = g_get_monotonic_time();
+  gint i;
+
+  for (i = 0; i < queries; i++)
+  {
+    connui_cell_sim_get_status(path, NULL);
+    connui_cell_sim_is_locked(path, NULL);
+    connui_cell_sim_needs_pin(path, NULL);
+    connui_cell_sim_verify_attempts_left(path, CONNUI_SIM_SECURITY_CODE_PIN,
+                                         NULL);
+    connui_cell_sim_get_present(path, NULL);
+    connui_cell_sim_get_imsi(path, NULL);
+  }
+
+  return (g_get_monotonic_time() - start) * 1000.0 / (queries * 6);
+}
+
+static gdouble
+_bench_round_trip(const gchar *path)
+{
+  GDBusConnection *bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+  gint n = MIN(queries, 1000);
+  gint64 start = g_get_monotonic_time();
+  gint i;
+
+  for (i = 0; i < n; i++)
+  {
+    GVariant *reply = g_dbus_connection_call_sync(
+          bus, "org.ofono", path, "org.ofono.SimManager", "GetProperties",
+          NULL, G_VARIANT_TYPE("(a{sv})"), G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+          NULL);
+
+    g_assert(reply);
+    g_variant_unref(reply);
+  }
+
+  g_object_unref(bus);
+
+  return (g_get_monotonic_time() - start) * 1000.0 / n;
+}
+
+/* PropertyChanged has to reach the cached state */
+static gboolean
+_wait_attempts_left(const gchar *path, guint attempts)
+{
+  gint64 end = g_get_monotonic_time() + TIMEOUT * 1000LL;
+
+  while (connui_cell_sim_verify_attempts_left(
+           path, CONNUI_SIM_SECURITY_CODE_PIN, NULL) != attempts)
+  {
+    if (g_get_monotonic_time() > end)
+      return FALSE;
+
+    ofono_mock_run_for(5);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+_wait_locked(const gchar *path, gboolean locked)
+{
+  gint64 end = g_get_monotonic_time() + TIMEOUT * 1000LL;
+
+  while (connui_cell_sim_is_locked(path, NULL) != locked)
+  {
+    if (g_get_monotonic_time() > end)
+      return FALSE;
+
+    ofono_mock_run_for(5);
+  }
+
+  return TRUE;
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context = g_option_context_new("- SIM queries");
+  GError *error = NULL;
+  gchar *path = ofono_mock_modem_path(0);
+  const gchar *locked[] = {"network", NULL};
+  const gchar *unlocked[] = {NULL};
+  GVariantBuilder retries;
+  guint round_trips;
+  gdouble cached;
+  gboolean ok = TRUE;
+
+  g_option_context_add_main_entries(context, entries, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error) || queries < 1)
+  {
+    g_printerr("%s\n", error ? error->message : "invalid arguments");
+    return 1;
+  }
+
+  g_option_context_free(context);
+
+  if (!ofono_mock_wait(TIMEOUT))
+  {
+    g_printerr("ofono mock is not running\n");
+    return 1;
+  }
+
+  connui_cell_sim_status_register(_sim_status_cb, path);
+
+  if (!ofono_mock_run_until(&sim_ok, TIMEOUT))
+  {
+    g_printerr("SIM of %s is not ready\n", path);
+    return 1;
+  }
+
+  ofono_mock_reset_call_counts();
+  cached = _bench_queries(path);
+  round_trips = ofono_mock_get_call_count("SimManager.GetProperties");
+
+  g_print("cached: %d queries, %.1f ns/query, %u GetProperties calls\n",
+          queries * 6, cached, round_trips);
+  g_print("round-trip: %.1f ns/GetProperties\n", _bench_round_trip(path));
+
+  if (round_trips)
+  {
+    g_printerr("queries still call GetProperties\n");
+    ok = FALSE;
+  }
+
+  g_variant_builder_init(&retries, G_VARIANT_TYPE("a{sy}"));
+  g_variant_builder_add(&retries, "{sy}", "pin", 2);
+  ofono_mock_set_property(path, "SimManager", "Retries",
+                          g_variant_builder_end(&retries));
+
+  if (!_wait_attempts_left(path, 2))
+  {
+    g_printerr("Retries change did not reach the cache\n");
+    ok = FALSE;
+  }
+
+  ofono_mock_set_property(path, "SimManager", "LockedPins",
+                          g_variant_new_strv(locked, -1));
+
+  if (!_wait_locked(path, TRUE))
+  {
+    g_printerr("LockedPins change did not reach the cache\n");
+    ok = FALSE;
+  }
+
+  ofono_mock_set_property(path, "SimManager", "LockedPins",
+                          g_variant_new_strv(unlocked, -1));
+
+  if (!_wait_locked(path, FALSE))
+  {
+    g_printerr("LockedPins change did not reach the cache\n");
+    ok = FALSE;
+  }
+
+  connui_cell_sim_status_close(_sim_status_cb);
+  g_free(path);
+
+  return ok ? 0 : 1;
+}
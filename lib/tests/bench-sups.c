@@ -0,0 +1,199 @@
+/*
+ * bench-sups.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Call waiting and call forwarding query latency against ofono-mock.py, on a
+ * modem with CallSettings and CallForwarding and on one that only has
+ * SupplementaryServices, so queries go through Initiate. The mock replies
+ * right away, --network-delay makes Initiate take as long as it would with
+ * the network in the loop.
+ */
+
+#include "connui-cellular.h"
+
+#include "ofono-mock.h"
+
+#define TIMEOUT 30000
+#define INITIATE "SupplementaryServices.Initiate"
+#define USSD_MODEM "/mock_ussd"
+
+static gint queries = 200;
+static gint network_delay = 0;
+
+static GOptionEntry entries[] =
+{
+  {"queries", 'q', 0, G_OPTION_ARG_INT, &queries, "Queries of each kind",
+   "N"},
+  {"network-delay", 'd', 0, G_OPTION_ARG_INT, &network_delay,
+   "Initiate reply delay in ms", "MS"},
+  {NULL}
+};
+
+static gboolean done;
+static guint errors;
+
+static void
+_call_waiting_cb(const char *modem_id, gboolean enabled, GError *error,
+                 gpointer user_data)
+{
+  if (error)
+    errors++;
+
+  done = TRUE;
+}
+
+static void
+_call_forwarding_cb(const char *modem_id, const connui_sups_call_forward *cf,
+                    gpointer user_data, GError *error)
+{
+  if (error)
+    errors++;
+
+  done = TRUE;
+}
+
+/* average us per query, or -1 */
+static gdouble
+_bench(const gchar *path, gboolean forwarding)
+{
+  gint64 start = g_get_monotonic_time();
+  gint i;
+
+  for (i = 0; i < queries; i++)
+  {
+    done = FALSE;
+
+    if (forwarding)
+    {
+      connui_cell_sups_get_call_forwarding_enabled(path, _call_forwarding_cb,
+                                                   NULL);
+    }
+    else
+    {
+      connui_cell_sups_get_call_waiting_enabled(path, _call_waiting_cb,
+                                                NULL);
+    }
+
+    if (!ofono_mock_run_until(&done, TIMEOUT))
+      return -1;
+  }
+
+  return (gdouble)(g_get_monotonic_time() - start) / queries;
+}
+
+static void
+_sim_status_cb(const char *modem_id, const connui_sim_status *status,
+               gpointer user_data)
+{
+  if (*status == CONNUI_SIM_STATUS_OK && !g_strcmp0(modem_id, user_data))
+    done = TRUE;
+}
+
+static gboolean
+_wait_modem(const gchar *path)
+{
+  gboolean ok;
+
+  done = FALSE;
+  connui_cell_sim_status_register(_sim_status_cb, (gpointer)path);
+  ok = ofono_mock_run_until(&done, TIMEOUT);
+  connui_cell_sim_status_close(_sim_status_cb);
+
+  return ok;
+}
+
+int
+main(int argc, char **argv)
+{
+  static const gchar * const interfaces[] =
+  {
+    "SimManager", "NetworkRegistration", "SupplementaryServices", NULL
+  };
+  GOptionContext *context = g_option_context_new("- sups query latency");
+  GError *error = NULL;
+  gchar *path = ofono_mock_modem_path(0);
+  gdouble props[2];
+  gdouble ussd[2];
+  guint initiates;
+  int i;
+
+  g_option_context_add_main_entries(context, entries, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error) ||
+      queries < 1 || network_delay < 0)
+  {
+    g_printerr("%s\n", error ? error->message : "invalid arguments");
+    return 1;
+  }
+
+  g_option_context_free(context);
+
+  if (!ofono_mock_wait(TIMEOUT))
+  {
+    g_printerr("ofono mock is not running\n");
+    return 1;
+  }
+
+  /* every query has to go to the backend */
+  connui_cell_sups_set_cache_ttl(0);
+  connui_cell_context_hold();
+  ofono_mock_add_modem(USSD_MODEM, interfaces);
+
+  if (!_wait_modem(path) || !_wait_modem(USSD_MODEM))
+  {
+    g_printerr("modems did not show up\n");
+    return 1;
+  }
+
+  /* CallSettings and CallForwarding properties come after the SIM */
+  ofono_mock_run_for(200);
+  ofono_mock_set_delay(INITIATE, network_delay);
+  ofono_mock_reset_call_counts();
+
+  for (i = 0; i < 2; i++)
+    props[i] = _bench(path, i);
+
+  initiates = ofono_mock_get_call_count(INITIATE);
+
+  for (i = 0; i < 2; i++)
+    ussd[i] = _bench(USSD_MODEM, i);
+
+  g_print("%d queries of each kind, Initiate delay %d ms\n", queries,
+          network_delay);
+  g_print("call waiting: properties %.1f us/query, USSD %.1f us/query\n",
+          props[0], ussd[0]);
+  g_print("call forwarding: properties %.1f us/query, USSD %.1f us/query\n",
+          props[1], ussd[1]);
+
+  g_free(path);
+
+  if (props[0] < 0 || props[1] < 0 || ussd[0] < 0 || ussd[1] < 0 || errors)
+  {
+    g_printerr("queries failed or timed out\n");
+    return 1;
+  }
+
+  if (initiates)
+  {
+    g_printerr("property backend sent %u Initiate calls\n", initiates);
+    return 1;
+  }
+
+  return 0;
+}
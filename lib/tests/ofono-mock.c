@@ -0,0 +1,234 @@
+/*
+ * ofono-mock.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ofono-mock.h"
+
+#define MOCK_SERVICE "org.ofono"
+#define MOCK_PATH "/mock"
+#define MOCK_INTERFACE "org.maemo.connui.OfonoMock"
+
+static GDBusConnection *
+_mock_bus()
+{
+  static GDBusConnection *bus;
+
+  if (!bus)
+  {
+    GError *error = NULL;
+
+    bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+
+    if (!bus)
+      g_error("Unable to get session bus [%s]", error->message);
+  }
+
+  return bus;
+}
+
+static GVariant *
+_mock_call(const gchar *method, GVariant *params, const gchar *reply_type)
+{
+  GError *error = NULL;
+  GVariant *reply;
+
+  reply = g_dbus_connection_call_sync(
+        _mock_bus(), MOCK_SERVICE, MOCK_PATH, MOCK_INTERFACE, method, params,
+        reply_type ? G_VARIANT_TYPE(reply_type) : NULL,
+        G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+
+  if (!reply)
+    g_error("ofono mock %s failed [%s]", method, error->message);
+
+  return reply;
+}
+
+static void
+_mock_call_void(const gchar *method, GVariant *params)
+{
+  g_variant_unref(_mock_call(method, params, NULL));
+}
+
+static gint64
+_mock_call_time(const gchar *method, GVariant *params)
+{
+  GVariant *reply = _mock_call(method, params, "(x)");
+  gint64 time;
+
+  g_variant_get(reply, "(x)", &time);
+  g_variant_unref(reply);
+
+  return time;
+}
+
+gboolean
+ofono_mock_wait(guint timeout_ms)
+{
+  gint64 end = g_get_monotonic_time() + timeout_ms * 1000LL;
+
+  /* mock registers its objects before it owns the name */
+  while (g_get_monotonic_time() < end)
+  {
+    GVariant *reply = g_dbus_connection_call_sync(
+          _mock_bus(), "org.freedesktop.DBus", "/org/freedesktop/DBus",
+          "org.freedesktop.DBus", "NameHasOwner",
+          g_variant_new("(s)", MOCK_SERVICE), G_VARIANT_TYPE("(b)"),
+          G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+    gboolean has_owner = FALSE;
+
+    if (reply)
+    {
+      g_variant_get(reply, "(b)", &has_owner);
+      g_variant_unref(reply);
+    }
+
+    if (has_owner)
+      return TRUE;
+
+    g_usleep(20000);
+  }
+
+  return FALSE;
+}
+
+gchar *
+ofono_mock_modem_path(guint index)
+{
+  return g_strdup_printf("/mock_%u", index);
+}
+
+void
+ofono_mock_add_modem(const gchar *path, const gchar * const *interfaces)
+{
+  static const gchar * const none[] = {NULL};
+
+  _mock_call_void("AddModem",
+                  g_variant_new("(o^as)", path, interfaces ? interfaces : none));
+}
+
+void
+ofono_mock_remove_modem(const gchar *path)
+{
+  _mock_call_void("RemoveModem", g_variant_new("(o)", path));
+}
+
+gint64
+ofono_mock_set_property(const gchar *path, const gchar *interface,
+                        const gchar *name, GVariant *value)
+{
+  return _mock_call_time("SetProperty",
+                         g_variant_new("(ossv)", path, interface, name, value));
+}
+
+gint64
+ofono_mock_storm(const gchar * const *paths, const gchar *interface,
+                 const gchar *name, GVariant **values, guint n_values,
+                 guint count)
+{
+  static const gchar * const all[] = {NULL};
+  GVariantBuilder b;
+  guint i;
+
+  g_variant_builder_init(&b, G_VARIANT_TYPE("av"));
+
+  for (i = 0; i < n_values; i++)
+    g_variant_builder_add(&b, "v", values[i]);
+
+  return _mock_call_time("Storm", g_variant_new("(^aossavu)",
+                                                paths ? paths : all, interface,
+                                                name, &b, count));
+}
+
+void
+ofono_mock_add_call(const gchar *path, const gchar *call)
+{
+  _mock_call_void("AddCall", g_variant_new("(oo)", path, call));
+}
+
+void
+ofono_mock_remove_call(const gchar *path, const gchar *call)
+{
+  _mock_call_void("RemoveCall", g_variant_new("(oo)", path, call));
+}
+
+void
+ofono_mock_set_delay(const gchar *method, guint delay)
+{
+  _mock_call_void("SetDelay", g_variant_new("(su)", method, delay));
+}
+
+void
+ofono_mock_set_error(const gchar *method, const gchar *error, guint count)
+{
+  _mock_call_void("SetError", g_variant_new("(ssu)", method, error, count));
+}
+
+guint
+ofono_mock_get_call_count(const gchar *method)
+{
+  GVariant *reply = _mock_call("GetCallCount", g_variant_new("(s)", method),
+                               "(u)");
+  guint count;
+
+  g_variant_get(reply, "(u)", &count);
+  g_variant_unref(reply);
+
+  return count;
+}
+
+void
+ofono_mock_reset_call_counts(void)
+{
+  _mock_call_void("ResetCallCounts", NULL);
+}
+
+static gboolean
+_run_timeout_cb(gpointer user_data)
+{
+  gboolean *timed_out = user_data;
+
+  *timed_out = TRUE;
+
+  return G_SOURCE_REMOVE;
+}
+
+gboolean
+ofono_mock_run_until(const gboolean *done, guint timeout_ms)
+{
+  gboolean timed_out = FALSE;
+  guint id = g_timeout_add(timeout_ms, _run_timeout_cb, &timed_out);
+
+  while (!*done && !timed_out)
+    g_main_context_iteration(NULL, TRUE);
+
+  if (!timed_out)
+    g_source_remove(id);
+
+  return *done;
+}
+
+void
+ofono_mock_run_for(guint ms)
+{
+  gboolean done = FALSE;
+
+  g_timeout_add(ms, _run_timeout_cb, &done);
+
+  while (!done)
+    g_main_context_iteration(NULL, TRUE);
+}
@@ -0,0 +1,90 @@
+/*
+ * ofono-mock.h
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __CONNUI_TESTS_OFONO_MOCK_H_INCLUDED__
+#define __CONNUI_TESTS_OFONO_MOCK_H_INCLUDED__
+
+#include <gio/gio.h>
+
+/*
+ * Client side of ofono-mock.py. All calls are synchronous and abort the test
+ * on errors. Interfaces are short names, like "NetworkRegistration", methods
+ * are like "SimManager.GetProperties". Times are g_get_monotonic_time(), the
+ * mock uses the same clock.
+ */
+
+/* waits for the mock to appear on the session bus, FALSE on timeout */
+gboolean
+ofono_mock_wait(guint timeout_ms);
+
+/* path of modem @index the mock started with */
+gchar *
+ofono_mock_modem_path(guint index);
+
+/* %NULL @interfaces adds a modem with all of them */
+void
+ofono_mock_add_modem(const gchar *path, const gchar * const *interfaces);
+
+void
+ofono_mock_remove_modem(const gchar *path);
+
+/* sets a property and emits PropertyChanged, returns when it was emitted */
+gint64
+ofono_mock_set_property(const gchar *path, const gchar *interface,
+                        const gchar *name, GVariant *value);
+
+/*
+ * emits @count PropertyChanged signals per modem in @paths (%NULL for all),
+ * cycling through @n_values @values, returns when it started emitting
+ */
+gint64
+ofono_mock_storm(const gchar * const *paths, const gchar *interface,
+                 const gchar *name, GVariant **values, guint n_values,
+                 guint count);
+
+/* emits VoiceCallManager CallAdded/CallRemoved of active call @call */
+void
+ofono_mock_add_call(const gchar *path, const gchar *call);
+
+void
+ofono_mock_remove_call(const gchar *path, const gchar *call);
+
+/* delays replies to @method by @delay ms, 0 removes the delay */
+void
+ofono_mock_set_delay(const gchar *method, guint delay);
+
+/* next @count calls to @method fail with D-Bus error @error */
+void
+ofono_mock_set_error(const gchar *method, const gchar *error, guint count);
+
+guint
+ofono_mock_get_call_count(const gchar *method);
+
+void
+ofono_mock_reset_call_counts(void);
+
+/* iterates the default main context until *@done or timeout, FALSE then */
+gboolean
+ofono_mock_run_until(const gboolean *done, guint timeout_ms);
+
+/* iterates the default main context for @ms */
+void
+ofono_mock_run_for(guint ms);
+
+#endif /* __CONNUI_TESTS_OFONO_MOCK_H_INCLUDED__ */
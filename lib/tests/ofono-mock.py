@@ -0,0 +1,639 @@
+#!/usr/bin/env python3
+#
+# ofono-mock.py
+#
+# Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+#
+# This library is free software: you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation.
+#
+# This library is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+# or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+# for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library. If not, see <https://www.gnu.org/licenses/>.
+#
+
+"""Stand-in ofono service for the test suite.
+
+Owns org.ofono on the session bus and implements the interfaces from
+data/*.xml on a number of fake modems, /mock_0 to /mock_<n - 1>. Tests script
+it through org.maemo.connui.OfonoMock on /mock, see ofono-mock.h. Methods are
+named like in the library stats, "SimManager.GetProperties".
+"""
+
+import argparse
+import os
+import signal
+import sys
+
+from gi.repository import Gio, GLib
+
+OFONO_SERVICE = 'org.ofono'
+OFONO_PREFIX = 'org.ofono.'
+MOCK_PATH = '/mock'
+
+MOCK_XML = '''
+<node>
+  <interface name="org.maemo.connui.OfonoMock">
+    <method name="AddModem">
+      <arg name="path" type="o" direction="in"/>
+      <arg name="interfaces" type="as" direction="in"/>
+    </method>
+    <method name="RemoveModem">
+      <arg name="path" type="o" direction="in"/>
+    </method>
+    <method name="SetProperty">
+      <arg name="path" type="o" direction="in"/>
+      <arg name="interface" type="s" direction="in"/>
+      <arg name="name" type="s" direction="in"/>
+      <arg name="value" type="v" direction="in"/>
+      <arg name="time" type="x" direction="out"/>
+    </method>
+    <method name="Storm">
+      <arg name="paths" type="ao" direction="in"/>
+      <arg name="interface" type="s" direction="in"/>
+      <arg name="name" type="s" direction="in"/>
+      <arg name="values" type="av" direction="in"/>
+      <arg name="count" type="u" direction="in"/>
+      <arg name="time" type="x" direction="out"/>
+    </method>
+    <method name="AddCall">
+      <arg name="path" type="o" direction="in"/>
+      <arg name="call" type="o" direction="in"/>
+    </method>
+    <method name="RemoveCall">
+      <arg name="path" type="o" direction="in"/>
+      <arg name="call" type="o" direction="in"/>
+    </method>
+    <method name="SetDelay">
+      <arg name="method" type="s" direction="in"/>
+      <arg name="delay" type="u" direction="in"/>
+    </method>
+    <method name="SetError">
+      <arg name="method" type="s" direction="in"/>
+      <arg name="error" type="s" direction="in"/>
+      <arg name="count" type="u" direction="in"/>
+    </method>
+    <method name="GetCallCount">
+      <arg name="method" type="s" direction="in"/>
+      <arg name="count" type="u" direction="out"/>
+    </method>
+    <method name="ResetCallCounts"/>
+  </interface>
+</node>
+'''
+
+MODEM_INTERFACES = [
+    'SimManager',
+    'NetworkRegistration',
+    'ConnectionManager',
+    'SupplementaryServices',
+    'VoiceCallManager',
+    'CallForwarding',
+    'CallSettings',
+]
+
+
+def _v(signature, value):
+    return GLib.Variant(signature, value)
+
+
+def _default_properties(index, interfaces):
+    return {
+        'Modem': {
+            'Powered': _v('b', True),
+            'Online': _v('b', True),
+            'Lockdown': _v('b', False),
+            'Emergency': _v('b', False),
+            'Name': _v('s', 'Mock modem %d' % index),
+            'Manufacturer': _v('s', 'Maemo'),
+            'Model': _v('s', 'mock'),
+            'Revision': _v('s', '1.0'),
+            'Serial': _v('s', '35693803%07d' % index),
+            'Type': _v('s', 'hardware'),
+            'Features': _v('as', ['sim', 'net', 'gprs', 'ussd']),
+            'Interfaces': _v('as', [OFONO_PREFIX + i for i in interfaces]),
+        },
+        'SimManager': {
+            'Present': _v('b', True),
+            'SubscriberIdentity': _v('s', '00101000%07d' % index),
+            'MobileCountryCode': _v('s', '001'),
+            'MobileNetworkCode': _v('s', '01'),
+            'ServiceProviderName': _v('s', 'Mock'),
+            'SubscriberNumbers': _v('as', []),
+            'PreferredLanguages': _v('as', ['en']),
+            'CardIdentifier': _v('s', '89001010000%07d' % index),
+            'PinRequired': _v('s', 'none'),
+            'LockedPins': _v('as', []),
+            'Retries': _v('a{sy}', {'pin': 3, 'puk': 10}),
+            'FixedDialing': _v('b', False),
+            'BarredDialing': _v('b', False),
+        },
+        'NetworkRegistration': {
+            'Mode': _v('s', 'auto'),
+            'Status': _v('s', 'registered'),
+            'LocationAreaCode': _v('q', 1),
+            'CellId': _v('u', 1),
+            'MobileCountryCode': _v('s', '001'),
+            'MobileNetworkCode': _v('s', '01'),
+            'Technology': _v('s', 'lte'),
+            'Name': _v('s', 'Mock Network'),
+            'Strength': _v('y', 80),
+        },
+        'ConnectionManager': {
+            'Attached': _v('b', True),
+            'Bearer': _v('s', 'lte'),
+            'Suspended': _v('b', False),
+            'RoamingAllowed': _v('b', False),
+            'Powered': _v('b', True),
+        },
+        'SupplementaryServices': {
+            'State': _v('s', 'idle'),
+        },
+        'VoiceCallManager': {
+            'EmergencyNumbers': _v('as', ['112', '911']),
+        },
+        'CallForwarding': {
+            'VoiceUnconditional': _v('s', ''),
+            'VoiceBusy': _v('s', ''),
+            'VoiceNoReply': _v('s', ''),
+            'VoiceNoReplyTimeout': _v('q', 20),
+            'VoiceNotReachable': _v('s', ''),
+            'ForwardingFlagOnSim': _v('b', False),
+        },
+        'CallSettings': {
+            'CallingLinePresentation': _v('s', 'enabled'),
+            'CalledLinePresentation': _v('s', 'disabled'),
+            'CallingNamePresentation': _v('s', 'unknown'),
+            'ConnectedLinePresentation': _v('s', 'disabled'),
+            'ConnectedLineRestriction': _v('s', 'disabled'),
+            'CallingLineRestriction': _v('s', 'off'),
+            'HideCallerId': _v('s', 'default'),
+            'VoiceCallWaiting': _v('s', 'disabled'),
+        },
+    }
+
+
+def _call_properties():
+    return {
+        'LineIdentification': _v('s', '+15551234567'),
+        'State': _v('s', 'active'),
+    }
+
+
+class MockError(Exception):
+    def __init__(self, name, message):
+        Exception.__init__(self, message)
+        self.name = name
+
+
+class Modem:
+    def __init__(self, path, index, interfaces):
+        self.path = path
+        self.interfaces = interfaces
+        self.props = _default_properties(index, interfaces)
+        self.registrations = []
+        self.initiating = False
+        self.voice_calls = []
+
+    def context_path(self):
+        return self.path + '/context1'
+
+
+class Mock:
+    def __init__(self, data_dir):
+        self.conn = None
+        self.modems = {}
+        self.order = []
+        self.delays = {}
+        self.errors = {}
+        self.calls = {}
+        self.introspection = {}
+
+        for name in ['Manager', 'Modem'] + MODEM_INTERFACES:
+            path = os.path.join(data_dir, OFONO_PREFIX + name + '.xml')
+
+            with open(path) as f:
+                node = Gio.DBusNodeInfo.new_for_xml(f.read())
+
+            self.introspection[name] = node.lookup_interface(
+                OFONO_PREFIX + name)
+
+    # objects
+
+    def _register(self, path, name, obj):
+        return self.conn.register_object(
+            path, self.introspection[name],
+            lambda *args: self._method_call(obj, *args), None, None)
+
+    def start(self, conn, modems):
+        self.conn = conn
+        self._register('/', 'Manager', None)
+        self.conn.register_object(
+            MOCK_PATH,
+            Gio.DBusNodeInfo.new_for_xml(MOCK_XML).interfaces[0],
+            self._mock_call, None, None)
+
+        for i in range(modems):
+            self.add_modem('/mock_%d' % i, MODEM_INTERFACES, False)
+
+    def add_modem(self, path, interfaces, notify=True):
+        if path in self.modems:
+            raise MockError('org.ofono.Error.InvalidArguments',
+                            'Modem %s exists' % path)
+
+        modem = Modem(path, len(self.order), interfaces)
+
+        for name in ['Modem'] + interfaces:
+            modem.registrations.append(self._register(path, name, modem))
+
+        self.modems[path] = modem
+        self.order.append(path)
+
+        if notify:
+            self._emit('/', 'Manager', 'ModemAdded',
+                       _v('(oa{sv})', (path, modem.props['Modem'])))
+
+    def remove_modem(self, path):
+        modem = self._modem(path)
+
+        for id in modem.registrations:
+            self.conn.unregister_object(id)
+
+        del self.modems[path]
+        self.order.remove(path)
+        self._emit('/', 'Manager', 'ModemRemoved', _v('(o)', (path,)))
+
+    def _modem(self, path):
+        modem = self.modems.get(path)
+
+        if not modem:
+            raise MockError('org.ofono.Error.NotFound',
+                            'No modem %s' % path)
+
+        return modem
+
+    def _emit(self, path, name, signal_name, params):
+        self.conn.emit_signal(None, path, OFONO_PREFIX + name, signal_name,
+                              params)
+
+    def set_property(self, modem, name, prop, value):
+        props = modem.props.get(name)
+
+        if props is None or prop not in props:
+            raise MockError('org.ofono.Error.InvalidArguments',
+                            'No property %s.%s' % (name, prop))
+
+        if props[prop].get_type_string() != value.get_type_string():
+            raise MockError('org.ofono.Error.InvalidFormat',
+                            '%s.%s is %s' % (name, prop,
+                                             props[prop].get_type_string()))
+
+        props[prop] = value
+        self._emit(modem.path, name, 'PropertyChanged',
+                   _v('(sv)', (prop, value)))
+
+    # ofono interfaces
+
+    def _method_call(self, modem, conn, sender, path, interface, method,
+                     params, invocation):
+        name = interface[len(OFONO_PREFIX):]
+        key = name + '.' + method
+        handler = getattr(self, '_%s_%s' % (name, method), None)
+
+        self.calls[key] = self.calls.get(key, 0) + 1
+
+        if not handler:
+            if method == 'GetProperties':
+                handler = self._get_properties
+            elif method == 'SetProperty':
+                handler = self._set_property
+            else:
+                invocation.return_dbus_error(
+                    'org.ofono.Error.NotImplemented', key)
+                return
+
+        error = self.errors.get(key)
+
+        if error:
+            if error[1] <= 1:
+                del self.errors[key]
+            else:
+                self.errors[key] = (error[0], error[1] - 1)
+
+            invocation.return_dbus_error(error[0], key + ' failed')
+            return
+
+        try:
+            reply = handler(modem, name, params)
+        except MockError as e:
+            invocation.return_dbus_error(e.name, str(e))
+            return
+
+        delay = self.delays.get(key, 0)
+
+        if delay:
+            GLib.timeout_add(delay, self._reply, invocation, reply)
+        else:
+            self._reply(invocation, reply)
+
+    def _reply(self, invocation, reply):
+        # modem is busy until the reply is sent, see Initiate
+        if callable(reply):
+            reply = reply()
+
+        invocation.return_value(reply)
+
+        return GLib.SOURCE_REMOVE
+
+    def _get_properties(self, modem, name, params):
+        return _v('(a{sv})', (modem.props[name],))
+
+    def _set_property(self, modem, name, params):
+        self.set_property(modem, name,
+                          params.get_child_value(0).get_string(),
+                          params.get_child_value(1).get_variant())
+
+        return None
+
+    def _Manager_GetModems(self, modem, name, params):
+        return _v('(a(oa{sv}))',
+                  ([(p, self.modems[p].props['Modem']) for p in self.order],))
+
+    def _SimManager_EnterPin(self, modem, name, params):
+        self.set_property(modem, name, 'PinRequired', _v('s', 'none'))
+
+        return None
+
+    def _SimManager_ResetPin(self, modem, name, params):
+        return self._SimManager_EnterPin(modem, name, params)
+
+    def _SimManager_ChangePin(self, modem, name, params):
+        return None
+
+    def _SimManager_LockPin(self, modem, name, params):
+        pin = params.get_child_value(0).get_string()
+        locked = modem.props[name]['LockedPins'].unpack()
+
+        if pin not in locked:
+            self.set_property(modem, name, 'LockedPins',
+                              _v('as', locked + [pin]))
+
+        return None
+
+    def _SimManager_UnlockPin(self, modem, name, params):
+        pin = params.get_child_value(0).get_string()
+        locked = modem.props[name]['LockedPins'].unpack()
+
+        if pin in locked:
+            locked.remove(pin)
+            self.set_property(modem, name, 'LockedPins', _v('as', locked))
+
+        return None
+
+    def _operators(self, modem):
+        props = modem.props['NetworkRegistration']
+        op = {
+            'Name': props['Name'],
+            'Status': _v('s', 'current'),
+            'MobileCountryCode': props['MobileCountryCode'],
+            'MobileNetworkCode': props['MobileNetworkCode'],
+            'Technologies': _v('as', [props['Technology'].get_string()]),
+        }
+
+        return _v('(a(oa{sv}))', ([(modem.path + '/operator/00101', op)],))
+
+    def _NetworkRegistration_GetOperators(self, modem, name, params):
+        return self._operators(modem)
+
+    def _NetworkRegistration_Scan(self, modem, name, params):
+        return self._operators(modem)
+
+    def _NetworkRegistration_Register(self, modem, name, params):
+        return None
+
+    def _ConnectionManager_GetContexts(self, modem, name, params):
+        props = {
+            'Active': _v('b', False),
+            'Type': _v('s', 'internet'),
+            'Name': _v('s', 'Internet'),
+            'AccessPointName': _v('s', 'internet'),
+            'Username': _v('s', ''),
+            'Password': _v('s', ''),
+            'Protocol': _v('s', 'ip'),
+            'Settings': _v('a{sv}', {}),
+        }
+
+        return _v('(a(oa{sv}))', ([(modem.context_path(), props)],))
+
+    def _VoiceCallManager_GetCalls(self, modem, name, params):
+        return _v('(a(oa{sv}))', ([(call, _call_properties())
+                                   for call in modem.voice_calls],))
+
+    def _CallForwarding_DisableAll(self, modem, name, params):
+        for prop in ['VoiceUnconditional', 'VoiceBusy', 'VoiceNoReply',
+                     'VoiceNotReachable']:
+            if modem.props[name][prop].get_string():
+                self.set_property(modem, name, prop, _v('s', ''))
+
+        return None
+
+    def _mmi(self, modem, mmi):
+        cs = modem.props['CallSettings']
+        cf = modem.props['CallForwarding']
+        waiting = {'*#43#': 'interrogation', '*43#': 'activation',
+                   '#43#': 'deactivation'}
+
+        if mmi in waiting:
+            if mmi != '*#43#':
+                value = 'enabled' if mmi == '*43#' else 'disabled'
+                self.set_property(modem, 'CallSettings', 'VoiceCallWaiting',
+                                  _v('s', value))
+
+            result = _v('(sa{sv})', (waiting[mmi], {
+                'VoiceCallWaiting': cs['VoiceCallWaiting']}))
+
+            return _v('(sv)', ('CallWaiting', result))
+
+        if mmi == '*#004**11#':
+            result = _v('(ssa{sv})', ('interrogation', 'all-conditional', {
+                prop: cf[prop] for prop in ['VoiceBusy', 'VoiceNoReply',
+                                            'VoiceNoReplyTimeout',
+                                            'VoiceNotReachable']}))
+
+            return _v('(sv)', ('CallForwarding', result))
+
+        return _v('(sv)', ('USSD', _v('s', 'mock')))
+
+    def _SupplementaryServices_Initiate(self, modem, name, params):
+        mmi = params.get_child_value(0).get_string()
+
+        # like ofono, one request at a time
+        if modem.initiating:
+            raise MockError('org.ofono.Error.InProgress',
+                            'Operation already in progress')
+
+        modem.initiating = True
+
+        def reply():
+            modem.initiating = False
+            return self._mmi(modem, mmi)
+
+        return reply
+
+    def _SupplementaryServices_Cancel(self, modem, name, params):
+        return None
+
+    # control interface
+
+    def _mock_call(self, conn, sender, path, interface, method, params,
+                   invocation):
+        try:
+            reply = getattr(self, '_mock_' + method)(params)
+        except MockError as e:
+            invocation.return_dbus_error(e.name, str(e))
+            return
+
+        invocation.return_value(reply)
+
+    def _mock_AddModem(self, params):
+        interfaces = params.get_child_value(1).unpack()
+
+        for name in interfaces:
+            if name not in MODEM_INTERFACES:
+                raise MockError('org.ofono.Error.InvalidArguments',
+                                'Unknown interface %s' % name)
+
+        self.add_modem(params.get_child_value(0).get_string(),
+                       interfaces or MODEM_INTERFACES)
+
+        return None
+
+    def _mock_RemoveModem(self, params):
+        self.remove_modem(params.get_child_value(0).get_string())
+
+        return None
+
+    def _mock_SetProperty(self, params):
+        modem = self._modem(params.get_child_value(0).get_string())
+        now = GLib.get_monotonic_time()
+
+        self.set_property(modem, params.get_child_value(1).get_string(),
+                          params.get_child_value(2).get_string(),
+                          params.get_child_value(3).get_variant())
+
+        return _v('(x)', (now,))
+
+    def _mock_Storm(self, params):
+        paths = params.get_child_value(0).unpack()
+        name = params.get_child_value(1).get_string()
+        prop = params.get_child_value(2).get_string()
+        av = params.get_child_value(3)
+        values = [av.get_child_value(i).get_variant()
+                  for i in range(av.n_children())]
+        count = params.get_child_value(4).get_uint32()
+        modems = [self._modem(path) for path in paths or self.order]
+        now = GLib.get_monotonic_time()
+
+        if not values:
+            raise MockError('org.ofono.Error.InvalidArguments', 'No values')
+
+        for i in range(count):
+            for modem in modems:
+                self.set_property(modem, name, prop, values[i % len(values)])
+
+        return _v('(x)', (now,))
+
+    def _mock_AddCall(self, params):
+        modem = self._modem(params.get_child_value(0).get_string())
+        call = params.get_child_value(1).get_string()
+
+        if call in modem.voice_calls:
+            raise MockError('org.ofono.Error.InvalidArguments',
+                            'Call %s exists' % call)
+
+        modem.voice_calls.append(call)
+        self._emit(modem.path, 'VoiceCallManager', 'CallAdded',
+                   _v('(oa{sv})', (call, _call_properties())))
+
+        return None
+
+    def _mock_RemoveCall(self, params):
+        modem = self._modem(params.get_child_value(0).get_string())
+        call = params.get_child_value(1).get_string()
+
+        if call not in modem.voice_calls:
+            raise MockError('org.ofono.Error.NotFound', 'No call %s' % call)
+
+        modem.voice_calls.remove(call)
+        self._emit(modem.path, 'VoiceCallManager', 'CallRemoved',
+                   _v('(o)', (call,)))
+
+        return None
+
+    def _mock_SetDelay(self, params):
+        method = params.get_child_value(0).get_string()
+        delay = params.get_child_value(1).get_uint32()
+
+        if delay:
+            self.delays[method] = delay
+        else:
+            self.delays.pop(method, None)
+
+        return None
+
+    def _mock_SetError(self, params):
+        method = params.get_child_value(0).get_string()
+        error = params.get_child_value(1).get_string()
+        count = params.get_child_value(2).get_uint32()
+
+        if count:
+            self.errors[method] = (error, count)
+        else:
+            self.errors.pop(method, None)
+
+        return None
+
+    def _mock_GetCallCount(self, params):
+        method = params.get_child_value(0).get_string()
+
+        return _v('(u)', (self.calls.get(method, 0),))
+
+    def _mock_ResetCallCounts(self, params):
+        self.calls.clear()
+
+        return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description='ofono stand-in')
+    parser.add_argument('--data', default=os.environ.get(
+        'OFONO_MOCK_DATA', os.path.join(os.path.dirname(__file__), '..', '..',
+                                        'data')),
+        help='directory with the ofono introspection files')
+    parser.add_argument('--modems', type=int, default=int(os.environ.get(
+        'OFONO_MOCK_MODEMS', '1')), help='number of modems at startup')
+    args = parser.parse_args()
+
+    mock = Mock(args.data)
+    loop = GLib.MainLoop()
+
+    def name_lost(conn, name):
+        sys.stderr.write('ofono-mock: unable to own %s\n' % name)
+        loop.quit()
+
+    # objects must be there before anyone sees the name
+    Gio.bus_own_name(Gio.BusType.SESSION, OFONO_SERVICE,
+                     Gio.BusNameOwnerFlags.NONE,
+                     lambda conn, name: mock.start(conn, args.modems),
+                     None, name_lost)
+    GLib.unix_signal_add(GLib.PRIORITY_DEFAULT, signal.SIGTERM, loop.quit)
+    loop.run()
+
+
+if __name__ == '__main__':
+    main()
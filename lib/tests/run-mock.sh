@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# Runs a test program against ofono-mock.py on a private session bus, with
+# caches and data in a scratch directory. Used as LOG_COMPILER for make check.
+#
+# OFONO_MOCK_MODEMS sets the number of modems the mock starts with.
+#
+
+srcdir=`dirname "$0"`
+
+if [ -z "$OFONO_MOCK_SESSION" ]; then
+  if ! command -v dbus-run-session >/dev/null 2>&1 ||
+     ! python3 -c 'from gi.repository import Gio' >/dev/null 2>&1; then
+    echo "dbus-run-session or python3 gi missing, skipping"
+    exit 77
+  fi
+
+  OFONO_MOCK_SESSION=1 exec dbus-run-session -- "$0" "$@"
+fi
+
+scratch=`mktemp -d`
+trap 'rm -rf "$scratch"' EXIT
+
+XDG_CACHE_HOME="$scratch/cache"
+XDG_DATA_HOME="$scratch/data"
+XDG_CONFIG_HOME="$scratch/config"
+CONNUI_CELL_OFONO_BUS=session
+export XDG_CACHE_HOME XDG_DATA_HOME XDG_CONFIG_HOME CONNUI_CELL_OFONO_BUS
+
+python3 "$srcdir/ofono-mock.py" &
+mock=$!
+
+"$@"
+ret=$?
+
+kill $mock
+wait $mock 2>/dev/null
+
+exit $ret
@@ -0,0 +1,185 @@
+/*
+ * test-call.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Call status as counted from GetCalls and CallAdded/CallRemoved. Listeners
+ * only hear about no calls vs. some.
+ */
+
+#include "connui-cellular.h"
+
+#include "ofono-mock.h"
+
+#define TIMEOUT 10000
+
+#define GET_CALLS "VoiceCallManager.GetCalls"
+#define MODEM "/mock_calls"
+
+typedef struct _fixture
+{
+  gchar *path;
+  gboolean done;
+  gboolean calls;
+  guint changed;
+}
+fixture;
+
+static void
+_call_status_cb(gboolean calls, gpointer user_data)
+{
+  fixture *f = user_data;
+
+  f->calls = calls;
+  f->changed++;
+  f->done = TRUE;
+}
+
+static void
+_wait(fixture *f, gboolean calls)
+{
+  g_assert_true(ofono_mock_run_until(&f->done, TIMEOUT));
+  g_assert_cmpint(f->calls, ==, calls);
+  f->done = FALSE;
+}
+
+/* current status comes first */
+static void
+fixture_setup(fixture *f, gconstpointer user_data)
+{
+  f->path = ofono_mock_modem_path(0);
+  connui_cell_call_status_register(_call_status_cb, f);
+  _wait(f, FALSE);
+  f->changed = 0;
+}
+
+static void
+fixture_teardown(fixture *f, gconstpointer user_data)
+{
+  connui_cell_call_status_close(_call_status_cb);
+  g_free(f->path);
+}
+
+static void
+test_added_removed(fixture *f, gconstpointer user_data)
+{
+  gchar *call1 = g_strconcat(f->path, "/voicecall01", NULL);
+  gchar *call2 = g_strconcat(f->path, "/voicecall02", NULL);
+
+  ofono_mock_add_call(f->path, call1);
+  _wait(f, TRUE);
+
+  /* still some calls, nothing to tell */
+  ofono_mock_add_call(f->path, call2);
+  ofono_mock_remove_call(f->path, call1);
+  ofono_mock_run_for(100);
+  g_assert_cmpuint(f->changed, ==, 1);
+
+  ofono_mock_remove_call(f->path, call2);
+  _wait(f, FALSE);
+  g_assert_cmpuint(f->changed, ==, 2);
+
+  g_free(call1);
+  g_free(call2);
+}
+
+static void
+test_modem_removed(fixture *f, gconstpointer user_data)
+{
+  /* seen by both CallAdded and GetCalls, still one call */
+  ofono_mock_add_modem(MODEM, NULL);
+  ofono_mock_add_call(MODEM, MODEM "/voicecall01");
+  _wait(f, TRUE);
+
+  /* calls of a modem go with it */
+  ofono_mock_remove_modem(MODEM);
+  _wait(f, FALSE);
+  g_assert_cmpuint(f->changed, ==, 2);
+}
+
+static connui_cell_stats_method *
+_stats_find(GList *stats, const gchar *method)
+{
+  for (; stats; stats = stats->next)
+  {
+    connui_cell_stats_method *m = stats->data;
+
+    if (!g_strcmp0(m->method, method))
+      return m;
+  }
+
+  return NULL;
+}
+
+static void
+test_get_calls_cancelled(fixture *f, gconstpointer user_data)
+{
+  connui_cell_stats_method *m;
+  GList *stats;
+  gint64 end;
+
+  connui_cell_stats_set_enabled(TRUE);
+  connui_cell_stats_reset();
+  ofono_mock_reset_call_counts();
+  ofono_mock_set_delay(GET_CALLS, 1000);
+
+  ofono_mock_add_modem(MODEM, NULL);
+  end = g_get_monotonic_time() + TIMEOUT * G_TIME_SPAN_MILLISECOND;
+
+  while (!ofono_mock_get_call_count(GET_CALLS))
+  {
+    g_assert_cmpint(g_get_monotonic_time(), <, end);
+    ofono_mock_run_for(10);
+  }
+
+  /* the modem is gone before GetCalls replied */
+  ofono_mock_remove_modem(MODEM);
+  ofono_mock_run_for(100);
+  ofono_mock_set_delay(GET_CALLS, 0);
+
+  stats = connui_cell_stats_get();
+  m = _stats_find(stats, GET_CALLS);
+  g_assert_nonnull(m);
+  g_assert_cmpuint(m->in_flight, ==, 0);
+  g_assert_cmpuint(m->calls, ==, 1);
+  g_assert_cmpuint(m->errors, ==, 1);
+  g_list_free_full(stats, g_free);
+
+  connui_cell_stats_set_enabled(FALSE);
+  g_assert_cmpuint(f->changed, ==, 0);
+}
+
+#define ADD_TEST(name, func) \
+  g_test_add(name, fixture, NULL, fixture_setup, func, fixture_teardown)
+
+int
+main(int argc, char **argv)
+{
+  g_test_init(&argc, &argv, NULL);
+
+  if (!ofono_mock_wait(TIMEOUT))
+    g_error("ofono mock is not running");
+
+  connui_cell_context_hold();
+
+  ADD_TEST("/call/added-removed", test_added_removed);
+  ADD_TEST("/call/modem-removed", test_modem_removed);
+  ADD_TEST("/call/get-calls-cancelled", test_get_calls_cancelled);
+
+  return g_test_run();
+}
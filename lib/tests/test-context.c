@@ -0,0 +1,178 @@
+/*
+ * test-context.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "connui-cellular.h"
+
+#include "ofono-mock.h"
+
+#define TIMEOUT 10000
+
+typedef struct _fixture
+{
+  gboolean done;
+  gchar *path;
+  connui_modem_status modem_status;
+  cell_network_state state;
+  gchar *operator_name;
+  guint changed;
+}
+fixture;
+
+static void
+fixture_setup(fixture *f, gconstpointer user_data)
+{
+  f->path = ofono_mock_modem_path(GPOINTER_TO_UINT(user_data));
+}
+
+static void
+fixture_teardown(fixture *f, gconstpointer user_data)
+{
+  g_free(f->operator_name);
+  g_free(f->path);
+}
+
+static void
+_ready_cb(gboolean ready, gpointer user_data)
+{
+  fixture *f = user_data;
+
+  g_assert_true(ready);
+  f->done = TRUE;
+}
+
+static void
+test_ready(fixture *f, gconstpointer user_data)
+{
+  connui_cell_context_ready_register(_ready_cb, f);
+  g_assert_true(ofono_mock_run_until(&f->done, TIMEOUT));
+  g_assert_true(connui_cell_context_is_ready());
+  connui_cell_context_ready_close(_ready_cb);
+}
+
+static void
+_modem_status_cb(const char *modem_id, const connui_modem_status *status,
+                 gpointer user_data)
+{
+  fixture *f = user_data;
+
+  if (g_strcmp0(modem_id, f->path))
+    return;
+
+  f->modem_status = *status;
+  f->done = TRUE;
+}
+
+static void
+test_modem_added_removed(fixture *f, gconstpointer user_data)
+{
+  connui_cell_modem_status_register(_modem_status_cb, f);
+  ofono_mock_add_modem(f->path, NULL);
+
+  while (f->modem_status != CONNUI_MODEM_STATUS_ONLINE)
+  {
+    f->done = FALSE;
+    g_assert_true(ofono_mock_run_until(&f->done, TIMEOUT));
+  }
+
+  f->done = FALSE;
+  ofono_mock_remove_modem(f->path);
+  g_assert_true(ofono_mock_run_until(&f->done, TIMEOUT));
+  g_assert_cmpint(f->modem_status, ==, CONNUI_MODEM_STATUS_REMOVED);
+
+  connui_cell_modem_status_close(_modem_status_cb);
+}
+
+static void
+_net_changed_cb(const char *modem_id, const cell_network_state *state,
+                guint changed, gpointer user_data)
+{
+  fixture *f = user_data;
+
+  if (g_strcmp0(modem_id, f->path))
+    return;
+
+  f->state = *state;
+  g_free(f->operator_name);
+  f->operator_name = g_strdup(state->operator_name);
+  f->changed = changed;
+  f->done = state->reg_status == CONNUI_NET_REG_STATUS_HOME;
+}
+
+static void
+test_net_state(fixture *f, gconstpointer user_data)
+{
+  connui_cell_net_status_changed_register(CONNUI_NET_CHANGED_ALL,
+                                          _net_changed_cb, f);
+  g_assert_true(ofono_mock_run_until(&f->done, TIMEOUT));
+  g_assert_cmpint(f->state.rat_name, ==, CONNUI_NET_RAT_LTE);
+  g_assert_cmpstr(f->operator_name, ==, "Mock Network");
+  g_assert_cmpuint(f->state.lac, ==, 1);
+
+  f->done = FALSE;
+  ofono_mock_set_property(f->path, "NetworkRegistration", "LocationAreaCode",
+                          g_variant_new_uint16(2));
+  g_assert_true(ofono_mock_run_until(&f->done, TIMEOUT));
+  g_assert_cmpuint(f->state.lac, ==, 2);
+  g_assert_cmpuint(f->changed, ==, CONNUI_NET_CHANGED_LAC);
+
+  connui_cell_net_status_changed_close(_net_changed_cb);
+}
+
+static void
+test_reply_delay(fixture *f, gconstpointer user_data)
+{
+  gint64 start;
+
+  ofono_mock_set_delay("NetworkRegistration.GetProperties", 500);
+
+  connui_cell_net_status_changed_register(CONNUI_NET_CHANGED_ALL,
+                                          _net_changed_cb, f);
+  start = g_get_monotonic_time();
+  ofono_mock_add_modem(f->path, NULL);
+  g_assert_true(ofono_mock_run_until(&f->done, TIMEOUT));
+  g_assert_cmpint(g_get_monotonic_time() - start, >=, 500000);
+
+  connui_cell_net_status_changed_close(_net_changed_cb);
+  ofono_mock_set_delay("NetworkRegistration.GetProperties", 0);
+  ofono_mock_remove_modem(f->path);
+}
+
+/* @modem is the index of the mock modem the test uses */
+#define ADD_TEST(name, modem, func) \
+  g_test_add(name, fixture, GUINT_TO_POINTER(modem), fixture_setup, func, \
+             fixture_teardown)
+
+int
+main(int argc, char **argv)
+{
+  g_test_init(&argc, &argv, NULL);
+
+  if (!ofono_mock_wait(TIMEOUT))
+    g_error("ofono mock is not running");
+
+  /* keep the context between tests, they run on the same mock */
+  connui_cell_context_hold();
+
+  ADD_TEST("/context/ready", 0, test_ready);
+  ADD_TEST("/context/modem-added-removed", 100, test_modem_added_removed);
+  ADD_TEST("/context/net-state", 0, test_net_state);
+  ADD_TEST("/context/reply-delay", 101, test_reply_delay);
+
+  return g_test_run();
+}
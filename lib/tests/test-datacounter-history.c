@@ -0,0 +1,246 @@
+/*
+ * test-datacounter-history.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Hourly usage history, recorded and queried with made up times in a
+ * history file of its own.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../datacounter-history.h"
+
+#define HOUR 3600
+#define SCOPE DATACOUNTER_SCOPE_HOME
+
+/* some hour in 2023 */
+#define T0 ((time_t)472222 * HOUR)
+
+static gchar *data_dir;
+
+/* an empty file is recreated by the next record */
+static void
+fixture_setup(gpointer f, gconstpointer user_data)
+{
+  gchar *path = g_build_filename(data_dir, "connui-cellular",
+                                 "datacounter-history-home", NULL);
+  int fd = g_open(path, O_WRONLY | O_CREAT, 0644);
+
+  g_assert_cmpint(fd, !=, -1);
+  g_assert_cmpint(ftruncate(fd, 0), ==, 0);
+  close(fd);
+  g_free(path);
+}
+
+static void
+fixture_teardown(gpointer f, gconstpointer user_data)
+{
+}
+
+static void
+_record(guint64 rx, guint64 tx, time_t now)
+{
+  g_assert_true(datacounter_history_record(SCOPE, rx, tx, now));
+}
+
+static void
+_assert_hours(time_t from, guint n, const guint64 *rx, const guint64 *tx)
+{
+  guint64 *r = g_new(guint64, n);
+  guint64 *t = g_new(guint64, n);
+  guint i;
+
+  g_assert_true(datacounter_history_query(SCOPE, from, HOUR, n, r, t));
+
+  for (i = 0; i < n; i++)
+  {
+    g_assert_cmpuint(r[i], ==, rx[i]);
+    g_assert_cmpuint(t[i], ==, tx[i]);
+  }
+
+  g_free(r);
+  g_free(t);
+}
+
+/* rx bytes used between @from and @to */
+static guint64
+_usage(time_t from, time_t to)
+{
+  guint64 rx;
+  guint64 tx;
+
+  g_assert_true(datacounter_history_query(SCOPE, from, to - from, 1, &rx,
+                                          &tx));
+
+  return rx;
+}
+
+static void
+test_empty(gpointer f, gconstpointer user_data)
+{
+  static const guint64 zero[2] = {0, 0};
+
+  _assert_hours(T0, 2, zero, zero);
+
+  /* what was counted before the history existed is not usage */
+  _record(1000, 100, T0);
+  _assert_hours(T0, 2, zero, zero);
+}
+
+static void
+test_spread(gpointer f, gconstpointer user_data)
+{
+  static const guint64 rx[3] = {800, 400, 0};
+  static const guint64 tx[3] = {80, 40, 0};
+
+  _record(0, 0, T0);
+  _record(600, 60, T0 + HOUR / 2);
+
+  /* 1/3 of the time since the previous record is in the first hour */
+  _record(1200, 120, T0 + 2 * HOUR);
+
+  _assert_hours(T0, 3, rx, tx);
+  g_assert_cmpuint(_usage(T0, T0 + 2 * HOUR), ==, 1200);
+}
+
+static void
+test_reset(gpointer f, gconstpointer user_data)
+{
+  _record(5000, 500, T0);
+  _record(6000, 600, T0 + 60);
+
+  /* the counters went back, everything they have now is new */
+  _record(300, 30, T0 + 120);
+
+  g_assert_cmpuint(_usage(T0, T0 + HOUR), ==, 1300);
+}
+
+static void
+test_gap(gpointer f, gconstpointer user_data)
+{
+  guint64 rx[48] = {0, };
+  guint64 tx[48] = {0, };
+  guint i;
+
+  _record(0, 0, T0);
+
+  /* two days without a record, the usage goes to the last 24 hours */
+  _record(24000, 2400, T0 + 48 * HOUR);
+
+  for (i = 24; i < 48; i++)
+  {
+    rx[i] = 1000;
+    tx[i] = 100;
+  }
+
+  _assert_hours(T0, 48, rx, tx);
+}
+
+static void
+test_range(gpointer f, gconstpointer user_data)
+{
+  guint64 rx[10];
+  guint64 tx[10];
+  guint i;
+
+  /* enough records for a few pages, the query has to find the right ones */
+  for (i = 0; i <= 1000; i++)
+    _record(i * 1000, i * 100, T0 + i * HOUR);
+
+  for (i = 0; i < G_N_ELEMENTS(rx); i++)
+  {
+    rx[i] = 1000;
+    tx[i] = 100;
+  }
+
+  _assert_hours(T0 + 500 * HOUR, G_N_ELEMENTS(rx), rx, tx);
+  g_assert_cmpuint(_usage(T0, T0 + 1000 * HOUR), ==, 1000 * 1000);
+
+  /* daily buckets */
+  g_assert_true(datacounter_history_query(SCOPE, T0 + 240 * HOUR, 24 * HOUR,
+                                          2, rx, tx));
+  g_assert_cmpuint(rx[0], ==, 24 * 1000);
+  g_assert_cmpuint(rx[1], ==, 24 * 1000);
+
+  /* nothing before the first record and after the last one */
+  g_assert_cmpuint(_usage(T0 - 10 * HOUR, T0), ==, 0);
+  g_assert_cmpuint(_usage(T0 + 1000 * HOUR, T0 + 1010 * HOUR), ==, 0);
+}
+
+static void
+test_wrap(gpointer f, gconstpointer user_data)
+{
+  /* big enough for the longest varints, so the ring fills before expiry */
+  const guint64 step = G_GUINT64_CONSTANT(1) << 50;
+  const guint hours = 8000;
+  guint i;
+
+  for (i = 0; i <= hours; i++)
+    _record(i * step, i * (step / 10), T0 + i * HOUR);
+
+  /* the oldest pages were overwritten */
+  g_assert_cmpuint(_usage(T0, T0 + HOUR), ==, 0);
+
+  /* the latest ones are still there */
+  g_assert_cmpuint(_usage(T0 + (hours - 10) * HOUR, T0 + hours * HOUR), ==,
+                   10 * step);
+}
+
+#define ADD_TEST(name, func) \
+  g_test_add(name, gpointer, NULL, fixture_setup, func, fixture_teardown)
+
+int
+main(int argc, char **argv)
+{
+  gchar *dir;
+  gchar *path;
+  int rv;
+
+  g_test_init(&argc, &argv, NULL);
+
+  /* before anything asks GLib for the data dir */
+  data_dir = g_dir_make_tmp("test-datacounter-history-XXXXXX", NULL);
+  g_assert_nonnull(data_dir);
+  g_setenv("XDG_DATA_HOME", data_dir, TRUE);
+  dir = g_build_filename(data_dir, "connui-cellular", NULL);
+  g_assert_cmpint(g_mkdir_with_parents(dir, 0755), ==, 0);
+
+  ADD_TEST("/datacounter/history/empty", test_empty);
+  ADD_TEST("/datacounter/history/spread", test_spread);
+  ADD_TEST("/datacounter/history/reset", test_reset);
+  ADD_TEST("/datacounter/history/gap", test_gap);
+  ADD_TEST("/datacounter/history/range", test_range);
+  ADD_TEST("/datacounter/history/wrap", test_wrap);
+
+  rv = g_test_run();
+
+  path = g_build_filename(dir, "datacounter-history-home", NULL);
+  g_remove(path);
+  g_rmdir(dir);
+  g_free(path);
+  g_rmdir(data_dir);
+  g_free(dir);
+  g_free(data_dir);
+
+  return rv;
+}
@@ -0,0 +1,139 @@
+/*
+ * test-emergency.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Emergency number trie, the code dialog walks it a digit at a time.
+ */
+
+#include <glib.h>
+
+#include "../emergency.h"
+
+static const gchar *const numbers[] =
+{
+  "112", "11", "911", "08", "1a2", "", NULL
+};
+
+static connui_emergency_match
+_match(const connui_emergency_trie *trie, const gchar *input)
+{
+  guint16 state = CONNUI_EMERGENCY_STATE_START;
+
+  for (; *input; input++)
+    state = connui_cell_emergency_trie_next(trie, state, *input);
+
+  return connui_cell_emergency_trie_match(trie, state);
+}
+
+static void
+test_full(void)
+{
+  connui_emergency_trie *trie = connui_cell_emergency_trie_new(numbers);
+
+  g_assert_cmpint(_match(trie, "112"), ==, CONNUI_EMERGENCY_MATCH_FULL);
+  g_assert_cmpint(_match(trie, "911"), ==, CONNUI_EMERGENCY_MATCH_FULL);
+  g_assert_cmpint(_match(trie, "08"), ==, CONNUI_EMERGENCY_MATCH_FULL);
+
+  /* a number and a prefix of another one */
+  g_assert_cmpint(_match(trie, "11"), ==, CONNUI_EMERGENCY_MATCH_FULL);
+
+  connui_cell_emergency_trie_unref(trie);
+}
+
+static void
+test_prefix(void)
+{
+  connui_emergency_trie *trie = connui_cell_emergency_trie_new(numbers);
+
+  g_assert_cmpint(_match(trie, ""), ==, CONNUI_EMERGENCY_MATCH_PREFIX);
+  g_assert_cmpint(_match(trie, "1"), ==, CONNUI_EMERGENCY_MATCH_PREFIX);
+  g_assert_cmpint(_match(trie, "91"), ==, CONNUI_EMERGENCY_MATCH_PREFIX);
+  g_assert_cmpint(_match(trie, "0"), ==, CONNUI_EMERGENCY_MATCH_PREFIX);
+
+  connui_cell_emergency_trie_unref(trie);
+}
+
+static void
+test_none(void)
+{
+  connui_emergency_trie *trie = connui_cell_emergency_trie_new(numbers);
+
+  g_assert_cmpint(_match(trie, "2"), ==, CONNUI_EMERGENCY_MATCH_NONE);
+  g_assert_cmpint(_match(trie, "1121"), ==, CONNUI_EMERGENCY_MATCH_NONE);
+  g_assert_cmpint(_match(trie, "9110"), ==, CONNUI_EMERGENCY_MATCH_NONE);
+
+  /* no way back from a dead end */
+  g_assert_cmpint(_match(trie, "2112"), ==, CONNUI_EMERGENCY_MATCH_NONE);
+
+  /* typed non-digits never match */
+  g_assert_cmpint(_match(trie, "1*2"), ==, CONNUI_EMERGENCY_MATCH_NONE);
+
+  connui_cell_emergency_trie_unref(trie);
+}
+
+static void
+test_ignored(void)
+{
+  connui_emergency_trie *trie = connui_cell_emergency_trie_new(numbers);
+
+  /* "1a2" is not a number, nor did its digits make "12" */
+  g_assert_cmpint(_match(trie, "1a2"), ==, CONNUI_EMERGENCY_MATCH_NONE);
+  g_assert_cmpint(_match(trie, "12"), ==, CONNUI_EMERGENCY_MATCH_NONE);
+
+  connui_cell_emergency_trie_unref(trie);
+}
+
+static void
+test_no_trie(void)
+{
+  /* numbers are not known yet */
+  g_assert_cmpuint(connui_cell_emergency_trie_next(
+                     NULL, CONNUI_EMERGENCY_STATE_START, '1'),
+                   ==, CONNUI_EMERGENCY_STATE_INVALID);
+  g_assert_cmpint(_match(NULL, ""), ==, CONNUI_EMERGENCY_MATCH_NONE);
+  g_assert_cmpint(_match(NULL, "112"), ==, CONNUI_EMERGENCY_MATCH_NONE);
+}
+
+static void
+test_ref(void)
+{
+  connui_emergency_trie *trie = connui_cell_emergency_trie_new(numbers);
+
+  g_assert_true(connui_cell_emergency_trie_ref(trie) == trie);
+  connui_cell_emergency_trie_unref(trie);
+
+  /* still there */
+  g_assert_cmpint(_match(trie, "112"), ==, CONNUI_EMERGENCY_MATCH_FULL);
+  connui_cell_emergency_trie_unref(trie);
+}
+
+int
+main(int argc, char **argv)
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/emergency/trie/full", test_full);
+  g_test_add_func("/emergency/trie/prefix", test_prefix);
+  g_test_add_func("/emergency/trie/none", test_none);
+  g_test_add_func("/emergency/trie/ignored", test_ignored);
+  g_test_add_func("/emergency/trie/no-trie", test_no_trie);
+  g_test_add_func("/emergency/trie/ref", test_ref);
+
+  return g_test_run();
+}
@@ -0,0 +1,92 @@
+/*
+ * test-mbpi.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * MBPI index lookups against tests/mbpi.xml. The index goes to the scratch
+ * cache dir run-mock.sh sets up.
+ */
+
+#include <glib.h>
+
+#include "../mbpi.h"
+
+static void
+_assert_name(guint mcc, guint mnc, guint mnc_digits, const gchar *name)
+{
+  mbpi_network network = {NULL, };
+
+  g_assert_true(connui_cell_mbpi_lookup(mcc, mnc, mnc_digits, &network));
+  g_assert_cmpstr(network.name, ==, name);
+}
+
+static void
+test_mnc_digits(void)
+{
+  _assert_name(1, 1, 2, "Two digits 01");
+  _assert_name(1, 1, 3, "Three digits 001");
+  _assert_name(1, 10, 3, "Three digits 010");
+
+  /* only "010" is in the database */
+  g_assert_false(connui_cell_mbpi_lookup(1, 10, 2, NULL));
+
+  /* the way the numeric API looks up, like '%02u' did */
+  g_assert_true(connui_cell_mbpi_lookup(1, 1, MBPI_MNC_DIGITS(1), NULL));
+  g_assert_false(connui_cell_mbpi_lookup(1, 10, MBPI_MNC_DIGITS(10), NULL));
+}
+
+static void
+test_invalid_mnc(void)
+{
+  /* "1x" and "" are not in the index */
+  g_assert_false(connui_cell_mbpi_lookup(1, 1, 1, NULL));
+  g_assert_false(connui_cell_mbpi_lookup(1, 0, 1, NULL));
+  g_assert_false(connui_cell_mbpi_lookup(2, 1, 2, NULL));
+}
+
+static void
+test_apn(void)
+{
+  mbpi_network network;
+
+  g_assert_true(connui_cell_mbpi_lookup(1, 1, 3, &network));
+  g_assert_cmpstr(network.apn, ==, "three.example");
+  g_assert_cmpstr(network.username, ==, "user");
+  g_assert_cmpstr(network.password, ==, "pass");
+
+  g_assert_true(connui_cell_mbpi_lookup(1, 1, 2, &network));
+  g_assert_cmpstr(network.apn, ==, "two.example");
+  g_assert_null(network.username);
+  g_assert_null(network.password);
+
+  /* internet APN is preferred over the first one */
+  g_assert_true(connui_cell_mbpi_lookup(1, 10, 3, &network));
+  g_assert_cmpstr(network.apn, ==, "internet.example");
+}
+
+int
+main(int argc, char **argv)
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/mbpi/mnc-digits", test_mnc_digits);
+  g_test_add_func("/mbpi/invalid-mnc", test_invalid_mnc);
+  g_test_add_func("/mbpi/apn", test_apn);
+
+  return g_test_run();
+}
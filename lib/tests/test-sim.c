@@ -0,0 +1,194 @@
+/*
+ * test-sim.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Asynchronous SIM code calls, those the code UI is driven from. Results
+ * arrive only through the callbacks, nothing may block in the caller.
+ */
+
+#include "connui-cellular.h"
+
+#include "ofono-mock.h"
+
+#define TIMEOUT 10000
+
+typedef struct _fixture
+{
+  gchar *path;
+  gboolean done;
+  guint called;
+  GError *error;
+}
+fixture;
+
+static void
+fixture_setup(fixture *f, gconstpointer user_data)
+{
+  f->path = ofono_mock_modem_path(0);
+  ofono_mock_reset_call_counts();
+}
+
+static void
+fixture_teardown(fixture *f, gconstpointer user_data)
+{
+  g_clear_error(&f->error);
+  g_free(f->path);
+}
+
+static void
+_code_cb(const char *modem_id, GError *error, gpointer user_data)
+{
+  fixture *f = user_data;
+
+  g_assert_cmpstr(modem_id, ==, f->path);
+
+  if (error)
+    f->error = g_error_copy(error);
+
+  f->called++;
+  f->done = TRUE;
+}
+
+static void
+_wait(fixture *f, guint id)
+{
+  g_assert_cmpuint(id, !=, 0);
+
+  /* the callback is never called from within the call */
+  g_assert_false(f->done);
+  g_assert_true(ofono_mock_run_until(&f->done, TIMEOUT));
+  g_assert_cmpuint(f->called, ==, 1);
+}
+
+static void
+test_enter_code(fixture *f, gconstpointer user_data)
+{
+  _wait(f, connui_cell_sim_enter_code(f->path, CONNUI_SIM_SECURITY_CODE_PIN,
+                                      "1234", NULL, _code_cb, f));
+  g_assert_no_error(f->error);
+  g_assert_cmpuint(ofono_mock_get_call_count("SimManager.EnterPin"), ==, 1);
+}
+
+static void
+test_enter_code_puk(fixture *f, gconstpointer user_data)
+{
+  _wait(f, connui_cell_sim_enter_code(f->path, CONNUI_SIM_SECURITY_CODE_PUK,
+                                      "12345678", "1234", _code_cb, f));
+  g_assert_no_error(f->error);
+  g_assert_cmpuint(ofono_mock_get_call_count("SimManager.ResetPin"), ==, 1);
+}
+
+static void
+test_enter_code_error(fixture *f, gconstpointer user_data)
+{
+  ofono_mock_set_error("SimManager.EnterPin",
+                       "org.ofono.Error.IncorrectPassword", 1);
+  _wait(f, connui_cell_sim_enter_code(f->path, CONNUI_SIM_SECURITY_CODE_PIN,
+                                      "0000", NULL, _code_cb, f));
+  g_assert_error(f->error, CONNUI_ERROR, CONNUI_ERROR_INCORRECT_PASSWORD);
+}
+
+static void
+test_change_code(fixture *f, gconstpointer user_data)
+{
+  _wait(f, connui_cell_sim_change_code(f->path, CONNUI_SIM_SECURITY_CODE_PIN,
+                                       "1234", "4321", _code_cb, f));
+  g_assert_no_error(f->error);
+  g_assert_cmpuint(ofono_mock_get_call_count("SimManager.ChangePin"), ==, 1);
+}
+
+static void
+test_set_code_enabled(fixture *f, gconstpointer user_data)
+{
+  _wait(f, connui_cell_sim_set_code_enabled(f->path,
+                                            CONNUI_SIM_SECURITY_CODE_PIN,
+                                            TRUE, "1234", _code_cb, f));
+  g_assert_no_error(f->error);
+  g_assert_cmpuint(ofono_mock_get_call_count("SimManager.LockPin"), ==, 1);
+
+  /* LockedPins PropertyChanged follows the reply */
+  ofono_mock_run_for(100);
+  g_assert_true(connui_cell_security_code_get_enabled(
+                  f->path, CONNUI_SIM_SECURITY_CODE_PIN, NULL));
+
+  f->done = FALSE;
+  f->called = 0;
+  _wait(f, connui_cell_sim_set_code_enabled(f->path,
+                                            CONNUI_SIM_SECURITY_CODE_PIN,
+                                            FALSE, "1234", _code_cb, f));
+  g_assert_no_error(f->error);
+  g_assert_cmpuint(ofono_mock_get_call_count("SimManager.UnlockPin"), ==, 1);
+
+  ofono_mock_run_for(100);
+  g_assert_false(connui_cell_security_code_get_enabled(
+                   f->path, CONNUI_SIM_SECURITY_CODE_PIN, NULL));
+}
+
+static void
+test_no_modem(fixture *f, gconstpointer user_data)
+{
+  g_assert_cmpuint(connui_cell_sim_enter_code("/no_such_modem",
+                                              CONNUI_SIM_SECURITY_CODE_PIN,
+                                              "1234", NULL, _code_cb, f),
+                   ==, 0);
+  ofono_mock_run_for(50);
+  g_assert_cmpuint(f->called, ==, 0);
+}
+
+static gboolean sim_ok;
+
+static void
+_sim_status_cb(const char *modem_id, const connui_sim_status *status,
+               gpointer user_data)
+{
+  if (*status == CONNUI_SIM_STATUS_OK && !g_strcmp0(modem_id, user_data))
+    sim_ok = TRUE;
+}
+
+#define ADD_TEST(name, func) \
+  g_test_add(name, fixture, NULL, fixture_setup, func, fixture_teardown)
+
+int
+main(int argc, char **argv)
+{
+  gchar *path = ofono_mock_modem_path(0);
+
+  g_test_init(&argc, &argv, NULL);
+
+  if (!ofono_mock_wait(TIMEOUT))
+    g_error("ofono mock is not running");
+
+  connui_cell_context_hold();
+  connui_cell_sim_status_register(_sim_status_cb, path);
+
+  if (!ofono_mock_run_until(&sim_ok, TIMEOUT))
+    g_error("SIM of %s is not ready", path);
+
+  connui_cell_sim_status_close(_sim_status_cb);
+  g_free(path);
+
+  ADD_TEST("/sim/async/enter-code", test_enter_code);
+  ADD_TEST("/sim/async/enter-code-puk", test_enter_code_puk);
+  ADD_TEST("/sim/async/enter-code-error", test_enter_code_error);
+  ADD_TEST("/sim/async/change-code", test_change_code);
+  ADD_TEST("/sim/async/set-code-enabled", test_set_code_enabled);
+  ADD_TEST("/sim/async/no-modem", test_no_modem);
+
+  return g_test_run();
+}
@@ -0,0 +1,334 @@
+/*
+ * test-sups.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Supplementary services request queue. The mock answers concurrent
+ * Initiate calls with InProgress like ofono does, so any request that is not
+ * serialized shows up as an error or a retry.
+ */
+
+#include "connui-cellular.h"
+
+#include "ofono-mock.h"
+
+#define TIMEOUT 10000
+#define INITIATE "SupplementaryServices.Initiate"
+
+/* a modem without CallSettings and CallForwarding, all goes through USSD */
+#define USSD_MODEM "/mock_ussd"
+
+typedef struct _fixture
+{
+  gboolean done;
+  guint pending;
+  /* completion order, "cw", "cf" or "set" */
+  GPtrArray *order;
+  guint errors;
+  guint cancelled;
+}
+fixture;
+
+static void
+fixture_setup(fixture *f, gconstpointer user_data)
+{
+  f->order = g_ptr_array_new();
+}
+
+/* no test may leave a delay behind for the next one */
+static void
+fixture_teardown(fixture *f, gconstpointer user_data)
+{
+  ofono_mock_set_delay(INITIATE, 0);
+  ofono_mock_set_delay("CallSettings.SetProperty", 0);
+  g_ptr_array_free(f->order, TRUE);
+}
+
+static void
+_completed(fixture *f, const gchar *what, GError *error)
+{
+  if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    f->cancelled++;
+  else if (error)
+  {
+    g_test_message("%s failed: %s", what, error->message);
+    f->errors++;
+  }
+
+  g_ptr_array_add(f->order, (gpointer)what);
+  f->done = !--f->pending;
+}
+
+static void
+_call_waiting_get_cb(const char *modem_id, gboolean enabled, GError *error,
+                     gpointer user_data)
+{
+  _completed(user_data, "cw", error);
+}
+
+static void
+_call_waiting_set_cb(const char *modem_id, GError *error, gpointer user_data)
+{
+  _completed(user_data, "set", error);
+}
+
+static void
+_call_forwarding_get_cb(const char *modem_id,
+                        const connui_sups_call_forward *cf,
+                        gpointer user_data, GError *error)
+{
+  _completed(user_data, "cf", error);
+}
+
+static guint
+_get_call_waiting(fixture *f)
+{
+  f->pending++;
+
+  return connui_cell_sups_get_call_waiting_enabled(USSD_MODEM,
+                                                   _call_waiting_get_cb, f);
+}
+
+static guint
+_get_call_forwarding(fixture *f)
+{
+  f->pending++;
+
+  return connui_cell_sups_get_call_forwarding_enabled(USSD_MODEM,
+                                                      _call_forwarding_get_cb,
+                                                      f);
+}
+
+static guint
+_set_call_waiting(fixture *f, const gchar *path, gboolean enabled)
+{
+  f->pending++;
+
+  return connui_cell_sups_set_call_waiting_enabled(path, enabled,
+                                                   _call_waiting_set_cb, f);
+}
+
+static const gchar *
+_service_call_method(guint id)
+{
+  GList *calls = connui_cell_service_calls_get();
+  const gchar *method = NULL;
+  GList *l;
+
+  for (l = calls; l; l = l->next)
+  {
+    connui_cell_service_call_info *info = l->data;
+
+    if (info->id == id)
+      method = info->method;
+  }
+
+  g_list_free_full(calls, g_free);
+
+  return method;
+}
+
+static void
+test_serialized(fixture *f, gconstpointer user_data)
+{
+  connui_sups_queue_stats before;
+  connui_sups_queue_stats after;
+  int i;
+
+  g_assert_true(connui_cell_sups_get_queue_stats(USSD_MODEM, &before));
+  ofono_mock_reset_call_counts();
+  ofono_mock_set_delay(INITIATE, 50);
+
+  /* identical queries share one Initiate */
+  for (i = 0; i < 5; i++)
+    _get_call_waiting(f);
+
+  _get_call_forwarding(f);
+  _set_call_waiting(f, USSD_MODEM, TRUE);
+  _set_call_waiting(f, USSD_MODEM, FALSE);
+
+  g_assert_true(ofono_mock_run_until(&f->done, TIMEOUT));
+
+  g_assert_cmpuint(f->errors, ==, 0);
+  g_assert_cmpuint(f->order->len, ==, 8);
+  g_assert_cmpuint(ofono_mock_get_call_count(INITIATE), ==, 4);
+
+  g_assert_true(connui_cell_sups_get_queue_stats(USSD_MODEM, &after));
+  g_assert_cmpuint(after.sent - before.sent, ==, 4);
+  g_assert_cmpuint(after.retries - before.retries, ==, 0);
+  g_assert_cmpuint(after.depth, ==, 0);
+  g_assert_cmpuint(after.max_depth, >=, 3);
+}
+
+static void
+test_priority(fixture *f, gconstpointer user_data)
+{
+  ofono_mock_set_delay(INITIATE, 50);
+
+  /* the first one is sent right away, sets go before the queued queries */
+  _get_call_waiting(f);
+  _get_call_forwarding(f);
+  _set_call_waiting(f, USSD_MODEM, TRUE);
+
+  g_assert_true(ofono_mock_run_until(&f->done, TIMEOUT));
+
+  g_assert_cmpuint(f->errors, ==, 0);
+  g_assert_cmpuint(f->order->len, ==, 3);
+  g_assert_cmpstr(g_ptr_array_index(f->order, 0), ==, "cw");
+  g_assert_cmpstr(g_ptr_array_index(f->order, 1), ==, "set");
+  g_assert_cmpstr(g_ptr_array_index(f->order, 2), ==, "cf");
+}
+
+static void
+test_busy_retry(fixture *f, gconstpointer user_data)
+{
+  connui_sups_queue_stats before;
+  connui_sups_queue_stats after;
+
+  g_assert_true(connui_cell_sups_get_queue_stats(USSD_MODEM, &before));
+
+  /* another client keeps ofono busy for a while */
+  ofono_mock_set_error(INITIATE, "org.ofono.Error.InProgress", 2);
+  _get_call_forwarding(f);
+
+  g_assert_true(ofono_mock_run_until(&f->done, TIMEOUT));
+  g_assert_cmpuint(f->errors, ==, 0);
+
+  g_assert_true(connui_cell_sups_get_queue_stats(USSD_MODEM, &after));
+  g_assert_cmpuint(after.sent - before.sent, ==, 1);
+  g_assert_cmpuint(after.retries - before.retries, ==, 2);
+}
+
+static void
+test_cancel_queued(fixture *f, gconstpointer user_data)
+{
+  guint id;
+
+  ofono_mock_reset_call_counts();
+  ofono_mock_set_delay(INITIATE, 50);
+
+  _get_call_waiting(f);
+  id = _get_call_forwarding(f);
+  connui_cell_cancel_service_call(id);
+
+  g_assert_true(ofono_mock_run_until(&f->done, TIMEOUT));
+
+  g_assert_cmpuint(f->errors, ==, 0);
+  g_assert_cmpuint(f->cancelled, ==, 1);
+  g_assert_cmpuint(ofono_mock_get_call_count(INITIATE), ==, 1);
+}
+
+static void
+test_cancel_unknown(fixture *f, gconstpointer user_data)
+{
+  guint id = _get_call_waiting(f);
+
+  g_assert_true(ofono_mock_run_until(&f->done, TIMEOUT));
+
+  /* completed already, cancelling it is not an error */
+  connui_cell_cancel_service_call(id);
+  connui_cell_cancel_service_call(0);
+  ofono_mock_run_for(50);
+
+  g_assert_cmpuint(f->cancelled, ==, 0);
+  g_assert_cmpuint(f->order->len, ==, 1);
+}
+
+static void
+test_method(fixture *f, gconstpointer user_data)
+{
+  gchar *path = ofono_mock_modem_path(0);
+  guint id;
+
+  ofono_mock_set_delay(INITIATE, 50);
+  ofono_mock_set_delay("CallSettings.SetProperty", 50);
+
+  id = _get_call_waiting(f);
+  g_assert_cmpstr(_service_call_method(id), ==, INITIATE);
+
+  /* modem 0 has CallSettings */
+  id = _set_call_waiting(f, path, TRUE);
+  g_assert_cmpstr(_service_call_method(id), ==, "CallSettings.SetProperty");
+
+  g_assert_true(ofono_mock_run_until(&f->done, TIMEOUT));
+  g_assert_cmpuint(f->errors, ==, 0);
+
+  g_free(path);
+}
+
+static gboolean sim_ok;
+
+static void
+_sim_status_cb(const char *modem_id, const connui_sim_status *status,
+               gpointer user_data)
+{
+  if (*status == CONNUI_SIM_STATUS_OK && !g_strcmp0(modem_id, user_data))
+    sim_ok = TRUE;
+}
+
+static void
+_wait_sim_ok(const gchar *path)
+{
+  sim_ok = FALSE;
+  connui_cell_sim_status_register(_sim_status_cb, (gpointer)path);
+
+  if (!ofono_mock_run_until(&sim_ok, TIMEOUT))
+    g_error("%s did not show up", path);
+
+  connui_cell_sim_status_close(_sim_status_cb);
+}
+
+#define ADD_TEST(name, func) \
+  g_test_add(name, fixture, NULL, fixture_setup, func, fixture_teardown)
+
+int
+main(int argc, char **argv)
+{
+  static const gchar * const interfaces[] =
+  {
+    "SimManager", "NetworkRegistration", "SupplementaryServices", NULL
+  };
+  gchar *path = ofono_mock_modem_path(0);
+
+  g_test_init(&argc, &argv, NULL);
+
+  if (!ofono_mock_wait(TIMEOUT))
+    g_error("ofono mock is not running");
+
+  /* the queue is what is tested, not the cache */
+  connui_cell_sups_set_cache_ttl(0);
+  connui_cell_context_hold();
+  ofono_mock_add_modem(USSD_MODEM, interfaces);
+  _wait_sim_ok(USSD_MODEM);
+
+  /* CallSettings of modem 0 for the SetProperty path */
+  _wait_sim_ok(path);
+  g_free(path);
+
+  /* let the rest of the interfaces settle */
+  ofono_mock_run_for(200);
+
+  ADD_TEST("/sups/queue/serialized", test_serialized);
+  ADD_TEST("/sups/queue/priority", test_priority);
+  ADD_TEST("/sups/queue/busy-retry", test_busy_retry);
+  ADD_TEST("/sups/queue/cancel-queued", test_cancel_queued);
+  ADD_TEST("/sups/queue/cancel-unknown", test_cancel_unknown);
+  ADD_TEST("/sups/method", test_method);
+
+  return g_test_run();
+}
@@ -0,0 +1,502 @@
+/*
+ * traffic.c
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <connui/connui-log.h>
+#include <connui/connui-utils.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "context.h"
+
+#include "connmgr.h"
+#include "traffic.h"
+
+#define PROC_NET_DEV "/proc/net/dev"
+
+/* ms, sampling slows down while interfaces are idle */
+#define TRAFFIC_INTERVAL_MIN 1000
+#define TRAFFIC_INTERVAL_MAX 8000
+
+#define MCE_SERVICE "com.nokia.mce"
+#define MCE_REQUEST_PATH "/com/nokia/mce/request"
+#define MCE_REQUEST_IF "com.nokia.mce.request"
+#define MCE_SIGNAL_PATH "/com/nokia/mce/signal"
+#define MCE_SIGNAL_IF "com.nokia.mce.signal"
+#define MCE_DISPLAY_SIG "display_status_ind"
+#define MCE_DISPLAY_STATUS_GET "get_display_status"
+#define MCE_DISPLAY_OFF_STRING "off"
+
+typedef struct _traffic_iface
+{
+  gchar *modem_id;
+  gchar *interface;
+  guint64 base_rx;
+  guint64 base_tx;
+  guint64 last_rx;
+  guint64 last_tx;
+  gint64 last_time;
+  gboolean seen;
+}
+traffic_iface;
+
+typedef struct _traffic_sampler
+{
+  connui_cell_context *ctx;
+  /* traffic_iface by modem path */
+  GHashTable *ifaces;
+  guint timeout_id;
+  guint interval;
+  GDBusConnection *system_bus;
+  guint display_id;
+  GCancellable *cancellable;
+  gboolean display_off;
+  /* closed by a subscriber while samples are being delivered */
+  gboolean dispatching;
+  gboolean free_pending;
+}
+traffic_sampler;
+
+typedef struct _traffic_counters
+{
+  guint64 rx;
+  guint64 tx;
+}
+traffic_counters;
+
+static void
+_sampler_schedule(traffic_sampler *ts);
+
+static void
+_sampler_free(traffic_sampler *ts);
+
+static void
+_iface_free(gpointer data)
+{
+  traffic_iface *ti = data;
+
+  g_free(ti->modem_id);
+  g_free(ti->interface);
+  g_free(ti);
+}
+
+/* returns interface name -> traffic_counters */
+static GHashTable *
+_read_counters()
+{
+  GHashTable *counters;
+  char line[512];
+  FILE *fp = fopen(PROC_NET_DEV, "r");
+
+  if (!fp)
+  {
+    CONNUI_ERR("Unable to open " PROC_NET_DEV);
+    return NULL;
+  }
+
+  counters = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+  while (fgets(line, sizeof(line), fp))
+  {
+    char *colon = strchr(line, ':');
+    traffic_counters *c;
+    guint64 rx;
+    guint64 tx;
+
+    /* skip the two header lines */
+    if (!colon)
+      continue;
+
+    *colon = 0;
+
+    if (sscanf(colon + 1, "%" G_GUINT64_FORMAT " %*u %*u %*u %*u %*u %*u %*u"
+               " %" G_GUINT64_FORMAT, &rx, &tx) != 2)
+    {
+      continue;
+    }
+
+    c = g_new(traffic_counters, 1);
+    c->rx = rx;
+    c->tx = tx;
+    g_hash_table_insert(counters, g_strdup(g_strstrip(line)), c);
+  }
+
+  fclose(fp);
+
+  return counters;
+}
+
+/* returns TRUE if there was any traffic, @notify is FALSE on resume */
+static gboolean
+_iface_sample(traffic_sampler *ts, traffic_iface *ti,
+              const traffic_counters *c, gint64 now, gboolean notify)
+{
+  cell_traffic_sample sample;
+  guint64 rx = c->rx;
+  guint64 tx = c->tx;
+  gint64 elapsed;
+
+  /*
+   * counter went back, interface was re-created or a 32-bit counter wrapped,
+   * rx and tx do not necessarily do that at the same time
+   */
+  if (rx < ti->last_rx)
+  {
+    ti->base_rx -= ti->last_rx;
+    ti->last_rx = 0;
+  }
+
+  if (tx < ti->last_tx)
+  {
+    ti->base_tx -= ti->last_tx;
+    ti->last_tx = 0;
+  }
+
+  elapsed = MAX(now - ti->last_time, 1);
+
+  sample.interface = ti->interface;
+  sample.rx_bytes = rx - ti->base_rx;
+  sample.tx_bytes = tx - ti->base_tx;
+  sample.rx_rate = (rx - ti->last_rx) * G_USEC_PER_SEC / elapsed;
+  sample.tx_rate = (tx - ti->last_tx) * G_USEC_PER_SEC / elapsed;
+
+  ti->last_rx = rx;
+  ti->last_tx = tx;
+  ti->last_time = now;
+
+  if (!notify)
+    return FALSE;
+
+  connui_utils_notify_notify(ts->ctx->traffic_cbs, ti->modem_id, &sample,
+                             NULL);
+
+  return sample.rx_rate || sample.tx_rate;
+}
+
+/* syncs ifaces with modem interfaces, returns FALSE if there are none */
+static gboolean
+_sampler_update(traffic_sampler *ts, GHashTable *counters, gboolean notify)
+{
+  GHashTableIter iter;
+  const gchar *path;
+  gpointer modem;
+  traffic_iface *ti;
+  gboolean active = FALSE;
+  gint64 now = g_get_monotonic_time();
+
+  g_hash_table_iter_init(&iter, ts->ifaces);
+
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&ti))
+    ti->seen = FALSE;
+
+  g_hash_table_iter_init(&iter, ts->ctx->modems);
+
+  while (g_hash_table_iter_next(&iter, (gpointer *)&path, &modem))
+  {
+    const gchar *interface = connui_cell_connection_get_interface(modem);
+    traffic_counters *c;
+
+    if (!interface || !(c = g_hash_table_lookup(counters, interface)))
+      continue;
+
+    ti = g_hash_table_lookup(ts->ifaces, path);
+
+    if (ti && g_strcmp0(ti->interface, interface))
+    {
+      g_hash_table_remove(ts->ifaces, path);
+      ti = NULL;
+    }
+
+    if (!ti)
+    {
+      g_debug("Start sampling %s for modem %s", interface, path);
+
+      ti = g_new0(traffic_iface, 1);
+      ti->modem_id = g_strdup(path);
+      ti->interface = g_strdup(interface);
+      ti->base_rx = ti->last_rx = c->rx;
+      ti->base_tx = ti->last_tx = c->tx;
+      ti->last_time = now;
+      g_hash_table_insert(ts->ifaces, ti->modem_id, ti);
+      active = TRUE;
+    }
+    else if (_iface_sample(ts, ti, c, now, notify))
+      active = TRUE;
+
+    ti->seen = TRUE;
+  }
+
+  g_hash_table_iter_init(&iter, ts->ifaces);
+
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&ti))
+  {
+    if (!ti->seen)
+    {
+      g_debug("Stop sampling %s for modem %s", ti->interface, ti->modem_id);
+      g_hash_table_iter_remove(&iter);
+    }
+  }
+
+  if (active)
+    ts->interval = TRAFFIC_INTERVAL_MIN;
+  else
+    ts->interval = MIN(ts->interval * 2, TRAFFIC_INTERVAL_MAX);
+
+  return g_hash_table_size(ts->ifaces) > 0;
+}
+
+static gboolean
+_sampler_timeout_cb(gpointer user_data)
+{
+  traffic_sampler *ts = user_data;
+  GHashTable *counters = _read_counters();
+
+  ts->timeout_id = 0;
+
+  if (counters)
+  {
+    gboolean more;
+
+    ts->dispatching = TRUE;
+    more = _sampler_update(ts, counters, TRUE);
+    ts->dispatching = FALSE;
+    g_hash_table_destroy(counters);
+
+    if (ts->free_pending)
+      _sampler_free(ts);
+    else if (more)
+      _sampler_schedule(ts);
+  }
+  else
+  {
+    /* try again later, do not leave subscribers without samples */
+    ts->interval = MIN(ts->interval * 2, TRAFFIC_INTERVAL_MAX);
+    _sampler_schedule(ts);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+_sampler_schedule(traffic_sampler *ts)
+{
+  if (!ts->timeout_id && !ts->display_off)
+  {
+    ts->timeout_id = g_timeout_add(ts->interval, _sampler_timeout_cb, ts);
+  }
+}
+
+static void
+_sampler_stop(traffic_sampler *ts)
+{
+  if (ts->timeout_id)
+  {
+    g_source_remove(ts->timeout_id);
+    ts->timeout_id = 0;
+  }
+}
+
+static void
+_sampler_start(traffic_sampler *ts)
+{
+  GHashTable *counters;
+
+  if (ts->timeout_id || ts->display_off)
+    return;
+
+  if ((counters = _read_counters()))
+  {
+    gboolean more = _sampler_update(ts, counters, FALSE);
+
+    ts->interval = TRAFFIC_INTERVAL_MIN;
+
+    if (more)
+      _sampler_schedule(ts);
+
+    g_hash_table_destroy(counters);
+  }
+}
+
+static void
+_display_set(traffic_sampler *ts, const gchar *status)
+{
+  gboolean off = !g_strcmp0(status, MCE_DISPLAY_OFF_STRING);
+
+  if (off == ts->display_off)
+    return;
+
+  g_debug("Display is %s, %s traffic sampling", status,
+          off ? "pausing" : "resuming");
+
+  ts->display_off = off;
+
+  if (off)
+    _sampler_stop(ts);
+  else
+    _sampler_start(ts);
+}
+
+static void
+_display_status_cb(GDBusConnection *connection, const gchar *sender_name,
+                   const gchar *object_path, const gchar *interface_name,
+                   const gchar *signal_name, GVariant *parameters,
+                   gpointer user_data)
+{
+  const gchar *status;
+
+  if (g_variant_is_of_type(parameters, G_VARIANT_TYPE("(s)")))
+  {
+    g_variant_get(parameters, "(&s)", &status);
+    _display_set(user_data, status);
+  }
+}
+
+static void
+_get_display_status_cb(GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  GError *error = NULL;
+  GVariant *v;
+  const gchar *status;
+
+  v = g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), res, &error);
+
+  if (!v)
+  {
+    /* no MCE, assume the display is on */
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_debug("Unable to get display status: %s", error->message);
+
+    g_error_free(error);
+    return;
+  }
+
+  g_variant_get(v, "(&s)", &status);
+  _display_set(user_data, status);
+  g_variant_unref(v);
+}
+
+static void
+_display_watch(traffic_sampler *ts)
+{
+  GError *error = NULL;
+
+  ts->system_bus = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, &error);
+
+  if (!ts->system_bus)
+  {
+    CONNUI_ERR("Unable to get system bus: %s", error->message);
+    g_error_free(error);
+    return;
+  }
+
+  ts->display_id = g_dbus_connection_signal_subscribe(
+        ts->system_bus, NULL, MCE_SIGNAL_IF, MCE_DISPLAY_SIG, MCE_SIGNAL_PATH,
+        NULL, G_DBUS_SIGNAL_FLAGS_NONE, _display_status_cb, ts, NULL);
+  g_dbus_connection_call(ts->system_bus, MCE_SERVICE, MCE_REQUEST_PATH,
+                         MCE_REQUEST_IF, MCE_DISPLAY_STATUS_GET, NULL,
+                         G_VARIANT_TYPE("(s)"), G_DBUS_CALL_FLAGS_NONE, -1,
+                         ts->cancellable, _get_display_status_cb, ts);
+}
+
+static traffic_sampler *
+_sampler_new(connui_cell_context *ctx)
+{
+  traffic_sampler *ts = g_new0(traffic_sampler, 1);
+
+  ts->ctx = ctx;
+  ts->ifaces = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                     _iface_free);
+  ts->interval = TRAFFIC_INTERVAL_MIN;
+  ts->cancellable = g_cancellable_new();
+  _display_watch(ts);
+
+  return ts;
+}
+
+static void
+_sampler_free(traffic_sampler *ts)
+{
+  _sampler_stop(ts);
+  g_cancellable_cancel(ts->cancellable);
+  g_object_unref(ts->cancellable);
+
+  if (ts->system_bus)
+  {
+    g_dbus_connection_signal_unsubscribe(ts->system_bus, ts->display_id);
+    g_object_unref(ts->system_bus);
+  }
+
+  g_hash_table_destroy(ts->ifaces);
+  g_free(ts);
+}
+
+__attribute__((visibility("hidden"))) void
+connui_cell_traffic_kick(connui_cell_context *ctx)
+{
+  if (ctx->traffic)
+    _sampler_start(ctx->traffic);
+}
+
+gboolean
+connui_cell_traffic_register(cell_traffic_cb cb, gpointer user_data)
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+
+  g_return_val_if_fail(ctx != NULL, FALSE);
+
+  ctx->traffic_cbs = connui_utils_notify_add(ctx->traffic_cbs,
+                                             (connui_utils_notify)cb,
+                                             user_data);
+
+  if (!ctx->traffic)
+    ctx->traffic = _sampler_new(ctx);
+
+  _sampler_start(ctx->traffic);
+
+  connui_cell_context_destroy(ctx);
+
+  return TRUE;
+}
+
+void
+connui_cell_traffic_close(cell_traffic_cb cb)
+{
+  connui_cell_context *ctx = connui_cell_context_get(NULL);
+
+  g_return_if_fail(ctx != NULL);
+
+  ctx->traffic_cbs = connui_utils_notify_remove(ctx->traffic_cbs, cb);
+
+  if (!ctx->traffic_cbs && ctx->traffic)
+  {
+    traffic_sampler *ts = ctx->traffic;
+
+    ctx->traffic = NULL;
+
+    if (ts->dispatching)
+    {
+      _sampler_stop(ts);
+      ts->free_pending = TRUE;
+    }
+    else
+      _sampler_free(ts);
+  }
+
+  connui_cell_context_destroy(ctx);
+}
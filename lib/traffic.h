@@ -0,0 +1,27 @@
+/*
+ * traffic.h
+ *
+ * Copyright (C) 2024 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __CONNUI_INTERNAL_TRAFFIC_H_INCLUDED__
+#define __CONNUI_INTERNAL_TRAFFIC_H_INCLUDED__
+
+/* call when a modem gets a data interface, (re)starts sampling */
+__attribute__((visibility("hidden"))) void
+connui_cell_traffic_kick(connui_cell_context *ctx);
+
+#endif /* __CONNUI_INTERNAL_TRAFFIC_H_INCLUDED__ */
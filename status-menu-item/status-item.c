@@ -34,7 +34,8 @@ struct _ConnuiCellularStatusItemClass
 
 struct _ConnuiCellularModem
 {
-  gchar *id;
+  /* interned, compared by pointer */
+  const gchar *id;
   cell_network_state state;
   cell_connection_status connmgr_status;
   const gchar *mode;
@@ -46,6 +47,9 @@ typedef struct _ConnuiCellularModem ConnuiCellularModem;
 struct _ConnuiCellularStatusItemPrivate
 {
   GList *modems;
+  /* modems in snapshot order, rebuilt once the generation changes */
+  connui_cell_modems *snapshot;
+  ConnuiCellularModem **slots;
   osso_context_t *osso_context;
   ConnuiPixbufCache *pixbuf_cache;
   osso_display_state_t display_state;
@@ -71,23 +75,60 @@ _find_modem(ConnuiCellularStatusItem *item, const char *modem_id)
   ConnuiCellularStatusItemPrivate *priv = PRIVATE(item);
   GList *l;
 
+  modem_id = g_intern_string(modem_id);
+
   for (l = priv->modems; l; l = l->next)
   {
-    if (!strcmp(((ConnuiCellularModem *)l->data)->id, modem_id))
+    if (((ConnuiCellularModem *)l->data)->id == modem_id)
       return l->data;
   }
 
   return NULL;
 }
 
+/* slots point to the modems, drop them when the list changes */
+static void
+_slots_invalidate(ConnuiCellularStatusItemPrivate *priv)
+{
+  g_free(priv->slots);
+  priv->slots = NULL;
+}
+
+static void
+_slots_update(ConnuiCellularStatusItem *item)
+{
+  ConnuiCellularStatusItemPrivate *priv = PRIVATE(item);
+  guint i;
+
+  if (priv->snapshot &&
+      priv->snapshot->generation != connui_cell_modem_get_generation())
+  {
+    connui_cell_modems_unref(priv->snapshot);
+    priv->snapshot = NULL;
+    _slots_invalidate(priv);
+  }
+
+  if (!priv->snapshot)
+    priv->snapshot = connui_cell_modem_get_snapshot();
+
+  if (priv->slots)
+    return;
+
+  priv->slots = g_new0(ConnuiCellularModem *, priv->snapshot->count);
+
+  for (i = 0; i < priv->snapshot->count; i++)
+    priv->slots[i] = _find_modem(item, priv->snapshot->ids[i]);
+}
+
 static ConnuiCellularModem *
 _add_modem(ConnuiCellularStatusItem *item, const char *modem_id)
 {
   ConnuiCellularStatusItemPrivate *priv = PRIVATE(item);
   ConnuiCellularModem *modem = g_new0(ConnuiCellularModem, 1);
 
-  modem->id = g_strdup(modem_id);
+  modem->id = g_intern_string(modem_id);
   priv->modems = g_list_append(priv->modems, modem);
+  _slots_invalidate(priv);
 
   return modem;
 }
@@ -106,7 +147,6 @@ _get_modem(ConnuiCellularStatusItem *item, const char *modem_id)
 static void
 _free_modem(ConnuiCellularModem *modem)
 {
-  g_free(modem->id);
   g_free(modem);
 }
 
@@ -203,10 +243,11 @@ connui_cellular_status_item_update_icon(ConnuiCellularStatusItem *item,
   GdkPixbuf *pixbuf = NULL;
   GdkPixbuf *icon;
   ConnuiCellularModem *modem;
-  GList *modems, *l;
+  GList *l;
   gboolean changed = priv->modems_changed;
   int x = 0;
   int count = 0;
+  guint i;
 
   if (priv->display_state == OSSO_DISPLAY_OFF)
   {
@@ -225,9 +266,9 @@ connui_cellular_status_item_update_icon(ConnuiCellularStatusItem *item,
   if (!changed)
     return;
 
-  modems = connui_cell_modem_get_modems();
+  _slots_update(item);
 
-  count = g_list_length(modems);
+  count = priv->snapshot->count;
 
   if (count > 2)
     count = 2;
@@ -238,9 +279,9 @@ connui_cellular_status_item_update_icon(ConnuiCellularStatusItem *item,
     gdk_pixbuf_fill(pixbuf, 0);
   }
 
-  for (l = modems; l && count; l = l->next)
+  for (i = 0; i < priv->snapshot->count && count; i++)
   {
-    modem = _find_modem(item, l->data);
+    modem = priv->slots[i];
 
     if (modem)
     {
@@ -266,7 +307,6 @@ connui_cellular_status_item_update_icon(ConnuiCellularStatusItem *item,
 
   hd_status_plugin_item_set_status_area_icon(HD_STATUS_PLUGIN_ITEM(item),
                                              pixbuf);
-  g_list_free_full(modems, g_free);
   g_object_unref(pixbuf);
 }
 
@@ -326,6 +366,7 @@ _modem_status_cb(const char *modem_id, const connui_modem_status *status,
     {
       priv->modems_changed = TRUE;
       priv->modems = g_list_remove(priv->modems, modem);
+      _slots_invalidate(priv);
       _free_modem(modem);
       connui_cellular_status_item_update_icon(item, NULL);
     }
@@ -350,7 +391,7 @@ _sim_status_cb(const char *modem_id, const connui_sim_status *sim_status,
 
 static void
 _net_status_cb(const char *modem_id, const cell_network_state *state,
-               gpointer user_data)
+               guint changed, gpointer user_data)
 {
   ConnuiCellularStatusItem *item = CONNUI_CELLULAR_STATUS_ITEM(user_data);
   ConnuiCellularModem *modem = _get_modem(item, modem_id);
@@ -388,11 +429,15 @@ connui_cellular_status_item_finalize(GObject *object)
   }
 
   connui_cell_modem_status_close(_modem_status_cb);
-  connui_cell_net_status_close(_net_status_cb);
+  connui_cell_net_status_changed_close(_net_status_cb);
   connui_cell_sim_status_close(_sim_status_cb);
   connui_cell_connection_status_close(_connmgr_status_cb);
   connui_flightmode_close(connui_cellular_status_item_flightmode_cb);
   g_list_free_full(priv->modems, (GDestroyNotify)_free_modem);
+  _slots_invalidate(priv);
+
+  if (priv->snapshot)
+    connui_cell_modems_unref(priv->snapshot);
 
   G_OBJECT_CLASS(connui_cellular_status_item_parent_class)->finalize(object);
 }
@@ -407,8 +452,8 @@ static void
 connui_cellular_status_item_init(ConnuiCellularStatusItem *item)
 {
   ConnuiCellularStatusItemPrivate *priv = PRIVATE(item);
-  GList *modems;
-  GList *l;
+  connui_cell_modems *modems;
+  guint i;
   priv->pixbuf_cache = connui_pixbuf_cache_new();
   priv->osso_context = osso_initialize("connui_cellular_status_item",
                                        PACKAGE_VERSION, TRUE, 0);
@@ -425,18 +470,21 @@ connui_cellular_status_item_init(ConnuiCellularStatusItem *item)
   if (!connui_cell_sim_status_register(_sim_status_cb, item))
     CONNUI_ERR("Unable to register SIM status");
 
-  if (!connui_cell_net_status_register(_net_status_cb, item))
+  if (!connui_cell_net_status_changed_register(CONNUI_NET_CHANGED_REG_STATUS |
+                                               CONNUI_NET_CHANGED_RAT |
+                                               CONNUI_NET_CHANGED_STRENGTH,
+                                               _net_status_cb, item))
     CONNUI_ERR("Unable to register cell net status!");
 
   if (!connui_cell_connection_status_register(_connmgr_status_cb, item))
     CONNUI_ERR("Unable to register cell connectionmanager status!");
 
-  modems = connui_cell_modem_get_modems();
+  modems = connui_cell_modem_get_snapshot();
 
-  for (l = modems; l; l = l->next)
-    _add_modem(item, l->data);
+  for (i = 0; i < modems->count; i++)
+    _add_modem(item, modems->ids[i]);
 
-  g_list_free(modems);
+  connui_cell_modems_unref(modems);
 
   connui_cellular_status_item_update_icon(item, NULL);
 }